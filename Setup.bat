@@ -204,7 +204,7 @@ cl /nologo /EHsc /std:c++17 /O2 /MT /DUNICODE /D_UNICODE ^
   "%SCRIPT_DIR%lanscr.cpp" "%SCRIPT_DIR%LANSCR.res" /Fe:"%SCRIPT_DIR%LANSCR.exe" ^
   /link /SUBSYSTEM:CONSOLE ^
   ws2_32.lib winhttp.lib ole32.lib oleaut32.lib windowscodecs.lib shlwapi.lib ^
-  user32.lib gdi32.lib shell32.lib advapi32.lib mmdevapi.lib winmm.lib uuid.lib
+  user32.lib gdi32.lib shell32.lib advapi32.lib mmdevapi.lib winmm.lib uuid.lib d3d11.lib dxgi.lib
 if errorlevel 1 (
 	echo [ERROR] Build failed.
 	popd >nul 2>nul
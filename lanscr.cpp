@@ -14,10 +14,20 @@
 #include <ws2tcpip.h>
 #include <winhttp.h>
 #include <wincodec.h>
+#include <d3d11.h>
+#include <dxgi1_2.h>
 #include <shlwapi.h>
 #include <shellapi.h>
 #include <sddl.h>
 
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define LANSCR_X86_SIMD 1
+#else
+#define LANSCR_X86_SIMD 0
+#endif
+
 #include <atomic>
 #include <algorithm>
 #include <cctype>
@@ -27,16 +37,23 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "winhttp.lib")
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "shlwapi.lib")
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "advapi32.lib")
@@ -116,6 +133,7 @@ static HWND g_launcherLog = nullptr;
 static HWND g_editPort = nullptr;
 static HWND g_editFps = nullptr;
 static HWND g_editQuality = nullptr;
+static HWND g_editMaxWidth = nullptr;
 static HWND g_editUrl = nullptr;
 static HWND g_btnStartServer = nullptr;
 static HWND g_btnStopServer = nullptr;
@@ -285,6 +303,21 @@ static constexpr const char* kBoundaryLine = "--frame\r\n";
 static std::atomic<bool> g_running{ true };
 static std::atomic<int> g_clientCount{ 0 };
 static bool g_verbose = false;
+static std::string g_captureSpec = "gdi"; // --capture gdi|dxgi|synthetic[:WxH]
+static std::string g_audioSourceSpec = "loopback"; // --audio-source loopback|synthetic[:Hz]
+static bool g_cursorMeta = false;          // --cursor-meta: cursor sent on /cursor instead of drawn into frames
+static int g_jpegThreads = 0;              // --jpeg-threads: strip encoder threads (alone, also selects that encoder)
+static std::string g_encoderSpec;          // --encoder wic|strips|turbo (empty = wic, or strips with --jpeg-threads)
+static std::string g_decoderSpec = "wic";  // --decoder wic|turbo (clients)
+
+// Output resolution (--max-width / --scale, or /control?maxWidth=&scale=): captures are
+// downsized before encoding. Read by the capture loop on every frame.
+static std::atomic<int> g_outputMaxWidth{ 0 };   // 0 = no limit
+static std::atomic<double> g_outputScale{ 1.0 }; // kMinOutputScale .. 1
+static std::atomic<int> g_outputWidth{ 0 };      // size of the last frame sent to the encoder
+static std::atomic<int> g_outputHeight{ 0 };
+static constexpr double kMinOutputScale = 0.1;
+static constexpr int kMinOutputWidth = 160;
 
 static std::atomic<bool> g_serverAudioEnabled{ true };
 static std::atomic<bool> g_serverAudioMuted{ false };
@@ -301,16 +334,160 @@ static std::wstring g_winhttpAuthHeaderW;
 
 static std::wstring g_clientVideoUrl;
 
+// MJPEG renditions (simulcast): the same frame at a scale and JPEG quality, best first. Each
+// /mjpeg viewer watches one (picked by its rate controller, capped by ?q=&scale=), and the encode
+// stage only produces renditions that have viewers, so encode cost follows distinct renditions
+// rather than the number of viewers.
+struct MjpegRendition
+{
+    double scale;
+    int quality;
+};
+
+static constexpr int kMaxMjpegRenditions = 4;
+static constexpr int kDefaultRenditionQualityDrop = 30;
+static constexpr int kMinRenditionQuality = 25;
+static std::string g_renditionSpec; // --renditions, e.g. "full:92,full:60,half:60" (empty = derived from the stream quality)
+static MjpegRendition g_renditions[kMaxMjpegRenditions];
+static int g_renditionCount = 1;
+
+// A published JPEG: immutable once shared, pinned by every viewer that sends it, and returned
+// to the buffer pool when the last reference drops (see ShareJpegBuffer).
+using JpegBufferRef = std::shared_ptr<const std::vector<uint8_t>>;
+
+// One rendition of a published frame: the JPEG and its multipart part header, built once when
+// the frame is published and sent by every viewer as header + jpeg + kMjpegPartTrailer.
+struct MjpegPart
+{
+    JpegBufferRef jpeg; // null = not encoded for this frame
+    std::string header;
+};
+
+static constexpr char kMjpegPartTrailer[] = "\r\n";
+
+// One published frame: a part per rendition.
+struct MjpegFrameSet
+{
+    uint64_t seq = 0;
+    double captureMs = 0.0; // PerfNowMs() when the screen was grabbed
+    MjpegPart renditions[kMaxMjpegRenditions];
+};
+
+// The latest MJPEG frame. current is replaced with std::atomic_store and pinned with
+// std::atomic_load, so viewers never copy JPEG bytes or hold a lock while sending; mtx/cv only
+// wake viewers when seq moves (see PublishMjpegFrame / WaitForMjpegFrame).
 struct SharedJpegFrame
 {
     std::mutex mtx;
     std::condition_variable cv;
-    std::vector<uint8_t> bytes;
-    uint64_t seq = 0;
+    std::shared_ptr<const MjpegFrameSet> current;
+    uint64_t seq = 0; // guarded by mtx
 };
 
 static SharedJpegFrame g_sharedFrame;
+static void WakeServerLoop(); // the HTTP server loop polls sockets, not the frame slot
+static std::atomic<int> g_renditionClients[kMaxMjpegRenditions];
+static std::atomic<uint64_t> g_renditionBytes[kMaxMjpegRenditions];   // running average JPEG size, 0 = unknown
+static std::atomic<uint64_t> g_renditionEncodes[kMaxMjpegRenditions];
 static std::atomic<bool> g_captureThreadRunning{ false };
+
+// Capture loop stats (reported by /control).
+static std::atomic<uint64_t> g_framesEncoded{ 0 };
+static std::atomic<uint64_t> g_framesSkipped{ 0 }; // identical to the previous frame: not encoded/sent
+
+// An unchanged desktop is not re-sent, but the last frame is re-published this often
+// so viewers/proxies never see a silent connection.
+static constexpr int kKeepaliveFrameMs = 2000;
+
+// Longest a capture loop blocks waiting for a screen update while the desktop is idle.
+static constexpr int kIdleWaitMs = 250;
+
+// Frame pacing stats of the capture loop (last window, reported by /control and -v).
+static std::atomic<double> g_paceFps{ 0.0 };
+static std::atomic<double> g_paceJitterMs{ 0.0 };
+static std::atomic<uint64_t> g_paceOverruns{ 0 };
+static std::atomic<uint64_t> g_paceSkippedTicks{ 0 };
+static constexpr int kPaceStatsWindowMs = 5000;
+
+// Per-stage timing of the capture -> encode pipeline. The stage that owns a timer adds
+// samples; the capture loop rolls them into an average once per stats window.
+struct StageTimer
+{
+    std::atomic<uint64_t> samples{ 0 };
+    std::atomic<uint64_t> totalUs{ 0 };
+    std::atomic<double> avgMs{ 0.0 };
+
+    void Add(double ms)
+    {
+        samples.fetch_add(1);
+        totalUs.fetch_add((uint64_t)(ms > 0.0 ? ms * 1000.0 : 0.0));
+    }
+    void Roll()
+    {
+        const uint64_t n = samples.exchange(0);
+        const uint64_t us = totalUs.exchange(0);
+        avgMs.store(n > 0 ? (double)us / 1000.0 / (double)n : 0.0);
+    }
+};
+
+static StageTimer g_stageCapture; // Capture() + tile hashing
+static StageTimer g_stageCopy;    // copy (or downscale) into a pipeline frame
+static StageTimer g_stageEncode;  // JPEG + /tiles message
+static std::atomic<uint64_t> g_pipelineDrops{ 0 }; // captured frames replaced before the encoder got to them
+
+// Dirty-tile stream (/tiles): the capture loop publishes one message per changed frame.
+struct SharedTileStream
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<uint8_t> msg;
+    uint64_t seq = 0;
+    bool full = false;
+};
+
+static SharedTileStream g_sharedTiles;
+static std::atomic<int> g_tileClientCount{ 0 };
+static std::atomic<bool> g_tilesKeyRequested{ false }; // a /tiles client needs a full frame to (re)sync
+
+// Tile clients get a full frame at least this often, and key requests are honoured at
+// most every kTileKeyMinIntervalMs so one slow client cannot turn every frame into a key.
+static constexpr int kTileFullRefreshMs = 10000;
+static constexpr int kTileKeyMinIntervalMs = 500;
+
+// --adaptive-tiles: /tiles tiles classified as photo/video are sent 4:2:0 at the stream
+// quality minus kNaturalTileQualityDrop (not below kMinNaturalTileQuality).
+static bool g_adaptiveTiles = false;
+static constexpr int kNaturalTileQualityDrop = 15;
+static constexpr int kMinNaturalTileQuality = 40;
+
+// Cursor metadata (--cursor-meta): position/shape published by the cursor tracker.
+// x/y are the hotspot relative to the captured surface; id names a PNG in the shape cache.
+struct SharedCursorState
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint64_t seq = 0;
+    bool visible = false;
+    int x = 0;
+    int y = 0;
+    int hotX = 0;
+    int hotY = 0;
+    int width = 0; // cursor image size
+    int height = 0;
+    int screenW = 0;
+    int screenH = 0;
+    uint64_t shapeId = 0;
+};
+
+static SharedCursorState g_sharedCursor;
+static std::atomic<int> g_cursorClientCount{ 0 };
+static std::atomic<bool> g_cursorThreadRunning{ false };
+
+// PNGs of recently seen cursor shapes, keyed by content hash (served by /cursor.png?id=).
+static std::mutex g_cursorShapesMtx;
+static std::vector<std::pair<uint64_t, std::vector<uint8_t>>> g_cursorShapes;
+static constexpr size_t kMaxCursorShapes = 32;
+static constexpr int kCursorPollMs = 10;
 static bool SendAll(SOCKET s, const void* data, int len);
 static HWND g_chkPrivate = nullptr;
 
@@ -318,13 +495,33 @@ static void PrintUsage()
 {
     std::printf(
         "Usage:\n"
-    "  LANSCR.exe [-v|--verbose] [--mute-audio] [--no-audio] [--private|--auth user:pass] server <port> [fps] [jpegQuality0to100]\n"
-    "  LANSCR.exe [-v|--verbose] [--mute] [--auth user:pass] client <url>\n"
-    "  LANSCR.exe [-v|--verbose] udp-server <port> [fps] [jpegQuality0to100]\n"
-    "  LANSCR.exe [-v|--verbose] udp-client <serverIp> <port>\n"
+    "  LANSCR.exe [-v|--verbose] [--mute-audio] [--no-audio] [--private|--auth user:pass] [--cursor-meta] [--adaptive-tiles] [--encoder E] [--jpeg-threads N|auto] [--max-width W] [--scale F] [--renditions LIST] [--audio-source SRC] server <port> [fps] [jpegQuality0to100]\n"
+    "  LANSCR.exe [-v|--verbose] [--mute] [--auth user:pass] [--decoder wic|turbo] client <url>\n"
+    "  LANSCR.exe [-v|--verbose] [--encoder E] [--jpeg-threads N|auto] [--max-width W] [--scale F] udp-server <port> [fps] [jpegQuality0to100]\n"
+    "  LANSCR.exe [-v|--verbose] [--decoder wic|turbo] udp-client <serverIp> <port>\n"
     "  LANSCR.exe [--auth user:pass] audio-mute <urlOrPort> <0|1>\n"
+    "  LANSCR.exe [--capture gdi|dxgi|synthetic[:WxH]] [--encoder E] bench [seconds] [jpegQuality0to100]\n"
+    "  LANSCR.exe [--auth user:pass] loadtest <url> [viewers] [seconds]\n"
     "  LANSCR.exe stop <port>\n"
     "  LANSCR.exe detect\n\n"
+    "Capture (server, udp-server, bench):\n"
+    "  --capture gdi             GDI BitBlt of the virtual screen (default)\n"
+    "  --capture dxgi            DXGI Desktop Duplication (falls back to GDI when unavailable)\n"
+    "  --capture synthetic:WxH   deterministic test pattern (no desktop needed; :still appended freezes it)\n"
+    "  --audio-source SRC        (server) /audio source: loopback (default) or synthetic[:Hz] test tone\n"
+    "  --cursor-meta             (server) send the cursor on /cursor instead of drawing it into frames\n"
+    "  --max-width W             (server, udp-server) downsize frames wider than W before encoding\n"
+    "  --scale F                 (server, udp-server) downsize frames by F (0.1..1) before encoding\n"
+    "                            (server: also /control?maxWidth=W&scale=F; -v logs encode time/size before/after)\n"
+    "  --renditions LIST         (server) MJPEG renditions, best first, up to 4 scale:quality pairs\n"
+    "                            (default full:Q,full:Q-30,half:Q-30; viewers pick one with /mjpeg?q=&scale=)\n\n"
+    "JPEG codecs:\n"
+    "  --encoder wic             (server, udp-server, bench) Windows Imaging Component (default)\n"
+    "  --encoder strips          built-in parallel strip encoder\n"
+    "  --encoder turbo           libjpeg-turbo, loaded from turbojpeg.dll (falls back to wic)\n"
+    "  --jpeg-threads N|auto     strip encoder threads (auto = one per core, up to 8); alone it selects strips\n"
+    "  --decoder wic|turbo       (client, udp-client) JPEG decoder (default wic)\n"
+    "  --adaptive-tiles          (server) /tiles: photo/video tiles as 4:2:0 at lower quality, text/UI tiles 4:4:4\n\n"
         "Examples:\n"
     "  LANSCR.exe server 8000 10 80\n"
     "  LANSCR.exe --private server 8000\n"
@@ -333,12 +530,194 @@ static void PrintUsage()
     "  LANSCR.exe client http://192.168.1.50:8000/\n"
     "  LANSCR.exe --auth lanscr:YOURPASS client http://192.168.1.50:8000/\n"
     "  LANSCR.exe --mute client http://192.168.1.50:8000/\n"
+    "  LANSCR.exe client http://192.168.1.50:8000/tiles\n"
     "  LANSCR.exe udp-server 9000 60 70\n"
     "  LANSCR.exe udp-client 192.168.1.50 9000\n"
     "  LANSCR.exe audio-mute 8000 1\n"
+    "  LANSCR.exe --capture dxgi server 8000 30 80\n"
+    "  LANSCR.exe --capture dxgi --cursor-meta server 8000 30 80\n"
+    "  LANSCR.exe --jpeg-threads auto server 8000 30 80\n"
+    "  LANSCR.exe --encoder turbo server 8000 30 80\n"
+    "  LANSCR.exe -v --max-width 1920 server 8000 30 80\n"
+    "  LANSCR.exe --capture synthetic:3840x2160 bench 10 80\n"
+    "  LANSCR.exe --capture synthetic:1920x1080 --renditions full:92,full:60,half:60 server 8000 30\n"
+    "  LANSCR.exe loadtest http://127.0.0.1:8000/ 50 10\n"
     "  LANSCR.exe stop 8000\n");
 }
 
+// ----------------------------
+// HTTP request parsing
+// ----------------------------
+
+static constexpr size_t kMaxRequestBytes = 16 * 1024; // whole request head
+static constexpr size_t kMaxHttpLineBytes = 8 * 1024;
+static constexpr size_t kMaxHttpHeaders = 64;
+
+struct HttpRequest
+{
+    std::string method;
+    std::string target; // as sent (origin form)
+    std::string path;   // target up to '?', "/" if empty
+    std::string query;  // after '?', not decoded
+    int minorVersion = 1;
+    std::vector<std::pair<std::string, std::string>> headers; // names lower-cased, values trimmed
+
+    // First header with this (lower-case) name, or null.
+    const std::string* Header(const char* lowerName) const
+    {
+        for (const auto& h : headers)
+        {
+            if (h.first == lowerName) return &h.second;
+        }
+        return nullptr;
+    }
+};
+
+enum class HttpParseState
+{
+    NeedMore,
+    Done,
+    Error,
+};
+
+// Incremental HTTP/1.x request-head parser. Feed() takes bytes as they arrive in any split and
+// completes as soon as the blank line does; each byte is scanned once (memchr for the line end).
+// Malformed requests, and heads over kMaxRequestBytes / kMaxHttpLineBytes / kMaxHttpHeaders,
+// are errors. Bytes after the head (a pipelined request) are left unconsumed.
+struct HttpRequestParser
+{
+    HttpRequest req;
+    HttpParseState state = HttpParseState::NeedMore;
+
+    void Reset()
+    {
+        req = HttpRequest();
+        state = HttpParseState::NeedMore;
+        line.clear();
+        total = 0;
+        sawRequestLine = false;
+    }
+
+    bool Started() const { return total > 0; }
+
+    // Returns the new state; *consumed (optional) is how many bytes of data were used.
+    HttpParseState Feed(const char* data, size_t len, size_t* consumed = nullptr)
+    {
+        size_t pos = 0;
+        while (state == HttpParseState::NeedMore && pos < len)
+        {
+            const char* nl = (const char*)std::memchr(data + pos, '\n', len - pos);
+            const size_t take = nl ? (size_t)(nl - (data + pos)) + 1 : len - pos;
+            total += take;
+            if (total > kMaxRequestBytes || line.size() + take > kMaxHttpLineBytes)
+            {
+                state = HttpParseState::Error;
+                break;
+            }
+            line.append(data + pos, nl ? take - 1 : take);
+            pos += take;
+            if (!nl) break;
+
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!OnLine()) state = HttpParseState::Error;
+            line.clear();
+        }
+        if (consumed) *consumed = pos;
+        return state;
+    }
+
+private:
+    std::string line;
+    size_t total = 0;
+    bool sawRequestLine = false;
+
+    static bool IsTokenChar(unsigned char ch)
+    {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+            (ch != 0 && std::strchr("!#$%&'*+-.^_`|~", ch) != nullptr);
+    }
+
+    bool OnLine()
+    {
+        if (!sawRequestLine)
+        {
+            if (line.empty()) return true; // stray CRLF before a request (RFC 7230 3.5)
+            sawRequestLine = true;
+            return ParseRequestLine();
+        }
+        if (line.empty())
+        {
+            state = HttpParseState::Done;
+            return true;
+        }
+        return ParseHeaderLine();
+    }
+
+    // METHOD SP target SP HTTP/1.x
+    bool ParseRequestLine()
+    {
+        const size_t sp1 = line.find(' ');
+        if (sp1 == std::string::npos || sp1 == 0) return false;
+        const size_t sp2 = line.find(' ', sp1 + 1);
+        if (sp2 == std::string::npos || sp2 == sp1 + 1) return false;
+        for (size_t i = 0; i < sp1; i++)
+        {
+            if (!IsTokenChar((unsigned char)line[i])) return false;
+        }
+        for (size_t i = sp1 + 1; i < sp2; i++)
+        {
+            const unsigned char ch = (unsigned char)line[i];
+            if (ch <= 32 || ch == 127) return false;
+        }
+        if (line.size() != sp2 + 9 || line.compare(sp2 + 1, 7, "HTTP/1.") != 0) return false;
+        const char minor = line[sp2 + 8];
+        if (minor != '0' && minor != '1') return false;
+
+        req.method.assign(line, 0, sp1);
+        req.target.assign(line, sp1 + 1, sp2 - sp1 - 1);
+        req.minorVersion = minor - '0';
+
+        // Absolute form (proxies): keep only the path and query.
+        std::string target = req.target;
+        if (target.compare(0, 7, "http://") == 0)
+        {
+            const size_t slash = target.find('/', 7);
+            target = slash == std::string::npos ? "/" : target.substr(slash);
+        }
+        if (target[0] != '/' && target != "*") return false;
+        const size_t q = target.find('?');
+        req.path = target.substr(0, q);
+        if (q != std::string::npos) req.query = target.substr(q + 1);
+        if (req.path.empty()) req.path = "/";
+        return true;
+    }
+
+    // name ":" OWS value OWS; obsolete line folding is rejected.
+    bool ParseHeaderLine()
+    {
+        if (req.headers.size() >= kMaxHttpHeaders) return false;
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) return false;
+        std::string name(line, 0, colon);
+        for (char& ch : name)
+        {
+            if (!IsTokenChar((unsigned char)ch)) return false;
+            if (ch >= 'A' && ch <= 'Z') ch = (char)(ch - 'A' + 'a');
+        }
+        size_t a = colon + 1;
+        size_t b = line.size();
+        while (a < b && (line[a] == ' ' || line[a] == '\t')) a++;
+        while (b > a && (line[b - 1] == ' ' || line[b - 1] == '\t')) b--;
+        for (size_t i = a; i < b; i++)
+        {
+            const unsigned char ch = (unsigned char)line[i];
+            if ((ch < 32 && ch != '\t') || ch == 127) return false;
+        }
+        req.headers.emplace_back(std::move(name), line.substr(a, b - a));
+        return true;
+    }
+};
+
 // ----------------------------
 // HTTP Basic Auth helpers
 // ----------------------------
@@ -405,38 +784,6 @@ static bool IStartsWith(const std::string& s, const char* prefix)
     return true;
 }
 
-static bool GetHttpHeaderValue(const std::string& req, const char* name, std::string& outValue)
-{
-    outValue.clear();
-    size_t pos = req.find("\r\n");
-    if (pos == std::string::npos) return false;
-    pos += 2;
-    const size_t nameLen = std::strlen(name);
-    while (pos < req.size())
-    {
-        size_t eol = req.find("\r\n", pos);
-        if (eol == std::string::npos) break;
-        if (eol == pos) return false; // end of headers
-        std::string line = req.substr(pos, eol - pos);
-        pos = eol + 2;
-        if (line.size() <= nameLen + 1) continue;
-        bool match = true;
-        for (size_t i = 0; i < nameLen; i++)
-        {
-            char a = line[i];
-            char b = name[i];
-            if (a >= 'A' && a <= 'Z') a = (char)(a - 'A' + 'a');
-            if (b >= 'A' && b <= 'Z') b = (char)(b - 'A' + 'a');
-            if (a != b) { match = false; break; }
-        }
-        if (!match) continue;
-        if (line[nameLen] != ':') continue;
-        outValue = TrimAscii(line.substr(nameLen + 1));
-        return true;
-    }
-    return false;
-}
-
 static void ConfigureHttpAuth(const std::string& user, const std::string& pass)
 {
     g_httpAuthUser = user;
@@ -489,12 +836,12 @@ static bool ParseAuthUserPass(const char* s, std::string& outUser, std::string&
     return true;
 }
 
-static bool IsHttpAuthorized(const std::string& req)
+static bool IsHttpAuthorized(const HttpRequest& req)
 {
     if (!g_httpAuthEnabled) return true;
-    std::string auth;
-    if (!GetHttpHeaderValue(req, "Authorization", auth)) return false;
-    auth = TrimAscii(auth);
+    const std::string* header = req.Header("authorization");
+    if (!header) return false;
+    const std::string& auth = *header;
     if (!IStartsWith(auth, "Basic")) return false;
     size_t sp = auth.find(' ');
     if (sp == std::string::npos) return false;
@@ -502,22 +849,6 @@ static bool IsHttpAuthorized(const std::string& req)
     return !g_httpAuthExpectedB64.empty() && token == g_httpAuthExpectedB64;
 }
 
-static bool SendHttpUnauthorized(SOCKET client)
-{
-    const std::string body = "Unauthorized";
-    char hdr[512];
-    std::snprintf(hdr, sizeof(hdr),
-        "HTTP/1.1 401 Unauthorized\r\n"
-        "Connection: close\r\n"
-        "WWW-Authenticate: Basic realm=\"LANSCR\"\r\n"
-        "Content-Type: text/plain; charset=utf-8\r\n"
-        "Content-Length: %zu\r\n"
-        "\r\n",
-        body.size());
-    if (!SendAll(client, hdr, (int)std::strlen(hdr))) return false;
-    return SendAll(client, body.data(), (int)body.size());
-}
-
 static void WinHttpMaybeAddAuthHeader(HINTERNET hReq)
 {
     if (!g_httpAuthEnabled) return;
@@ -852,1728 +1183,8411 @@ static bool HttpGetSimpleWinHttp(const std::wstring& url, std::string* outBody)
     return true;
 }
 
-static bool RecvSome(SOCKET s, std::string& out)
-{
-    char buf[4096];
-    int n = recv(s, buf, (int)sizeof(buf), 0);
-    if (n <= 0) return false;
-    out.append(buf, buf + n);
-    return true;
-}
-
 static int GetIntArg(char** argv, int idx, int argc, int def)
 {
     if (idx >= argc) return def;
     return std::atoi(argv[idx]);
 }
 
+static double PerfNowMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// User + kernel CPU time of the whole process, in ms.
+static double ProcessCpuMs()
+{
+    FILETIME created{}, exited{}, kernel{}, user{};
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    const uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    const uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (double)(k + u) / 10000.0; // 100 ns units
+}
+
 // ----------------------------
-// Screen capture (GDI) + JPEG (WIC)
+// Frame pacing
 // ----------------------------
 
-struct JpegFrame
+static void PacerSleepMs(double ms)
 {
-    std::vector<uint8_t> bytes;
-    int width = 0;
-    int height = 0;
+    if (ms >= 1.0) std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(std::floor(ms) * 1000.0)));
+    else std::this_thread::yield();
+}
+
+struct FramePacerStats
+{
+    uint64_t frames = 0;
+    uint64_t overruns = 0;     // frames that started after their deadline (+ slack)
+    uint64_t skippedTicks = 0; // whole ticks dropped because work took longer than a tick
+    double fps = 0.0;
+    double jitterMs = 0.0;     // mean |start-to-start interval - target interval|
+    double maxJitterMs = 0.0;
 };
 
-static HRESULT CaptureScreenToJpeg(IWICImagingFactory* factory, int jpegQuality0to100, JpegFrame& out)
+// Schedules frame starts on absolute deadlines (k * interval) of a monotonic clock, so the
+// rate does not drift with the work time. A late frame starts right away; ticks that were
+// missed entirely are skipped instead of being caught up in a burst.
+// Clock and sleep are injectable (ms, double) so the schedule can be checked with a fake clock.
+struct FramePacer
 {
-    out.bytes.clear();
+    using ClockFn = std::function<double()>;
+    using SleepFn = std::function<void(double)>;
 
-    const int x = GetSystemMetrics(SM_XVIRTUALSCREEN);
-    const int y = GetSystemMetrics(SM_YVIRTUALSCREEN);
-    const int w = GetSystemMetrics(SM_CXVIRTUALSCREEN);
-    const int h = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    static constexpr double kSlackMs = 1.0;
 
-    HDC screenDC = GetDC(nullptr);
-    if (!screenDC) return E_FAIL;
+    FramePacer(int fps, ClockFn clockFn = PerfNowMs, SleepFn sleepFn = PacerSleepMs)
+        : clock(std::move(clockFn)), sleep(std::move(sleepFn))
+    {
+        SetFps(fps);
+        Rebase();
+    }
 
-    HDC memDC = CreateCompatibleDC(screenDC);
-    if (!memDC)
+    void SetFps(int fps)
     {
-        ReleaseDC(nullptr, screenDC);
-        return E_FAIL;
+        intervalMs = 1000.0 / (double)std::max(1, fps);
     }
 
-    HBITMAP bmp = CreateCompatibleBitmap(screenDC, w, h);
-    if (!bmp)
+    // A frame starts now and the deadline grid restarts from here (use after idling).
+    void Rebase()
     {
-        DeleteDC(memDC);
-        ReleaseDC(nullptr, screenDC);
-        return E_FAIL;
+        next = clock() + intervalMs;
+        lastStart = -1.0;
     }
 
-    HGDIOBJ old = SelectObject(memDC, bmp);
-    BOOL ok = BitBlt(memDC, 0, 0, w, h, screenDC, x, y, SRCCOPY | CAPTUREBLT);
+    double MsUntilNextTick() const
+    {
+        return std::max(0.0, next - clock());
+    }
 
-    // Overlay the mouse cursor (hardware cursor isn't included in BitBlt capture).
-    if (ok)
+    // Call after a frame's work: waits for the next deadline and marks the next frame's start.
+    // Returns the number of ticks skipped.
+    int Wait()
     {
-        CURSORINFO ci{};
-        ci.cbSize = sizeof(ci);
-        if (GetCursorInfo(&ci) && (ci.flags & CURSOR_SHOWING) && ci.hCursor)
+        double now = clock();
+        int missed = 0;
+        if (now > next + kSlackMs)
         {
-            ICONINFO ii{};
-            if (GetIconInfo(ci.hCursor, &ii))
+            window.overruns++;
+            missed = (int)std::floor((now - next) / intervalMs);
+            window.skippedTicks += (uint64_t)missed;
+            next += missed * intervalMs;
+        }
+        else
+        {
+            while (now < next)
             {
-                const int cx = (int)ci.ptScreenPos.x - x - (int)ii.xHotspot;
-                const int cy = (int)ci.ptScreenPos.y - y - (int)ii.yHotspot;
-                (void)DrawIconEx(memDC, cx, cy, ci.hCursor, 0, 0, 0, nullptr, DI_NORMAL);
-
-                if (ii.hbmMask) DeleteObject(ii.hbmMask);
-                if (ii.hbmColor) DeleteObject(ii.hbmColor);
+                sleep(next - now);
+                now = clock();
             }
         }
-    }
-    SelectObject(memDC, old);
 
-    DeleteDC(memDC);
-    ReleaseDC(nullptr, screenDC);
+        if (lastStart >= 0.0)
+        {
+            const double dev = std::fabs((now - lastStart) - intervalMs);
+            jitterSum += dev;
+            window.maxJitterMs = std::max(window.maxJitterMs, dev);
+            intervals++;
+        }
+        if (window.frames == 0) windowStart = now;
+        window.frames++;
+        lastStart = now;
+        next += intervalMs;
+        return missed;
+    }
+
+    // Stats since the previous call (frames counted by Wait()).
+    FramePacerStats TakeStats()
+    {
+        FramePacerStats s = window;
+        const double span = lastStart - windowStart;
+        s.fps = (s.frames > 1 && span > 0.0) ? (s.frames - 1) * 1000.0 / span : 0.0;
+        s.jitterMs = intervals ? jitterSum / (double)intervals : 0.0;
+        window = FramePacerStats();
+        jitterSum = 0.0;
+        intervals = 0;
+        return s;
+    }
+
+    ClockFn clock;
+    SleepFn sleep;
+    double intervalMs = 100.0;
+    double next = 0.0;
+    double lastStart = -1.0;
+    double windowStart = 0.0;
+    double jitterSum = 0.0;
+    uint64_t intervals = 0;
+    FramePacerStats window;
+};
 
-    if (!ok)
+// ----------------------------
+// Capture sources (persistent BGRA surfaces)
+// ----------------------------
+
+// A captured frame: top-down 32bpp BGRA owned by the capture source.
+// The memory is reused frame after frame and stays valid until the next Capture().
+struct CaptureSurface
+{
+    uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    int originX = 0; // virtual-screen coordinate of pixel (0,0)
+    int originY = 0;
+    // Surface rects that changed since the previous Capture(), owned by the source.
+    // nullptr = unknown (treat the whole surface as changed); empty = nothing changed.
+    const std::vector<RECT>* damage = nullptr;
+};
+
+struct CaptureSource
+{
+    virtual ~CaptureSource() {}
+    virtual const char* Name() const = 0;
+    virtual HRESULT Capture(CaptureSurface& out) = 0;
+
+    // Called instead of sleeping after an unchanged frame. Sources that can be notified of
+    // screen updates block until one arrives (at most maxMs); the rest just sleep minMs.
+    virtual void WaitForChange(int minMs, int maxMs)
     {
-        DeleteObject(bmp);
-        return E_FAIL;
+        (void)maxMs;
+        Sleep(minMs);
     }
 
-    IWICBitmap* wicBitmap = nullptr;
-    HRESULT hr = factory->CreateBitmapFromHBITMAP(bmp, nullptr, WICBitmapIgnoreAlpha, &wicBitmap);
-    DeleteObject(bmp);
-    if (FAILED(hr)) return hr;
+    // Damage tracking on/off (off = report every frame as fully changed; used by bench).
+    virtual void SetDamageTracking(bool enabled) { (void)enabled; }
 
-    IStream* stream = nullptr;
-    hr = CreateStreamOnHGlobal(nullptr, TRUE, &stream);
-    if (FAILED(hr))
+    // Whether the mouse cursor is drawn into frames (off with --cursor-meta).
+    virtual void SetCursorOverlay(bool enabled) { (void)enabled; }
+};
+
+// Clips a rect to the surface and appends it if non-empty.
+static void AddDamageRect(std::vector<RECT>& damage, int left, int top, int right, int bottom, int surfW, int surfH)
+{
+    RECT r;
+    r.left = std::max(0, left);
+    r.top = std::max(0, top);
+    r.right = std::min(surfW, right);
+    r.bottom = std::min(surfH, bottom);
+    if (r.right > r.left && r.bottom > r.top) damage.push_back(r);
+}
+
+// Merges overlapping/touching rects so each region is copied and hashed once; a long
+// list (scrolling, video) collapses into its bounding box.
+static void CoalesceDamage(std::vector<RECT>& damage)
+{
+    static constexpr size_t kMaxDamageRects = 64;
+    bool merged = true;
+    while (merged && damage.size() > 1)
     {
-        wicBitmap->Release();
-        return hr;
+        merged = false;
+        for (size_t i = 0; i < damage.size() && !merged; i++)
+        {
+            for (size_t j = i + 1; j < damage.size(); j++)
+            {
+                const RECT& a = damage[i];
+                const RECT& b = damage[j];
+                if (a.left <= b.right && b.left <= a.right && a.top <= b.bottom && b.top <= a.bottom)
+                {
+                    RECT u;
+                    u.left = std::min(a.left, b.left);
+                    u.top = std::min(a.top, b.top);
+                    u.right = std::max(a.right, b.right);
+                    u.bottom = std::max(a.bottom, b.bottom);
+                    damage[i] = u;
+                    damage.erase(damage.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
     }
-
-    IWICBitmapEncoder* encoder = nullptr;
-    hr = factory->CreateEncoder(GUID_ContainerFormatJpeg, nullptr, &encoder);
-    if (FAILED(hr))
+    if (damage.size() > kMaxDamageRects)
     {
-        stream->Release();
-        wicBitmap->Release();
-        return hr;
+        RECT u = damage[0];
+        for (const RECT& r : damage)
+        {
+            u.left = std::min(u.left, r.left);
+            u.top = std::min(u.top, r.top);
+            u.right = std::max(u.right, r.right);
+            u.bottom = std::max(u.bottom, r.bottom);
+        }
+        damage.assign(1, u);
     }
+}
 
-    hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
-    if (FAILED(hr))
+// The visible cursor and the rect it covers on a surface whose pixel (0,0) is at (originX, originY).
+struct CursorSnapshot
+{
+    HCURSOR cursor = nullptr;
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+    int hotX = 0;
+    int hotY = 0;
+};
+
+static bool GetCursorSnapshot(int originX, int originY, CursorSnapshot& out)
+{
+    CURSORINFO ci{};
+    ci.cbSize = sizeof(ci);
+    if (!GetCursorInfo(&ci) || !(ci.flags & CURSOR_SHOWING) || !ci.hCursor) return false;
+
+    ICONINFO ii{};
+    if (!GetIconInfo(ci.hCursor, &ii)) return false;
+    BITMAP bm{};
+    if (ii.hbmColor && GetObject(ii.hbmColor, sizeof(bm), &bm))
     {
-        encoder->Release();
-        stream->Release();
-        wicBitmap->Release();
-        return hr;
+        out.w = bm.bmWidth;
+        out.h = bm.bmHeight;
     }
-
-    IWICBitmapFrameEncode* frame = nullptr;
-    IPropertyBag2* props = nullptr;
-    hr = encoder->CreateNewFrame(&frame, &props);
-    if (FAILED(hr))
+    else if (ii.hbmMask && GetObject(ii.hbmMask, sizeof(bm), &bm))
     {
-        encoder->Release();
-        stream->Release();
-        wicBitmap->Release();
-        return hr;
+        out.w = bm.bmWidth;
+        out.h = bm.bmHeight / 2; // monochrome cursor: AND mask on top of XOR mask
     }
-
-    // Set JPEG encoder options.
-    // - ImageQuality: float [0..1]
-    // - JpegYCrCbSubsampling: BYTE enum (force 4:4:4 to avoid chroma blur)
-    if (props)
+    else
     {
-        PROPBAG2 options[2] = {};
-        options[0].pstrName = const_cast<LPOLESTR>(L"ImageQuality");
-        options[1].pstrName = const_cast<LPOLESTR>(L"JpegYCrCbSubsampling");
+        out.w = GetSystemMetrics(SM_CXCURSOR);
+        out.h = GetSystemMetrics(SM_CYCURSOR);
+    }
+    out.cursor = ci.hCursor;
+    out.hotX = (int)ii.xHotspot;
+    out.hotY = (int)ii.yHotspot;
+    out.x = (int)ci.ptScreenPos.x - originX - out.hotX;
+    out.y = (int)ci.ptScreenPos.y - originY - out.hotY;
 
-        VARIANT vars[2];
-        VariantInit(&vars[0]);
-        VariantInit(&vars[1]);
+    if (ii.hbmMask) DeleteObject(ii.hbmMask);
+    if (ii.hbmColor) DeleteObject(ii.hbmColor);
+    return true;
+}
 
-        vars[0].vt = VT_R4;
-        float q = (jpegQuality0to100 <= 1) ? 0.01f : (jpegQuality0to100 >= 100 ? 1.0f : (jpegQuality0to100 / 100.0f));
-        vars[0].fltVal = q;
+static void DrawCursorOverlay(HDC dc, int originX, int originY)
+{
+    // Overlay the mouse cursor (hardware cursor isn't included in BitBlt capture).
+    CursorSnapshot cs;
+    if (!GetCursorSnapshot(originX, originY, cs)) return;
+    (void)DrawIconEx(dc, cs.x, cs.y, cs.cursor, 0, 0, 0, nullptr, DI_NORMAL);
+}
 
-        vars[1].vt = VT_UI1;
-        vars[1].bVal = (BYTE)WICJpegYCrCbSubsampling444;
+// GDI BitBlt into a DIB section that is created once and only rebuilt when the
+// virtual-screen geometry changes (monitor plugged/unplugged, resolution change).
+struct GdiCaptureSource : CaptureSource
+{
+    HDC screenDC = nullptr;
+    HDC memDC = nullptr;
+    HBITMAP dib = nullptr;
+    HGDIOBJ oldBmp = nullptr;
+    uint8_t* bits = nullptr;
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+    bool drawCursor = true;
+
+    ~GdiCaptureSource() override { ReleaseSurface(); }
+    const char* Name() const override { return "gdi"; }
+    void SetCursorOverlay(bool enabled) override { drawCursor = enabled; }
+
+    void ReleaseSurface()
+    {
+        if (memDC && oldBmp) SelectObject(memDC, oldBmp);
+        if (dib) DeleteObject(dib);
+        if (memDC) DeleteDC(memDC);
+        if (screenDC) ReleaseDC(nullptr, screenDC);
+        screenDC = nullptr;
+        memDC = nullptr;
+        dib = nullptr;
+        oldBmp = nullptr;
+        bits = nullptr;
+        w = h = 0;
+    }
+
+    bool EnsureSurface(int nx, int ny, int nw, int nh)
+    {
+        if (dib && nx == x && ny == y && nw == w && nh == h) return true;
+        ReleaseSurface();
+        if (nw <= 0 || nh <= 0) return false;
+
+        screenDC = GetDC(nullptr);
+        if (!screenDC) return false;
+        memDC = CreateCompatibleDC(screenDC);
+        if (!memDC)
+        {
+            ReleaseSurface();
+            return false;
+        }
 
-        (void)props->Write(2, options, vars);
-        VariantClear(&vars[0]);
-        VariantClear(&vars[1]);
+        BITMAPINFO bmi{};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = nw;
+        bmi.bmiHeader.biHeight = -nh; // top-down
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        void* p = nullptr;
+        dib = CreateDIBSection(screenDC, &bmi, DIB_RGB_COLORS, &p, nullptr, 0);
+        if (!dib || !p)
+        {
+            ReleaseSurface();
+            return false;
+        }
+        bits = (uint8_t*)p;
+        oldBmp = SelectObject(memDC, dib);
+        x = nx;
+        y = ny;
+        w = nw;
+        h = nh;
+        if (g_verbose) LogInfo("GDI capture surface %dx%d at (%d,%d)\n", w, h, x, y);
+        return true;
     }
 
-    hr = frame->Initialize(props);
-    if (props) props->Release();
-    if (FAILED(hr))
+    HRESULT Capture(CaptureSurface& out) override
     {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        wicBitmap->Release();
-        return hr;
+        const int nx = GetSystemMetrics(SM_XVIRTUALSCREEN);
+        const int ny = GetSystemMetrics(SM_YVIRTUALSCREEN);
+        const int nw = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+        const int nh = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+        if (!EnsureSurface(nx, ny, nw, nh)) return E_FAIL;
+
+        if (!BitBlt(memDC, 0, 0, w, h, screenDC, x, y, SRCCOPY | CAPTUREBLT))
+        {
+            // Typically a desktop switch (UAC / lock screen): rebuild on the next frame.
+            ReleaseSurface();
+            return E_FAIL;
+        }
+        if (drawCursor) DrawCursorOverlay(memDC, x, y);
+        GdiFlush(); // make sure GDI is done writing before the pixels are read directly
+
+        out.pixels = bits;
+        out.width = w;
+        out.height = h;
+        out.stride = w * 4;
+        out.originX = x;
+        out.originY = y;
+        out.damage = nullptr;
+        return S_OK;
     }
+};
 
-    hr = frame->WriteSource(wicBitmap, nullptr);
-    wicBitmap->Release();
-    if (FAILED(hr))
+// Deterministic test pattern: a static gradient with a box sweeping across it and a
+// small "clock" strip that changes every frame. Same frame index => same pixels, so
+// runs are repeatable and need no desktop (benchmarks, headless sessions). A "still"
+// source keeps its first frame forever (an idle desktop).
+struct SyntheticCaptureSource : CaptureSource
+{
+    uint8_t* buf = nullptr;
+    int w = 0;
+    int h = 0;
+    int stride = 0;
+    uint64_t frameIndex = 0;
+    int boxX = -1;
+    int boxY = -1;
+    bool still = false;
+    bool trackDamage = true;
+    std::vector<RECT> damage;
+
+    static constexpr int kBox = 128;
+
+    SyntheticCaptureSource(int width, int height, bool stillScreen)
+    {
+        w = std::max(16, width);
+        h = std::max(16, height);
+        still = stillScreen;
+        stride = w * 4;
+        buf = (uint8_t*)_aligned_malloc((size_t)stride * (size_t)h, 64);
+        if (buf) PaintBackground(0, 0, w, h);
+    }
+    ~SyntheticCaptureSource() override
+    {
+        if (buf) _aligned_free(buf);
+    }
+    const char* Name() const override { return "synthetic"; }
+    void SetDamageTracking(bool enabled) override { trackDamage = enabled; }
+
+    void PaintBackground(int x0, int y0, int x1, int y1)
+    {
+        x0 = std::max(0, x0);
+        y0 = std::max(0, y0);
+        x1 = std::min(w, x1);
+        y1 = std::min(h, y1);
+        for (int yy = y0; yy < y1; yy++)
+        {
+            uint8_t* row = buf + (size_t)yy * stride;
+            for (int xx = x0; xx < x1; xx++)
+            {
+                uint8_t* px = row + (size_t)xx * 4;
+                px[0] = (uint8_t)(xx * 255 / w);
+                px[1] = (uint8_t)(yy * 255 / h);
+                px[2] = (uint8_t)(((xx >> 5) ^ (yy >> 5)) & 1 ? 0xC0 : 0x40);
+                px[3] = 0xFF;
+            }
+        }
+    }
+
+    void FillBox(int x0, int y0, int x1, int y1, uint32_t bgra)
     {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        return hr;
+        x0 = std::max(0, x0);
+        y0 = std::max(0, y0);
+        x1 = std::min(w, x1);
+        y1 = std::min(h, y1);
+        for (int yy = y0; yy < y1; yy++)
+        {
+            uint32_t* row = (uint32_t*)(buf + (size_t)yy * stride);
+            for (int xx = x0; xx < x1; xx++) row[xx] = bgra;
+        }
     }
 
-    hr = frame->Commit();
-    frame->Release();
-    if (FAILED(hr))
+    HRESULT Capture(CaptureSurface& out) override
     {
-        encoder->Release();
-        stream->Release();
-        return hr;
+        if (!buf) return E_OUTOFMEMORY;
+
+        // Erase last frame's box, then draw the new one.
+        const bool firstFrame = boxX < 0;
+        damage.clear();
+        if (still && !firstFrame)
+        {
+            out.pixels = buf;
+            out.width = w;
+            out.height = h;
+            out.stride = stride;
+            out.originX = 0;
+            out.originY = 0;
+            out.damage = trackDamage ? &damage : nullptr;
+            return S_OK;
+        }
+        if (!firstFrame)
+        {
+            PaintBackground(boxX, boxY, boxX + kBox, boxY + kBox);
+            AddDamageRect(damage, boxX, boxY, boxX + kBox, boxY + kBox, w, h);
+        }
+        const int span = std::max(1, w - kBox);
+        boxX = (int)((frameIndex * 8) % (uint64_t)span);
+        boxY = std::max(0, (h - kBox) / 2);
+        FillBox(boxX, boxY, boxX + kBox, boxY + kBox, 0xFF2080F0u);
+        AddDamageRect(damage, boxX, boxY, boxX + kBox, boxY + kBox, w, h);
+        AddDamageRect(damage, w - 8 * 12, h - 12, w, h, w, h);
+        CoalesceDamage(damage);
+
+        // "Clock" strip: 8 cells in the bottom-right corner, one bit of the frame index each.
+        for (int bit = 0; bit < 8; bit++)
+        {
+            const uint32_t c = ((frameIndex >> bit) & 1) ? 0xFFFFFFFFu : 0xFF000000u;
+            const int cx = w - (8 - bit) * 12;
+            FillBox(cx, h - 12, cx + 12, h, c);
+        }
+        frameIndex++;
+
+        out.pixels = buf;
+        out.width = w;
+        out.height = h;
+        out.stride = stride;
+        out.originX = 0;
+        out.originY = 0;
+        out.damage = (trackDamage && !firstFrame) ? &damage : nullptr;
+        return S_OK;
     }
+};
 
-    hr = encoder->Commit();
-    encoder->Release();
-    if (FAILED(hr))
+// DXGI Desktop Duplication: one IDXGIOutputDuplication per monitor, each copied through a
+// staging texture into a persistent DIB covering the virtual screen. Only the dirty/move
+// rects DXGI reports are copied, and they are handed on as the surface damage; monitors
+// with no new frame cost nothing. The cursor is not part of duplicated frames, so it is
+// drawn on top and the pixels under it are restored before the next update. Rotated
+// monitors are duplicated in panel orientation, so for them a new frame only triggers a
+// GDI grab of that monitor.
+// While duplication is unavailable (secure desktop, no GPU, RDP session) frames come from GDI.
+struct DxgiCaptureSource : CaptureSource
+{
+    struct Output
+    {
+        ID3D11Device* device = nullptr;
+        ID3D11DeviceContext* context = nullptr;
+        IDXGIOutputDuplication* dup = nullptr;
+        ID3D11Texture2D* staging = nullptr;
+        RECT desktop{}; // virtual-screen coordinates
+        bool rotated = false;
+        int stagingW = 0;
+        int stagingH = 0;
+        // Frame acquired by WaitForChange() and not yet consumed by Capture().
+        IDXGIResource* pendingRes = nullptr;
+        DXGI_OUTDUPL_FRAME_INFO pendingInfo{};
+    };
+
+    std::vector<Output> outputs;
+    GdiCaptureSource surface; // owns the DIB the outputs are composed into; also the fallback
+    bool duplicating = false;
+    bool needBaseGrab = false;
+    bool fallbackLogged = false;
+    double nextInitMs = 0.0;
+
+    CursorSnapshot cursor;
+    bool cursorSaved = false;
+    std::vector<uint8_t> underCursor;
+
+    bool trackDamage = true;
+    bool overlayCursor = true;
+    std::vector<RECT> damage;
+    std::vector<uint8_t> metadata; // move + dirty rects of the frame being copied
+    std::vector<RECT> outputRects;
+
+    static constexpr int kRetryInitMs = 1000;
+    static constexpr int kWaitSliceMs = 4; // per-output wait when several outputs are duplicated
+
+    ~DxgiCaptureSource() override { ReleaseOutputs(); }
+    const char* Name() const override { return duplicating ? "dxgi" : "dxgi(gdi)"; }
+    void SetDamageTracking(bool enabled) override { trackDamage = enabled; }
+    void SetCursorOverlay(bool enabled) override
     {
-        stream->Release();
-        return hr;
+        overlayCursor = enabled;
+        surface.drawCursor = enabled;
     }
 
-    HGLOBAL hg = nullptr;
-    hr = GetHGlobalFromStream(stream, &hg);
-    if (FAILED(hr))
+    void ReleaseOutputs()
     {
-        stream->Release();
-        return hr;
+        for (Output& o : outputs)
+        {
+            if (o.pendingRes)
+            {
+                o.pendingRes->Release();
+                (void)o.dup->ReleaseFrame();
+            }
+            if (o.staging) o.staging->Release();
+            if (o.dup) o.dup->Release();
+            if (o.context) o.context->Release();
+            if (o.device) o.device->Release();
+        }
+        outputs.clear();
+        duplicating = false;
+        cursorSaved = false;
     }
 
-    SIZE_T size = GlobalSize(hg);
-    void* ptr = GlobalLock(hg);
-    if (!ptr || size == 0)
+    bool InitOutputs()
     {
-        if (ptr) GlobalUnlock(hg);
-        stream->Release();
-        return E_FAIL;
+        ReleaseOutputs();
+
+        IDXGIFactory1* dxgiFactory = nullptr;
+        if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&dxgiFactory))) return false;
+
+        IDXGIAdapter1* adapter = nullptr;
+        for (UINT ai = 0; dxgiFactory->EnumAdapters1(ai, &adapter) != DXGI_ERROR_NOT_FOUND; ai++)
+        {
+            // Duplication must use a device created on the adapter that owns the output.
+            ID3D11Device* device = nullptr;
+            ID3D11DeviceContext* context = nullptr;
+            HRESULT hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, 0, nullptr, 0,
+                D3D11_SDK_VERSION, &device, nullptr, &context);
+            if (SUCCEEDED(hr))
+            {
+                IDXGIOutput* output = nullptr;
+                for (UINT oi = 0; adapter->EnumOutputs(oi, &output) != DXGI_ERROR_NOT_FOUND; oi++)
+                {
+                    DXGI_OUTPUT_DESC desc{};
+                    IDXGIOutput1* output1 = nullptr;
+                    if (SUCCEEDED(output->GetDesc(&desc)) && desc.AttachedToDesktop &&
+                        SUCCEEDED(output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1)))
+                    {
+                        Output o;
+                        if (SUCCEEDED(output1->DuplicateOutput(device, &o.dup)))
+                        {
+                            DXGI_OUTDUPL_DESC dd{};
+                            o.dup->GetDesc(&dd);
+                            o.rotated = dd.Rotation != DXGI_MODE_ROTATION_IDENTITY && dd.Rotation != DXGI_MODE_ROTATION_UNSPECIFIED;
+                            o.device = device;
+                            o.context = context;
+                            device->AddRef();
+                            context->AddRef();
+                            o.desktop = desc.DesktopCoordinates;
+                            outputs.push_back(o);
+                        }
+                        output1->Release();
+                    }
+                    output->Release();
+                }
+                context->Release();
+                device->Release();
+            }
+            adapter->Release();
+        }
+        dxgiFactory->Release();
+
+        duplicating = !outputs.empty();
+        needBaseGrab = duplicating;
+        if (g_verbose && duplicating) LogInfo("DXGI duplication: %zu output(s)\n", outputs.size());
+        return duplicating;
+    }
+
+    bool EnsureStaging(Output& o, const D3D11_TEXTURE2D_DESC& src)
+    {
+        if (o.staging && o.stagingW == (int)src.Width && o.stagingH == (int)src.Height) return true;
+        if (o.staging) o.staging->Release();
+        o.staging = nullptr;
+
+        D3D11_TEXTURE2D_DESC desc = src;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+        if (FAILED(o.device->CreateTexture2D(&desc, nullptr, &o.staging))) return false;
+        o.stagingW = (int)src.Width;
+        o.stagingH = (int)src.Height;
+        return true;
     }
 
-    out.bytes.resize(size);
-    std::memcpy(out.bytes.data(), ptr, size);
-    GlobalUnlock(hg);
-    stream->Release();
+    // Collects the output-space rects that changed in this frame (move destinations count as
+    // dirty: the duplicated image already has the moved pixels). false = copy everything.
+    bool CollectFrameRects(Output& o, const DXGI_OUTDUPL_FRAME_INFO& info)
+    {
+        outputRects.clear();
+        if (!trackDamage || info.TotalMetadataBufferSize == 0) return false;
+        if (metadata.size() < info.TotalMetadataBufferSize) metadata.resize(info.TotalMetadataBufferSize);
 
-    out.width = w;
-    out.height = h;
-    return S_OK;
-}
+        UINT used = 0;
+        if (FAILED(o.dup->GetFrameMoveRects((UINT)metadata.size(), (DXGI_OUTDUPL_MOVE_RECT*)metadata.data(), &used))) return false;
+        const DXGI_OUTDUPL_MOVE_RECT* moves = (const DXGI_OUTDUPL_MOVE_RECT*)metadata.data();
+        for (UINT i = 0; i < used / sizeof(DXGI_OUTDUPL_MOVE_RECT); i++) outputRects.push_back(moves[i].DestinationRect);
 
-static void CaptureLoopThread(int fps, int jpegQuality0to100, HANDLE stopEvent)
-{
-    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-    IWICImagingFactory* factory = nullptr;
-    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
-    if (FAILED(hr))
+        const UINT moveBytes = used;
+        used = 0;
+        if (FAILED(o.dup->GetFrameDirtyRects((UINT)metadata.size() - moveBytes, (RECT*)(metadata.data() + moveBytes), &used))) return false;
+        const RECT* dirty = (const RECT*)(metadata.data() + moveBytes);
+        for (UINT i = 0; i < used / sizeof(RECT); i++) outputRects.push_back(dirty[i]);
+        CoalesceDamage(outputRects);
+        return true;
+    }
+
+    // Grabs a whole (rotated) output into the surface with GDI and records it as damage.
+    HRESULT CopyOutputWithGdi(const Output& o)
     {
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        g_captureThreadRunning.store(false);
-        return;
+        const int x0 = std::max(0, (int)o.desktop.left - surface.x);
+        const int y0 = std::max(0, (int)o.desktop.top - surface.y);
+        const int x1 = std::min(surface.w, (int)o.desktop.right - surface.x);
+        const int y1 = std::min(surface.h, (int)o.desktop.bottom - surface.y);
+        if (x1 <= x0 || y1 <= y0) return S_OK;
+        if (!BitBlt(surface.memDC, x0, y0, x1 - x0, y1 - y0, surface.screenDC, surface.x + x0, surface.y + y0, SRCCOPY | CAPTUREBLT)) return E_FAIL;
+        AddDamageRect(damage, x0, y0, x1, y1, surface.w, surface.h);
+        return S_OK;
     }
 
-    // Demand-driven capture:
-    // - do not capture when there are no clients (reduces CPU + mouse/input disruption)
-    // - cap fps to avoid overloading the machine
-    if (fps <= 0) fps = 10;
-    if (fps > 60) fps = 60;
-    const int delayMs = (int)(1000 / fps);
-    uint64_t seqLocal = 0;
+    // Copies what changed in the output's newest frame (if any) into the surface and
+    // records it as damage. S_FALSE = nothing new.
+    HRESULT UpdateOutput(Output& o)
+    {
+        DXGI_OUTDUPL_FRAME_INFO info{};
+        IDXGIResource* res = nullptr;
+        HRESULT hr = S_OK;
+        if (o.pendingRes)
+        {
+            res = o.pendingRes;
+            info = o.pendingInfo;
+            o.pendingRes = nullptr;
+        }
+        else
+        {
+            hr = o.dup->AcquireNextFrame(0, &info, &res);
+            if (hr == DXGI_ERROR_WAIT_TIMEOUT) return S_FALSE;
+            if (FAILED(hr)) return hr;
+        }
 
-    while (g_running.load())
+        ID3D11Texture2D* tex = nullptr;
+        hr = res->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&tex);
+        res->Release();
+        bool partial = false;
+        if (SUCCEEDED(hr))
+        {
+            D3D11_TEXTURE2D_DESC td{};
+            tex->GetDesc(&td);
+            if (info.LastPresentTime.QuadPart == 0)
+            {
+                hr = S_FALSE; // cursor-only update: desktop image unchanged
+            }
+            else if (o.rotated)
+            {
+                // Copied with GDI below, after the frame is released.
+            }
+            else if (td.Format != DXGI_FORMAT_B8G8R8A8_UNORM || !EnsureStaging(o, td))
+            {
+                hr = E_FAIL;
+            }
+            else if (CollectFrameRects(o, info))
+            {
+                partial = true;
+                for (const RECT& r : outputRects)
+                {
+                    D3D11_BOX box{ (UINT)r.left, (UINT)r.top, 0, (UINT)r.right, (UINT)r.bottom, 1 };
+                    o.context->CopySubresourceRegion(o.staging, 0, (UINT)r.left, (UINT)r.top, 0, tex, 0, &box);
+                }
+            }
+            else
+            {
+                o.context->CopyResource(o.staging, tex);
+            }
+            tex->Release();
+        }
+        (void)o.dup->ReleaseFrame();
+        if (hr != S_OK) return hr;
+        if (o.rotated) return CopyOutputWithGdi(o);
+        if (partial && outputRects.empty()) return S_FALSE;
+
+        D3D11_MAPPED_SUBRESOURCE map{};
+        hr = o.context->Map(o.staging, 0, D3D11_MAP_READ, 0, &map);
+        if (FAILED(hr)) return hr;
+
+        const int dstX = (int)o.desktop.left - surface.x;
+        const int dstY = (int)o.desktop.top - surface.y;
+        const int outW = std::min({ o.stagingW, (int)(o.desktop.right - o.desktop.left), surface.w - dstX });
+        const int outH = std::min({ o.stagingH, (int)(o.desktop.bottom - o.desktop.top), surface.h - dstY });
+        if (!partial)
+        {
+            outputRects.assign(1, RECT{ 0, 0, outW, outH });
+        }
+        if (dstX >= 0 && dstY >= 0 && outW > 0 && outH > 0)
+        {
+            for (const RECT& r : outputRects)
+            {
+                const int x0 = std::max(0, (int)r.left);
+                const int y0 = std::max(0, (int)r.top);
+                const int x1 = std::min(outW, (int)r.right);
+                const int y1 = std::min(outH, (int)r.bottom);
+                if (x1 <= x0 || y1 <= y0) continue;
+                for (int yy = y0; yy < y1; yy++)
+                {
+                    std::memcpy(surface.bits + ((size_t)(dstY + yy) * surface.w + dstX + x0) * 4,
+                        (const uint8_t*)map.pData + (size_t)yy * map.RowPitch + (size_t)x0 * 4, (size_t)(x1 - x0) * 4);
+                }
+                AddDamageRect(damage, dstX + x0, dstY + y0, dstX + x1, dstY + y1, surface.w, surface.h);
+            }
+        }
+        o.context->Unmap(o.staging, 0);
+        return S_OK;
+    }
+
+    // Blocks on the outputs' next frame instead of sleeping; the acquired frame is consumed
+    // by the next Capture(). Several outputs are waited on in turn, a short slice each, so a
+    // change on any monitor ends the wait.
+    void WaitForChange(int minMs, int maxMs) override
     {
-        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        bool pending = false;
+        for (const Output& o : outputs) pending = pending || o.pendingRes;
+        if (!duplicating || outputs.empty() || pending)
         {
-            g_running.store(false);
-            break;
+            Sleep(minMs);
+            return;
+        }
+        const double deadline = PerfNowMs() + std::max(0, maxMs);
+        const int slice = outputs.size() > 1 ? kWaitSliceMs : std::max(0, maxMs);
+        for (size_t i = 0;; i = (i + 1) % outputs.size())
+        {
+            Output& o = outputs[i];
+            const int waitMs = std::max(0, std::min(slice, (int)(deadline - PerfNowMs())));
+            HRESULT hr = o.dup->AcquireNextFrame((UINT)waitMs, &o.pendingInfo, &o.pendingRes);
+            if (SUCCEEDED(hr)) return;
+            o.pendingRes = nullptr;
+            if (hr != DXGI_ERROR_WAIT_TIMEOUT)
+            {
+                Sleep(minMs); // lost: Capture() recreates the duplications
+                return;
+            }
+            if (PerfNowMs() >= deadline) return;
         }
+    }
 
-        // If nobody is watching, don't waste CPU capturing/encoding.
-        if (g_clientCount.load() <= 0)
+    void CopyCursorRect(bool save)
+    {
+        const int x0 = std::max(0, cursor.x);
+        const int y0 = std::max(0, cursor.y);
+        const int x1 = std::min(surface.w, cursor.x + cursor.w);
+        const int y1 = std::min(surface.h, cursor.y + cursor.h);
+        if (x1 <= x0 || y1 <= y0) return;
+        const size_t rowBytes = (size_t)(x1 - x0) * 4;
+        if (save) underCursor.resize(rowBytes * (size_t)(y1 - y0));
+        for (int yy = y0; yy < y1; yy++)
         {
-            Sleep(50);
-            continue;
+            uint8_t* px = surface.bits + ((size_t)yy * surface.w + x0) * 4;
+            uint8_t* saved = underCursor.data() + rowBytes * (size_t)(yy - y0);
+            if (save) std::memcpy(saved, px, rowBytes);
+            else std::memcpy(px, saved, rowBytes);
         }
+    }
 
-        JpegFrame frame;
-        hr = CaptureScreenToJpeg(factory, jpegQuality0to100, frame);
-        if (SUCCEEDED(hr) && !frame.bytes.empty())
+    HRESULT Capture(CaptureSurface& out) override
+    {
+        const int nx = GetSystemMetrics(SM_XVIRTUALSCREEN);
+        const int ny = GetSystemMetrics(SM_YVIRTUALSCREEN);
+        const int nw = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+        const int nh = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+        const bool geometryChanged = nx != surface.x || ny != surface.y || nw != surface.w || nh != surface.h;
+        if (geometryChanged && duplicating) ReleaseOutputs();
+
+        if (!duplicating && PerfNowMs() >= nextInitMs)
+        {
+            if (!InitOutputs())
+            {
+                nextInitMs = PerfNowMs() + kRetryInitMs;
+                if (!fallbackLogged) LogError("DXGI duplication unavailable, capturing with GDI\n");
+                fallbackLogged = true;
+            }
+            else
+            {
+                fallbackLogged = false;
+            }
+        }
+        if (!duplicating)
+        {
+            return surface.Capture(out);
+        }
+
+        damage.clear();
+        bool fullDamage = !trackDamage;
+
+        // Fresh surface or new duplications: start from a cursor-less GDI grab so monitors
+        // that have not presented a frame yet are filled too.
+        if (geometryChanged || !surface.bits || needBaseGrab)
+        {
+            surface.drawCursor = false;
+            HRESULT hr = surface.Capture(out);
+            surface.drawCursor = overlayCursor;
+            if (FAILED(hr)) return hr;
+            needBaseGrab = false;
+            cursorSaved = false;
+            fullDamage = true;
+        }
+        else if (cursorSaved)
+        {
+            CopyCursorRect(false);
+            cursorSaved = false;
+            AddDamageRect(damage, cursor.x, cursor.y, cursor.x + cursor.w, cursor.y + cursor.h, surface.w, surface.h);
+        }
+
+        for (Output& o : outputs)
+        {
+            HRESULT hr = UpdateOutput(o);
+            if (hr == DXGI_ERROR_ACCESS_LOST || hr == DXGI_ERROR_INVALID_CALL)
+            {
+                // Mode change / desktop switch: recreate the duplications on the next frame.
+                ReleaseOutputs();
+                return surface.Capture(out);
+            }
+        }
+
+        if (overlayCursor && GetCursorSnapshot(surface.x, surface.y, cursor))
         {
-            std::lock_guard<std::mutex> lock(g_sharedFrame.mtx);
-            g_sharedFrame.bytes = std::move(frame.bytes);
-            g_sharedFrame.seq = ++seqLocal;
-            g_sharedFrame.cv.notify_all();
+            CopyCursorRect(true);
+            cursorSaved = true;
+            (void)DrawIconEx(surface.memDC, cursor.x, cursor.y, cursor.cursor, 0, 0, 0, nullptr, DI_NORMAL);
+            AddDamageRect(damage, cursor.x, cursor.y, cursor.x + cursor.w, cursor.y + cursor.h, surface.w, surface.h);
         }
-        Sleep(delayMs);
+        GdiFlush();
+        CoalesceDamage(damage);
+
+        out.pixels = surface.bits;
+        out.width = surface.w;
+        out.height = surface.h;
+        out.stride = surface.w * 4;
+        out.originX = surface.x;
+        out.originY = surface.y;
+        out.damage = fullDamage ? nullptr : &damage;
+        return S_OK;
     }
+};
 
-    factory->Release();
-    if (SUCCEEDED(hrCo)) CoUninitialize();
-    g_captureThreadRunning.store(false);
+// "gdi" (default), "dxgi" or "synthetic[:WxH][:still]".
+static std::unique_ptr<CaptureSource> CreateCaptureSource(const std::string& spec)
+{
+    if (spec.empty() || spec == "gdi") return std::make_unique<GdiCaptureSource>();
+    if (spec == "dxgi") return std::make_unique<DxgiCaptureSource>();
+    if (spec.compare(0, 9, "synthetic") == 0)
+    {
+        int sw = 1920;
+        int sh = 1080;
+        if (spec.size() > 10 && spec[9] == ':')
+        {
+            int pw = 0, ph = 0;
+            if (std::sscanf(spec.c_str() + 10, "%dx%d", &pw, &ph) == 2 && pw > 0 && ph > 0)
+            {
+                sw = pw;
+                sh = ph;
+            }
+        }
+        const bool still = spec.size() >= 6 && spec.compare(spec.size() - 6, 6, ":still") == 0;
+        return std::make_unique<SyntheticCaptureSource>(sw, sh, still);
+    }
+    return nullptr;
 }
 
 // ----------------------------
-// HTTP MJPEG server (WinSock)
+// Tile hashing (change detection)
 // ----------------------------
 
-static bool ParseHttpPath(const std::string& req, std::string& outPath)
-{
-    // Expected: "GET /path HTTP/1.1"...
-    size_t sp1 = req.find(' ');
-    if (sp1 == std::string::npos) return false;
-    size_t sp2 = req.find(' ', sp1 + 1);
-    if (sp2 == std::string::npos) return false;
-    outPath = req.substr(sp1 + 1, sp2 - (sp1 + 1));
-    if (outPath.empty()) outPath = "/";
-    size_t q = outPath.find('?');
-    if (q != std::string::npos) outPath.resize(q);
-    return true;
+// The surface is split into kTileSize x kTileSize tiles and each tile gets a 64-bit hash.
+// Hash definition (identical for every code path): 8 uint32 lanes, pixel i of a tile row
+// goes to lane (i & 7), lane = rotl32(lane + pixel, 5); rows are fed in order into the
+// same lanes, then the lanes are folded FNV-style. Every step is a bijection of the lane
+// state, so a single changed pixel always changes the hash.
+static constexpr int kTileSize = 64;
+
+struct TileHashGrid
+{
+    int width = 0;
+    int height = 0;
+    int cols = 0;
+    int rows = 0;
+    std::vector<uint64_t> hashes;
+};
+
+static bool DetectCpuAvx2()
+{
+#if LANSCR_X86_SIMD
+    int r[4] = {};
+    __cpuid(r, 0);
+    if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    const bool osxsave = (r[2] & (1 << 27)) != 0;
+    const bool avx = (r[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false; // OS saves XMM+YMM state
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+static const bool g_cpuHasAvx2 = DetectCpuAvx2();
+
+static inline uint32_t Rotl32(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
 }
 
-static bool ParseHttpTarget(const std::string& req, std::string& outPath, std::string& outQuery)
+static uint64_t FoldTileLanes(const uint32_t lanes[8], int w, int h)
 {
-    outPath.clear();
-    outQuery.clear();
-    size_t sp1 = req.find(' ');
-    if (sp1 == std::string::npos) return false;
-    size_t sp2 = req.find(' ', sp1 + 1);
-    if (sp2 == std::string::npos) return false;
-    std::string target = req.substr(sp1 + 1, sp2 - (sp1 + 1));
-    if (target.empty()) target = "/";
-    size_t q = target.find('?');
-    if (q != std::string::npos)
+    uint64_t x = 0xcbf29ce484222325ull ^ ((uint64_t)w << 32) ^ (uint64_t)h;
+    for (int i = 0; i < 8; i++)
     {
-        outPath = target.substr(0, q);
-        outQuery = target.substr(q + 1);
+        x ^= lanes[i];
+        x *= 0x100000001b3ull;
     }
-    else
+    return x ^ (x >> 29);
+}
+
+static inline void HashTileTail(uint32_t lanes[8], const uint32_t* px, int from, int to)
+{
+    for (int i = from; i < to; i++) lanes[i & 7] = Rotl32(lanes[i & 7] + px[i], 5);
+}
+
+static uint64_t HashTileScalar(const uint8_t* p, int stride, int w, int h)
+{
+    uint32_t lanes[8] = {};
+    for (int y = 0; y < h; y++)
     {
-        outPath = target;
+        HashTileTail(lanes, (const uint32_t*)(p + (size_t)y * stride), 0, w);
     }
-    return true;
+    return FoldTileLanes(lanes, w, h);
 }
 
-static bool QueryGetInt(const std::string& query, const char* key, int& out)
+#if LANSCR_X86_SIMD
+static uint64_t HashTileSse2(const uint8_t* p, int stride, int w, int h)
 {
-    // very small query parser: key=value&...
-    std::string k(key);
-    size_t pos = 0;
-    while (pos < query.size())
+    // Two accumulators: lanes 0-3 (even 16-byte blocks) and lanes 4-7 (odd blocks).
+    __m128i a = _mm_setzero_si128();
+    __m128i b = _mm_setzero_si128();
+    const int wVec = w & ~7;
+    uint32_t lanes[8];
+    for (int y = 0; y < h; y++)
+    {
+        const uint8_t* row = p + (size_t)y * stride;
+        for (int x = 0; x < wVec; x += 8)
+        {
+            __m128i t = _mm_add_epi32(a, _mm_loadu_si128((const __m128i*)(row + (size_t)x * 4)));
+            a = _mm_or_si128(_mm_slli_epi32(t, 5), _mm_srli_epi32(t, 27));
+            t = _mm_add_epi32(b, _mm_loadu_si128((const __m128i*)(row + (size_t)x * 4 + 16)));
+            b = _mm_or_si128(_mm_slli_epi32(t, 5), _mm_srli_epi32(t, 27));
+        }
+        if (wVec < w)
+        {
+            _mm_storeu_si128((__m128i*)lanes, a);
+            _mm_storeu_si128((__m128i*)(lanes + 4), b);
+            HashTileTail(lanes, (const uint32_t*)row, wVec, w);
+            a = _mm_loadu_si128((const __m128i*)lanes);
+            b = _mm_loadu_si128((const __m128i*)(lanes + 4));
+        }
+    }
+    _mm_storeu_si128((__m128i*)lanes, a);
+    _mm_storeu_si128((__m128i*)(lanes + 4), b);
+    return FoldTileLanes(lanes, w, h);
+}
+
+static uint64_t HashTileAvx2(const uint8_t* p, int stride, int w, int h)
+{
+    __m256i a = _mm256_setzero_si256();
+    const int wVec = w & ~7;
+    uint32_t lanes[8];
+    for (int y = 0; y < h; y++)
     {
-        size_t amp = query.find('&', pos);
-        if (amp == std::string::npos) amp = query.size();
-        std::string part = query.substr(pos, amp - pos);
-        size_t eq = part.find('=');
-        std::string pk = (eq == std::string::npos) ? part : part.substr(0, eq);
-        std::string pv = (eq == std::string::npos) ? "" : part.substr(eq + 1);
-        if (pk == k)
+        const uint8_t* row = p + (size_t)y * stride;
+        for (int x = 0; x < wVec; x += 8)
         {
-            out = std::atoi(pv.c_str());
-            return true;
+            __m256i t = _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)(row + (size_t)x * 4)));
+            a = _mm256_or_si256(_mm256_slli_epi32(t, 5), _mm256_srli_epi32(t, 27));
+        }
+        if (wVec < w)
+        {
+            _mm256_storeu_si256((__m256i*)lanes, a);
+            HashTileTail(lanes, (const uint32_t*)row, wVec, w);
+            a = _mm256_loadu_si256((const __m256i*)lanes);
         }
-        pos = amp + 1;
     }
-    return false;
+    _mm256_storeu_si256((__m256i*)lanes, a);
+    return FoldTileLanes(lanes, w, h);
 }
+#endif
 
-static bool SendHttpText(SOCKET client, const char* contentType, const std::string& body)
+enum class TileHashImpl { Scalar, Sse2, Avx2 };
+
+static uint64_t HashTile(TileHashImpl impl, const uint8_t* p, int stride, int w, int h)
 {
-    char hdr[512];
-    std::snprintf(hdr, sizeof(hdr),
-        "HTTP/1.1 200 OK\r\n"
-        "Connection: close\r\n"
-        "Cache-Control: no-cache\r\n"
-        "Pragma: no-cache\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %zu\r\n"
-        "\r\n",
-        contentType,
-        body.size());
+#if LANSCR_X86_SIMD
+    if (impl == TileHashImpl::Avx2) return HashTileAvx2(p, stride, w, h);
+    if (impl == TileHashImpl::Sse2) return HashTileSse2(p, stride, w, h);
+#endif
+    (void)impl;
+    return HashTileScalar(p, stride, w, h);
+}
 
-    if (!SendAll(client, hdr, (int)std::strlen(hdr))) return false;
-    return SendAll(client, body.data(), (int)body.size());
+static TileHashImpl BestTileHashImpl()
+{
+#if LANSCR_X86_SIMD
+    return g_cpuHasAvx2 ? TileHashImpl::Avx2 : TileHashImpl::Sse2;
+#else
+    return TileHashImpl::Scalar;
+#endif
 }
 
-static std::string MakeLandingHtml(uint16_t port)
+static void ComputeTileHashes(const CaptureSurface& surf, TileHashGrid& grid, TileHashImpl impl)
 {
-    // NOTE: Most browsers block autoplay audio until a user gesture.
-    char buf[65536];
-    const bool priv = g_httpAuthEnabled;
-    std::snprintf(buf, sizeof(buf),
-        "<!doctype html><html><head><meta charset='utf-8'>"
-        "<meta name='viewport' content='width=device-width, initial-scale=1'>"
-        "<title>LANSCR</title>"
-        "<style>"
-        ":root{--primary:#12c780;--primary-dark:#0ea06a;--accent:#22b8ff;--accent-dark:#0b9ddf;--dark:#0b1220;--txt:#eaf6ff;--mut:rgba(234,246,255,.82);--card:rgba(255,255,255,.10);--bd:rgba(255,255,255,.16);--shadow:0 16px 45px rgba(2,12,27,.22);}"
-        "*{box-sizing:border-box}"
-        "body{margin:0;font-family:system-ui,-apple-system,Segoe UI,Inter,Arial;background:radial-gradient(1200px 600px at 10%% 0%%,rgba(18,199,128,0.10),transparent 55%%),radial-gradient(900px 500px at 90%% 20%%,rgba(34,184,255,0.12),transparent 60%%),linear-gradient(135deg,#071018 0%%,#0a1626 100%%);color:var(--txt);}"
-        "a{color:rgba(210,248,255,.95);text-decoration:none}a:hover{text-decoration:underline}"
-        "@keyframes fadeIn{0%%{opacity:0;transform:translateY(14px)}100%%{opacity:1;transform:translateY(0)}}"
-        ".animate-in{animation:fadeIn .6s ease forwards}"
-        ".wrap{max-width:1180px;margin:0 auto;padding:18px;}"
-        ".hero{padding:22px 0 16px;text-align:left;background:linear-gradient(135deg,var(--primary) 0%%,var(--accent) 100%%);color:white;border-radius:0 0 26px 26px;position:relative;overflow:hidden;}"
-        ".hero:before{content:'';position:absolute;inset:0;background:radial-gradient(900px 420px at 10%% 0%%,rgba(255,255,255,.16),transparent 55%%),radial-gradient(900px 420px at 95%% 25%%,rgba(255,255,255,.12),transparent 60%%);pointer-events:none;}"
-        ".hero .wrap{position:relative}"
-        ".top{display:flex;gap:12px;align-items:center;justify-content:space-between;flex-wrap:wrap;}"
-        ".brand{display:flex;align-items:center;gap:10px;font-weight:900;font-size:18px;letter-spacing:.4px;}"
-        ".logo{width:34px;height:34px;border-radius:10px;background:linear-gradient(135deg,rgba(255,255,255,.98),rgba(255,255,255,.82));box-shadow:0 14px 30px rgba(2,12,27,.22);}"
-        ".pill{display:inline-flex;align-items:center;gap:10px;padding:8px 12px;border-radius:999px;background:rgba(255,255,255,.16);border:1px solid rgba(255,255,255,.22);}"
-        ".badge{display:inline-flex;align-items:center;gap:8px;padding:6px 10px;border-radius:999px;font-size:12px;background:rgba(0,0,0,.20);border:1px solid rgba(255,255,255,.18);}"
-        ".tabs{display:flex;gap:8px;flex-wrap:wrap;margin-top:12px;}"
-        ".tab{appearance:none;border:1px solid rgba(255,255,255,.16);background:rgba(255,255,255,.05);color:var(--txt);padding:10px 12px;border-radius:12px;cursor:pointer;font-weight:800;}"
-        ".tab.on{background:linear-gradient(135deg,rgba(18,199,128,.98),rgba(34,184,255,.98));color:#08131f;border:0}"
-        ".panel{display:none;margin-top:12px;}"
-        ".panel.on{display:block;}"
-        ".grid{display:grid;grid-template-columns:1.35fr .65fr;gap:14px;}"
-        "@media (max-width:980px){.grid{grid-template-columns:1fr;}}"
-        ".card{background:var(--card);border:1px solid var(--bd);border-radius:16px;overflow:hidden;box-shadow:var(--shadow);backdrop-filter:blur(14px);}"
-        ".card h3{margin:0;padding:14px 16px;border-bottom:1px solid var(--bd);font-size:14px;font-weight:900;opacity:.98;display:flex;justify-content:space-between;align-items:center;}"
-        ".card .body{padding:14px 16px;}"
-        ".btn{appearance:none;border:0;border-radius:12px;padding:10px 12px;font-weight:900;cursor:pointer;color:#08131f;background:linear-gradient(135deg,rgba(18,199,128,.98),rgba(34,184,255,.98));transition:transform .12s ease,filter .12s ease;}"
-        ".btn:hover{transform:translateY(-1px);filter:brightness(1.03);}"
-        ".btn2{appearance:none;border:1px solid rgba(255,255,255,.18);border-radius:12px;padding:10px 12px;font-weight:900;cursor:pointer;color:var(--txt);background:rgba(255,255,255,.06);transition:transform .12s ease,filter .12s ease;}"
-        ".btn2:hover{transform:translateY(-1px);filter:brightness(1.05);}"
-        ".row{display:flex;gap:10px;flex-wrap:wrap;margin-top:10px;}"
-        ".muted{opacity:.88;font-size:13px;line-height:1.45;color:var(--mut);}"
-        ".video{display:block;width:100%%;background:#000;}"
-        ".kv{display:grid;grid-template-columns:120px 1fr;gap:6px 10px;margin-top:10px;font-size:13px;opacity:.92}"
-        ".kv b{opacity:.92}"
-        "</style></head><body><section class='hero animate-in'><div class='wrap'>"
-        "<div class='top'>"
-        "<div class='brand'><div class='logo'></div> LANSCR <span class='badge'>Live Screen + Audio</span>%s</div>"
-        "<div class='pill'><span class='badge' id='mode'>%s</span> <span>Host: <b id='host'></b></span></div>"
-        "</div></div></section><div class='wrap'>"
-        "<div class='tabs'>"
-        "<button class='tab on' data-tab='video'>Video</button>"
-        "<button class='tab' data-tab='settings'>Settings</button>"
-        "<button class='tab' data-tab='about'>About</button>"
-        "</div>"
-
-        "<div class='panel on' id='p-video'>"
-        "<div class='grid'>"
-        "<div class='card'><h3>Screen <span class='badge'><a href='/mjpeg' rel='nofollow'>/mjpeg</a></span></h3><div id='vwrap'><img id='vid' class='video' src='/mjpeg' alt='stream'></div></div>"
-        "<div class='card'><h3>Quick Controls <span class='badge' id='st'>Loading...</span></h3><div class='body'>"
-        "<div class='row'>"
-        "<button class='btn2' id='fs'>Full Screen</button>"
-        "<button class='btn2' id='cp'>Copy Link</button>"
-        "</div>"
-        "<div class='kv'>"
-        "<b>Links</b><span><a href='/' rel='nofollow'>Home</a> | <a href='/mjpeg' rel='nofollow'>Video</a> | <a href='/audio' rel='nofollow'>Audio</a></span>"
-        "<b>Share</b><span id='lnk' style='opacity:.95'></span></span>"
-        "</div>"
-        "<p class='muted' style='margin-top:10px'>Tip: Open this link on a phone on the same Wi-Fi for a live view.</p>"
-        "</div></div>"
-        "</div>"
-        "</div>"
-
-        "<div class='panel' id='p-settings'>"
-        "<div class='grid'>"
-        "<div class='card'><h3>Audio <span class='badge'><a href='/audio' rel='nofollow'>/audio</a></span></h3><div class='body'>"
-        "<div class='row'>"
-        "<button class='btn' id='en'>Enable Audio</button>"
-        "<button class='btn2' id='mb'>Mute/Unmute Browser</button>"
-        "<button class='btn2' id='mt'>Mute/Unmute Server</button>"
-        "</div>"
-        "<audio id='a' controls style='width:100%%;margin-top:12px' src='/audio'></audio>"
-        "<p class='muted' style='margin-top:10px'>Browser audio may need a click due to autoplay rules.</p>"
-        "</div></div>"
-        "<div class='card'><h3>Status</h3><div class='body'>"
-        "<div class='kv'>"
-        "<b>Private</b><span id='priv'></span>"
-        "<b>Server mute</b><span id='sm'></span>"
-        "<b>Port</b><span id='prt'></span>"
-        "</div>"
-        "<div class='row'><button class='btn2' id='rf'>Refresh</button></div>"
-        "</div></div>"
-        "</div>"
-        "</div>"
-
-        "<div class='panel' id='p-about'>"
-        "<div class='grid'>"
-        "<div class='card'><h3>Project</h3><div class='body'>"
-        "<p class='muted'>LANSCR is a lightweight LAN screen + audio sharing tool (MJPEG video + WAV audio). Open from any browser on the same network.</p>"
-        "<div class='kv'>"
-        "<b>Website</b><span><a href='http://info.likhil.42web.io/lanscr' target='_blank' rel='nofollow'>info.likhil.42web.io/lanscr</a></span>"
-        "<b>GitHub</b><span><a href='https://github.com/pidugulikhil/LANSCR' target='_blank' rel='nofollow'>pidugulikhil/LANSCR</a></span>"
-        "<b>Releases</b><span><a href='https://github.com/pidugulikhil/LANSCR/releases' target='_blank' rel='nofollow'>Download builds</a></span>"
-        "</div>"
-        "</div></div>"
-        "<div class='card'><h3>Social / Bio</h3><div class='body'>"
-        "<p class='muted'>Follow the links above for updates, releases, and source.</p>"
-        "</div></div>"
-        "</div>"
-        "</div>"
+    grid.width = surf.width;
+    grid.height = surf.height;
+    grid.cols = (surf.width + kTileSize - 1) / kTileSize;
+    grid.rows = (surf.height + kTileSize - 1) / kTileSize;
+    grid.hashes.resize((size_t)grid.cols * (size_t)grid.rows);
 
-        "</div><script>"
-        "const a=document.getElementById('a');"
-        "const st=document.getElementById('st');"
-        "const host=document.getElementById('host');host.textContent=location.host||(':'+location.port);"
-        "const lnk=document.getElementById('lnk');lnk.textContent=location.href;"
-        "const privEl=document.getElementById('priv');"
-        "const smEl=document.getElementById('sm');"
-        "const prtEl=document.getElementById('prt');"
+    for (int ty = 0; ty < grid.rows; ty++)
+    {
+        const int y0 = ty * kTileSize;
+        const int th = std::min(kTileSize, surf.height - y0);
+        for (int tx = 0; tx < grid.cols; tx++)
+        {
+            const int x0 = tx * kTileSize;
+            const int tw = std::min(kTileSize, surf.width - x0);
+            const uint8_t* p = surf.pixels + (size_t)y0 * surf.stride + (size_t)x0 * 4;
+            grid.hashes[(size_t)ty * grid.cols + tx] = HashTile(impl, p, surf.stride, tw, th);
+        }
+    }
+}
 
-        "function setTab(name){document.querySelectorAll('.tab').forEach(b=>b.classList.toggle('on',b.dataset.tab===name));"
-        "document.getElementById('p-video').classList.toggle('on',name==='video');"
-        "document.getElementById('p-settings').classList.toggle('on',name==='settings');"
-        "document.getElementById('p-about').classList.toggle('on',name==='about');}"
-        "document.querySelectorAll('.tab').forEach(b=>b.onclick=()=>setTab(b.dataset.tab));"
+// Brings grid (the hashes of the previous capture) up to date with surf. With damage
+// information only the tiles it touches are re-hashed; otherwise every tile is.
+static void UpdateTileHashes(const CaptureSurface& surf, TileHashGrid& grid, TileHashImpl impl)
+{
+    if (!surf.damage || grid.width != surf.width || grid.height != surf.height || grid.hashes.empty())
+    {
+        ComputeTileHashes(surf, grid, impl);
+        return;
+    }
 
-        "document.getElementById('en').onclick=()=>{a.muted=false;a.play().catch(()=>{});};"
-        "document.getElementById('mb').onclick=()=>{a.muted=!a.muted;st.textContent=a.muted?'Browser muted':'Browser unmuted';setTimeout(()=>poll(),500);};"
-        "document.getElementById('fs').onclick=()=>{const el=document.getElementById('vwrap');(el.requestFullscreen||el.webkitRequestFullscreen||el.msRequestFullscreen||(()=>{})).call(el);};"
-        "document.getElementById('cp').onclick=()=>{navigator.clipboard&&navigator.clipboard.writeText(location.href).then(()=>{st.textContent='Link copied';setTimeout(()=>poll(),800);}).catch(()=>{});};"
-        "document.getElementById('rf').onclick=()=>poll();"
-        "async function poll(){try{const r=await fetch('/control',{cache:'no-store'});const j=await r.json();"
-        "st.textContent=j.audioMuted?'Server audio muted':'Server audio on';"
-        "if(privEl) privEl.textContent=j.privateMode?'ON':'OFF';"
-        "if(smEl) smEl.textContent=j.audioMuted?'Muted':'Unmuted';"
-        "if(prtEl) prtEl.textContent=j.port;"
-        "}catch(e){st.textContent='Status unavailable';}}"
-        "async function toggleMute(){try{const r=await fetch('/control',{cache:'no-store'});const j=await r.json();const want=j.audioMuted?0:1;await fetch('/control?mute='+want,{cache:'no-store'});poll();}catch(e){}}"
-        "document.getElementById('mt').onclick=toggleMute;"
-        "poll();"
-        "</script></body></html>",
-        priv ? " <span class='badge'>Private</span>" : "",
-        priv ? "Private" : "Public");
-    return std::string(buf);
+    for (const RECT& r : *surf.damage)
+    {
+        const int tx0 = std::max(0, (int)r.left) / kTileSize;
+        const int ty0 = std::max(0, (int)r.top) / kTileSize;
+        const int tx1 = std::min(grid.cols - 1, ((int)r.right - 1) / kTileSize);
+        const int ty1 = std::min(grid.rows - 1, ((int)r.bottom - 1) / kTileSize);
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            const int y0 = ty * kTileSize;
+            const int th = std::min(kTileSize, surf.height - y0);
+            for (int tx = tx0; tx <= tx1; tx++)
+            {
+                const int x0 = tx * kTileSize;
+                const int tw = std::min(kTileSize, surf.width - x0);
+                const uint8_t* p = surf.pixels + (size_t)y0 * surf.stride + (size_t)x0 * 4;
+                grid.hashes[(size_t)ty * grid.cols + tx] = HashTile(impl, p, surf.stride, tw, th);
+            }
+        }
+    }
 }
 
-static bool SendWavHeaderPcm16(SOCKET client, int sampleRate, int channels)
+static bool SameTileHashes(const TileHashGrid& a, const TileHashGrid& b)
 {
-    // Streaming WAV with unknown total size: use 0xFFFFFFFF placeholders.
-    uint8_t hdr[44] = {};
-    auto w32 = [&](int off, uint32_t v) {
-        hdr[off + 0] = (uint8_t)(v & 0xFF);
-        hdr[off + 1] = (uint8_t)((v >> 8) & 0xFF);
-        hdr[off + 2] = (uint8_t)((v >> 16) & 0xFF);
-        hdr[off + 3] = (uint8_t)((v >> 24) & 0xFF);
-    };
-    auto w16 = [&](int off, uint16_t v) {
-        hdr[off + 0] = (uint8_t)(v & 0xFF);
-        hdr[off + 1] = (uint8_t)((v >> 8) & 0xFF);
-    };
-
-    // RIFF
-    hdr[0] = 'R'; hdr[1] = 'I'; hdr[2] = 'F'; hdr[3] = 'F';
-    w32(4, 0xFFFFFFFF);
-    hdr[8] = 'W'; hdr[9] = 'A'; hdr[10] = 'V'; hdr[11] = 'E';
+    return a.width == b.width && a.height == b.height && !a.hashes.empty() && a.hashes == b.hashes;
+}
 
-    // fmt 
-    hdr[12] = 'f'; hdr[13] = 'm'; hdr[14] = 't'; hdr[15] = ' ';
-    w32(16, 16);
-    w16(20, 1); // PCM
-    w16(22, (uint16_t)channels);
-    w32(24, (uint32_t)sampleRate);
-    uint16_t blockAlign = (uint16_t)(channels * 2);
-    uint32_t byteRate = (uint32_t)sampleRate * (uint32_t)blockAlign;
-    w32(28, byteRate);
-    w16(32, blockAlign);
-    w16(34, 16);
+// ----------------------------
+// Pixel kernels (colour conversion, downscale)
+// ----------------------------
 
-    // data
-    hdr[36] = 'd'; hdr[37] = 'a'; hdr[38] = 't'; hdr[39] = 'a';
-    w32(40, 0xFFFFFFFF);
+// Row kernels in scalar, SSE2 and AVX2 variants, picked once by CPUID (g_cpuHasAvx2).
+// All arithmetic is fixed-point and every variant is bit-exact with the scalar one, so the
+// strip encoder's output does not depend on the CPU it runs on.
+//
+// BGRA -> YCbCr (JFIF, full range), 15-bit coefficients, level-shifted for the JPEG encoder:
+//   Y  = ((9798 R + 19235 G + 3736 B + 16384) >> 15) - 128
+//   Cb =  (-5529 R - 10855 G + 16384 B + 16384) >> 15
+//   Cr =  (16384 R - 13720 G - 2664 B + 16384) >> 15
+// YCbCr -> BGRA, 14-bit coefficients (cb/cr already minus 128), clamped to 0..255:
+//   R = Y + ((22970 cr + 8192) >> 14)
+//   G = Y + ((-5638 cb - 11700 cr + 8192) >> 14)
+//   B = Y + ((29032 cb + 8192) >> 14)
+struct PixelKernels
+{
+    const char* name;
+    // n BGRA pixels -> level-shifted Y, Cb, Cr.
+    void (*bgraToYcc)(const uint8_t* bgra, int n, int16_t* y, int16_t* cb, int16_t* cr);
+    // n outputs, each the rounded-down mean of a 2x2 block of two rows of 2n samples.
+    void (*average2x2)(const int16_t* r0, const int16_t* r1, int n, int16_t* out);
+    // n pixels from 8-bit Y and interleaved 8-bit CbCr (one pair per 2 pixels if chromaHalfX).
+    void (*yccToBgra)(const uint8_t* y, const uint8_t* cbcr, int n, bool chromaHalfX, uint8_t* bgra);
+    // n BGRA pixels, each the rounded mean of a 2x2 block of two rows of 2n pixels.
+    void (*halveBgra)(const uint8_t* r0, const uint8_t* r1, int n, uint8_t* out);
+    // bytes of (r0 * (256 - fy) + r1 * fy + 128) >> 8, fy in 0..256.
+    void (*lerpRows)(const uint8_t* r0, const uint8_t* r1, int bytes, int fy, uint8_t* out);
+};
 
-    return SendAll(client, hdr, (int)sizeof(hdr));
+static inline uint8_t ClampU8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
 }
 
-static inline int16_t FloatToS16(float f)
+static void BgraToYccScalar(const uint8_t* p, int n, int16_t* y, int16_t* cb, int16_t* cr)
 {
-    if (f > 1.0f) f = 1.0f;
-    if (f < -1.0f) f = -1.0f;
-    return (int16_t)std::lrintf(f * 32767.0f);
+    for (int i = 0; i < n; i++, p += 4)
+    {
+        const int B = p[0], G = p[1], R = p[2];
+        y[i] = (int16_t)(((9798 * R + 19235 * G + 3736 * B + 16384) >> 15) - 128);
+        cb[i] = (int16_t)((-5529 * R - 10855 * G + 16384 * B + 16384) >> 15);
+        cr[i] = (int16_t)((16384 * R - 13720 * G - 2664 * B + 16384) >> 15);
+    }
 }
 
-static void StreamAudioThread(SOCKET client, const std::string& clientIp, HANDLE stopEvent)
+static void Average2x2Scalar(const int16_t* r0, const int16_t* r1, int n, int16_t* out)
 {
-    if (!g_serverAudioEnabled.load())
+    for (int i = 0; i < n; i++)
     {
-        const std::string body = "Audio disabled";
-        (void)SendHttpText(client, "text/plain; charset=utf-8", body);
-        closesocket(client);
-        return;
+        out[i] = (int16_t)(((int)r0[2 * i] + r0[2 * i + 1] + r1[2 * i] + r1[2 * i + 1] + 2) >> 2);
     }
-    const std::string headers =
-        "HTTP/1.1 200 OK\r\n"
-        "Connection: close\r\n"
-        "Cache-Control: no-cache\r\n"
-        "Pragma: no-cache\r\n"
-        "Content-Type: audio/wav\r\n"
-        "\r\n";
+}
 
-    if (!SendAll(client, headers.data(), (int)headers.size()))
+static void YccToBgraScalar(const uint8_t* y, const uint8_t* cbcr, int n, bool chromaHalfX, uint8_t* out)
+{
+    const int shift = chromaHalfX ? 1 : 0;
+    for (int i = 0; i < n; i++, out += 4)
+    {
+        const uint8_t* c = cbcr + (size_t)(i >> shift) * 2;
+        const int cb = (int)c[0] - 128;
+        const int cr = (int)c[1] - 128;
+        const int Y = y[i];
+        out[0] = ClampU8(Y + ((29032 * cb + 8192) >> 14));
+        out[1] = ClampU8(Y + ((-5638 * cb - 11700 * cr + 8192) >> 14));
+        out[2] = ClampU8(Y + ((22970 * cr + 8192) >> 14));
+        out[3] = 255;
+    }
+}
+
+static void HalveBgraScalar(const uint8_t* r0, const uint8_t* r1, int n, uint8_t* out)
+{
+    for (int i = 0; i < n; i++)
     {
-        closesocket(client);
-        return;
+        for (int c = 0; c < 4; c++)
+        {
+            out[i * 4 + c] = (uint8_t)((r0[i * 8 + c] + r0[i * 8 + 4 + c] + r1[i * 8 + c] + r1[i * 8 + 4 + c] + 2) >> 2);
+        }
     }
+}
 
-    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+static void LerpRowsScalar(const uint8_t* r0, const uint8_t* r1, int bytes, int fy, uint8_t* out)
+{
+    const int w0 = 256 - fy;
+    for (int i = 0; i < bytes; i++) out[i] = (uint8_t)((r0[i] * w0 + r1[i] * fy + 128) >> 8);
+}
 
-    IMMDeviceEnumerator* enumerator = nullptr;
-    IMMDevice* device = nullptr;
-    IAudioClient* audioClient = nullptr;
-    IAudioCaptureClient* capture = nullptr;
-    WAVEFORMATEX* mix = nullptr;
+#if LANSCR_X86_SIMD
+// Sums the two 32-bit halves of each pixel's pmaddwd result: t holds pixels 0-1, u pixels 2-3.
+static inline __m128i PairSum4Sse2(__m128i t, __m128i u)
+{
+    const __m128 a = _mm_shuffle_ps(_mm_castsi128_ps(t), _mm_castsi128_ps(u), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 b = _mm_shuffle_ps(_mm_castsi128_ps(t), _mm_castsi128_ps(u), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(a), _mm_castps_si128(b));
+}
 
-    HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&enumerator));
-    if (FAILED(hr)) goto cleanup;
+static void BgraToYccSse2(const uint8_t* p, int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i cy = _mm_setr_epi16(3736, 19235, 9798, 0, 3736, 19235, 9798, 0);
+    const __m128i ccb = _mm_setr_epi16(16384, -10855, -5529, 0, 16384, -10855, -5529, 0);
+    const __m128i ccr = _mm_setr_epi16(-2664, -13720, 16384, 0, -2664, -13720, 16384, 0);
+    const __m128i rnd = _mm_set1_epi32(16384);
+    const __m128i bias = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i v0 = _mm_loadu_si128((const __m128i*)(p + (size_t)i * 4));
+        const __m128i v1 = _mm_loadu_si128((const __m128i*)(p + (size_t)i * 4 + 16));
+        const __m128i a0 = _mm_unpacklo_epi8(v0, z);
+        const __m128i a1 = _mm_unpackhi_epi8(v0, z);
+        const __m128i a2 = _mm_unpacklo_epi8(v1, z);
+        const __m128i a3 = _mm_unpackhi_epi8(v1, z);
+        auto conv = [&](__m128i c) {
+            const __m128i lo = _mm_srai_epi32(_mm_add_epi32(PairSum4Sse2(_mm_madd_epi16(a0, c), _mm_madd_epi16(a1, c)), rnd), 15);
+            const __m128i hi = _mm_srai_epi32(_mm_add_epi32(PairSum4Sse2(_mm_madd_epi16(a2, c), _mm_madd_epi16(a3, c)), rnd), 15);
+            return _mm_packs_epi32(lo, hi);
+        };
+        _mm_storeu_si128((__m128i*)(y + i), _mm_sub_epi16(conv(cy), bias));
+        _mm_storeu_si128((__m128i*)(cb + i), conv(ccb));
+        _mm_storeu_si128((__m128i*)(cr + i), conv(ccr));
+    }
+    BgraToYccScalar(p + (size_t)i * 4, n - i, y + i, cb + i, cr + i);
+}
 
-    hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
-    if (FAILED(hr)) goto cleanup;
+static void Average2x2Sse2(const int16_t* r0, const int16_t* r1, int n, int16_t* out)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i s0 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r0 + 2 * i)), _mm_loadu_si128((const __m128i*)(r1 + 2 * i)));
+        const __m128i s1 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r0 + 2 * i + 8)), _mm_loadu_si128((const __m128i*)(r1 + 2 * i + 8)));
+        const __m128i m0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(s0, one), two), 2);
+        const __m128i m1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(s1, one), two), 2);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(m0, m1));
+    }
+    Average2x2Scalar(r0 + 2 * i, r1 + 2 * i, n - i, out + i);
+}
 
-    hr = device->Activate(__uuidof(IAudioClient), CLSCTX_INPROC_SERVER, nullptr, (void**)&audioClient);
-    if (FAILED(hr)) goto cleanup;
+// Interleaves 8 B, G, R (int16, clamped by the pack) into 8 BGRA pixels with alpha 255.
+static inline void StoreBgra8Sse2(__m128i b, __m128i g, __m128i r, uint8_t* out)
+{
+    const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8((char)0xFF));
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(bg, ra));
+}
 
-    hr = audioClient->GetMixFormat(&mix);
-    if (FAILED(hr) || !mix) goto cleanup;
+static void YccToBgraSse2(const uint8_t* y, const uint8_t* cbcr, int n, bool chromaHalfX, uint8_t* out)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i kr = _mm_setr_epi16(0, 22970, 0, 22970, 0, 22970, 0, 22970);
+    const __m128i kg = _mm_setr_epi16(-5638, -11700, -5638, -11700, -5638, -11700, -5638, -11700);
+    const __m128i kb = _mm_setr_epi16(29032, 0, 29032, 0, 29032, 0, 29032, 0);
+    const __m128i rnd = _mm_set1_epi32(8192);
+    auto off = [&](__m128i c, __m128i k) { return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c, k), rnd), 14); };
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i dr, dg, db;
+        if (chromaHalfX)
+        {
+            const __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cbcr + (size_t)i)), z), bias);
+            const __m128i r = off(c, kr), g = off(c, kg), b = off(c, kb);
+            dr = _mm_packs_epi32(_mm_unpacklo_epi32(r, r), _mm_unpackhi_epi32(r, r));
+            dg = _mm_packs_epi32(_mm_unpacklo_epi32(g, g), _mm_unpackhi_epi32(g, g));
+            db = _mm_packs_epi32(_mm_unpacklo_epi32(b, b), _mm_unpackhi_epi32(b, b));
+        }
+        else
+        {
+            const __m128i cc = _mm_loadu_si128((const __m128i*)(cbcr + (size_t)i * 2));
+            const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(cc, z), bias);
+            const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(cc, z), bias);
+            dr = _mm_packs_epi32(off(lo, kr), off(hi, kr));
+            dg = _mm_packs_epi32(off(lo, kg), off(hi, kg));
+            db = _mm_packs_epi32(off(lo, kb), off(hi, kb));
+        }
+        const __m128i yy = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + i)), z);
+        StoreBgra8Sse2(_mm_add_epi16(yy, db), _mm_add_epi16(yy, dg), _mm_add_epi16(yy, dr), out + (size_t)i * 4);
+    }
+    YccToBgraScalar(y + i, cbcr + (size_t)(chromaHalfX ? i : i * 2), n - i, chromaHalfX, out + (size_t)i * 4);
+}
 
-    // Shared-mode loopback must use the mix format.
-    REFERENCE_TIME hnsBuffer = 10000000; // 1 second
-    hr = audioClient->Initialize(
-        AUDCLNT_SHAREMODE_SHARED,
-        AUDCLNT_STREAMFLAGS_LOOPBACK,
-        hnsBuffer,
-        0,
-        mix,
-        nullptr);
-    if (FAILED(hr)) goto cleanup;
+static void HalveBgraSse2(const uint8_t* r0, const uint8_t* r1, int n, uint8_t* out)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const uint8_t* a = r0 + (size_t)i * 8;
+        const uint8_t* b = r1 + (size_t)i * 8;
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)a);
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(a + 16));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)b);
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(b + 16));
+        const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, z), _mm_unpacklo_epi8(b0, z));
+        const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, z), _mm_unpackhi_epi8(b0, z));
+        const __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, z), _mm_unpacklo_epi8(b1, z));
+        const __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, z), _mm_unpackhi_epi8(b1, z));
+        const __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+        const __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+        const __m128i o0 = _mm_srli_epi16(_mm_add_epi16(h0, two), 2);
+        const __m128i o1 = _mm_srli_epi16(_mm_add_epi16(h1, two), 2);
+        _mm_storeu_si128((__m128i*)(out + (size_t)i * 4), _mm_packus_epi16(o0, o1));
+    }
+    HalveBgraScalar(r0 + (size_t)i * 8, r1 + (size_t)i * 8, n - i, out + (size_t)i * 4);
+}
 
-    hr = audioClient->GetService(IID_PPV_ARGS(&capture));
-    if (FAILED(hr)) goto cleanup;
+static void LerpRowsSse2(const uint8_t* r0, const uint8_t* r1, int bytes, int fy, uint8_t* out)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i w0 = _mm_set1_epi16((short)(256 - fy));
+    const __m128i w1 = _mm_set1_epi16((short)fy);
+    const __m128i rnd = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(r0 + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(r1 + i));
+        const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, z), w0),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(b, z), w1)), rnd), 8);
+        const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, z), w0),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(b, z), w1)), rnd), 8);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+    LerpRowsScalar(r0 + i, r1 + i, bytes - i, fy, out + i);
+}
 
-    int channels = mix->nChannels ? (int)mix->nChannels : 2;
-    int sampleRate = mix->nSamplesPerSec ? (int)mix->nSamplesPerSec : 48000;
-    if (!SendWavHeaderPcm16(client, sampleRate, channels)) goto cleanup;
+// AVX2 variants: same math on 256-bit registers. Most ops work per 128-bit lane, so packs
+// are followed by a qword permute (0xD8) to restore pixel order.
+static inline __m256i PairSum4Avx2(__m256i t, __m256i u)
+{
+    const __m256 a = _mm256_shuffle_ps(_mm256_castsi256_ps(t), _mm256_castsi256_ps(u), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 b = _mm256_shuffle_ps(_mm256_castsi256_ps(t), _mm256_castsi256_ps(u), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm256_add_epi32(_mm256_castps_si256(a), _mm256_castps_si256(b));
+}
 
-    hr = audioClient->Start();
-    if (FAILED(hr)) goto cleanup;
+static void BgraToYccAvx2(const uint8_t* p, int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i cy = _mm256_setr_epi16(3736, 19235, 9798, 0, 3736, 19235, 9798, 0, 3736, 19235, 9798, 0, 3736, 19235, 9798, 0);
+    const __m256i ccb = _mm256_setr_epi16(16384, -10855, -5529, 0, 16384, -10855, -5529, 0, 16384, -10855, -5529, 0, 16384, -10855, -5529, 0);
+    const __m256i ccr = _mm256_setr_epi16(-2664, -13720, 16384, 0, -2664, -13720, 16384, 0, -2664, -13720, 16384, 0, -2664, -13720, 16384, 0);
+    const __m256i rnd = _mm256_set1_epi32(16384);
+    const __m256i bias = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256i v0 = _mm256_loadu_si256((const __m256i*)(p + (size_t)i * 4));
+        const __m256i v1 = _mm256_loadu_si256((const __m256i*)(p + (size_t)i * 4 + 32));
+        const __m256i a0 = _mm256_unpacklo_epi8(v0, z);
+        const __m256i a1 = _mm256_unpackhi_epi8(v0, z);
+        const __m256i a2 = _mm256_unpacklo_epi8(v1, z);
+        const __m256i a3 = _mm256_unpackhi_epi8(v1, z);
+        auto conv = [&](__m256i c) {
+            const __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(PairSum4Avx2(_mm256_madd_epi16(a0, c), _mm256_madd_epi16(a1, c)), rnd), 15);
+            const __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(PairSum4Avx2(_mm256_madd_epi16(a2, c), _mm256_madd_epi16(a3, c)), rnd), 15);
+            return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        };
+        _mm256_storeu_si256((__m256i*)(y + i), _mm256_sub_epi16(conv(cy), bias));
+        _mm256_storeu_si256((__m256i*)(cb + i), conv(ccb));
+        _mm256_storeu_si256((__m256i*)(cr + i), conv(ccr));
+    }
+    BgraToYccSse2(p + (size_t)i * 4, n - i, y + i, cb + i, cr + i);
+}
 
-    LogInfo("Audio streaming to %s (rate=%d, ch=%d)\n", clientIp.c_str(), sampleRate, channels);
+static void Average2x2Avx2(const int16_t* r0, const int16_t* r1, int n, int16_t* out)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256i s0 = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r0 + 2 * i)), _mm256_loadu_si256((const __m256i*)(r1 + 2 * i)));
+        const __m256i s1 = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r0 + 2 * i + 16)), _mm256_loadu_si256((const __m256i*)(r1 + 2 * i + 16)));
+        const __m256i m0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(s0, one), two), 2);
+        const __m256i m1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(s1, one), two), 2);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(m0, m1), 0xD8));
+    }
+    Average2x2Sse2(r0 + 2 * i, r1 + 2 * i, n - i, out + i);
+}
 
-    while (g_running.load())
-    {
-        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+static void YccToBgraAvx2(const uint8_t* y, const uint8_t* cbcr, int n, bool chromaHalfX, uint8_t* out)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i kr = _mm256_setr_epi16(0, 22970, 0, 22970, 0, 22970, 0, 22970, 0, 22970, 0, 22970, 0, 22970, 0, 22970);
+    const __m256i kg = _mm256_setr_epi16(-5638, -11700, -5638, -11700, -5638, -11700, -5638, -11700,
+        -5638, -11700, -5638, -11700, -5638, -11700, -5638, -11700);
+    const __m256i kb = _mm256_setr_epi16(29032, 0, 29032, 0, 29032, 0, 29032, 0, 29032, 0, 29032, 0, 29032, 0, 29032, 0);
+    const __m256i rnd = _mm256_set1_epi32(8192);
+    const __m256i alpha = _mm256_set1_epi8((char)0xFF);
+    auto off = [&](__m256i c, __m256i k) { return _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c, k), rnd), 14); };
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i dr, dg, db;
+        if (chromaHalfX)
         {
-            g_running.store(false);
-            break;
+            const __m256i c = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(cbcr + (size_t)i))), bias);
+            const __m256i r = off(c, kr), g = off(c, kg), b = off(c, kb);
+            dr = _mm256_packs_epi32(_mm256_unpacklo_epi32(r, r), _mm256_unpackhi_epi32(r, r));
+            dg = _mm256_packs_epi32(_mm256_unpacklo_epi32(g, g), _mm256_unpackhi_epi32(g, g));
+            db = _mm256_packs_epi32(_mm256_unpacklo_epi32(b, b), _mm256_unpackhi_epi32(b, b));
         }
-
-        UINT32 packetFrames = 0;
-        hr = capture->GetNextPacketSize(&packetFrames);
-        if (FAILED(hr)) break;
-        if (packetFrames == 0)
+        else
         {
-            Sleep(5);
-            continue;
+            const __m256i cc = _mm256_loadu_si256((const __m256i*)(cbcr + (size_t)i * 2));
+            const __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(cc, z), bias);
+            const __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(cc, z), bias);
+            dr = _mm256_packs_epi32(off(lo, kr), off(hi, kr));
+            dg = _mm256_packs_epi32(off(lo, kg), off(hi, kg));
+            db = _mm256_packs_epi32(off(lo, kb), off(hi, kb));
         }
+        const __m256i yy = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + i)));
+        const __m256i b8 = _mm256_packus_epi16(_mm256_add_epi16(yy, db), _mm256_add_epi16(yy, db));
+        const __m256i g8 = _mm256_packus_epi16(_mm256_add_epi16(yy, dg), _mm256_add_epi16(yy, dg));
+        const __m256i r8 = _mm256_packus_epi16(_mm256_add_epi16(yy, dr), _mm256_add_epi16(yy, dr));
+        const __m256i bg = _mm256_unpacklo_epi8(b8, g8);
+        const __m256i ra = _mm256_unpacklo_epi8(r8, alpha);
+        const __m256i lo = _mm256_unpacklo_epi16(bg, ra); // pixels 0-3 | 8-11
+        const __m256i hi = _mm256_unpackhi_epi16(bg, ra); // pixels 4-7 | 12-15
+        _mm256_storeu_si256((__m256i*)(out + (size_t)i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + (size_t)i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    YccToBgraSse2(y + i, cbcr + (size_t)(chromaHalfX ? i : i * 2), n - i, chromaHalfX, out + (size_t)i * 4);
+}
 
-        BYTE* data = nullptr;
-        UINT32 frames = 0;
-        DWORD flags = 0;
-        hr = capture->GetBuffer(&data, &frames, &flags, nullptr, nullptr);
-        if (FAILED(hr)) break;
-
-        size_t outSamples = (size_t)frames * (size_t)channels;
-        std::vector<int16_t> out;
-        out.resize(outSamples);
-
-        if (g_serverAudioMuted.load())
-        {
-            std::memset(out.data(), 0, out.size() * sizeof(int16_t));
-        }
-        else if (flags & AUDCLNT_BUFFERFLAGS_SILENT)
-        {
-            std::memset(out.data(), 0, out.size() * sizeof(int16_t));
-        }
-        else
-        {
-            bool isFloat = false;
-            bool isPcm16 = false;
-            if (mix->wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
-            {
-                isFloat = true;
-            }
-            else if (mix->wFormatTag == WAVE_FORMAT_PCM && mix->wBitsPerSample == 16)
-            {
-                isPcm16 = true;
-            }
-            else if (mix->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
-            {
-                auto* ext = (WAVEFORMATEXTENSIBLE*)mix;
-                if (ext->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT) isFloat = true;
-                if (ext->SubFormat == KSDATAFORMAT_SUBTYPE_PCM && mix->wBitsPerSample == 16) isPcm16 = true;
-            }
-
-            if (isPcm16)
-            {
-                std::memcpy(out.data(), data, out.size() * sizeof(int16_t));
-            }
-            else if (isFloat)
-            {
-                const float* f = (const float*)data;
-                for (size_t s = 0; s < outSamples; s++) out[s] = FloatToS16(f[s]);
-            }
-            else
-            {
-                // Fallback: silence (unknown mix format)
-                std::memset(out.data(), 0, out.size() * sizeof(int16_t));
-            }
-        }
+static void HalveBgraAvx2(const uint8_t* r0, const uint8_t* r1, int n, uint8_t* out)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const uint8_t* a = r0 + (size_t)i * 8;
+        const uint8_t* b = r1 + (size_t)i * 8;
+        const __m256i a0 = _mm256_loadu_si256((const __m256i*)a);
+        const __m256i a1 = _mm256_loadu_si256((const __m256i*)(a + 32));
+        const __m256i b0 = _mm256_loadu_si256((const __m256i*)b);
+        const __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+        const __m256i sLo0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, z), _mm256_unpacklo_epi8(b0, z));
+        const __m256i sHi0 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, z), _mm256_unpackhi_epi8(b0, z));
+        const __m256i sLo1 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, z), _mm256_unpacklo_epi8(b1, z));
+        const __m256i sHi1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, z), _mm256_unpackhi_epi8(b1, z));
+        const __m256i h0 = _mm256_add_epi16(_mm256_unpacklo_epi64(sLo0, sHi0), _mm256_unpackhi_epi64(sLo0, sHi0));
+        const __m256i h1 = _mm256_add_epi16(_mm256_unpacklo_epi64(sLo1, sHi1), _mm256_unpackhi_epi64(sLo1, sHi1));
+        const __m256i o0 = _mm256_srli_epi16(_mm256_add_epi16(h0, two), 2);
+        const __m256i o1 = _mm256_srli_epi16(_mm256_add_epi16(h1, two), 2);
+        _mm256_storeu_si256((__m256i*)(out + (size_t)i * 4), _mm256_permute4x64_epi64(_mm256_packus_epi16(o0, o1), 0xD8));
+    }
+    HalveBgraSse2(r0 + (size_t)i * 8, r1 + (size_t)i * 8, n - i, out + (size_t)i * 4);
+}
 
-        (void)capture->ReleaseBuffer(frames);
+static void LerpRowsAvx2(const uint8_t* r0, const uint8_t* r1, int bytes, int fy, uint8_t* out)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i w0 = _mm256_set1_epi16((short)(256 - fy));
+    const __m256i w1 = _mm256_set1_epi16((short)fy);
+    const __m256i rnd = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 32 <= bytes; i += 32)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(r0 + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(r1 + i));
+        const __m256i lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, z), w0),
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, z), w1)), rnd), 8);
+        const __m256i hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, z), w0),
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, z), w1)), rnd), 8);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(lo, hi));
+    }
+    LerpRowsSse2(r0 + i, r1 + i, bytes - i, fy, out + i);
+}
+#endif
 
-        if (!SendAll(client, out.data(), (int)(out.size() * sizeof(int16_t))))
-        {
-            break;
-        }
-    }
+static const PixelKernels kPixelKernelsScalar = { "scalar", BgraToYccScalar, Average2x2Scalar, YccToBgraScalar, HalveBgraScalar, LerpRowsScalar };
+#if LANSCR_X86_SIMD
+static const PixelKernels kPixelKernelsSse2 = { "sse2", BgraToYccSse2, Average2x2Sse2, YccToBgraSse2, HalveBgraSse2, LerpRowsSse2 };
+static const PixelKernels kPixelKernelsAvx2 = { "avx2", BgraToYccAvx2, Average2x2Avx2, YccToBgraAvx2, HalveBgraAvx2, LerpRowsAvx2 };
+#endif
 
-cleanup:
-    if (audioClient) (void)audioClient->Stop();
-    if (mix) CoTaskMemFree(mix);
-    if (capture) capture->Release();
-    if (audioClient) audioClient->Release();
-    if (device) device->Release();
-    if (enumerator) enumerator->Release();
-    if (SUCCEEDED(hrCo)) CoUninitialize();
-    closesocket(client);
+// Every variant this CPU can run, scalar first.
+static std::vector<const PixelKernels*> AvailablePixelKernels()
+{
+    std::vector<const PixelKernels*> out{ &kPixelKernelsScalar };
+#if LANSCR_X86_SIMD
+    out.push_back(&kPixelKernelsSse2);
+    if (g_cpuHasAvx2) out.push_back(&kPixelKernelsAvx2);
+#endif
+    return out;
 }
 
-static void StreamMjpegThread(SOCKET client, const std::string& clientIp, int fps, int jpegQuality0to100, HANDLE stopEvent)
+static const PixelKernels& Kernels()
 {
-    const std::string headers =
-        "HTTP/1.1 200 OK\r\n"
-        "Connection: close\r\n"
-        "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
-        "Pragma: no-cache\r\n"
-        "Expires: 0\r\n"
-        "X-Accel-Buffering: no\r\n"
-        "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
-        "\r\n";
+    static const PixelKernels* best = AvailablePixelKernels().back();
+    return *best;
+}
 
-    // Non-blocking stream socket + bounded send: prevents multi-second buffering on slow clients.
-    u_long nb = 1;
-    (void)ioctlsocket(client, FIONBIO, &nb);
-    int snd = 64 * 1024;
-    (void)setsockopt(client, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+// Scratch buffers for DownscaleBgra, kept by the caller between frames.
+struct DownscaleScratch
+{
+    std::vector<uint8_t> a;
+    std::vector<uint8_t> b;
+    std::vector<uint8_t> row;
+    std::vector<int> xIndex;
+    std::vector<int> xFrac;
+};
 
-    if (!SendAllWithTimeout(client, headers.data(), (int)headers.size(), 1000, stopEvent))
+// Bilinear sample positions (pixel centres aligned) in 8-bit fractions.
+static void BilinearTaps(int srcLen, int dstLen, int i, int& i0, int& frac)
+{
+    const int64_t pos = ((int64_t)(2 * i + 1) * srcLen * 65536) / (2 * (int64_t)dstLen) - 32768;
+    if (pos <= 0)
     {
-        closesocket(client);
+        i0 = 0;
+        frac = 0;
         return;
     }
-
-    g_clientCount.fetch_add(1);
-    LogInfo("Streaming to %s (clients=%d)\n", clientIp.c_str(), g_clientCount.load());
-
-    (void)fps;
-    (void)jpegQuality0to100;
-
-    uint64_t lastSeq = 0;
-
-    while (g_running.load())
+    i0 = (int)(pos >> 16);
+    frac = (int)((pos & 0xFFFF) >> 8);
+    if (i0 >= srcLen - 1)
     {
-        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
-        {
-            g_running.store(false);
-            break;
-        }
-
-        std::vector<uint8_t> bytes;
-        {
-            std::unique_lock<std::mutex> lock(g_sharedFrame.mtx);
-            g_sharedFrame.cv.wait_for(lock, std::chrono::milliseconds(1000), [&]() {
-                return !g_running.load() || g_sharedFrame.seq != lastSeq;
-            });
-            if (!g_running.load()) break;
-            if (g_sharedFrame.seq == lastSeq || g_sharedFrame.bytes.empty())
-            {
-                continue;
-            }
-            lastSeq = g_sharedFrame.seq;
-            bytes = g_sharedFrame.bytes;
-        }
-
-        char meta[256];
-        std::snprintf(meta, sizeof(meta),
-            "--frame\r\n"
-            "Content-Type: image/jpeg\r\n"
-            "Content-Length: %zu\r\n"
-            "\r\n",
-            bytes.size());
-
-        // If a client can't keep up, drop it rather than accumulating seconds of latency.
-        if (!SendAllWithTimeout(client, meta, (int)std::strlen(meta), 500, stopEvent)) break;
-        if (!SendAllWithTimeout(client, bytes.data(), (int)bytes.size(), 500, stopEvent)) break;
-        if (!SendAllWithTimeout(client, "\r\n", 2, 500, stopEvent)) break;
+        i0 = srcLen - 1;
+        frac = 0;
     }
-    closesocket(client);
-
-    int left = g_clientCount.fetch_sub(1) - 1;
-    LogInfo("Client disconnected: %s (clients=%d)\n", clientIp.c_str(), left);
 }
 
-static void HandleHttpClientThread(SOCKET client, const std::string& clientIp, uint16_t serverPort, int fps, int jpegQuality0to100, HANDLE stopEvent)
+// Resizes BGRA src (sw x sh) into dst (dw x dh). With box, the image is first halved with a
+// 2x2 box filter while it is at least twice the target size (no aliasing on large
+// reductions), then the rest is bilinear; without it, it is bilinear in one pass.
+static void DownscaleBgra(const uint8_t* src, int sw, int sh, int srcStride, uint8_t* dst, int dw, int dh, int dstStride,
+    bool box, DownscaleScratch& scratch, const PixelKernels& k = Kernels())
 {
-    // Read request headers (best-effort)
-    std::string req;
-    for (int i = 0; i < 32; i++)
-    {
-        u_long avail = 0;
-        ioctlsocket(client, FIONREAD, &avail);
-        if (avail > 0)
+    if (sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) return;
+
+    const uint8_t* cur = src;
+    int cw = sw;
+    int ch = sh;
+    int cstride = srcStride;
+    while (box && cw >= 2 * dw && ch >= 2 * dh)
+    {
+        const int nw = cw / 2;
+        const int nh = ch / 2;
+        std::vector<uint8_t>& next = (cur == scratch.a.data()) ? scratch.b : scratch.a;
+        next.resize((size_t)nw * nh * 4);
+        for (int y = 0; y < nh; y++)
         {
-            if (!RecvSome(client, req)) break;
-            if (req.find("\r\n\r\n") != std::string::npos) break;
+            const uint8_t* r0 = cur + (size_t)(2 * y) * cstride;
+            k.halveBgra(r0, r0 + cstride, nw, next.data() + (size_t)y * nw * 4);
         }
-        Sleep(5);
+        cur = next.data();
+        cw = nw;
+        ch = nh;
+        cstride = nw * 4;
     }
 
-    std::string path;
-    std::string query;
-    (void)ParseHttpTarget(req, path, query);
-
-    if (g_httpAuthEnabled && !IsHttpAuthorized(req))
+    if (cw == dw && ch == dh)
     {
-        (void)SendHttpUnauthorized(client);
-        closesocket(client);
+        for (int y = 0; y < dh; y++) std::memcpy(dst + (size_t)y * dstStride, cur + (size_t)y * cstride, (size_t)dw * 4);
         return;
     }
 
-    if (g_verbose)
-    {
-        size_t eol = req.find("\r\n");
-        std::string first = (eol == std::string::npos) ? req : req.substr(0, eol);
-        LogInfo("HTTP %s from %s\n", first.c_str(), clientIp.c_str());
-    }
+    scratch.xIndex.resize(dw);
+    scratch.xFrac.resize(dw);
+    for (int x = 0; x < dw; x++) BilinearTaps(cw, dw, x, scratch.xIndex[x], scratch.xFrac[x]);
+    scratch.row.resize((size_t)cw * 4);
 
-    if (path == "/control")
+    for (int y = 0; y < dh; y++)
     {
-        int mute = -1;
-        if (QueryGetInt(query, "mute", mute))
+        int y0 = 0, fy = 0;
+        BilinearTaps(ch, dh, y, y0, fy);
+        const int y1 = std::min(y0 + 1, ch - 1);
+        k.lerpRows(cur + (size_t)y0 * cstride, cur + (size_t)y1 * cstride, cw * 4, fy, scratch.row.data());
+
+        const uint8_t* row = scratch.row.data();
+        uint8_t* out = dst + (size_t)y * dstStride;
+        for (int x = 0; x < dw; x++, out += 4)
         {
-            g_serverAudioMuted.store(mute != 0);
+            const int x0 = scratch.xIndex[x];
+            const int fx = scratch.xFrac[x];
+            const uint8_t* p0 = row + (size_t)x0 * 4;
+            const uint8_t* p1 = row + (size_t)std::min(x0 + 1, cw - 1) * 4;
+            for (int c = 0; c < 4; c++) out[c] = (uint8_t)((p0[c] * (256 - fx) + p1[c] * fx + 128) >> 8);
         }
-
-        // Always return status (also works as a read endpoint).
-        std::string body = std::string("{\"audioMuted\":") + (g_serverAudioMuted.load() ? "true" : "false") +
-            std::string(",\"privateMode\":") + (g_httpAuthEnabled ? "true" : "false") +
-            std::string(",\"port\":") + std::to_string((unsigned)serverPort) +
-            "}";
-        (void)SendHttpText(client, "application/json; charset=utf-8", body);
-        closesocket(client);
-        return;
     }
+}
 
-    if (path == "/" || path == "/index.html")
-    {
-        std::string html = MakeLandingHtml(serverPort);
-        (void)SendHttpText(client, "text/html; charset=utf-8", html);
-        closesocket(client);
-        return;
-    }
+// ----------------------------
+// Dirty-tile stream protocol (/tiles)
+// ----------------------------
 
-    if (path == "/audio")
-    {
-        StreamAudioThread(client, clientIp, stopEvent);
-        return;
-    }
+// A /tiles response body is a sequence of messages (all integers little-endian):
+//   header (20 bytes): magic 'LST1' u32 | payloadLen u32 | seq u32 | width u16 | height u16 | tileCount u16 | flags u16
+//   tileCount x { x u16 | y u16 | w u16 | h u16 | jpegLen u32 | jpeg bytes }
+// A message with kTileMsgFull covers the whole frame and is a sync point; every other
+// message only patches the frame produced by the message before it (seq + 1).
+static constexpr uint32_t kTileMsgMagic = 0x3154534Cu; // 'LST1'
+static constexpr size_t kTileMsgHeaderSize = 20;
+static constexpr size_t kTileEntryHeaderSize = 12;
+static constexpr uint16_t kTileMsgFull = 1;
+static constexpr uint32_t kTileMsgMaxPayload = 64u * 1024u * 1024u;
+
+struct TileRect
+{
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+};
+
+struct TileEntryView
+{
+    TileRect rect;
+    const uint8_t* jpeg = nullptr;
+    size_t jpegLen = 0;
+};
+
+struct TileMessageView
+{
+    uint32_t seq = 0;
+    int width = 0;
+    int height = 0;
+    bool full = false;
+    std::vector<TileEntryView> tiles;
+};
 
-    // Default: MJPEG stream (also supports explicit /mjpeg)
-    StreamMjpegThread(client, clientIp, fps, jpegQuality0to100, stopEvent);
+static inline void PutLe16(std::vector<uint8_t>& b, uint16_t v)
+{
+    b.push_back((uint8_t)(v & 0xFF));
+    b.push_back((uint8_t)(v >> 8));
 }
 
-static int RunServer(uint16_t port, int fps, int jpegQuality0to100)
+static inline void PutLe32(std::vector<uint8_t>& b, uint32_t v)
 {
-    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+    for (int i = 0; i < 4; i++) b.push_back((uint8_t)((v >> (8 * i)) & 0xFF));
+}
 
-    // Improve Sleep() timing precision for lower jitter.
-    timeBeginPeriod(1);
+static inline void SetLe16At(std::vector<uint8_t>& b, size_t off, uint16_t v)
+{
+    b[off] = (uint8_t)(v & 0xFF);
+    b[off + 1] = (uint8_t)(v >> 8);
+}
 
-    // Reset run flag in case this process previously ran client/server.
-    g_running.store(true);
+static inline void SetLe32At(std::vector<uint8_t>& b, size_t off, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) b[off + i] = (uint8_t)((v >> (8 * i)) & 0xFF);
+}
 
-    HANDLE stopEvent = CreateStopEventForPort(port);
-    if (!stopEvent)
-    {
-        LogError("CreateEvent failed (stop event)\n");
-        return 1;
-    }
-    if (GetLastError() == ERROR_ALREADY_EXISTS)
-    {
-        LogError("A server is already running for port %u.\n", (unsigned)port);
-        CloseHandle(stopEvent);
-        return 1;
-    }
+static inline uint16_t GetLe16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
 
-    g_serverPort.store(port);
+static inline uint32_t GetLe32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+// Dirty tiles between two hash grids, merged into horizontal runs per tile row so a
+// changed line of text is one JPEG rather than a dozen. Geometry change => everything.
+static void CollectDirtyTileRects(const TileHashGrid& prev, const TileHashGrid& cur, std::vector<TileRect>& out)
+{
+    out.clear();
+    const bool sameGeom = prev.width == cur.width && prev.height == cur.height && prev.hashes.size() == cur.hashes.size();
+    for (int ty = 0; ty < cur.rows; ty++)
     {
-        LogError("WSAStartup failed\n");
-        CloseHandle(stopEvent);
-        return 1;
+        int runStart = -1;
+        for (int tx = 0; tx <= cur.cols; tx++)
+        {
+            bool dirty = false;
+            if (tx < cur.cols)
+            {
+                const size_t i = (size_t)ty * cur.cols + tx;
+                dirty = !sameGeom || prev.hashes[i] != cur.hashes[i];
+            }
+            if (dirty && runStart < 0) runStart = tx;
+            if (!dirty && runStart >= 0)
+            {
+                TileRect r;
+                r.x = runStart * kTileSize;
+                r.y = ty * kTileSize;
+                r.w = std::min(tx * kTileSize, cur.width) - r.x;
+                r.h = std::min(kTileSize, cur.height - r.y);
+                out.push_back(r);
+                runStart = -1;
+            }
+        }
     }
+}
 
-    SOCKET listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (listenSock == INVALID_SOCKET)
+static void BeginTileMessage(std::vector<uint8_t>& msg, uint32_t seq, int width, int height, bool full)
+{
+    msg.clear();
+    PutLe32(msg, kTileMsgMagic);
+    PutLe32(msg, 0); // payloadLen, patched by AppendTileToMessage
+    PutLe32(msg, seq);
+    PutLe16(msg, (uint16_t)width);
+    PutLe16(msg, (uint16_t)height);
+    PutLe16(msg, 0); // tileCount
+    PutLe16(msg, full ? kTileMsgFull : 0);
+}
+
+static void AppendTileToMessage(std::vector<uint8_t>& msg, const TileRect& r, const uint8_t* jpeg, size_t jpegLen)
+{
+    PutLe16(msg, (uint16_t)r.x);
+    PutLe16(msg, (uint16_t)r.y);
+    PutLe16(msg, (uint16_t)r.w);
+    PutLe16(msg, (uint16_t)r.h);
+    PutLe32(msg, (uint32_t)jpegLen);
+    msg.insert(msg.end(), jpeg, jpeg + jpegLen);
+    SetLe32At(msg, 4, (uint32_t)(msg.size() - kTileMsgHeaderSize));
+    SetLe16At(msg, 16, (uint16_t)(GetLe16(msg.data() + 16) + 1));
+}
+
+// Parses the first message in buf.
+// Returns its total size, 0 if more bytes are needed, or -1 if the stream is corrupt.
+static long long ParseTileMessage(const uint8_t* buf, size_t len, TileMessageView& out)
+{
+    if (len < kTileMsgHeaderSize) return 0;
+    if (GetLe32(buf) != kTileMsgMagic) return -1;
+    const uint32_t payloadLen = GetLe32(buf + 4);
+    if (payloadLen > kTileMsgMaxPayload) return -1;
+    const size_t total = kTileMsgHeaderSize + (size_t)payloadLen;
+    if (len < total) return 0;
+
+    out.seq = GetLe32(buf + 8);
+    out.width = GetLe16(buf + 12);
+    out.height = GetLe16(buf + 14);
+    const uint16_t count = GetLe16(buf + 16);
+    out.full = (GetLe16(buf + 18) & kTileMsgFull) != 0;
+    out.tiles.clear();
+
+    size_t off = kTileMsgHeaderSize;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (total - off < kTileEntryHeaderSize) return -1;
+        TileEntryView t;
+        t.rect.x = GetLe16(buf + off);
+        t.rect.y = GetLe16(buf + off + 2);
+        t.rect.w = GetLe16(buf + off + 4);
+        t.rect.h = GetLe16(buf + off + 6);
+        t.jpegLen = GetLe32(buf + off + 8);
+        off += kTileEntryHeaderSize;
+        if (t.jpegLen > total - off) return -1;
+        if (t.rect.w <= 0 || t.rect.h <= 0 || t.rect.x + t.rect.w > out.width || t.rect.y + t.rect.h > out.height) return -1;
+        t.jpeg = buf + off;
+        off += t.jpegLen;
+        out.tiles.push_back(t);
+    }
+    if (off != total) return -1;
+    return (long long)total;
+}
+
+// Copies a decoded tile (tightly packed BGRA) into a frame buffer at the tile's position.
+static bool PatchTileBgra(std::vector<uint8_t>& frame, int frameW, int frameH, const TileRect& r, const uint8_t* tile, int tileW, int tileH)
+{
+    if (tileW != r.w || tileH != r.h) return false;
+    if (r.x < 0 || r.y < 0 || r.x + r.w > frameW || r.y + r.h > frameH) return false;
+    if (frame.size() < (size_t)frameW * (size_t)frameH * 4) return false;
+    for (int y = 0; y < r.h; y++)
     {
-        LogError("socket() failed\n");
-        WSACleanup();
-        CloseHandle(stopEvent);
-        return 1;
+        std::memcpy(frame.data() + ((size_t)(r.y + y) * frameW + r.x) * 4, tile + (size_t)y * r.w * 4, (size_t)r.w * 4);
     }
+    return true;
+}
 
-    int yes = 1;
-    setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+// ----------------------------
+// JPEG encode (WIC)
+// ----------------------------
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
+struct JpegFrame
+{
+    std::vector<uint8_t> bytes;
+    int width = 0;
+    int height = 0;
+};
 
-    if (bind(listenSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+// Minimal IWICBitmapSource over a CaptureSurface so the encoder reads the capture
+// surface in place (no CreateBitmapFromHBITMAP copy per frame).
+// Stack-owned: lives for the duration of one encode call, so ref-counting is a no-op.
+struct SurfaceBitmapSource : IWICBitmapSource
+{
+    const CaptureSurface* surf = nullptr;
+
+    explicit SurfaceBitmapSource(const CaptureSurface* s) : surf(s) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override
     {
-        LogError("bind() failed (port %u). Maybe already in use?\n", (unsigned)port);
-        closesocket(listenSock);
-        WSACleanup();
-        CloseHandle(stopEvent);
-        return 1;
+        if (!ppv) return E_POINTER;
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IWICBitmapSource))
+        {
+            *ppv = static_cast<IWICBitmapSource*>(this);
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
     }
+    ULONG STDMETHODCALLTYPE AddRef() override { return 2; }
+    ULONG STDMETHODCALLTYPE Release() override { return 1; }
 
-    if (listen(listenSock, SOMAXCONN) == SOCKET_ERROR)
+    HRESULT STDMETHODCALLTYPE GetSize(UINT* pw, UINT* ph) override
     {
-        LogError("listen() failed\n");
-        closesocket(listenSock);
-        WSACleanup();
-        CloseHandle(stopEvent);
-        return 1;
+        if (!pw || !ph) return E_POINTER;
+        *pw = (UINT)surf->width;
+        *ph = (UINT)surf->height;
+        return S_OK;
     }
-
-    LogInfo("LAN MJPEG server running on http://0.0.0.0:%u/\n", (unsigned)port);
-    LogInfo("Press Ctrl+C to stop.\n");
-
-    // Start one capture thread for all clients (much smoother for LAN / multiple clients).
-    if (!g_captureThreadRunning.exchange(true))
+    HRESULT STDMETHODCALLTYPE GetPixelFormat(WICPixelFormatGUID* fmt) override
     {
-        std::thread cap([fps, jpegQuality0to100, stopEvent]() {
-            CaptureLoopThread(fps, jpegQuality0to100, stopEvent);
-        });
-        cap.detach();
+        if (!fmt) return E_POINTER;
+        *fmt = GUID_WICPixelFormat32bppBGR; // alpha from GDI is undefined; ignore it
+        return S_OK;
     }
-
-    while (g_running.load())
+    HRESULT STDMETHODCALLTYPE GetResolution(double* dx, double* dy) override
+    {
+        if (!dx || !dy) return E_POINTER;
+        *dx = 96.0;
+        *dy = 96.0;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE CopyPalette(IWICPalette*) override
+    {
+        return WINCODEC_ERR_PALETTEUNAVAILABLE;
+    }
+    HRESULT STDMETHODCALLTYPE CopyPixels(const WICRect* prc, UINT stride, UINT bufSize, BYTE* buf) override
     {
-        if (WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        if (!buf) return E_POINTER;
+        WICRect rc{ 0, 0, surf->width, surf->height };
+        if (prc) rc = *prc;
+        if (rc.X < 0 || rc.Y < 0 || rc.Width < 0 || rc.Height < 0 ||
+            rc.X + rc.Width > surf->width || rc.Y + rc.Height > surf->height)
         {
-            g_running.store(false);
-            break;
+            return E_INVALIDARG;
         }
+        if (rc.Width == 0 || rc.Height == 0) return S_OK;
+        const UINT rowBytes = (UINT)rc.Width * 4;
+        if (stride < rowBytes) return E_INVALIDARG;
+        if ((uint64_t)stride * (uint64_t)(rc.Height - 1) + rowBytes > bufSize) return E_INVALIDARG;
 
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(listenSock, &fds);
-
-        timeval tv{};
-        tv.tv_sec = 0;
-        tv.tv_usec = 250 * 1000;
-
-        int r = select(0, &fds, nullptr, nullptr, &tv);
-        if (r <= 0) continue;
+        for (int r = 0; r < rc.Height; r++)
+        {
+            const uint8_t* src = surf->pixels + (size_t)(rc.Y + r) * (size_t)surf->stride + (size_t)rc.X * 4;
+            std::memcpy(buf + (size_t)r * stride, src, rowBytes);
+        }
+        return S_OK;
+    }
+};
 
-        sockaddr_in clientAddr{};
-        int clientLen = sizeof(clientAddr);
-        SOCKET client = accept(listenSock, (sockaddr*)&clientAddr, &clientLen);
-        if (client == INVALID_SOCKET) continue;
+// Encodes through a caller-owned stream that is rewound and reused across frames, so its
+// HGLOBAL grows to the largest frame once instead of being reallocated per frame. WIC's JPEG
+// encoder writes sequentially, so the stream position after Commit is the JPEG size.
+static HRESULT EncodeSurfaceToJpeg(IWICImagingFactory* factory, IStream* stream, const CaptureSurface& surf, int jpegQuality0to100,
+    bool subsample420, JpegFrame& out)
+{
+    out.bytes.clear();
+    if (!surf.pixels || surf.width <= 0 || surf.height <= 0) return E_INVALIDARG;
 
-        // Lower latency for streaming.
-        int one = 1;
-        (void)setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    SurfaceBitmapSource source(&surf);
 
-        char ip[64] = {};
-        inet_ntop(AF_INET, &clientAddr.sin_addr, ip, sizeof(ip));
-        LogInfo("Client connected: %s\n", ip);
+    LARGE_INTEGER zero{};
+    HRESULT hr = stream->Seek(zero, STREAM_SEEK_SET, nullptr);
+    if (FAILED(hr)) return hr;
 
-        std::string ipStr(ip);
+    IWICBitmapEncoder* encoder = nullptr;
+    hr = factory->CreateEncoder(GUID_ContainerFormatJpeg, nullptr, &encoder);
+    if (FAILED(hr)) return hr;
 
-        // Duplicate stop event for the detached thread so we can safely close the originals later.
-        HANDLE stopEventThread = nullptr;
-        (void)DuplicateHandle(GetCurrentProcess(), stopEvent, GetCurrentProcess(), &stopEventThread, SYNCHRONIZE, FALSE, 0);
+    hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+    if (FAILED(hr))
+    {
+        encoder->Release();
+        return hr;
+    }
 
-        std::thread t([client, ipStr, port, fps, jpegQuality0to100, stopEventThread]() {
-            HandleHttpClientThread(client, ipStr, (uint16_t)port, fps, jpegQuality0to100, stopEventThread);
-            if (stopEventThread) CloseHandle(stopEventThread);
-        });
-        t.detach();
+    IWICBitmapFrameEncode* frame = nullptr;
+    IPropertyBag2* props = nullptr;
+    hr = encoder->CreateNewFrame(&frame, &props);
+    if (FAILED(hr))
+    {
+        encoder->Release();
+        return hr;
     }
 
-    closesocket(listenSock);
-    WSACleanup();
-    CloseHandle(stopEvent);
-    timeEndPeriod(1);
-    return 0;
-}
-
-// ----------------------------
-// MJPEG client viewer (WinHTTP + WIC + Win32 window)
-// ----------------------------
-
-struct FrameBuffer
-{
-    std::mutex mtx;
-    int width = 0;
-    int height = 0;
-    std::vector<uint8_t> bgra;
-    bool hasFrame = false;
-};
-
-static FrameBuffer g_frame;
-static HWND g_hwnd = nullptr;
-static constexpr UINT WM_NEW_FRAME = WM_APP + 1;
-
-static std::string ToLowerAscii(std::string s)
-{
-    for (char& c : s) c = (char)std::tolower((unsigned char)c);
-    return s;
-}
-
-static bool FindBytes(const std::vector<uint8_t>& buf, const char* needle, size_t needleLen, size_t start, size_t& posOut)
-{
-    if (needleLen == 0 || buf.size() < needleLen) return false;
-    for (size_t i = start; i + needleLen <= buf.size(); i++)
+    // Set JPEG encoder options.
+    // - ImageQuality: float [0..1]
+    // - JpegYCrCbSubsampling: BYTE enum (4:4:4 unless asked otherwise, to avoid chroma blur)
+    if (props)
     {
-        if (std::memcmp(buf.data() + i, needle, needleLen) == 0)
-        {
-            posOut = i;
-            return true;
-        }
-    }
-    return false;
-}
-
-static HRESULT DecodeJpegToBGRA(IWICImagingFactory* factory, const uint8_t* jpg, size_t jpgLen, int& outW, int& outH, std::vector<uint8_t>& outBGRA)
-{
-    outBGRA.clear();
+        PROPBAG2 options[2] = {};
+        options[0].pstrName = const_cast<LPOLESTR>(L"ImageQuality");
+        options[1].pstrName = const_cast<LPOLESTR>(L"JpegYCrCbSubsampling");
 
-    HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, jpgLen);
-    if (!hg) return E_OUTOFMEMORY;
+        VARIANT vars[2];
+        VariantInit(&vars[0]);
+        VariantInit(&vars[1]);
 
-    void* p = GlobalLock(hg);
-    if (!p)
-    {
-        GlobalFree(hg);
-        return E_FAIL;
-    }
+        vars[0].vt = VT_R4;
+        float q = (jpegQuality0to100 <= 1) ? 0.01f : (jpegQuality0to100 >= 100 ? 1.0f : (jpegQuality0to100 / 100.0f));
+        vars[0].fltVal = q;
 
-    std::memcpy(p, jpg, jpgLen);
-    GlobalUnlock(hg);
+        vars[1].vt = VT_UI1;
+        vars[1].bVal = (BYTE)(subsample420 ? WICJpegYCrCbSubsampling420 : WICJpegYCrCbSubsampling444);
 
-    IStream* stream = nullptr;
-    HRESULT hr = CreateStreamOnHGlobal(hg, TRUE, &stream); // stream frees hg
-    if (FAILED(hr))
-    {
-        GlobalFree(hg);
-        return hr;
+        (void)props->Write(2, options, vars);
+        VariantClear(&vars[0]);
+        VariantClear(&vars[1]);
     }
 
-    IWICBitmapDecoder* decoder = nullptr;
-    hr = factory->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnLoad, &decoder);
-    stream->Release();
-    if (FAILED(hr)) return hr;
-
-    IWICBitmapFrameDecode* frame = nullptr;
-    hr = decoder->GetFrame(0, &frame);
-    decoder->Release();
-    if (FAILED(hr)) return hr;
-
-    UINT w = 0, h = 0;
-    hr = frame->GetSize(&w, &h);
+    hr = frame->Initialize(props);
+    if (props) props->Release();
     if (FAILED(hr))
     {
         frame->Release();
+        encoder->Release();
         return hr;
     }
 
-    IWICFormatConverter* conv = nullptr;
-    hr = factory->CreateFormatConverter(&conv);
+    hr = frame->WriteSource(&source, nullptr);
     if (FAILED(hr))
     {
         frame->Release();
+        encoder->Release();
         return hr;
     }
 
-    hr = conv->Initialize(frame, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+    hr = frame->Commit();
     frame->Release();
     if (FAILED(hr))
     {
-        conv->Release();
+        encoder->Release();
         return hr;
     }
 
-    const UINT stride = w * 4;
-    outBGRA.resize((size_t)stride * (size_t)h);
-    hr = conv->CopyPixels(nullptr, stride, (UINT)outBGRA.size(), outBGRA.data());
-    conv->Release();
-    if (FAILED(hr))
+    hr = encoder->Commit();
+    encoder->Release();
+    if (FAILED(hr)) return hr;
+
+    ULARGE_INTEGER end{};
+    hr = stream->Seek(zero, STREAM_SEEK_CUR, &end);
+    if (FAILED(hr)) return hr;
+
+    HGLOBAL hg = nullptr;
+    hr = GetHGlobalFromStream(stream, &hg);
+    if (FAILED(hr)) return hr;
+
+    const SIZE_T size = (SIZE_T)end.QuadPart;
+    void* ptr = GlobalLock(hg);
+    if (!ptr || size == 0 || size > GlobalSize(hg))
     {
-        outBGRA.clear();
-        return hr;
+        if (ptr) GlobalUnlock(hg);
+        return E_FAIL;
     }
 
-    outW = (int)w;
-    outH = (int)h;
+    out.bytes.assign((const uint8_t*)ptr, (const uint8_t*)ptr + size);
+    GlobalUnlock(hg);
+
+    out.width = surf.width;
+    out.height = surf.height;
     return S_OK;
 }
 
-static bool MakeAudioUrlFromVideoUrl(const std::wstring& url, std::wstring& outAudioUrl)
+// ----------------------------
+// Worker pool
+// ----------------------------
+
+// Fixed set of threads running parallel-for jobs. Run() blocks until every index is done and
+// the calling thread works too, so Size() counts it. One job at a time (single owner).
+struct WorkerPool
 {
-    URL_COMPONENTS uc{};
-    uc.dwStructSize = sizeof(uc);
+    std::mutex mtx;
+    std::condition_variable startCv;
+    std::condition_variable doneCv;
+    std::vector<std::thread> threads;
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextIndex{ 0 };
+    int busy = 0;
+    uint64_t generation = 0;
+    bool quit = false;
 
-    std::wstring scheme(16, L'\0');
-    std::wstring host(256, L'\0');
-    std::wstring path(1024, L'\0');
-    uc.lpszScheme = scheme.data();
-    uc.dwSchemeLength = (DWORD)scheme.size();
-    uc.lpszHostName = host.data();
-    uc.dwHostNameLength = (DWORD)host.size();
-    uc.lpszUrlPath = path.data();
-    uc.dwUrlPathLength = (DWORD)path.size();
+    explicit WorkerPool(int parallelism)
+    {
+        for (int i = 1; i < parallelism; i++) threads.emplace_back([this]() { WorkerMain(); });
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        startCv.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
 
-    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) return false;
+    int Size() const { return (int)threads.size() + 1; }
 
-    scheme.resize(uc.dwSchemeLength);
-    host.resize(uc.dwHostNameLength);
+    void Run(int count, const std::function<void(int)>& fn)
+    {
+        if (count <= 0) return;
+        if (threads.empty() || count == 1)
+        {
+            for (int i = 0; i < count; i++) fn(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            job = &fn;
+            jobCount = count;
+            nextIndex.store(0);
+            busy = (int)threads.size();
+            generation++;
+        }
+        startCv.notify_all();
+        for (int i = nextIndex.fetch_add(1); i < count; i = nextIndex.fetch_add(1)) fn(i);
+        std::unique_lock<std::mutex> lock(mtx);
+        doneCv.wait(lock, [this]() { return busy == 0; });
+        job = nullptr;
+    }
 
-    wchar_t buf[2048];
-    swprintf_s(buf, L"%s://%s:%u/audio", scheme.c_str(), host.c_str(), (unsigned)uc.nPort);
-    outAudioUrl = buf;
-    return true;
-}
+    void WorkerMain()
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            const std::function<void(int)>* fn = nullptr;
+            int count = 0;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                startCv.wait(lock, [&]() { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+                fn = job;
+                count = jobCount;
+            }
+            for (int i = nextIndex.fetch_add(1); i < count; i = nextIndex.fetch_add(1)) (*fn)(i);
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--busy == 0) doneCv.notify_all();
+        }
+    }
+};
 
-static bool MakeControlUrlFromVideoUrl(const std::wstring& url, std::wstring& outControlUrl)
-{
-    URL_COMPONENTS uc{};
-    uc.dwStructSize = sizeof(uc);
+// ----------------------------
+// Strip JPEG encoder (built-in, parallel)
+// ----------------------------
 
-    std::wstring scheme(16, L'\0');
-    std::wstring host(256, L'\0');
-    std::wstring path(1024, L'\0');
-    uc.lpszScheme = scheme.data();
-    uc.dwSchemeLength = (DWORD)scheme.size();
-    uc.lpszHostName = host.data();
-    uc.dwHostNameLength = (DWORD)host.size();
-    uc.lpszUrlPath = path.data();
-    uc.dwUrlPathLength = (DWORD)path.size();
+// Baseline JPEG (standard Annex K tables, IJG quality scaling) with a restart interval of one
+// MCU row. Every MCU row is then an independent entropy segment (DC prediction and bit
+// buffer reset at each RSTn), so strips of rows are encoded on separate cores and simply
+// concatenated; the marker after row r is RST(r % 8). The output is a plain baseline JPEG
+// that browsers and WIC decode, and it is byte-identical for any number of threads.
+
+static const uint8_t kJpegZigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
 
-    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) return false;
+static const uint8_t kJpegStdLumaQuant[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
 
-    scheme.resize(uc.dwSchemeLength);
-    host.resize(uc.dwHostNameLength);
+static const uint8_t kJpegStdChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
 
-    wchar_t buf[2048];
-    swprintf_s(buf, L"%s://%s:%u/control", scheme.c_str(), host.c_str(), (unsigned)uc.nPort);
-    outControlUrl = buf;
-    return true;
+static const uint8_t kJpegDcLumaBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t kJpegDcChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t kJpegDcVals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t kJpegAcLumaBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t kJpegAcLumaVals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t kJpegAcChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t kJpegAcChromaVals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Canonical Huffman codes by symbol.
+struct JpegHuffCodes
+{
+    uint16_t code[256] = {};
+    uint8_t size[256] = {};
+};
+
+static JpegHuffCodes BuildJpegHuffCodes(const uint8_t bits[16], const uint8_t* vals)
+{
+    JpegHuffCodes t;
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++)
+    {
+        for (int i = 0; i < bits[len - 1]; i++)
+        {
+            t.code[vals[k]] = code++;
+            t.size[vals[k]] = (uint8_t)len;
+            k++;
+        }
+        code <<= 1;
+    }
+    return t;
 }
 
-static void ClientAudioThread(const std::wstring& audioUrl)
+static const JpegHuffCodes& JpegHuffTable(int index)
 {
-    // This expects the server to return PCM16 WAV with a streaming header.
-    URL_COMPONENTS uc{};
-    uc.dwStructSize = sizeof(uc);
+    static const JpegHuffCodes tables[4] = {
+        BuildJpegHuffCodes(kJpegDcLumaBits, kJpegDcVals),
+        BuildJpegHuffCodes(kJpegAcLumaBits, kJpegAcLumaVals),
+        BuildJpegHuffCodes(kJpegDcChromaBits, kJpegDcVals),
+        BuildJpegHuffCodes(kJpegAcChromaBits, kJpegAcChromaVals),
+    };
+    return tables[index];
+}
 
-    std::wstring host(256, L'\0');
-    std::wstring path(1024, L'\0');
-    uc.lpszHostName = host.data();
-    uc.dwHostNameLength = (DWORD)host.size();
-    uc.lpszUrlPath = path.data();
-    uc.dwUrlPathLength = (DWORD)path.size();
+// IJG quality scaling of a standard table (natural order).
+static void ScaleJpegQuant(const uint8_t base[64], int quality, uint8_t out[64])
+{
+    quality = std::max(1, std::min(100, quality));
+    const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++)
+    {
+        const int q = ((int)base[i] * scale + 50) / 100;
+        out[i] = (uint8_t)std::max(1, std::min(255, q));
+    }
+}
 
-    if (!WinHttpCrackUrl(audioUrl.c_str(), 0, 0, &uc)) return;
-    host.resize(uc.dwHostNameLength);
-    path.resize(uc.dwUrlPathLength);
+// Entropy-coded output with 0xFF byte stuffing.
+struct JpegBitWriter
+{
+    std::vector<uint8_t>& out;
+    uint32_t acc = 0;
+    int bits = 0;
 
-    const bool https = (uc.nScheme == INTERNET_SCHEME_HTTPS);
-    HINTERNET hSession = WinHttpOpen(L"lanscr-audio/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-    if (!hSession) return;
-    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
-    if (!hConnect) { WinHttpCloseHandle(hSession); return; }
+    explicit JpegBitWriter(std::vector<uint8_t>& o) : out(o) {}
 
-    DWORD flags = WINHTTP_FLAG_REFRESH;
-    if (https) flags |= WINHTTP_FLAG_SECURE;
-    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.empty() ? L"/audio" : path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
-    if (!hReq) { WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession); return; }
+    inline void Put(uint32_t code, int size)
+    {
+        acc = (acc << size) | (code & ((1u << size) - 1u));
+        bits += size;
+        while (bits >= 8)
+        {
+            const uint8_t b = (uint8_t)(acc >> (bits - 8));
+            out.push_back(b);
+            if (b == 0xFF) out.push_back(0);
+            bits -= 8;
+        }
+        acc &= (1u << bits) - 1u;
+    }
 
-    WinHttpMaybeAddAuthHeader(hReq);
+    // Pads the last byte with 1-bits (as required before a marker).
+    void Flush()
+    {
+        if (bits > 0) Put(0x7F, 8 - bits);
+        acc = 0;
+        bits = 0;
+    }
+};
 
-    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
-        !WinHttpReceiveResponse(hReq, nullptr))
+static inline int JpegBitLength(int v)
+{
+    unsigned a = (unsigned)(v < 0 ? -v : v);
+    int n = 0;
+    while (a)
     {
-        WinHttpCloseHandle(hReq);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        return;
+        n++;
+        a >>= 1;
     }
+    return n;
+}
 
-    // If unauthorized, tell the user how to fix it.
+// AAN float forward DCT in place (natural order); output is scaled, see JpegEncodeTables::fdiv.
+static void JpegFdctFloat(float* d)
+{
+    for (int pass = 0; pass < 2; pass++)
     {
-        wchar_t code[16] = {};
-        DWORD codeLen = (DWORD)sizeof(code);
-        if (WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE, WINHTTP_HEADER_NAME_BY_INDEX, code, &codeLen, WINHTTP_NO_HEADER_INDEX))
+        const int step = pass == 0 ? 1 : 8;  // element step within a row / column
+        const int next = pass == 0 ? 8 : 1;  // step between rows / columns
+        for (int i = 0; i < 8; i++)
         {
-            if (wcscmp(code, L"401") == 0)
+            float* p = d + i * next;
+            const float tmp0 = p[0 * step] + p[7 * step];
+            const float tmp7 = p[0 * step] - p[7 * step];
+            const float tmp1 = p[1 * step] + p[6 * step];
+            const float tmp6 = p[1 * step] - p[6 * step];
+            const float tmp2 = p[2 * step] + p[5 * step];
+            const float tmp5 = p[2 * step] - p[5 * step];
+            const float tmp3 = p[3 * step] + p[4 * step];
+            const float tmp4 = p[3 * step] - p[4 * step];
+
+            float tmp10 = tmp0 + tmp3;
+            const float tmp13 = tmp0 - tmp3;
+            float tmp11 = tmp1 + tmp2;
+            float tmp12 = tmp1 - tmp2;
+            p[0 * step] = tmp10 + tmp11;
+            p[4 * step] = tmp10 - tmp11;
+            const float z1 = (tmp12 + tmp13) * 0.707106781f;
+            p[2 * step] = tmp13 + z1;
+            p[6 * step] = tmp13 - z1;
+
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+            const float z5 = (tmp10 - tmp12) * 0.382683433f;
+            const float z2 = 0.541196100f * tmp10 + z5;
+            const float z4 = 1.306562965f * tmp12 + z5;
+            const float z3 = tmp11 * 0.707106781f;
+            const float z11 = tmp7 + z3;
+            const float z13 = tmp7 - z3;
+            p[5 * step] = z13 + z2;
+            p[3 * step] = z13 - z2;
+            p[1 * step] = z11 + z4;
+            p[7 * step] = z11 - z4;
+        }
+    }
+}
+
+struct JpegEncodeTables
+{
+    int quality = -1;
+    uint8_t quant[2][64] = {}; // natural order
+    float fdiv[2][64] = {};    // 1 / (quant * AAN scale), natural order
+
+    void Prepare(int q)
+    {
+        if (q == quality) return;
+        static const float aan[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+        ScaleJpegQuant(kJpegStdLumaQuant, q, quant[0]);
+        ScaleJpegQuant(kJpegStdChromaQuant, q, quant[1]);
+        for (int t = 0; t < 2; t++)
+        {
+            for (int i = 0; i < 64; i++)
             {
-                std::fprintf(stderr, "Unauthorized (401). Use --auth user:pass\n");
+                fdiv[t][i] = 1.0f / ((float)quant[t][i] * aan[i >> 3] * aan[i & 7] * 8.0f);
             }
         }
+        quality = q;
     }
+};
 
-    // Read WAV header (44 bytes)
-    uint8_t wav[44] = {};
-    size_t got = 0;
-    while (got < sizeof(wav) && g_running.load())
+// Level-shifted samples of one 8x8 block -> DCT, quantize, Huffman.
+static void EncodeJpegBlock(JpegBitWriter& bw, float* blk, const float* fdiv, int& dcPred,
+    const JpegHuffCodes& dc, const JpegHuffCodes& ac)
+{
+    JpegFdctFloat(blk);
+    int q[64];
+    for (int k = 0; k < 64; k++)
     {
-        DWORD avail = 0;
-        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
-        if (avail == 0) { Sleep(5); continue; }
-        DWORD read = 0;
-        DWORD toRead = (DWORD)std::min<DWORD>((DWORD)(sizeof(wav) - got), avail);
-        if (!WinHttpReadData(hReq, wav + got, toRead, &read) || read == 0) break;
-        got += read;
+        const int i = kJpegZigzag[k];
+        const float v = blk[i] * fdiv[i];
+        q[k] = (int)(v < 0.0f ? v - 0.5f : v + 0.5f);
     }
-    if (got < sizeof(wav))
+
+    const int diff = q[0] - dcPred;
+    dcPred = q[0];
+    int nbits = JpegBitLength(diff);
+    bw.Put(dc.code[nbits], dc.size[nbits]);
+    if (nbits) bw.Put((uint32_t)(diff < 0 ? diff - 1 : diff), nbits);
+
+    // Screen content is mostly flat: stop at the last non-zero coefficient.
+    int last = 63;
+    while (last > 0 && q[last] == 0) last--;
+    int run = 0;
+    for (int k = 1; k <= last; k++)
     {
-        WinHttpCloseHandle(hReq);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        return;
+        const int v = q[k];
+        if (v == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run > 15)
+        {
+            bw.Put(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+        nbits = JpegBitLength(v);
+        const int sym = (run << 4) | nbits;
+        bw.Put(ac.code[sym], ac.size[sym]);
+        bw.Put((uint32_t)(v < 0 ? v - 1 : v), nbits);
+        run = 0;
     }
+    if (last < 63) bw.Put(ac.code[0x00], ac.size[0x00]);
+}
 
-    auto r16 = [&](int off) -> uint16_t { return (uint16_t)(wav[off] | (wav[off + 1] << 8)); };
-    auto r32 = [&](int off) -> uint32_t {
-        return (uint32_t)(wav[off] | (wav[off + 1] << 8) | (wav[off + 2] << 16) | (wav[off + 3] << 24));
+// Encodes MCU rows [row0, row1) of surf, each row followed by its RST marker except the
+// image's last row.
+static void EncodeJpegMcuRows(const CaptureSurface& surf, bool subsample420, const JpegEncodeTables& tables,
+    int row0, int row1, int mcuRows, std::vector<uint8_t>& out)
+{
+    const int mcuSize = subsample420 ? 16 : 8;
+    const int mcusPerRow = (surf.width + mcuSize - 1) / mcuSize;
+    const int planeW = mcusPerRow * mcuSize; // width padded to whole MCUs
+    const int chromaW = subsample420 ? planeW / 2 : planeW;
+    const int chromaRows = subsample420 ? 8 : mcuSize;
+    const JpegHuffCodes& dcY = JpegHuffTable(0);
+    const JpegHuffCodes& acY = JpegHuffTable(1);
+    const JpegHuffCodes& dcC = JpegHuffTable(2);
+    const JpegHuffCodes& acC = JpegHuffTable(3);
+    const PixelKernels& k = Kernels();
+
+    // One MCU row of level-shifted planes, converted a pixel row at a time by the SIMD
+    // kernels. For 4:2:0, two full-resolution chroma rows are averaged into one.
+    std::vector<int16_t> yPlane((size_t)planeW * mcuSize);
+    std::vector<int16_t> cbPlane((size_t)chromaW * chromaRows);
+    std::vector<int16_t> crPlane((size_t)chromaW * chromaRows);
+    std::vector<int16_t> cbRows((size_t)planeW * 2);
+    std::vector<int16_t> crRows((size_t)planeW * 2);
+
+    JpegBitWriter bw(out);
+    float yb[64];
+    float cb[64];
+    float cr[64];
+    auto loadBlock = [](const int16_t* plane, int stride, int x0, float* blk) {
+        for (int r = 0; r < 8; r++)
+        {
+            const int16_t* s = plane + (size_t)r * stride + x0;
+            for (int c = 0; c < 8; c++) blk[r * 8 + c] = s[c];
+        }
     };
 
-    uint16_t fmt = r16(20);
-    uint16_t channels = r16(22);
-    uint32_t rate = r32(24);
-    uint16_t bits = r16(34);
-    if (fmt != 1 || bits != 16 || channels == 0 || rate == 0)
+    for (int my = row0; my < row1; my++)
     {
-        WinHttpCloseHandle(hReq);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        return;
+        // Color-convert the MCU row (edge pixels replicated past the image border).
+        for (int r = 0; r < mcuSize; r++)
+        {
+            const int y = std::min(my * mcuSize + r, surf.height - 1);
+            int16_t* yRow = yPlane.data() + (size_t)r * planeW;
+            int16_t* cbRow = subsample420 ? cbRows.data() + (size_t)(r & 1) * planeW : cbPlane.data() + (size_t)r * chromaW;
+            int16_t* crRow = subsample420 ? crRows.data() + (size_t)(r & 1) * planeW : crPlane.data() + (size_t)r * chromaW;
+            k.bgraToYcc(surf.pixels + (size_t)y * (size_t)surf.stride, surf.width, yRow, cbRow, crRow);
+            for (int x = surf.width; x < planeW; x++)
+            {
+                yRow[x] = yRow[surf.width - 1];
+                cbRow[x] = cbRow[surf.width - 1];
+                crRow[x] = crRow[surf.width - 1];
+            }
+            if (subsample420 && (r & 1))
+            {
+                k.average2x2(cbRows.data(), cbRows.data() + planeW, chromaW, cbPlane.data() + (size_t)(r >> 1) * chromaW);
+                k.average2x2(crRows.data(), crRows.data() + planeW, chromaW, crPlane.data() + (size_t)(r >> 1) * chromaW);
+            }
+        }
+
+        int dcPred[3] = { 0, 0, 0 };
+        for (int mx = 0; mx < mcusPerRow; mx++)
+        {
+            if (subsample420)
+            {
+                for (int b = 0; b < 4; b++)
+                {
+                    loadBlock(yPlane.data() + (size_t)(b >> 1) * 8 * planeW, planeW, mx * 16 + (b & 1) * 8, yb);
+                    EncodeJpegBlock(bw, yb, tables.fdiv[0], dcPred[0], dcY, acY);
+                }
+            }
+            else
+            {
+                loadBlock(yPlane.data(), planeW, mx * 8, yb);
+                EncodeJpegBlock(bw, yb, tables.fdiv[0], dcPred[0], dcY, acY);
+            }
+            loadBlock(cbPlane.data(), chromaW, mx * 8, cb);
+            loadBlock(crPlane.data(), chromaW, mx * 8, cr);
+            EncodeJpegBlock(bw, cb, tables.fdiv[1], dcPred[1], dcC, acC);
+            EncodeJpegBlock(bw, cr, tables.fdiv[1], dcPred[2], dcC, acC);
+        }
+
+        bw.Flush();
+        if (my != mcuRows - 1)
+        {
+            out.push_back(0xFF);
+            out.push_back((uint8_t)(0xD0 + (my & 7)));
+        }
     }
+}
 
-    WAVEFORMATEX wf{};
-    wf.wFormatTag = WAVE_FORMAT_PCM;
-    wf.nChannels = channels;
-    wf.nSamplesPerSec = rate;
-    wf.wBitsPerSample = 16;
-    wf.nBlockAlign = (WORD)(channels * 2);
-    wf.nAvgBytesPerSec = wf.nSamplesPerSec * wf.nBlockAlign;
+static void PutBe16(std::vector<uint8_t>& b, int v)
+{
+    b.push_back((uint8_t)((v >> 8) & 0xFF));
+    b.push_back((uint8_t)(v & 0xFF));
+}
 
-    HWAVEOUT hwo = nullptr;
-    if (waveOutOpen(&hwo, WAVE_MAPPER, &wf, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR)
+static void WriteJpegHeaders(std::vector<uint8_t>& out, int width, int height, bool subsample420, int restartInterval,
+    const JpegEncodeTables& tables)
+{
+    static const uint8_t jfif[] = { 0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00 };
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    out.push_back(0xFF);
+    out.push_back(0xDB);
+    PutBe16(out, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++)
+    {
+        out.push_back((uint8_t)t);
+        for (int k = 0; k < 64; k++) out.push_back(tables.quant[t][kJpegZigzag[k]]);
+    }
+
+    out.push_back(0xFF);
+    out.push_back(0xC0);
+    PutBe16(out, 17);
+    out.push_back(8);
+    PutBe16(out, height);
+    PutBe16(out, width);
+    out.push_back(3);
+    const uint8_t comps[3][3] = { { 1, (uint8_t)(subsample420 ? 0x22 : 0x11), 0 }, { 2, 0x11, 1 }, { 3, 0x11, 1 } };
+    for (const auto& c : comps) out.insert(out.end(), c, c + 3);
+
+    struct HuffSpec { uint8_t cls; const uint8_t* bits; const uint8_t* vals; };
+    const HuffSpec specs[4] = {
+        { 0x00, kJpegDcLumaBits, kJpegDcVals },
+        { 0x10, kJpegAcLumaBits, kJpegAcLumaVals },
+        { 0x01, kJpegDcChromaBits, kJpegDcVals },
+        { 0x11, kJpegAcChromaBits, kJpegAcChromaVals },
+    };
+    int dhtLen = 2;
+    for (const HuffSpec& s : specs)
     {
-        WinHttpCloseHandle(hReq);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        return;
+        int n = 0;
+        for (int i = 0; i < 16; i++) n += s.bits[i];
+        dhtLen += 17 + n;
+    }
+    out.push_back(0xFF);
+    out.push_back(0xC4);
+    PutBe16(out, dhtLen);
+    for (const HuffSpec& s : specs)
+    {
+        int n = 0;
+        for (int i = 0; i < 16; i++) n += s.bits[i];
+        out.push_back(s.cls);
+        out.insert(out.end(), s.bits, s.bits + 16);
+        out.insert(out.end(), s.vals, s.vals + n);
     }
 
-    const int kBufCount = 4;
-    const DWORD kBufSize = 16384;
-    std::vector<std::vector<uint8_t>> bufs(kBufCount);
-    std::vector<WAVEHDR> hdrs(kBufCount);
-    for (int i = 0; i < kBufCount; i++)
+    out.push_back(0xFF);
+    out.push_back(0xDD);
+    PutBe16(out, 4);
+    PutBe16(out, restartInterval);
+
+    static const uint8_t sos[] = { 0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00 };
+    out.insert(out.end(), sos, sos + sizeof(sos));
+}
+
+// Splits the frame into about two strips per worker (for load balance) and encodes them
+// on the pool. Segment buffers are kept between frames.
+struct StripJpegEncoder
+{
+    std::unique_ptr<WorkerPool> pool;
+    JpegEncodeTables tables;
+    std::vector<std::vector<uint8_t>> strips;
+
+    explicit StripJpegEncoder(int threads)
     {
-        bufs[i].resize(kBufSize);
-        std::memset(&hdrs[i], 0, sizeof(WAVEHDR));
-        hdrs[i].lpData = (LPSTR)bufs[i].data();
-        hdrs[i].dwBufferLength = 0;
-        waveOutPrepareHeader(hwo, &hdrs[i], sizeof(WAVEHDR));
-        hdrs[i].dwFlags |= WHDR_DONE;
+        if (threads > 1) pool = std::make_unique<WorkerPool>(threads);
     }
 
-    int idx = 0;
-    while (g_running.load())
+    int Threads() const { return pool ? pool->Size() : 1; }
+
+    bool Encode(const CaptureSurface& surf, int quality, bool subsample420, std::vector<uint8_t>& out)
     {
-        // Local client-side mute: keep connection but silence output.
-        if (g_clientAudioMuted.load())
+        out.clear();
+        if (!surf.pixels || surf.width <= 0 || surf.height <= 0 || surf.width > 65535 || surf.height > 65535) return false;
+
+        const int mcuSize = subsample420 ? 16 : 8;
+        const int mcusPerRow = (surf.width + mcuSize - 1) / mcuSize;
+        const int mcuRows = (surf.height + mcuSize - 1) / mcuSize;
+        tables.Prepare(quality);
+
+        const int wanted = std::min(mcuRows, Threads() == 1 ? 1 : Threads() * 2);
+        const int rowsPerStrip = (mcuRows + wanted - 1) / wanted;
+        const int count = (mcuRows + rowsPerStrip - 1) / rowsPerStrip;
+        if ((int)strips.size() < count) strips.resize(count);
+
+        const std::function<void(int)> encodeStrip = [&](int i) {
+            std::vector<uint8_t>& seg = strips[i];
+            seg.clear();
+            const int row0 = i * rowsPerStrip;
+            const int row1 = std::min(mcuRows, row0 + rowsPerStrip);
+            EncodeJpegMcuRows(surf, subsample420, tables, row0, row1, mcuRows, seg);
+        };
+        if (pool) pool->Run(count, encodeStrip);
+        else for (int i = 0; i < count; i++) encodeStrip(i);
+
+        size_t total = 0;
+        for (int i = 0; i < count; i++) total += strips[i].size();
+        out.reserve(total + 1024);
+        WriteJpegHeaders(out, surf.width, surf.height, subsample420, mcusPerRow, tables);
+        for (int i = 0; i < count; i++) out.insert(out.end(), strips[i].begin(), strips[i].end());
+        out.push_back(0xFF);
+        out.push_back(0xD9);
+        return true;
+    }
+};
+
+// ----------------------------
+// Frame encoders (WIC / built-in strips / TurboJPEG)
+// ----------------------------
+
+// A JPEG encoder that keeps its state (streams, handles, buffers) across frames.
+// One instance per encoding thread. Frames are 4:4:4 (sharp text, and backends stay
+// comparable); only the adaptive /tiles path asks for 4:2:0.
+struct FrameEncoder
+{
+    virtual ~FrameEncoder() = default;
+    virtual const char* Name() const = 0;
+    virtual HRESULT EncodeSampled(const CaptureSurface& surf, int jpegQuality0to100, bool subsample420, JpegFrame& out) = 0;
+
+    HRESULT Encode(const CaptureSurface& surf, int jpegQuality0to100, JpegFrame& out)
+    {
+        return EncodeSampled(surf, jpegQuality0to100, false, out);
+    }
+};
+
+// factory is borrowed and must outlive the encoder.
+struct WicFrameEncoder : FrameEncoder
+{
+    IWICImagingFactory* factory = nullptr;
+    IStream* stream = nullptr;
+
+    explicit WicFrameEncoder(IWICImagingFactory* f) : factory(f)
+    {
+        (void)CreateStreamOnHGlobal(nullptr, TRUE, &stream);
+    }
+    ~WicFrameEncoder() override
+    {
+        if (stream) stream->Release();
+    }
+    const char* Name() const override { return "wic"; }
+
+    HRESULT EncodeSampled(const CaptureSurface& surf, int jpegQuality0to100, bool subsample420, JpegFrame& out) override
+    {
+        if (!factory || !stream) return E_FAIL;
+        return EncodeSurfaceToJpeg(factory, stream, surf, jpegQuality0to100, subsample420, out);
+    }
+};
+
+struct StripFrameEncoder : FrameEncoder
+{
+    StripJpegEncoder enc;
+
+    explicit StripFrameEncoder(int threads) : enc(threads) {}
+    const char* Name() const override { return "strips"; }
+
+    HRESULT EncodeSampled(const CaptureSurface& surf, int jpegQuality0to100, bool subsample420, JpegFrame& out) override
+    {
+        if (!enc.Encode(surf, jpegQuality0to100, subsample420, out.bytes)) return E_INVALIDARG;
+        out.width = surf.width;
+        out.height = surf.height;
+        return S_OK;
+    }
+};
+
+// TurboJPEG API (libjpeg-turbo), loaded from turbojpeg.dll on first use so the exe builds
+// without the SDK and still runs where the DLL is not installed.
+struct TurboJpegApi
+{
+    using Handle = void*;
+
+    static constexpr int kPixelBgrx = 3;     // TJPF_BGRX
+    static constexpr int kPixelBgra = 8;     // TJPF_BGRA
+    static constexpr int kSamp444 = 0;       // TJSAMP_444
+    static constexpr int kSamp420 = 2;       // TJSAMP_420
+    static constexpr int kFlagNoRealloc = 1024; // TJFLAG_NOREALLOC
+
+    Handle (*initCompress)() = nullptr;
+    Handle (*initDecompress)() = nullptr;
+    int (*destroy)(Handle) = nullptr;
+    int (*compress2)(Handle, const unsigned char*, int, int, int, int, unsigned char**, unsigned long*, int, int, int) = nullptr;
+    unsigned long (*bufSize)(int, int, int) = nullptr;
+    unsigned char* (*allocBuffer)(int) = nullptr;
+    void (*freeBuffer)(unsigned char*) = nullptr;
+    int (*decompressHeader3)(Handle, const unsigned char*, unsigned long, int*, int*, int*, int*) = nullptr;
+    int (*decompress2)(Handle, const unsigned char*, unsigned long, unsigned char*, int, int, int, int, int) = nullptr;
+    char* (*errorStr2)(Handle) = nullptr;
+    bool loaded = false;
+};
+
+static const TurboJpegApi& TurboJpeg()
+{
+    static const TurboJpegApi api = []() {
+        TurboJpegApi t;
+        HMODULE dll = LoadLibraryW(L"turbojpeg.dll");
+        if (!dll) return t;
+        auto bind = [dll](auto& fn, const char* name) {
+            fn = reinterpret_cast<std::remove_reference_t<decltype(fn)>>(reinterpret_cast<void*>(GetProcAddress(dll, name)));
+            return fn != nullptr;
+        };
+        t.loaded = bind(t.initCompress, "tjInitCompress") && bind(t.initDecompress, "tjInitDecompress") &&
+            bind(t.destroy, "tjDestroy") && bind(t.compress2, "tjCompress2") && bind(t.bufSize, "tjBufSize") &&
+            bind(t.allocBuffer, "tjAlloc") && bind(t.freeBuffer, "tjFree") && bind(t.decompressHeader3, "tjDecompressHeader3") &&
+            bind(t.decompress2, "tjDecompress2") && bind(t.errorStr2, "tjGetErrorStr2");
+        if (!t.loaded) FreeLibrary(dll); // too old (needs libjpeg-turbo 2.0+)
+        return t;
+    }();
+    return api;
+}
+
+// Compressor handle and output buffer live as long as the encoder; the buffer is sized with
+// tjBufSize for the current geometry, so TurboJPEG never reallocates it.
+struct TurboFrameEncoder : FrameEncoder
+{
+    const TurboJpegApi& tj = TurboJpeg();
+    TurboJpegApi::Handle handle = nullptr;
+    unsigned char* buf = nullptr;
+    unsigned long bufCap = 0;
+
+    TurboFrameEncoder()
+    {
+        if (tj.loaded) handle = tj.initCompress();
+    }
+    ~TurboFrameEncoder() override
+    {
+        if (buf) tj.freeBuffer(buf);
+        if (handle) tj.destroy(handle);
+    }
+    const char* Name() const override { return "turbo"; }
+
+    HRESULT EncodeSampled(const CaptureSurface& surf, int jpegQuality0to100, bool subsample420, JpegFrame& out) override
+    {
+        out.bytes.clear();
+        if (!handle) return E_FAIL;
+        if (!surf.pixels || surf.width <= 0 || surf.height <= 0) return E_INVALIDARG;
+
+        const int samp = subsample420 ? TurboJpegApi::kSamp420 : TurboJpegApi::kSamp444;
+        const unsigned long need = tj.bufSize(surf.width, surf.height, samp);
+        if (need > bufCap)
         {
-            (void)waveOutSetVolume(hwo, 0);
+            if (buf) tj.freeBuffer(buf);
+            buf = tj.allocBuffer((int)need);
+            bufCap = buf ? need : 0;
+            if (!buf) return E_OUTOFMEMORY;
         }
-        else
+
+        unsigned long size = bufCap;
+        const int q = std::max(1, std::min(100, jpegQuality0to100));
+        if (tj.compress2(handle, surf.pixels, surf.width, surf.stride, surf.height, TurboJpegApi::kPixelBgrx,
+            &buf, &size, samp, q, TurboJpegApi::kFlagNoRealloc) != 0)
         {
-            (void)waveOutSetVolume(hwo, 0xFFFFFFFF);
+            if (g_verbose) LogError("turbojpeg: %s\n", tj.errorStr2(handle));
+            return E_FAIL;
         }
 
-        if (!(hdrs[idx].dwFlags & WHDR_DONE))
+        out.bytes.assign(buf, buf + size);
+        out.width = surf.width;
+        out.height = surf.height;
+        return S_OK;
+    }
+};
+
+static bool IsFrameEncoderName(const std::string& name)
+{
+    return name == "wic" || name == "strips" || name == "turbo";
+}
+
+// Returns nullptr if the backend is unavailable (turbojpeg.dll missing, no WIC factory).
+static std::unique_ptr<FrameEncoder> CreateFrameEncoder(const std::string& name, IWICImagingFactory* factory)
+{
+    if (name == "wic")
+    {
+        auto enc = std::make_unique<WicFrameEncoder>(factory);
+        if (!enc->factory || !enc->stream) return nullptr;
+        return enc;
+    }
+    if (name == "strips")
+    {
+        const int threads = g_jpegThreads > 0 ? g_jpegThreads : (int)std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+        return std::make_unique<StripFrameEncoder>(threads);
+    }
+    if (name == "turbo")
+    {
+        auto enc = std::make_unique<TurboFrameEncoder>();
+        if (!enc->handle) return nullptr;
+        return enc;
+    }
+    return nullptr;
+}
+
+// The encoder chosen on the command line (--encoder, or strips when only --jpeg-threads is
+// given), falling back to WIC when it cannot be created.
+static std::unique_ptr<FrameEncoder> CreateConfiguredFrameEncoder(IWICImagingFactory* factory)
+{
+    const std::string name = !g_encoderSpec.empty() ? g_encoderSpec : (g_jpegThreads > 0 ? "strips" : "wic");
+    std::unique_ptr<FrameEncoder> enc = CreateFrameEncoder(name, factory);
+    if (!enc && name != "wic")
+    {
+        LogError("JPEG encoder '%s' unavailable%s, using wic\n", name.c_str(), name == "turbo" ? " (turbojpeg.dll not found)" : "");
+        enc = CreateFrameEncoder("wic", factory);
+    }
+    return enc;
+}
+
+// Builds a /tiles message: a full frame reuses the already-encoded JPEG as one tile,
+// otherwise each dirty rect is encoded straight from the capture surface (sub-view, same stride).
+static HRESULT BuildTileMessage(FrameEncoder* encoder, const CaptureSurface& surf, const std::vector<TileRect>& rects,
+    int jpegQuality0to100, uint32_t seq, const JpegFrame* fullFrame, std::vector<uint8_t>& msg)
+{
+    BeginTileMessage(msg, seq, surf.width, surf.height, fullFrame != nullptr);
+    if (fullFrame)
+    {
+        if (fullFrame->bytes.empty()) return E_INVALIDARG;
+        TileRect r;
+        r.w = surf.width;
+        r.h = surf.height;
+        AppendTileToMessage(msg, r, fullFrame->bytes.data(), fullFrame->bytes.size());
+        return S_OK;
+    }
+
+    JpegFrame tile;
+    for (const TileRect& r : rects)
+    {
+        CaptureSurface sub = surf;
+        sub.pixels = surf.pixels + (size_t)r.y * (size_t)surf.stride + (size_t)r.x * 4;
+        sub.width = r.w;
+        sub.height = r.h;
+        HRESULT hr = encoder->Encode(sub, jpegQuality0to100, tile);
+        if (FAILED(hr)) return hr;
+        AppendTileToMessage(msg, r, tile.bytes.data(), tile.bytes.size());
+    }
+    return S_OK;
+}
+
+// Content-adaptive /tiles coding (--adaptive-tiles): text/UI tiles stay 4:4:4 at the
+// stream quality, photo/video tiles go 4:2:0 at a lower quality, where chroma detail and
+// high frequencies are not missed.
+enum class TileContent
+{
+    Text,
+    Natural,
+};
+
+// Classifies a tile by its horizontal luma steps (every other row). Text and UI are mostly
+// flat runs broken by hard edges; photos and video are mostly small-to-medium steps.
+static TileContent ClassifyTile(const uint8_t* p, int stride, int w, int h)
+{
+    int flat = 0;
+    int mid = 0;
+    int total = 0;
+    for (int y = 0; y < h; y += 2)
+    {
+        const uint8_t* row = p + (size_t)y * (size_t)stride;
+        int prev = row[0] + 2 * row[1] + row[2]; // 4x luma (approx.)
+        for (int x = 1; x < w; x++)
         {
-            Sleep(5);
-            continue;
+            const uint8_t* px = row + (size_t)x * 4;
+            const int l = px[0] + 2 * px[1] + px[2];
+            const int d = l > prev ? l - prev : prev - l;
+            prev = l;
+            if (d <= 4) flat++;       // |dY| <= 1
+            else if (d < 192) mid++;  // |dY| < 48: shading, texture, noise
+            total++;
+        }
+    }
+    if (total == 0) return TileContent::Text;
+    return (flat * 2 < total && mid * 5 >= total * 2) ? TileContent::Natural : TileContent::Text;
+}
+
+static int NaturalTileQuality(int jpegQuality0to100)
+{
+    return std::max(kMinNaturalTileQuality, jpegQuality0to100 - kNaturalTileQualityDrop);
+}
+
+struct TileCodingStats
+{
+    int textTiles = 0;
+    int naturalTiles = 0;
+};
+
+// Like BuildTileMessage, but each 64x64 tile is classified and runs of same-class tiles are
+// encoded together with that class's settings. rects == nullptr encodes the whole frame as
+// a full (sync) message.
+static HRESULT BuildAdaptiveTileMessage(FrameEncoder* encoder, const CaptureSurface& surf, const std::vector<TileRect>* rects,
+    int jpegQuality0to100, uint32_t seq, std::vector<uint8_t>& msg, TileCodingStats* stats = nullptr)
+{
+    BeginTileMessage(msg, seq, surf.width, surf.height, rects == nullptr);
+
+    std::vector<TileRect> all;
+    if (!rects)
+    {
+        for (int y = 0; y < surf.height; y += kTileSize)
+        {
+            TileRect r;
+            r.y = y;
+            r.w = surf.width;
+            r.h = std::min(kTileSize, surf.height - y);
+            all.push_back(r);
         }
+        rects = &all;
+    }
+
+    JpegFrame tile;
+    auto encodeRun = [&](const TileRect& r, TileContent c) {
+        CaptureSurface sub = surf;
+        sub.pixels = surf.pixels + (size_t)r.y * (size_t)surf.stride + (size_t)r.x * 4;
+        sub.width = r.w;
+        sub.height = r.h;
+        const bool natural = c == TileContent::Natural;
+        HRESULT hr = encoder->EncodeSampled(sub, natural ? NaturalTileQuality(jpegQuality0to100) : jpegQuality0to100, natural, tile);
+        if (SUCCEEDED(hr)) AppendTileToMessage(msg, r, tile.bytes.data(), tile.bytes.size());
+        return hr;
+    };
 
-        DWORD avail = 0;
-        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
-        if (avail == 0) { Sleep(5); continue; }
+    for (const TileRect& r : *rects)
+    {
+        TileRect run = r;
+        run.w = 0;
+        TileContent runClass = TileContent::Text;
+        for (int x = r.x; x < r.x + r.w; x += kTileSize)
+        {
+            const int tw = std::min(kTileSize, r.x + r.w - x);
+            const TileContent c = ClassifyTile(surf.pixels + (size_t)r.y * (size_t)surf.stride + (size_t)x * 4, surf.stride, tw, r.h);
+            if (stats) (c == TileContent::Natural ? stats->naturalTiles : stats->textTiles)++;
+            if (run.w > 0 && c != runClass)
+            {
+                HRESULT hr = encodeRun(run, runClass);
+                if (FAILED(hr)) return hr;
+                run.x = x;
+                run.w = 0;
+            }
+            runClass = c;
+            run.w += tw;
+        }
+        if (run.w > 0)
+        {
+            HRESULT hr = encodeRun(run, runClass);
+            if (FAILED(hr)) return hr;
+        }
+    }
+    return S_OK;
+}
 
-        DWORD toRead = (DWORD)std::min<DWORD>(avail, kBufSize);
-        DWORD read = 0;
-        if (!WinHttpReadData(hReq, bufs[idx].data(), toRead, &read) || read == 0) break;
+// ----------------------------
+// Published frames (reference-counted JPEG buffers)
+// ----------------------------
 
-        hdrs[idx].dwBufferLength = read;
-        hdrs[idx].dwFlags &= ~WHDR_DONE;
-        waveOutWrite(hwo, &hdrs[idx], sizeof(WAVEHDR));
+// Storage of published JPEGs is recycled: the encode stage encodes into a pooled vector (keeping
+// its capacity), shares it, and the last viewer to let go puts it back.
+struct JpegBufferPool
+{
+    std::mutex mtx;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> free;
+};
 
-        idx = (idx + 1) % kBufCount;
+static constexpr size_t kMaxPooledJpegBuffers = 16;
+
+// Held by every shared buffer's deleter, so the pool outlives the last buffer.
+static const std::shared_ptr<JpegBufferPool> g_jpegBufferPool = std::make_shared<JpegBufferPool>();
+
+static std::unique_ptr<std::vector<uint8_t>> TakeJpegBuffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_jpegBufferPool->mtx);
+        if (!g_jpegBufferPool->free.empty())
+        {
+            std::unique_ptr<std::vector<uint8_t>> buf = std::move(g_jpegBufferPool->free.back());
+            g_jpegBufferPool->free.pop_back();
+            buf->clear();
+            return buf;
+        }
+    }
+    return std::make_unique<std::vector<uint8_t>>();
+}
+
+// Freezes buf into an immutable shared buffer.
+static JpegBufferRef ShareJpegBuffer(std::unique_ptr<std::vector<uint8_t>> buf)
+{
+    std::shared_ptr<JpegBufferPool> pool = g_jpegBufferPool;
+    return JpegBufferRef(buf.release(), [pool](std::vector<uint8_t>* p) {
+        std::unique_ptr<std::vector<uint8_t>> owned(p);
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        if (pool->free.size() < kMaxPooledJpegBuffers) pool->free.push_back(std::move(owned));
+    });
+}
+
+// Each part carries the frame's seq, its capture time on the server's monotonic clock
+// (PerfNowMs) and its encode time, so viewers can see skipped frames and measure latency.
+static MjpegPart MakeMjpegPart(JpegBufferRef jpeg, uint64_t seq, double captureMs, double encodeMs)
+{
+    char header[192];
+    std::snprintf(header, sizeof(header),
+        "--frame\r\n"
+        "Content-Type: image/jpeg\r\n"
+        "Content-Length: %zu\r\n"
+        "X-Seq: %llu\r\n"
+        "X-Timestamp: %.3f\r\n"
+        "X-Encode-Ms: %.2f\r\n"
+        "\r\n",
+        jpeg->size(), (unsigned long long)seq, captureMs, encodeMs);
+    MjpegPart part;
+    part.jpeg = std::move(jpeg);
+    part.header = header;
+    return part;
+}
+
+static void MjpegPartBuffers(const MjpegPart& part, WSABUF bufs[3])
+{
+    bufs[0].buf = const_cast<char*>(part.header.data());
+    bufs[0].len = (ULONG)part.header.size();
+    bufs[1].buf = (char*)part.jpeg->data();
+    bufs[1].len = (ULONG)part.jpeg->size();
+    bufs[2].buf = const_cast<char*>(kMjpegPartTrailer);
+    bufs[2].len = (ULONG)(sizeof(kMjpegPartTrailer) - 1);
+}
+
+static void PublishMjpegFrame(SharedJpegFrame& slot, std::shared_ptr<const MjpegFrameSet> set)
+{
+    const uint64_t seq = set->seq;
+    std::atomic_store(&slot.current, std::move(set));
+    {
+        std::lock_guard<std::mutex> lock(slot.mtx);
+        slot.seq = seq;
+        slot.cv.notify_all();
+    }
+    WakeServerLoop();
+}
+
+// Waits up to timeoutMs for a frame newer than lastSeq and pins it; null on timeout or shutdown.
+static std::shared_ptr<const MjpegFrameSet> WaitForMjpegFrame(SharedJpegFrame& slot, uint64_t lastSeq, int timeoutMs)
+{
+    {
+        std::unique_lock<std::mutex> lock(slot.mtx);
+        slot.cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+            return !g_running.load() || slot.seq != lastSeq;
+        });
+        if (!g_running.load() || slot.seq == lastSeq) return nullptr;
+    }
+    return std::atomic_load(&slot.current);
+}
+
+// The part for a rendition. Right after a viewer changes level its rendition may not be
+// encoded yet, so the nearest one is used.
+static const MjpegPart* PickRendition(const MjpegFrameSet& set, int rendition)
+{
+    for (int d = 0; d < g_renditionCount; d++)
+    {
+        if (rendition + d < g_renditionCount && set.renditions[rendition + d].jpeg) return &set.renditions[rendition + d];
+        if (rendition - d >= 0 && set.renditions[rendition - d].jpeg) return &set.renditions[rendition - d];
+    }
+    return nullptr;
+}
+
+// True when the published set is missing a rendition some viewer is on (or there is no set
+// at all), e.g. a viewer joined or stepped down to a rendition left out while unwatched.
+static bool MjpegRenditionMissing(const MjpegFrameSet* set)
+{
+    if (!set) return true;
+    for (int r = 0; r < g_renditionCount; r++)
+    {
+        if (g_renditionClients[r].load() > 0 && !set->renditions[r].jpeg) return true;
+    }
+    return false;
+}
+
+// ----------------------------
+// Capture -> encode pipeline
+// ----------------------------
+
+// A capture copied out of the source's surface (which the source reuses on the next
+// Capture), possibly downsized, together with the tile hashes computed for it.
+struct PipelineFrame
+{
+    std::vector<uint8_t> pixels;
+    CaptureSurface surf; // tightly packed view of pixels, no damage
+    TileHashGrid tiles;
+    double captureMs = 0.0;
+    double scaleMs = 0.0;   // downscale time, 0 at native size
+    bool keepalive = false; // unchanged, forwarded because the keepalive interval elapsed
+
+    // -v with output scaling: a native-size copy is attached now and then so the encoder
+    // can log encode time and size before/after scaling.
+    bool probe = false;
+    std::vector<uint8_t> probePixels;
+    CaptureSurface probeSurf;
+};
+
+// Copies src into pixels and points view at the tightly packed copy.
+static void CopySurfacePixels(const CaptureSurface& src, std::vector<uint8_t>& pixels, CaptureSurface& view)
+{
+    const size_t rowBytes = (size_t)src.width * 4;
+    pixels.resize(rowBytes * (size_t)src.height);
+    for (int y = 0; y < src.height; y++)
+    {
+        std::memcpy(pixels.data() + (size_t)y * rowBytes, src.pixels + (size_t)y * (size_t)src.stride, rowBytes);
+    }
+    view = src;
+    view.pixels = pixels.data();
+    view.stride = (int)rowBytes;
+    view.damage = nullptr;
+}
+
+static void CopySurfaceToFrame(const CaptureSurface& src, const TileHashGrid& tiles, PipelineFrame& dst)
+{
+    CopySurfacePixels(src, dst.pixels, dst.surf);
+    dst.tiles = tiles;
+}
+
+// Encoded size for a srcW x srcH capture under the current --scale / --max-width.
+static void OutputSizeFor(int srcW, int srcH, int& outW, int& outH)
+{
+    double s = std::min(1.0, std::max(kMinOutputScale, g_outputScale.load()));
+    const int maxW = g_outputMaxWidth.load();
+    if (maxW > 0 && srcW * s > maxW) s = (double)maxW / (double)srcW;
+    outW = std::max(1, (int)(srcW * s + 0.5));
+    outH = std::max(1, (int)(srcH * s + 0.5));
+    if (outW >= srcW || outH >= srcH)
+    {
+        outW = srcW;
+        outH = srcH;
+    }
+}
+
+// Downsizes src to outW x outH (box + bilinear, see DownscaleBgra) into pixels.
+static void ScaleSurface(const CaptureSurface& src, int outW, int outH, DownscaleScratch& scratch, std::vector<uint8_t>& pixels,
+    CaptureSurface& view)
+{
+    pixels.resize((size_t)outW * (size_t)outH * 4);
+    DownscaleBgra(src.pixels, src.width, src.height, src.stride, pixels.data(), outW, outH, outW * 4, true, scratch);
+    view = src;
+    view.pixels = pixels.data();
+    view.width = outW;
+    view.height = outH;
+    view.stride = outW * 4;
+    view.damage = nullptr;
+}
+
+// Like CopySurfaceToFrame, at output size. The tile hashes describe the capture, so they
+// are recomputed on the downsized frame for the encoder's change checks and /tiles rects.
+static void ScaleSurfaceToFrame(const CaptureSurface& src, int outW, int outH, TileHashImpl impl, DownscaleScratch& scratch,
+    PipelineFrame& dst)
+{
+    ScaleSurface(src, outW, outH, scratch, dst.pixels, dst.surf);
+    ComputeTileHashes(dst.surf, dst.tiles, impl);
+}
+
+// Hand-off between one capture thread and one encode thread over a fixed pool of reusable
+// frames. At most one frame waits for the encoder; pushing over it recycles the older one
+// (latest wins), so a slow encoder lowers the frame rate instead of adding latency.
+// Three frames are enough for the producer never to wait: one being filled, one waiting,
+// one being encoded.
+struct FrameQueue
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::unique_ptr<PipelineFrame>> freeFrames;
+    std::unique_ptr<PipelineFrame> pending;
+    bool closed = false;
+    uint64_t drops = 0;
+
+    explicit FrameQueue(int poolSize = 3)
+    {
+        for (int i = 0; i < poolSize; i++) freeFrames.push_back(std::make_unique<PipelineFrame>());
+    }
+
+    std::unique_ptr<PipelineFrame> AcquireFree()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (freeFrames.empty()) return nullptr;
+        std::unique_ptr<PipelineFrame> f = std::move(freeFrames.back());
+        freeFrames.pop_back();
+        return f;
+    }
+
+    // Returns false if the queued frame it replaced was never encoded.
+    bool Push(std::unique_ptr<PipelineFrame> f)
+    {
+        bool replaced = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (pending)
+            {
+                freeFrames.push_back(std::move(pending));
+                drops++;
+                replaced = true;
+            }
+            pending = std::move(f);
+        }
+        cv.notify_one();
+        return !replaced;
+    }
+
+    // Waits up to timeoutMs for a frame; nullptr on timeout or once closed.
+    std::unique_ptr<PipelineFrame> Pop(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return pending != nullptr || closed; });
+        return std::move(pending);
+    }
+
+    void Recycle(std::unique_ptr<PipelineFrame> f)
+    {
+        if (!f) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        freeFrames.push_back(std::move(f));
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+static void PublishPaceStats(const FramePacerStats& s)
+{
+    g_paceFps.store(s.fps);
+    g_paceJitterMs.store(s.jitterMs);
+    g_paceOverruns.store(s.overruns);
+    g_paceSkippedTicks.store(s.skippedTicks);
+    g_stageCapture.Roll();
+    g_stageCopy.Roll();
+    g_stageEncode.Roll();
+    if (g_verbose && s.frames > 0)
+    {
+        LogInfo("pace: fps=%.1f jitter=%.2f ms (max %.1f) overruns=%llu skipped ticks=%llu\n",
+            s.fps, s.jitterMs, s.maxJitterMs, (unsigned long long)s.overruns, (unsigned long long)s.skippedTicks);
+        LogInfo("pipeline: capture=%.2f ms copy=%.2f ms encode=%.2f ms drops=%llu\n",
+            g_stageCapture.avgMs.load(), g_stageCopy.avgMs.load(), g_stageEncode.avgMs.load(),
+            (unsigned long long)g_pipelineDrops.load());
+    }
+}
+
+// Encode stage: turns queued captures into the shared MJPEG frame and /tiles messages.
+// MJPEG and /tiles each keep the hashes of the last frame they actually published, so
+// dropped captures never break the /tiles delta chain and a frame published to only one
+// of them is still news to the other.
+static void EncodeStageThread(FrameEncoder* encoder, FrameQueue* queue, int jpegQuality0to100)
+{
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    uint64_t seqLocal = 0;
+    TileHashGrid mjpegTiles;
+    TileHashGrid tileTiles;
+    uint64_t tileSeq = 0;
+    double lastTileKeyMs = -1e9;
+    std::vector<TileRect> dirtyRects;
+    std::vector<uint8_t> tileMsg;
+    DownscaleScratch renditionScratch;
+    std::vector<uint8_t> renditionPixels;
+    CaptureSurface renditionSurf{};
+
+    for (;;)
+    {
+        std::unique_ptr<PipelineFrame> pf = queue->Pop(kIdleWaitMs);
+        if (!pf)
+        {
+            std::lock_guard<std::mutex> lock(queue->mtx);
+            if (queue->closed) break;
+            continue;
+        }
+
+        const CaptureSurface& surf = pf->surf;
+        const TileHashGrid& curTiles = pf->tiles;
+        const bool mjpegWanted = g_clientCount.load() > 0;
+        const bool tilesWanted = g_tileClientCount.load() > 0;
+        std::shared_ptr<const MjpegFrameSet> last = std::atomic_load(&g_sharedFrame.current);
+        const bool mjpegDue = mjpegWanted && (!last || !SameTileHashes(mjpegTiles, curTiles));
+        const bool tilesDue = tilesWanted && !SameTileHashes(tileTiles, curTiles);
+        // Screen unchanged but a viewer is on a rendition the current set lacks: encode just
+        // that one and carry the others over.
+        const bool mjpegFill = mjpegWanted && !mjpegDue && MjpegRenditionMissing(last.get());
+
+        // Tile clients need a full frame when they join/resync, periodically, and on resize.
+        bool tileKey = false;
+        if (tilesWanted)
+        {
+            const double now = PerfNowMs();
+            const bool geometryChanged = tileTiles.width != curTiles.width || tileTiles.height != curTiles.height;
+            if (g_tilesKeyRequested.load() && now - lastTileKeyMs >= kTileKeyMinIntervalMs)
+            {
+                g_tilesKeyRequested.store(false);
+                tileKey = true;
+            }
+            if (geometryChanged || now - lastTileKeyMs >= kTileFullRefreshMs) tileKey = true;
+        }
+
+        // Static desktop: on the keepalive frame re-publish the last JPEG (and an empty tile
+        // message, which keeps /tiles clients in sequence); otherwise there is nothing to do.
+        if (!mjpegDue && !mjpegFill && !tilesDue && !tileKey)
+        {
+            if (!pf->keepalive)
+            {
+                queue->Recycle(std::move(pf));
+                continue;
+            }
+            // Same buffers under a new seq: nothing is copied.
+            if (last)
+            {
+                std::shared_ptr<MjpegFrameSet> again = std::make_shared<MjpegFrameSet>(*last);
+                again->seq = ++seqLocal;
+                again->captureMs = pf->captureMs;
+                for (int r = 0; r < g_renditionCount; r++)
+                {
+                    if (again->renditions[r].jpeg) again->renditions[r] = MakeMjpegPart(again->renditions[r].jpeg, again->seq, again->captureMs, 0.0);
+                }
+                PublishMjpegFrame(g_sharedFrame, std::move(again));
+            }
+            if (tilesWanted)
+            {
+                BeginTileMessage(tileMsg, (uint32_t)(tileSeq + 1), surf.width, surf.height, false);
+                std::lock_guard<std::mutex> lock(g_sharedTiles.mtx);
+                g_sharedTiles.msg.swap(tileMsg);
+                g_sharedTiles.seq = ++tileSeq;
+                g_sharedTiles.full = false;
+                g_sharedTiles.cv.notify_all();
+            }
+            queue->Recycle(std::move(pf));
+            continue;
+        }
+
+        const double e0 = PerfNowMs();
+
+        // Full-frame JPEGs: one per MJPEG rendition that has viewers when the frame changed, and
+        // a native one as the /tiles key frame (rendition 0 when it is native; adaptive tiles
+        // build their own key frames). Renditions of the same scale share one downscale, and
+        // each JPEG is encoded into recycled storage that is published without a copy.
+        JpegFrame frames[kMaxMjpegRenditions];
+        std::unique_ptr<std::vector<uint8_t>> buffers[kMaxMjpegRenditions];
+        JpegFrame tileKeyFrame;
+        const bool rendition0Native = g_renditions[0].scale >= 1.0 && g_renditions[0].quality == jpegQuality0to100;
+        const bool needTileKeyJpeg = tileKey && !g_adaptiveTiles;
+        int scaledW = 0;
+        int scaledH = 0;
+        bool encoded = false;
+        bool encodeFailed = false;
+        for (int r = 0; r < g_renditionCount && !encodeFailed; r++)
+        {
+            const bool forViewers = g_renditionClients[r].load() > 0 && (mjpegDue || (mjpegFill && !last->renditions[r].jpeg));
+            const bool forTileKey = r == 0 && rendition0Native && needTileKeyJpeg;
+            if (!forViewers && !forTileKey) continue;
+
+            const MjpegRendition& rend = g_renditions[r];
+            const CaptureSurface* view = &surf;
+            if (rend.scale < 1.0)
+            {
+                const int w = std::max(1, (int)(surf.width * rend.scale + 0.5));
+                const int h = std::max(1, (int)(surf.height * rend.scale + 0.5));
+                if (w != scaledW || h != scaledH)
+                {
+                    ScaleSurface(surf, w, h, renditionScratch, renditionPixels, renditionSurf);
+                    scaledW = w;
+                    scaledH = h;
+                }
+                view = &renditionSurf;
+            }
+
+            buffers[r] = TakeJpegBuffer();
+            frames[r].bytes.swap(*buffers[r]);
+            const double r0 = PerfNowMs();
+            HRESULT hr = encoder->Encode(*view, rend.quality, frames[r]);
+            if (FAILED(hr) || frames[r].bytes.empty())
+            {
+                encodeFailed = true;
+                break;
+            }
+            encoded = true;
+            g_renditionEncodes[r].fetch_add(1);
+            const uint64_t avg = g_renditionBytes[r].load();
+            g_renditionBytes[r].store(avg == 0 ? frames[r].bytes.size() : (avg * 7 + frames[r].bytes.size()) / 8);
+
+            if (r == 0 && pf->probe)
+            {
+                const double scaledMs = PerfNowMs() - r0;
+                JpegFrame native;
+                const double n0 = PerfNowMs();
+                if (SUCCEEDED(encoder->Encode(pf->probeSurf, jpegQuality0to100, native)))
+                {
+                    LogInfo("scale: %dx%d -> %dx%d encode %.2f -> %.2f ms, %zu -> %zu bytes (downscale %.2f ms)\n",
+                        pf->probeSurf.width, pf->probeSurf.height, view->width, view->height, PerfNowMs() - n0, scaledMs,
+                        native.bytes.size(), frames[0].bytes.size(), pf->scaleMs);
+                }
+            }
+        }
+        if (!encodeFailed && needTileKeyJpeg && !rendition0Native)
+        {
+            HRESULT hr = encoder->Encode(surf, jpegQuality0to100, tileKeyFrame);
+            encodeFailed = FAILED(hr) || tileKeyFrame.bytes.empty();
+            encoded = true;
+        }
+        if (encodeFailed)
+        {
+            queue->Recycle(std::move(pf));
+            continue;
+        }
+        if (encoded) g_framesEncoded.fetch_add(1);
+
+        if (tilesWanted && (tilesDue || tileKey))
+        {
+            if (!tileKey) CollectDirtyTileRects(tileTiles, curTiles, dirtyRects);
+            HRESULT hr = g_adaptiveTiles ?
+                BuildAdaptiveTileMessage(encoder, surf, tileKey ? nullptr : &dirtyRects, jpegQuality0to100, (uint32_t)(tileSeq + 1), tileMsg) :
+                BuildTileMessage(encoder, surf, dirtyRects, jpegQuality0to100, (uint32_t)(tileSeq + 1), tileKey ? (rendition0Native ? &frames[0] : &tileKeyFrame) : nullptr, tileMsg);
+            if (SUCCEEDED(hr))
+            {
+                if (tileKey) lastTileKeyMs = PerfNowMs();
+                std::lock_guard<std::mutex> lock(g_sharedTiles.mtx);
+                g_sharedTiles.msg.swap(tileMsg);
+                g_sharedTiles.seq = ++tileSeq;
+                g_sharedTiles.full = tileKey;
+                g_sharedTiles.cv.notify_all();
+                tileTiles = curTiles;
+            }
+            else
+            {
+                // This delta is lost: clients resync from the next key frame.
+                g_tilesKeyRequested.store(true);
+            }
+        }
+
+        if (mjpegDue || mjpegFill)
+        {
+            // Renditions nobody watches are left out rather than carried over stale; a fill
+            // carries over the unchanged screen's parts under the new seq.
+            std::shared_ptr<MjpegFrameSet> set = std::make_shared<MjpegFrameSet>();
+            set->seq = ++seqLocal;
+            set->captureMs = pf->captureMs;
+            const double encodeMs = PerfNowMs() - e0;
+            for (int r = 0; r < g_renditionCount; r++)
+            {
+                if (!buffers[r] || frames[r].bytes.empty())
+                {
+                    if (mjpegFill && last->renditions[r].jpeg) set->renditions[r] = MakeMjpegPart(last->renditions[r].jpeg, set->seq, set->captureMs, 0.0);
+                    continue;
+                }
+                buffers[r]->swap(frames[r].bytes);
+                set->renditions[r] = MakeMjpegPart(ShareJpegBuffer(std::move(buffers[r])), set->seq, set->captureMs, encodeMs);
+            }
+            PublishMjpegFrame(g_sharedFrame, std::move(set));
+            mjpegTiles = curTiles;
+        }
+        else if (!mjpegWanted && last && !SameTileHashes(mjpegTiles, curTiles))
+        {
+            // Only /tiles is watching and the screen moved on: drop the stale JPEGs so the next
+            // MJPEG viewer gets a fresh frame instead of an old one (the capture stage pushes
+            // a frame as soon as a viewer finds the slot empty).
+            std::atomic_store(&g_sharedFrame.current, std::shared_ptr<const MjpegFrameSet>());
+        }
+        g_stageEncode.Add(PerfNowMs() - e0);
+        queue->Recycle(std::move(pf));
+    }
+
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+}
+
+// Capture stage. Captures on the pacer's deadlines and hands changed frames to the encode
+// stage (EncodeStageThread), so capturing frame N+1 overlaps encoding frame N and the
+// frame rate is bounded by the slower stage rather than by their sum.
+static void CaptureLoopThread(int fps, int jpegQuality0to100, HANDLE stopEvent)
+{
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (FAILED(hr))
+    {
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        g_captureThreadRunning.store(false);
+        return;
+    }
+
+    std::unique_ptr<CaptureSource> source = CreateCaptureSource(g_captureSpec);
+    if (!source)
+    {
+        LogError("Unknown capture source '%s', using gdi\n", g_captureSpec.c_str());
+        source = CreateCaptureSource("gdi");
+    }
+    source->SetCursorOverlay(!g_cursorMeta);
+
+    std::unique_ptr<FrameEncoder> jpegEncoder = CreateConfiguredFrameEncoder(factory);
+    if (!jpegEncoder)
+    {
+        LogError("No JPEG encoder available\n");
+        source.reset();
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        g_captureThreadRunning.store(false);
+        return;
+    }
+    if (g_verbose) LogInfo("JPEG encoder: %s\n", jpegEncoder->Name());
+
+    FrameQueue queue;
+    FrameEncoder* encoderPtr = jpegEncoder.get();
+    std::thread encoder([encoderPtr, &queue, jpegQuality0to100]() { EncodeStageThread(encoderPtr, &queue, jpegQuality0to100); });
+
+    // Demand-driven capture:
+    // - do not capture when there are no clients (reduces CPU + mouse/input disruption)
+    // - cap fps to avoid overloading the machine
+    if (fps <= 0) fps = 10;
+    if (fps > 60) fps = 60;
+    FramePacer pacer(fps);
+    double lastStatsMs = PerfNowMs();
+    CaptureSurface surf;
+    const TileHashImpl hashImpl = BestTileHashImpl();
+    TileHashGrid pushedTiles;
+    TileHashGrid curTiles;
+    double lastPushMs = 0.0;
+    DownscaleScratch scaleScratch;
+    int pushedW = 0;
+    int pushedH = 0;
+    double lastProbeMs = -1e9;
+
+    while (g_running.load())
+    {
+        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        {
+            g_running.store(false);
+            break;
+        }
+
+        // If nobody is watching, don't waste CPU capturing/encoding.
+        const bool mjpegWanted = g_clientCount.load() > 0;
+        const bool tilesWanted = g_tileClientCount.load() > 0;
+        if (!mjpegWanted && !tilesWanted)
+        {
+            Sleep(50);
+            pacer.Rebase();
+            continue;
+        }
+
+        if (PerfNowMs() - lastStatsMs >= kPaceStatsWindowMs)
+        {
+            PublishPaceStats(pacer.TakeStats());
+            lastStatsMs = PerfNowMs();
+        }
+
+        const double c0 = PerfNowMs();
+        hr = source->Capture(surf);
+        if (FAILED(hr))
+        {
+            pacer.Wait();
+            continue;
+        }
+
+        // curTiles always describes the previous capture, so damage reported by the source
+        // (if any) limits re-hashing to the tiles it touches.
+        UpdateTileHashes(surf, curTiles, hashImpl);
+        const double c1 = PerfNowMs();
+        g_stageCapture.Add(c1 - c0);
+
+        int outW = surf.width;
+        int outH = surf.height;
+        OutputSizeFor(surf.width, surf.height, outW, outH);
+
+        // Static desktop: nothing to encode. A frame still goes through once per keepalive
+        // interval (the encoder re-publishes and handles periodic /tiles keys from it), and
+        // right away when a /tiles client asks for a key frame or an MJPEG viewer's rendition
+        // is missing from the published set. A new output size counts as a change.
+        const bool unchanged = SameTileHashes(pushedTiles, curTiles) && outW == pushedW && outH == pushedH;
+        const bool keepalive = unchanged && c1 - lastPushMs >= kKeepaliveFrameMs;
+        const bool mjpegMissing = mjpegWanted && MjpegRenditionMissing(std::atomic_load(&g_sharedFrame.current).get());
+        if (unchanged && !keepalive && !mjpegMissing && !(tilesWanted && g_tilesKeyRequested.load()))
+        {
+            g_framesSkipped.fetch_add(1);
+            // Idle: wait for the next tick (or, if the source can tell, the next screen update)
+            // and restart the deadline grid from there.
+            source->WaitForChange((int)pacer.MsUntilNextTick(), kIdleWaitMs);
+            pacer.Rebase();
+            continue;
+        }
+
+        std::unique_ptr<PipelineFrame> pf = queue.AcquireFree();
+        if (pf)
+        {
+            pf->probe = false;
+            pf->scaleMs = 0.0;
+            if (outW != surf.width || outH != surf.height)
+            {
+                ScaleSurfaceToFrame(surf, outW, outH, hashImpl, scaleScratch, *pf);
+                pf->scaleMs = PerfNowMs() - c1;
+                if (g_verbose && c1 - lastProbeMs >= kPaceStatsWindowMs)
+                {
+                    CopySurfacePixels(surf, pf->probePixels, pf->probeSurf);
+                    pf->probe = true;
+                    lastProbeMs = c1;
+                }
+            }
+            else
+            {
+                CopySurfaceToFrame(surf, curTiles, *pf);
+            }
+            pf->captureMs = c0;
+            pf->keepalive = keepalive;
+            g_stageCopy.Add(PerfNowMs() - c1);
+            if (!queue.Push(std::move(pf))) g_pipelineDrops.fetch_add(1);
+            pushedTiles = curTiles;
+            pushedW = outW;
+            pushedH = outH;
+            g_outputWidth.store(outW);
+            g_outputHeight.store(outH);
+            lastPushMs = c1;
+        }
+        pacer.Wait();
+    }
+
+    queue.Close();
+    encoder.join();
+    jpegEncoder.reset();
+    source.reset();
+    factory->Release();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+    g_captureThreadRunning.store(false);
+}
+
+// ----------------------------
+// Cursor metadata (--cursor-meta)
+// ----------------------------
+
+// Renders a cursor into straight-alpha BGRA by drawing it on black and on white:
+// alpha = 255 - (white - black), colour = black / alpha. Inverting (XOR) pixels come out
+// as opaque, which is the closest a plain image can get.
+static bool RenderCursorBgra(HCURSOR cursor, int w, int h, std::vector<uint8_t>& out)
+{
+    if (!cursor || w <= 0 || h <= 0 || w > 256 || h > 256) return false;
+
+    HDC screenDC = GetDC(nullptr);
+    HDC memDC = screenDC ? CreateCompatibleDC(screenDC) : nullptr;
+    if (!memDC)
+    {
+        if (screenDC) ReleaseDC(nullptr, screenDC);
+        return false;
+    }
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = w;
+    bmi.bmiHeader.biHeight = -h; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    const size_t n = (size_t)w * (size_t)h;
+    std::vector<uint8_t> onBlack(n * 4);
+    bool ok = true;
+    for (int pass = 0; pass < 2 && ok; pass++)
+    {
+        void* bits = nullptr;
+        HBITMAP dib = CreateDIBSection(screenDC, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+        if (!dib || !bits)
+        {
+            if (dib) DeleteObject(dib);
+            ok = false;
+            break;
+        }
+        HGDIOBJ old = SelectObject(memDC, dib);
+        std::memset(bits, pass == 0 ? 0x00 : 0xFF, n * 4);
+        ok = DrawIconEx(memDC, 0, 0, cursor, w, h, 0, nullptr, DI_NORMAL) != FALSE;
+        GdiFlush();
+
+        const uint8_t* px = (const uint8_t*)bits;
+        if (pass == 0)
+        {
+            std::memcpy(onBlack.data(), px, n * 4);
+        }
+        else
+        {
+            out.resize(n * 4);
+            for (size_t i = 0; i < n; i++)
+            {
+                const uint8_t* b = onBlack.data() + i * 4;
+                const uint8_t* wh = px + i * 4;
+                const int diff = std::max({ wh[0] - b[0], wh[1] - b[1], wh[2] - b[2], 0 });
+                const int alpha = 255 - std::min(255, diff);
+                uint8_t* o = out.data() + i * 4;
+                for (int c = 0; c < 3; c++) o[c] = alpha ? (uint8_t)std::min(255, b[c] * 255 / alpha) : 0;
+                o[3] = (uint8_t)alpha;
+            }
+        }
+        SelectObject(memDC, old);
+        DeleteObject(dib);
+    }
+
+    DeleteDC(memDC);
+    ReleaseDC(nullptr, screenDC);
+    return ok;
+}
+
+static HRESULT EncodeBgraToPng(IWICImagingFactory* factory, const uint8_t* bgra, int w, int h, std::vector<uint8_t>& out)
+{
+    out.clear();
+    IWICBitmap* bmp = nullptr;
+    HRESULT hr = factory->CreateBitmapFromMemory((UINT)w, (UINT)h, GUID_WICPixelFormat32bppBGRA, (UINT)w * 4,
+        (UINT)((size_t)w * h * 4), const_cast<BYTE*>(bgra), &bmp);
+    if (FAILED(hr)) return hr;
+
+    IStream* stream = nullptr;
+    hr = CreateStreamOnHGlobal(nullptr, TRUE, &stream);
+    if (FAILED(hr))
+    {
+        bmp->Release();
+        return hr;
+    }
+
+    IWICBitmapEncoder* encoder = nullptr;
+    IWICBitmapFrameEncode* frame = nullptr;
+    hr = factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
+    if (SUCCEEDED(hr)) hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+    if (SUCCEEDED(hr)) hr = encoder->CreateNewFrame(&frame, nullptr);
+    if (SUCCEEDED(hr)) hr = frame->Initialize(nullptr);
+    if (SUCCEEDED(hr)) hr = frame->WriteSource(bmp, nullptr);
+    if (SUCCEEDED(hr)) hr = frame->Commit();
+    if (SUCCEEDED(hr)) hr = encoder->Commit();
+    if (frame) frame->Release();
+    if (encoder) encoder->Release();
+    bmp->Release();
+
+    HGLOBAL hg = nullptr;
+    if (SUCCEEDED(hr)) hr = GetHGlobalFromStream(stream, &hg);
+    if (SUCCEEDED(hr))
+    {
+        STATSTG stat{};
+        SIZE_T size = SUCCEEDED(stream->Stat(&stat, STATFLAG_NONAME)) ? (SIZE_T)stat.cbSize.QuadPart : GlobalSize(hg);
+        void* ptr = GlobalLock(hg);
+        if (ptr && size > 0)
+        {
+            out.assign((const uint8_t*)ptr, (const uint8_t*)ptr + size);
+        }
+        else
+        {
+            hr = E_FAIL;
+        }
+        if (ptr) GlobalUnlock(hg);
+    }
+    stream->Release();
+    return hr;
+}
+
+static uint64_t HashCursorShape(const std::vector<uint8_t>& bgra, int w, int h, int hotX, int hotY)
+{
+    uint64_t x = 0xcbf29ce484222325ull;
+    const int dims[4] = { w, h, hotX, hotY };
+    for (int d : dims)
+    {
+        x ^= (uint32_t)d;
+        x *= 0x100000001b3ull;
+    }
+    for (uint8_t b : bgra)
+    {
+        x ^= b;
+        x *= 0x100000001b3ull;
+    }
+    return x ? x : 1; // 0 = "no shape"
+}
+
+static void StoreCursorShape(uint64_t id, std::vector<uint8_t>&& png)
+{
+    std::lock_guard<std::mutex> lock(g_cursorShapesMtx);
+    for (const auto& e : g_cursorShapes)
+    {
+        if (e.first == id) return;
+    }
+    if (g_cursorShapes.size() >= kMaxCursorShapes) g_cursorShapes.erase(g_cursorShapes.begin());
+    g_cursorShapes.emplace_back(id, std::move(png));
+}
+
+static bool FindCursorShape(uint64_t id, std::vector<uint8_t>& png)
+{
+    std::lock_guard<std::mutex> lock(g_cursorShapesMtx);
+    for (const auto& e : g_cursorShapes)
+    {
+        if (e.first == id)
+        {
+            png = e.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Polls the cursor while /cursor clients are connected and publishes changes. A shape is
+// rendered + PNG-encoded once per HCURSOR change; position updates are a few bytes each.
+static void CursorTrackerThread(HANDLE stopEvent)
+{
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (FAILED(hr))
+    {
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        g_cursorThreadRunning.store(false);
+        return;
+    }
+
+    HCURSOR lastCursor = nullptr;
+    uint64_t shapeId = 0;
+    std::vector<uint8_t> bgra;
+    std::vector<uint8_t> png;
+
+    while (g_running.load())
+    {
+        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0) break;
+        if (g_cursorClientCount.load() <= 0)
+        {
+            lastCursor = nullptr;
+            Sleep(100);
+            continue;
+        }
+
+        const int originX = GetSystemMetrics(SM_XVIRTUALSCREEN);
+        const int originY = GetSystemMetrics(SM_YVIRTUALSCREEN);
+        CursorSnapshot cs;
+        const bool visible = GetCursorSnapshot(originX, originY, cs);
+        if (visible && cs.cursor != lastCursor)
+        {
+            lastCursor = cs.cursor;
+            shapeId = 0;
+            if (RenderCursorBgra(cs.cursor, cs.w, cs.h, bgra))
+            {
+                const uint64_t id = HashCursorShape(bgra, cs.w, cs.h, cs.hotX, cs.hotY);
+                std::vector<uint8_t> cached;
+                if (FindCursorShape(id, cached) || SUCCEEDED(EncodeBgraToPng(factory, bgra.data(), cs.w, cs.h, png)))
+                {
+                    if (cached.empty()) StoreCursorShape(id, std::move(png));
+                    shapeId = id;
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(g_sharedCursor.mtx);
+            SharedCursorState& s = g_sharedCursor;
+            const int x = cs.x + cs.hotX;
+            const int y = cs.y + cs.hotY;
+            const int sw = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+            const int sh = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+            const bool show = visible && shapeId != 0;
+            if (s.seq == 0 || show != s.visible || (show && (x != s.x || y != s.y || shapeId != s.shapeId)) ||
+                sw != s.screenW || sh != s.screenH)
+            {
+                s.visible = show;
+                s.x = x;
+                s.y = y;
+                s.hotX = cs.hotX;
+                s.hotY = cs.hotY;
+                s.width = cs.w;
+                s.height = cs.h;
+                s.screenW = sw;
+                s.screenH = sh;
+                s.shapeId = show ? shapeId : 0;
+                s.seq++;
+                s.cv.notify_all();
+            }
+        }
+        Sleep(kCursorPollMs);
+    }
+
+    factory->Release();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+    g_cursorThreadRunning.store(false);
+}
+
+// ----------------------------
+// gzip for cached HTTP responses
+// ----------------------------
+
+static uint32_t Crc32(const uint8_t* data, size_t len)
+{
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// LSB-first bit writer for deflate. Huffman codes are stored MSB-first, so they go through
+// PutCode, which reverses them.
+struct DeflateBitWriter
+{
+    std::string& out;
+    uint32_t acc = 0;
+    int bits = 0;
+
+    explicit DeflateBitWriter(std::string& o) : out(o) {}
+
+    void Put(uint32_t value, int count)
+    {
+        acc |= value << bits;
+        bits += count;
+        while (bits >= 8)
+        {
+            out.push_back((char)(acc & 0xFF));
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    void PutCode(uint32_t code, int count)
+    {
+        uint32_t rev = 0;
+        for (int i = 0; i < count; i++) rev |= ((code >> i) & 1) << (count - 1 - i);
+        Put(rev, count);
+    }
+
+    void Flush()
+    {
+        if (bits > 0) out.push_back((char)(acc & 0xFF));
+        acc = 0;
+        bits = 0;
+    }
+};
+
+static void DeflatePutLiteral(DeflateBitWriter& bw, int sym)
+{
+    if (sym < 144) bw.PutCode(0x30 + sym, 8);
+    else if (sym < 256) bw.PutCode(0x190 + (sym - 144), 9);
+    else if (sym < 280) bw.PutCode(sym - 256, 7);
+    else bw.PutCode(0xC0 + (sym - 280), 8);
+}
+
+static void DeflatePutMatch(DeflateBitWriter& bw, int length, int distance)
+{
+    static const int kLenBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int kLenExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+        4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int l = 28;
+    while (kLenBase[l] > length) l--;
+    DeflatePutLiteral(bw, 257 + l);
+    bw.Put((uint32_t)(length - kLenBase[l]), kLenExtra[l]);
+
+    int d = 29;
+    while (kDistBase[d] > distance) d--;
+    bw.PutCode((uint32_t)d, 5);
+    bw.Put((uint32_t)(distance - kDistBase[d]), kDistExtra[d]);
+}
+
+// One fixed-Huffman deflate block with hash-chain LZ77 over a 32 KB window. Not zlib's ratio,
+// but the landing page is compressed once per configuration, and this needs no library.
+static void DeflateFixed(const uint8_t* data, size_t len, std::string& out)
+{
+    static constexpr int kHashBits = 15;
+    static constexpr size_t kWindow = 32768;
+    static constexpr int kMaxChain = 64;
+    std::vector<int32_t> head((size_t)1 << kHashBits, -1);
+    std::vector<int32_t> prev(len, -1);
+    auto hash3 = [&](size_t i) {
+        return (((uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - kHashBits);
+    };
+
+    DeflateBitWriter bw(out);
+    bw.Put(1, 1); // BFINAL
+    bw.Put(1, 2); // BTYPE = fixed Huffman
+    size_t i = 0;
+    while (i < len)
+    {
+        int bestLen = 0;
+        size_t bestDist = 0;
+        if (i + 3 <= len)
+        {
+            const uint32_t h = hash3(i);
+            const size_t maxLen = std::min<size_t>(258, len - i);
+            int chain = kMaxChain;
+            for (int32_t cand = head[h]; cand >= 0 && i - (size_t)cand <= kWindow && chain-- > 0; cand = prev[(size_t)cand])
+            {
+                size_t n = 0;
+                while (n < maxLen && data[(size_t)cand + n] == data[i + n]) n++;
+                if ((int)n > bestLen)
+                {
+                    bestLen = (int)n;
+                    bestDist = i - (size_t)cand;
+                    if (n == maxLen) break;
+                }
+            }
+        }
+
+        const size_t advance = bestLen >= 3 ? (size_t)bestLen : 1;
+        if (bestLen >= 3) DeflatePutMatch(bw, bestLen, (int)bestDist);
+        else DeflatePutLiteral(bw, data[i]);
+        for (size_t k = 0; k < advance; k++, i++)
+        {
+            if (i + 3 > len) continue;
+            const uint32_t h = hash3(i);
+            prev[i] = head[h];
+            head[h] = (int32_t)i;
+        }
+    }
+    DeflatePutLiteral(bw, 256);
+    bw.Flush();
+}
+
+static std::string GzipCompress(const std::string& data)
+{
+    static const uint8_t kHeader[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff }; // deflate, no name/mtime, OS unknown
+    std::string out((const char*)kHeader, sizeof(kHeader));
+    DeflateFixed((const uint8_t*)data.data(), data.size(), out);
+    const uint32_t crc = Crc32((const uint8_t*)data.data(), data.size());
+    const uint32_t size = (uint32_t)data.size();
+    for (int i = 0; i < 4; i++) out.push_back((char)((crc >> (8 * i)) & 0xFF));
+    for (int i = 0; i < 4; i++) out.push_back((char)((size >> (8 * i)) & 0xFF));
+    return out;
+}
+
+// ----------------------------
+// HTTP MJPEG server (WinSock)
+// ----------------------------
+
+static std::string FormatFixed(double v, int decimals)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    return buf;
+}
+
+static bool QueryGetString(const std::string& query, const char* key, std::string& out)
+{
+    // very small query parser: key=value&...
+    std::string k(key);
+    size_t pos = 0;
+    while (pos < query.size())
+    {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        std::string part = query.substr(pos, amp - pos);
+        size_t eq = part.find('=');
+        std::string pk = (eq == std::string::npos) ? part : part.substr(0, eq);
+        std::string pv = (eq == std::string::npos) ? "" : part.substr(eq + 1);
+        if (pk == k)
+        {
+            out = pv;
+            return true;
+        }
+        pos = amp + 1;
+    }
+    return false;
+}
+
+static bool QueryGetInt(const std::string& query, const char* key, int& out)
+{
+    std::string v;
+    if (!QueryGetString(query, key, v)) return false;
+    out = std::atoi(v.c_str());
+    return true;
+}
+
+static bool SendHttpText(SOCKET client, const char* contentType, const std::string& body)
+{
+    char hdr[512];
+    std::snprintf(hdr, sizeof(hdr),
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Pragma: no-cache\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "\r\n",
+        contentType,
+        body.size());
+
+    if (!SendAll(client, hdr, (int)std::strlen(hdr))) return false;
+    return SendAll(client, body.data(), (int)body.size());
+}
+
+static bool SendHttpNotFound(SOCKET client)
+{
+    const char* resp =
+        "HTTP/1.1 404 Not Found\r\n"
+        "Connection: close\r\n"
+        "Content-Type: text/plain; charset=utf-8\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "Not found\n";
+    return SendAll(client, resp, (int)std::strlen(resp));
+}
+
+static std::string MakeLandingHtml(uint16_t port)
+{
+    // NOTE: Most browsers block autoplay audio until a user gesture.
+    char buf[65536];
+    const bool priv = g_httpAuthEnabled;
+    std::snprintf(buf, sizeof(buf),
+        "<!doctype html><html><head><meta charset='utf-8'>"
+        "<meta name='viewport' content='width=device-width, initial-scale=1'>"
+        "<title>LANSCR</title>"
+        "<style>"
+        ":root{--primary:#12c780;--primary-dark:#0ea06a;--accent:#22b8ff;--accent-dark:#0b9ddf;--dark:#0b1220;--txt:#eaf6ff;--mut:rgba(234,246,255,.82);--card:rgba(255,255,255,.10);--bd:rgba(255,255,255,.16);--shadow:0 16px 45px rgba(2,12,27,.22);}"
+        "*{box-sizing:border-box}"
+        "body{margin:0;font-family:system-ui,-apple-system,Segoe UI,Inter,Arial;background:radial-gradient(1200px 600px at 10%% 0%%,rgba(18,199,128,0.10),transparent 55%%),radial-gradient(900px 500px at 90%% 20%%,rgba(34,184,255,0.12),transparent 60%%),linear-gradient(135deg,#071018 0%%,#0a1626 100%%);color:var(--txt);}"
+        "a{color:rgba(210,248,255,.95);text-decoration:none}a:hover{text-decoration:underline}"
+        "@keyframes fadeIn{0%%{opacity:0;transform:translateY(14px)}100%%{opacity:1;transform:translateY(0)}}"
+        ".animate-in{animation:fadeIn .6s ease forwards}"
+        ".wrap{max-width:1180px;margin:0 auto;padding:18px;}"
+        ".hero{padding:22px 0 16px;text-align:left;background:linear-gradient(135deg,var(--primary) 0%%,var(--accent) 100%%);color:white;border-radius:0 0 26px 26px;position:relative;overflow:hidden;}"
+        ".hero:before{content:'';position:absolute;inset:0;background:radial-gradient(900px 420px at 10%% 0%%,rgba(255,255,255,.16),transparent 55%%),radial-gradient(900px 420px at 95%% 25%%,rgba(255,255,255,.12),transparent 60%%);pointer-events:none;}"
+        ".hero .wrap{position:relative}"
+        ".top{display:flex;gap:12px;align-items:center;justify-content:space-between;flex-wrap:wrap;}"
+        ".brand{display:flex;align-items:center;gap:10px;font-weight:900;font-size:18px;letter-spacing:.4px;}"
+        ".logo{width:34px;height:34px;border-radius:10px;background:linear-gradient(135deg,rgba(255,255,255,.98),rgba(255,255,255,.82));box-shadow:0 14px 30px rgba(2,12,27,.22);}"
+        ".pill{display:inline-flex;align-items:center;gap:10px;padding:8px 12px;border-radius:999px;background:rgba(255,255,255,.16);border:1px solid rgba(255,255,255,.22);}"
+        ".badge{display:inline-flex;align-items:center;gap:8px;padding:6px 10px;border-radius:999px;font-size:12px;background:rgba(0,0,0,.20);border:1px solid rgba(255,255,255,.18);}"
+        ".tabs{display:flex;gap:8px;flex-wrap:wrap;margin-top:12px;}"
+        ".tab{appearance:none;border:1px solid rgba(255,255,255,.16);background:rgba(255,255,255,.05);color:var(--txt);padding:10px 12px;border-radius:12px;cursor:pointer;font-weight:800;}"
+        ".tab.on{background:linear-gradient(135deg,rgba(18,199,128,.98),rgba(34,184,255,.98));color:#08131f;border:0}"
+        ".panel{display:none;margin-top:12px;}"
+        ".panel.on{display:block;}"
+        ".grid{display:grid;grid-template-columns:1.35fr .65fr;gap:14px;}"
+        "@media (max-width:980px){.grid{grid-template-columns:1fr;}}"
+        ".card{background:var(--card);border:1px solid var(--bd);border-radius:16px;overflow:hidden;box-shadow:var(--shadow);backdrop-filter:blur(14px);}"
+        ".card h3{margin:0;padding:14px 16px;border-bottom:1px solid var(--bd);font-size:14px;font-weight:900;opacity:.98;display:flex;justify-content:space-between;align-items:center;}"
+        ".card .body{padding:14px 16px;}"
+        ".btn{appearance:none;border:0;border-radius:12px;padding:10px 12px;font-weight:900;cursor:pointer;color:#08131f;background:linear-gradient(135deg,rgba(18,199,128,.98),rgba(34,184,255,.98));transition:transform .12s ease,filter .12s ease;}"
+        ".btn:hover{transform:translateY(-1px);filter:brightness(1.03);}"
+        ".btn2{appearance:none;border:1px solid rgba(255,255,255,.18);border-radius:12px;padding:10px 12px;font-weight:900;cursor:pointer;color:var(--txt);background:rgba(255,255,255,.06);transition:transform .12s ease,filter .12s ease;}"
+        ".btn2:hover{transform:translateY(-1px);filter:brightness(1.05);}"
+        ".row{display:flex;gap:10px;flex-wrap:wrap;margin-top:10px;}"
+        ".muted{opacity:.88;font-size:13px;line-height:1.45;color:var(--mut);}"
+        ".video{display:block;width:100%%;background:#000;}"
+        ".kv{display:grid;grid-template-columns:120px 1fr;gap:6px 10px;margin-top:10px;font-size:13px;opacity:.92}"
+        ".kv b{opacity:.92}"
+        "</style></head><body><section class='hero animate-in'><div class='wrap'>"
+        "<div class='top'>"
+        "<div class='brand'><div class='logo'></div> LANSCR <span class='badge'>Live Screen + Audio</span>%s</div>"
+        "<div class='pill'><span class='badge' id='mode'>%s</span> <span>Host: <b id='host'></b></span></div>"
+        "</div></div></section><div class='wrap'>"
+        "<div class='tabs'>"
+        "<button class='tab on' data-tab='video'>Video</button>"
+        "<button class='tab' data-tab='settings'>Settings</button>"
+        "<button class='tab' data-tab='about'>About</button>"
+        "</div>"
+
+        "<div class='panel on' id='p-video'>"
+        "<div class='grid'>"
+        "<div class='card'><h3>Screen <span class='badge'><a href='/?player=mjpeg' rel='nofollow'>MJPEG player</a></span></h3><div id='vwrap' style='position:relative'><canvas id='cv' class='video'></canvas><img id='vid' class='video' alt='stream' style='display:none'><img id='cur' alt='' style='position:absolute;left:0;top:0;display:none;pointer-events:none'></div></div>"
+        "<div class='card'><h3>Quick Controls <span class='badge' id='st'>Loading...</span></h3><div class='body'>"
+        "<div class='row'>"
+        "<button class='btn2' id='fs'>Full Screen</button>"
+        "<button class='btn2' id='cp'>Copy Link</button>"
+        "</div>"
+        "<div class='kv'>"
+        "<b>Links</b><span><a href='/' rel='nofollow'>Home</a> | <a href='/mjpeg' rel='nofollow'>Video</a> | <a href='/audio' rel='nofollow'>Audio</a></span>"
+        "<b>Share</b><span id='lnk' style='opacity:.95'></span></span>"
+        "<b>Player</b><span id='pl'></span>"
+        "<b>Latency</b><span id='lat'>-</span>"
+        "</div>"
+        "<p class='muted' style='margin-top:10px'>Tip: Open this link on a phone on the same Wi-Fi for a live view.</p>"
+        "</div></div>"
+        "</div>"
+        "</div>"
+
+        "<div class='panel' id='p-settings'>"
+        "<div class='grid'>"
+        "<div class='card'><h3>Audio <span class='badge'><a href='/audio' rel='nofollow'>/audio</a></span></h3><div class='body'>"
+        "<div class='row'>"
+        "<button class='btn' id='en'>Enable Audio</button>"
+        "<button class='btn2' id='mb'>Mute/Unmute Browser</button>"
+        "<button class='btn2' id='mt'>Mute/Unmute Server</button>"
+        "</div>"
+        "<audio id='a' controls style='width:100%%;margin-top:12px' src='/audio'></audio>"
+        "<p class='muted' style='margin-top:10px'>Browser audio may need a click due to autoplay rules.</p>"
+        "</div></div>"
+        "<div class='card'><h3>Status</h3><div class='body'>"
+        "<div class='kv'>"
+        "<b>Private</b><span id='priv'></span>"
+        "<b>Server mute</b><span id='sm'></span>"
+        "<b>Port</b><span id='prt'></span>"
+        "<b>Viewers</b><span id='vw'></span>"
+        "<b>Frame rate</b><span id='fr'></span>"
+        "<b>Bitrate</b><span id='br'></span>"
+        "</div>"
+        "<div class='row'><button class='btn2' id='rf'>Refresh</button></div>"
+        "</div></div>"
+        "</div>"
+        "</div>"
+
+        "<div class='panel' id='p-about'>"
+        "<div class='grid'>"
+        "<div class='card'><h3>Project</h3><div class='body'>"
+        "<p class='muted'>LANSCR is a lightweight LAN screen + audio sharing tool (MJPEG video + WAV audio). Open from any browser on the same network.</p>"
+        "<div class='kv'>"
+        "<b>Website</b><span><a href='http://info.likhil.42web.io/lanscr' target='_blank' rel='nofollow'>info.likhil.42web.io/lanscr</a></span>"
+        "<b>GitHub</b><span><a href='https://github.com/pidugulikhil/LANSCR' target='_blank' rel='nofollow'>pidugulikhil/LANSCR</a></span>"
+        "<b>Releases</b><span><a href='https://github.com/pidugulikhil/LANSCR/releases' target='_blank' rel='nofollow'>Download builds</a></span>"
+        "</div>"
+        "</div></div>"
+        "<div class='card'><h3>Social / Bio</h3><div class='body'>"
+        "<p class='muted'>Follow the links above for updates, releases, and source.</p>"
+        "</div></div>"
+        "</div>"
+        "</div>"
+
+        "</div><script>"
+        "const a=document.getElementById('a');"
+        "const st=document.getElementById('st');"
+        "const host=document.getElementById('host');host.textContent=location.host||(':'+location.port);"
+        "const lnk=document.getElementById('lnk');lnk.textContent=location.href;"
+        "const privEl=document.getElementById('priv');"
+        "const smEl=document.getElementById('sm');"
+        "const prtEl=document.getElementById('prt');"
+        "const vwEl=document.getElementById('vw');const frEl=document.getElementById('fr');const brEl=document.getElementById('br');"
+
+        "function setTab(name){document.querySelectorAll('.tab').forEach(b=>b.classList.toggle('on',b.dataset.tab===name));"
+        "document.getElementById('p-video').classList.toggle('on',name==='video');"
+        "document.getElementById('p-settings').classList.toggle('on',name==='settings');"
+        "document.getElementById('p-about').classList.toggle('on',name==='about');}"
+        "document.querySelectorAll('.tab').forEach(b=>b.onclick=()=>setTab(b.dataset.tab));"
+
+        "document.getElementById('en').onclick=()=>{a.muted=false;a.play().catch(()=>{});};"
+        "document.getElementById('mb').onclick=()=>{a.muted=!a.muted;st.textContent=a.muted?'Browser muted':'Browser unmuted';setTimeout(()=>show(last),500);};"
+        "document.getElementById('fs').onclick=()=>{const el=document.getElementById('vwrap');(el.requestFullscreen||el.webkitRequestFullscreen||el.msRequestFullscreen||(()=>{})).call(el);};"
+        "document.getElementById('cp').onclick=()=>{navigator.clipboard&&navigator.clipboard.writeText(location.href).then(()=>{st.textContent='Link copied';setTimeout(()=>show(last),800);}).catch(()=>{});};"
+        "document.getElementById('rf').onclick=()=>fetch('/control',{cache:'no-store'}).then(r=>r.json()).then(show).catch(()=>{});"
+        // Status is pushed over one /events connection (Server-Sent Events) instead of polled.
+        "let last=null,cursorStarted=false;"
+        "function show(j){if(!j)return;last=j;"
+        "st.textContent=j.audioMuted?'Server audio muted':'Server audio on';"
+        "if(privEl) privEl.textContent=j.privateMode?'ON':'OFF';"
+        "if(smEl) smEl.textContent=j.audioMuted?'Muted':'Unmuted';"
+        "if(prtEl) prtEl.textContent=j.port;"
+        "if(vwEl&&j.viewers!==undefined) vwEl.textContent=j.viewers;"
+        "if(frEl&&j.fps!==undefined) frEl.textContent=j.fps.toFixed(1)+' fps';"
+        "if(brEl&&j.kbps!==undefined) brEl.textContent=(j.kbps>=1000?(j.kbps/1000).toFixed(1)+' Mbps':j.kbps.toFixed(0)+' kbps');"
+        "if(j.cursorMeta&&!cursorStarted){cursorStarted=true;cursorLoop();}}"
+        "const es=new EventSource('/events');"
+        "es.onmessage=e=>{try{show(JSON.parse(e.data));}catch(x){}};"
+        "es.onerror=()=>{st.textContent='Reconnecting...';};"
+        "async function toggleMute(){try{const want=last&&last.audioMuted?0:1;const r=await fetch('/control?mute='+want,{cache:'no-store'});show(await r.json());}catch(e){}}"
+        "document.getElementById('mt').onclick=toggleMute;"
+        // Default player: /ws binary frames drawn on a canvas, one at a time, each acked once drawn so
+        // the server never has more than two frames in flight. ?player=mjpeg (or no WebSocket) uses <img>.
+        "const cv=document.getElementById('cv');const vid=document.getElementById('vid');"
+        "const latEl=document.getElementById('lat');const plEl=document.getElementById('pl');let view=cv;"
+        "function useMjpeg(){if(view===vid)return;view=vid;cv.style.display='none';vid.style.display='block';vid.src='/mjpeg';plEl.textContent='MJPEG';latEl.textContent='n/a';}"
+        "function startWs(){if(!window.WebSocket||!window.createImageBitmap||new URLSearchParams(location.search).get('player')==='mjpeg'){useMjpeg();return;}"
+        "plEl.textContent='WebSocket';const ctx=cv.getContext('2d');let chain=Promise.resolve(),got=false;"
+        "const ws=new WebSocket((location.protocol==='https:'?'wss://':'ws://')+location.host+'/ws');ws.binaryType='arraybuffer';"
+        "ws.onmessage=e=>{got=true;const t0=performance.now();const d=e.data;const dv=new DataView(d);"
+        "const hb=dv.getUint32(4,true);const seq=dv.getFloat64(8,true);const lat=dv.getFloat64(16,true);"
+        "chain=chain.then(()=>createImageBitmap(new Blob([new Uint8Array(d,hb)],{type:'image/jpeg'})))"
+        ".then(b=>{if(cv.width!==b.width||cv.height!==b.height){cv.width=b.width;cv.height=b.height;}ctx.drawImage(b,0,0);b.close();})"
+        ".catch(()=>{}).then(()=>{const ack=new DataView(new ArrayBuffer(16));ack.setFloat64(0,seq,true);ack.setFloat64(8,performance.now()-t0,true);"
+        "if(ws.readyState===1)ws.send(ack.buffer);if(lat>0)latEl.textContent=lat.toFixed(0)+' ms';});};"
+        "ws.onclose=()=>{if(!got)useMjpeg();else setTimeout(startWs,1000);};}"
+        "startWs();"
+        // --cursor-meta: the pointer is not in the video; draw it from the /cursor stream.
+        "const cur=document.getElementById('cur');"
+        "async function cursorLoop(){try{const r=await fetch('/cursor',{cache:'no-store'});if(!r.ok||!r.body)return;"
+        "const rd=r.body.getReader();const dec=new TextDecoder();let buf='',id='';"
+        "for(;;){const x=await rd.read();if(x.done)break;buf+=dec.decode(x.value,{stream:true});let i;"
+        "while((i=buf.indexOf('\\n'))>=0){const ln=buf.slice(0,i);buf=buf.slice(i+1);if(!ln)continue;const c=JSON.parse(ln);"
+        "if(!c.v||!c.w){cur.style.display='none';continue;}"
+        "if(c.id!==id){id=c.id;cur.src='/cursor.png?id='+id;}"
+        "const s=view.clientWidth/c.w;cur.style.width=(c.cw*s)+'px';"
+        "cur.style.transform='translate('+((c.x-c.hx)*s)+'px,'+((c.y-c.hy)*s)+'px)';cur.style.display='block';}}"
+        "}catch(e){}setTimeout(cursorLoop,2000);}"
+        "</script></body></html>",
+        priv ? " <span class='badge'>Private</span>" : "",
+        priv ? "Private" : "Public");
+    return std::string(buf);
+}
+
+// Connection: close wins; otherwise HTTP/1.1 keeps the connection open and 1.0 only on request.
+static bool WantsKeepAlive(const HttpRequest& req)
+{
+    const std::string* conn = req.Header("connection");
+    if (conn)
+    {
+        std::string v = *conn;
+        for (char& ch : v) ch = (char)std::tolower((unsigned char)ch);
+        if (v.find("close") != std::string::npos) return false;
+        if (v.find("keep-alive") != std::string::npos) return true;
+    }
+    return req.minorVersion >= 1;
+}
+
+// Accept-Encoding: "gzip" (or "*") with a non-zero q value.
+static bool AcceptsGzip(const HttpRequest& req)
+{
+    const std::string* ae = req.Header("accept-encoding");
+    if (!ae) return false;
+    bool star = false;
+    size_t pos = 0;
+    while (pos <= ae->size())
+    {
+        size_t comma = ae->find(',', pos);
+        if (comma == std::string::npos) comma = ae->size();
+        std::string item = TrimAscii(ae->substr(pos, comma - pos));
+        pos = comma + 1;
+        double q = 1.0;
+        const size_t semi = item.find(';');
+        if (semi != std::string::npos)
+        {
+            const size_t qpos = item.find("q=", semi);
+            if (qpos != std::string::npos) q = std::strtod(item.c_str() + qpos + 2, nullptr);
+            item = TrimAscii(item.substr(0, semi));
+        }
+        for (char& ch : item) ch = (char)std::tolower((unsigned char)ch);
+        if (item == "gzip" || item == "x-gzip") return q > 0.0;
+        if (item == "*") star = q > 0.0;
+    }
+    return star;
+}
+
+// If-None-Match lists the tag (weak or strong), or is "*".
+static bool IfNoneMatchHits(const HttpRequest& req, const std::string& etag)
+{
+    const std::string* inm = req.Header("if-none-match");
+    if (!inm) return false;
+    size_t pos = 0;
+    while (pos <= inm->size())
+    {
+        size_t comma = inm->find(',', pos);
+        if (comma == std::string::npos) comma = inm->size();
+        std::string tag = TrimAscii(inm->substr(pos, comma - pos));
+        pos = comma + 1;
+        if (IStartsWith(tag, "W/")) tag = tag.substr(2);
+        if (tag == "*" || tag == etag) return true;
+    }
+    return false;
+}
+
+// Status line and headers. contentType null = no body (304).
+static std::string MakeHttpResponseHead(const char* status, const char* contentType, size_t length, bool keepAlive,
+    const std::string& extraHeaders)
+{
+    std::string head = std::string("HTTP/1.1 ") + status + "\r\n";
+    head += keepAlive ? "Connection: keep-alive\r\nKeep-Alive: timeout=30\r\n" : "Connection: close\r\n";
+    if (contentType)
+    {
+        head += std::string("Content-Type: ") + contentType + "\r\n";
+        head += "Content-Length: " + std::to_string((unsigned long long)length) + "\r\n";
+    }
+    head += extraHeaders;
+    head += "\r\n";
+    return head;
+}
+
+// A page rendered once and kept as sent: body, gzip body and validator.
+struct CachedHttpAsset
+{
+    std::string contentType;
+    std::string etag; // quoted, for the identity body; the gzip body's tag has "-gz" added
+    std::string identity;
+    std::string gzip;
+};
+
+static std::mutex g_landingPageMtx;
+static std::shared_ptr<const CachedHttpAsset> g_landingPage;
+static bool g_landingPagePrivate = false;
+static uint16_t g_landingPagePort = 0;
+
+// The landing page only depends on the port and private mode, so it is rendered and compressed
+// again only when one of them changes.
+static std::shared_ptr<const CachedHttpAsset> GetLandingPage(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(g_landingPageMtx);
+    if (g_landingPage && g_landingPagePrivate == g_httpAuthEnabled && g_landingPagePort == port) return g_landingPage;
+
+    std::shared_ptr<CachedHttpAsset> page = std::make_shared<CachedHttpAsset>();
+    page->contentType = "text/html; charset=utf-8";
+    page->identity = MakeLandingHtml(port);
+    page->gzip = GzipCompress(page->identity);
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (unsigned char ch : page->identity) h = (h ^ ch) * 1099511628211ull;
+    char tag[32];
+    std::snprintf(tag, sizeof(tag), "\"%016llx\"", (unsigned long long)h);
+    page->etag = tag;
+
+    g_landingPage = page;
+    g_landingPagePrivate = g_httpAuthEnabled;
+    g_landingPagePort = port;
+    if (g_verbose) LogInfo("Landing page rendered: %zu bytes, gzip %zu bytes\n", page->identity.size(), page->gzip.size());
+    return g_landingPage;
+}
+
+static bool SendWavHeaderPcm16(SOCKET client, int sampleRate, int channels)
+{
+    // Streaming WAV with unknown total size: use 0xFFFFFFFF placeholders.
+    uint8_t hdr[44] = {};
+    auto w32 = [&](int off, uint32_t v) {
+        hdr[off + 0] = (uint8_t)(v & 0xFF);
+        hdr[off + 1] = (uint8_t)((v >> 8) & 0xFF);
+        hdr[off + 2] = (uint8_t)((v >> 16) & 0xFF);
+        hdr[off + 3] = (uint8_t)((v >> 24) & 0xFF);
+    };
+    auto w16 = [&](int off, uint16_t v) {
+        hdr[off + 0] = (uint8_t)(v & 0xFF);
+        hdr[off + 1] = (uint8_t)((v >> 8) & 0xFF);
+    };
+
+    // RIFF
+    hdr[0] = 'R'; hdr[1] = 'I'; hdr[2] = 'F'; hdr[3] = 'F';
+    w32(4, 0xFFFFFFFF);
+    hdr[8] = 'W'; hdr[9] = 'A'; hdr[10] = 'V'; hdr[11] = 'E';
+
+    // fmt 
+    hdr[12] = 'f'; hdr[13] = 'm'; hdr[14] = 't'; hdr[15] = ' ';
+    w32(16, 16);
+    w16(20, 1); // PCM
+    w16(22, (uint16_t)channels);
+    w32(24, (uint32_t)sampleRate);
+    uint16_t blockAlign = (uint16_t)(channels * 2);
+    uint32_t byteRate = (uint32_t)sampleRate * (uint32_t)blockAlign;
+    w32(28, byteRate);
+    w16(32, blockAlign);
+    w16(34, 16);
+
+    // data
+    hdr[36] = 'd'; hdr[37] = 'a'; hdr[38] = 't'; hdr[39] = 'a';
+    w32(40, 0xFFFFFFFF);
+
+    return SendAll(client, hdr, (int)sizeof(hdr));
+}
+
+static inline int16_t FloatToS16(float f)
+{
+    if (f > 1.0f) f = 1.0f;
+    if (f < -1.0f) f = -1.0f;
+    return (int16_t)std::lrintf(f * 32767.0f);
+}
+
+// ----------------------------
+// Shared audio capture (/audio)
+// ----------------------------
+
+// Where /audio samples come from. Start opens the source and reports its format; Read waits up
+// to waitMs for the next packet and appends it to out as interleaved PCM16 (nothing appended =
+// no packet yet).
+struct AudioSource
+{
+    virtual ~AudioSource() {}
+    virtual const char* Name() const = 0;
+    virtual HRESULT Start(int& sampleRate, int& channels) = 0;
+    virtual HRESULT Read(std::vector<int16_t>& out, int waitMs) = 0;
+};
+
+// WASAPI loopback of the default render device (what the speakers play). COM must be
+// initialized on the calling thread.
+struct LoopbackAudioSource : AudioSource
+{
+    IMMDeviceEnumerator* enumerator = nullptr;
+    IMMDevice* device = nullptr;
+    IAudioClient* audioClient = nullptr;
+    IAudioCaptureClient* capture = nullptr;
+    WAVEFORMATEX* mix = nullptr;
+    bool isFloat = false;
+    bool isPcm16 = false;
+    bool started = false;
+
+    ~LoopbackAudioSource() override
+    {
+        if (started) (void)audioClient->Stop();
+        if (mix) CoTaskMemFree(mix);
+        if (capture) capture->Release();
+        if (audioClient) audioClient->Release();
+        if (device) device->Release();
+        if (enumerator) enumerator->Release();
+    }
+
+    const char* Name() const override { return "loopback"; }
+
+    HRESULT Start(int& sampleRate, int& channels) override
+    {
+        HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&enumerator));
+        if (FAILED(hr)) return hr;
+        hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+        if (FAILED(hr)) return hr;
+        hr = device->Activate(__uuidof(IAudioClient), CLSCTX_INPROC_SERVER, nullptr, (void**)&audioClient);
+        if (FAILED(hr)) return hr;
+        hr = audioClient->GetMixFormat(&mix);
+        if (FAILED(hr) || !mix) return FAILED(hr) ? hr : E_FAIL;
+
+        // Shared-mode loopback must use the mix format.
+        REFERENCE_TIME hnsBuffer = 10000000; // 1 second
+        hr = audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK, hnsBuffer, 0, mix, nullptr);
+        if (FAILED(hr)) return hr;
+        hr = audioClient->GetService(IID_PPV_ARGS(&capture));
+        if (FAILED(hr)) return hr;
+
+        if (mix->wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
+        {
+            isFloat = true;
+        }
+        else if (mix->wFormatTag == WAVE_FORMAT_PCM && mix->wBitsPerSample == 16)
+        {
+            isPcm16 = true;
+        }
+        else if (mix->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+        {
+            auto* ext = (WAVEFORMATEXTENSIBLE*)mix;
+            if (ext->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT) isFloat = true;
+            if (ext->SubFormat == KSDATAFORMAT_SUBTYPE_PCM && mix->wBitsPerSample == 16) isPcm16 = true;
+        }
+        channels = mix->nChannels ? (int)mix->nChannels : 2;
+        sampleRate = mix->nSamplesPerSec ? (int)mix->nSamplesPerSec : 48000;
+
+        hr = audioClient->Start();
+        started = SUCCEEDED(hr);
+        return hr;
+    }
+
+    HRESULT Read(std::vector<int16_t>& out, int waitMs) override
+    {
+        UINT32 packetFrames = 0;
+        HRESULT hr = capture->GetNextPacketSize(&packetFrames);
+        if (FAILED(hr)) return hr;
+        if (packetFrames == 0)
+        {
+            Sleep((DWORD)std::min(5, waitMs));
+            return S_OK;
+        }
+
+        BYTE* data = nullptr;
+        UINT32 frames = 0;
+        DWORD flags = 0;
+        hr = capture->GetBuffer(&data, &frames, &flags, nullptr, nullptr);
+        if (FAILED(hr)) return hr;
+
+        const size_t samples = (size_t)frames * (size_t)mix->nChannels;
+        const size_t at = out.size();
+        out.resize(at + samples);
+        int16_t* dst = out.data() + at;
+        if ((flags & AUDCLNT_BUFFERFLAGS_SILENT) || (!isPcm16 && !isFloat))
+        {
+            // Unknown mix formats play as silence.
+            std::memset(dst, 0, samples * sizeof(int16_t));
+        }
+        else if (isPcm16)
+        {
+            std::memcpy(dst, data, samples * sizeof(int16_t));
+        }
+        else
+        {
+            const float* f = (const float*)data;
+            for (size_t s = 0; s < samples; s++) dst[s] = FloatToS16(f[s]);
+        }
+        return capture->ReleaseBuffer(frames);
+    }
+};
+
+// A sine tone (a different pitch per channel) paced by the clock in 10 ms packets, so /audio
+// can be tested and benchmarked without an audio device.
+struct SyntheticAudioSource : AudioSource
+{
+    static constexpr int kRate = 48000;
+    static constexpr int kChannels = 2;
+    static constexpr int kPacketFrames = kRate / 100;
+
+    double hz;
+    uint64_t frame = 0;
+    double startMs = 0.0;
+
+    explicit SyntheticAudioSource(double toneHz) : hz(toneHz) {}
+
+    const char* Name() const override { return "synthetic"; }
+
+    HRESULT Start(int& sampleRate, int& channels) override
+    {
+        sampleRate = kRate;
+        channels = kChannels;
+        startMs = PerfNowMs();
+        return S_OK;
+    }
+
+    HRESULT Read(std::vector<int16_t>& out, int waitMs) override
+    {
+        const double dueMs = startMs + (double)(frame + kPacketFrames) * 1000.0 / kRate;
+        const double now = PerfNowMs();
+        if (now < dueMs)
+        {
+            Sleep((DWORD)std::min((double)waitMs, std::ceil(dueMs - now)));
+            return S_OK;
+        }
+        const size_t at = out.size();
+        out.resize(at + (size_t)kPacketFrames * kChannels);
+        int16_t* dst = out.data() + at;
+        for (int i = 0; i < kPacketFrames; i++, frame++)
+        {
+            const double t = (double)frame / kRate;
+            for (int ch = 0; ch < kChannels; ch++)
+            {
+                *dst++ = (int16_t)std::lrint(8000.0 * std::sin(2.0 * 3.14159265358979 * hz * (ch + 1) * t));
+            }
+        }
+        return S_OK;
+    }
+};
+
+// "loopback" (default) or "synthetic[:Hz]".
+static std::unique_ptr<AudioSource> CreateAudioSource(const std::string& spec)
+{
+    if (spec.empty() || spec == "loopback") return std::make_unique<LoopbackAudioSource>();
+    if (spec.compare(0, 9, "synthetic") == 0)
+    {
+        double hz = 440.0;
+        if (spec.size() > 10 && spec[9] == ':')
+        {
+            const double v = std::strtod(spec.c_str() + 10, nullptr);
+            if (v > 0.0 && v < 20000.0) hz = v;
+        }
+        return std::make_unique<SyntheticAudioSource>(hz);
+    }
+    return nullptr;
+}
+
+// Single-writer, many-reader ring of interleaved PCM16 samples, addressed by the total number
+// of samples written. Neither side locks (a seqlock): the writer marks how far it is about to
+// overwrite, copies, then publishes the new total, and a reader checks after its copy that
+// the marker has not come round onto what it read.
+struct AudioRing
+{
+    static constexpr size_t kCapacity = (size_t)1 << 18; // samples (2.7 s of 48 kHz stereo)
+    static constexpr size_t kMaxWrite = (size_t)1 << 14; // per publish
+
+    std::unique_ptr<int16_t[]> samples{ new int16_t[kCapacity] };
+    std::atomic<uint64_t> written{ 0 }; // samples published
+    std::atomic<uint64_t> writing{ 0 }; // samples the writer may be overwriting, >= written
+
+    uint64_t Written() const { return written.load(std::memory_order_acquire); }
+
+    void Write(const int16_t* data, size_t n)
+    {
+        while (n > 0)
+        {
+            const size_t chunk = std::min(n, kMaxWrite);
+            const uint64_t pos = written.load(std::memory_order_relaxed);
+            const size_t at = (size_t)(pos % kCapacity);
+            const size_t first = std::min(chunk, kCapacity - at);
+            // Announce the overwrite before touching the samples: a reader that saw any of the
+            // new samples sees the marker after its acquire fence.
+            writing.store(pos + chunk, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(samples.get() + at, data, first * sizeof(int16_t));
+            std::memcpy(samples.get(), data + first, (chunk - first) * sizeof(int16_t));
+            written.store(pos + chunk, std::memory_order_release);
+            data += chunk;
+            n -= chunk;
+        }
+    }
+
+    // Whether samples from pos on survive writes up to w.
+    bool Holds(uint64_t pos, uint64_t w) const { return pos + kCapacity >= w; }
+
+    // Copies up to max samples from cursor on and advances it. Returns the count (0 = nothing
+    // new), or -1 when the writer overwrote them meanwhile (cursor unchanged). A seqlock read:
+    // the copy only counts if the writer's overwrite marker stayed clear of it.
+    long long Read(uint64_t& cursor, int16_t* out, size_t max) const
+    {
+        const uint64_t w = Written();
+        if (cursor >= w) return 0;
+        if (!Holds(cursor, writing.load(std::memory_order_relaxed))) return -1;
+        const size_t n = (size_t)std::min<uint64_t>(max, w - cursor);
+        const size_t at = (size_t)(cursor % kCapacity);
+        const size_t first = std::min(n, kCapacity - at);
+        std::memcpy(out, samples.get() + at, first * sizeof(int16_t));
+        std::memcpy(out + first, samples.get(), (n - first) * sizeof(int16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!Holds(cursor, writing.load(std::memory_order_relaxed))) return -1;
+        cursor += n;
+        return (long long)n;
+    }
+};
+
+static constexpr int kAudioPrerollMs = 200; // a new listener starts this far back, so playback starts at once
+static constexpr int kAudioMaxLagMs = 1000; // a listener further behind skips ahead to the preroll point
+static constexpr int kAudioReadWaitMs = 100;
+
+// The one capture per server. The first /audio listener starts the capture thread and it stops
+// once the last listener has left; listeners read the ring through their own cursors.
+struct AudioHub
+{
+    AudioRing ring;
+    std::mutex mtx; // the fields below; also what listeners wait on for new samples
+    std::condition_variable cv;
+    std::atomic<int> listeners{ 0 };
+    bool capturing = false; // a capture thread is running (and the only ring writer)
+    bool ready = false;     // its format is known
+    bool failed = false;
+    int sampleRate = 0;
+    int channels = 0;
+    uint64_t startPos = 0; // ring position of its first sample
+};
+
+static AudioHub g_audioHub;
+
+struct AudioListener
+{
+    uint64_t cursor = 0;
+    int sampleRate = 0;
+    int channels = 0;
+    uint64_t startPos = 0;
+    uint64_t skippedSamples = 0;
+};
+
+// Latest ring position at least lagMs behind the writer, on a frame boundary and not before
+// the capture's first sample.
+static uint64_t AudioPositionBehind(const AudioListener& l, uint64_t w, int lagMs)
+{
+    const uint64_t frames = (uint64_t)l.sampleRate * (uint64_t)lagMs / 1000;
+    const uint64_t back = std::min<uint64_t>(frames * (uint64_t)l.channels, AudioRing::kCapacity / 2);
+    if (w < l.startPos + back) return l.startPos;
+    return w - (w - l.startPos - back) % (uint64_t)l.channels - back;
+}
+
+static void AudioCaptureThread()
+{
+    AudioHub& hub = g_audioHub;
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    std::unique_ptr<AudioSource> source = CreateAudioSource(g_audioSourceSpec);
+    if (!source) source = CreateAudioSource("loopback");
+    int sampleRate = 0;
+    int channels = 0;
+    HRESULT hr = source->Start(sampleRate, channels);
+    {
+        std::lock_guard<std::mutex> lock(hub.mtx);
+        hub.ready = SUCCEEDED(hr);
+        hub.failed = FAILED(hr);
+        hub.sampleRate = sampleRate;
+        hub.channels = channels;
+        hub.startPos = hub.ring.Written();
+    }
+    hub.cv.notify_all();
+    if (SUCCEEDED(hr)) LogInfo("Audio capture started (%s, rate=%d, ch=%d)\n", source->Name(), sampleRate, channels);
+    else LogError("Audio capture failed to start (%s): 0x%08lx\n", source->Name(), (unsigned long)hr);
+
+    // Stops in the same locked step that sees no listeners, so a listener joining meanwhile
+    // starts a new capture instead of attaching to this one.
+    bool released = false;
+    std::vector<int16_t> packet;
+    while (SUCCEEDED(hr) && g_running.load())
+    {
+        if (hub.listeners.load() == 0)
+        {
+            std::lock_guard<std::mutex> lock(hub.mtx);
+            if (hub.listeners.load() == 0)
+            {
+                hub.capturing = false;
+                hub.ready = false;
+                released = true;
+                break;
+            }
+        }
+        packet.clear();
+        hr = source->Read(packet, kAudioReadWaitMs);
+        if (packet.empty()) continue;
+        if (g_serverAudioMuted.load()) std::memset(packet.data(), 0, packet.size() * sizeof(int16_t));
+        hub.ring.Write(packet.data(), packet.size());
+        // Taking the lock orders this wake-up after any listener's check of the ring.
+        {
+            std::lock_guard<std::mutex> lock(hub.mtx);
+        }
+        hub.cv.notify_all();
+    }
+    if (!released)
+    {
+        if (FAILED(hr) && hub.ready) LogError("Audio capture stopped: 0x%08lx\n", (unsigned long)hr);
+        {
+            std::lock_guard<std::mutex> lock(hub.mtx);
+            hub.capturing = false;
+            hub.ready = false;
+        }
+        hub.cv.notify_all();
+    }
+    source.reset();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+    LogInfo("Audio capture stopped\n");
+}
+
+// Joins the shared capture (starting it if needed) and places the listener kAudioPrerollMs
+// behind the newest sample. False if the capture could not start.
+static bool JoinAudioCapture(AudioListener& l)
+{
+    AudioHub& hub = g_audioHub;
+    std::unique_lock<std::mutex> lock(hub.mtx);
+    hub.listeners.fetch_add(1);
+    if (!hub.capturing)
+    {
+        hub.capturing = true;
+        hub.ready = false;
+        hub.failed = false;
+        std::thread(AudioCaptureThread).detach();
+    }
+    hub.cv.wait_for(lock, std::chrono::seconds(3), [&]() { return hub.ready || hub.failed || !hub.capturing; });
+    if (!hub.ready)
+    {
+        hub.listeners.fetch_sub(1);
+        return false;
+    }
+    l.sampleRate = hub.sampleRate;
+    l.channels = hub.channels;
+    l.startPos = hub.startPos;
+    l.cursor = AudioPositionBehind(l, hub.ring.Written(), kAudioPrerollMs);
+    return true;
+}
+
+static void LeaveAudioCapture()
+{
+    g_audioHub.listeners.fetch_sub(1);
+}
+
+// Copies the listener's next samples (waiting up to waitMs for some). A listener more than
+// kAudioMaxLagMs behind, or overrun by the writer, skips ahead. Returns the count (0 = none
+// yet), or -1 when the capture has stopped.
+static long long ReadAudioSamples(AudioListener& l, int16_t* out, size_t max, int waitMs)
+{
+    AudioHub& hub = g_audioHub;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        const uint64_t w = hub.ring.Written();
+        const uint64_t maxLag = std::min<uint64_t>((uint64_t)l.sampleRate * l.channels * kAudioMaxLagMs / 1000,
+            AudioRing::kCapacity - 2 * AudioRing::kMaxWrite);
+        long long n = w - l.cursor > maxLag ? -1 : hub.ring.Read(l.cursor, out, max);
+        if (n < 0)
+        {
+            const uint64_t to = AudioPositionBehind(l, w, kAudioPrerollMs);
+            l.skippedSamples += to - l.cursor;
+            l.cursor = to;
+            continue;
+        }
+        if (n > 0) return n;
+
+        std::unique_lock<std::mutex> lock(hub.mtx);
+        if (!hub.ready) return -1;
+        hub.cv.wait_for(lock, std::chrono::milliseconds(waitMs), [&]() { return !hub.ready || hub.ring.Written() != l.cursor; });
+        if (!hub.ready) return -1;
+    }
+    return 0;
+}
+
+static void StreamAudioThread(SOCKET client, const std::string& clientIp, HANDLE stopEvent)
+{
+    if (!g_serverAudioEnabled.load())
+    {
+        const std::string body = "Audio disabled";
+        (void)SendHttpText(client, "text/plain; charset=utf-8", body);
+        closesocket(client);
+        return;
+    }
+
+    AudioListener listener;
+    if (!JoinAudioCapture(listener))
+    {
+        closesocket(client);
+        return;
+    }
+
+    const std::string headers =
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Pragma: no-cache\r\n"
+        "Content-Type: audio/wav\r\n"
+        "\r\n";
+    bool ok = SendAll(client, headers.data(), (int)headers.size()) && SendWavHeaderPcm16(client, listener.sampleRate, listener.channels);
+    if (ok)
+    {
+        LogInfo("Audio streaming to %s (rate=%d, ch=%d, listeners=%d)\n", clientIp.c_str(), listener.sampleRate, listener.channels,
+            g_audioHub.listeners.load());
+    }
+
+    std::vector<int16_t> out(AudioRing::kMaxWrite);
+    while (ok && g_running.load())
+    {
+        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        {
+            g_running.store(false);
+            break;
+        }
+        const long long n = ReadAudioSamples(listener, out.data(), out.size(), kAudioReadWaitMs);
+        if (n < 0) break;
+        if (n > 0) ok = SendAll(client, out.data(), (int)((size_t)n * sizeof(int16_t)));
+    }
+
+    LeaveAudioCapture();
+    if (listener.skippedSamples > 0 && g_verbose)
+    {
+        LogInfo("Audio listener %s skipped %.1f s while behind\n", clientIp.c_str(),
+            (double)listener.skippedSamples / ((double)listener.sampleRate * listener.channels));
+    }
+    closesocket(client);
+}
+
+// ----------------------------
+// MJPEG renditions and per-client rate control
+// ----------------------------
+
+// Parses a --renditions spec: comma-separated scale:quality pairs, best first, where scale is
+// "full", "half" or a number in (0, 1] (e.g. "full:92,full:60,half:60").
+static bool ParseRenditionSpec(const std::string& spec, std::vector<MjpegRendition>& out)
+{
+    out.clear();
+    size_t pos = 0;
+    while (pos <= spec.size())
+    {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) comma = spec.size();
+        const std::string item = spec.substr(pos, comma - pos);
+        const size_t colon = item.find(':');
+        if (colon == std::string::npos) return false;
+        const std::string s = item.substr(0, colon);
+        MjpegRendition r;
+        r.scale = s == "full" ? 1.0 : s == "half" ? 0.5 : std::strtod(s.c_str(), nullptr);
+        r.quality = std::atoi(item.c_str() + colon + 1);
+        if (r.scale < kMinOutputScale || r.scale > 1.0 || r.quality < 1 || r.quality > 100) return false;
+        if ((int)out.size() == kMaxMjpegRenditions) return false;
+        out.push_back(r);
+        pos = comma + 1;
+    }
+    return !out.empty();
+}
+
+// Quality/frame-rate ladder for /mjpeg viewers, best first: each rendition at the full frame
+// rate, then the last one at 1/2 and 1/4 of it. A level names a rendition (shared with every
+// viewer on it) and a divisor of the server frame rate; level r is rendition r at full rate.
+struct MjpegLevel
+{
+    int rendition;
+    int fpsDivisor;
+};
+
+static std::vector<MjpegLevel> g_mjpegLevels{ { 0, 1 } };
+
+// Sets up the renditions from --renditions, or full/q, full/q-30 and half/q-30 for stream
+// quality q.
+static void ConfigureMjpegRenditions(int jpegQuality0to100)
+{
+    std::vector<MjpegRendition> list;
+    if (g_renditionSpec.empty() || !ParseRenditionSpec(g_renditionSpec, list))
+    {
+        const int low = std::min(jpegQuality0to100, std::max(kMinRenditionQuality, jpegQuality0to100 - kDefaultRenditionQualityDrop));
+        list = { { 1.0, jpegQuality0to100 }, { 1.0, low }, { 0.5, low } };
+    }
+    g_renditionCount = (int)list.size();
+    g_mjpegLevels.clear();
+    for (int r = 0; r < g_renditionCount; r++)
+    {
+        g_renditions[r] = list[r];
+        g_mjpegLevels.push_back({ r, 1 });
+    }
+    g_mjpegLevels.push_back({ g_renditionCount - 1, 2 });
+    g_mjpegLevels.push_back({ g_renditionCount - 1, 4 });
+}
+
+// The rendition closest to a viewer's ?q=&scale= request (either may be absent): scale counts
+// most (one halving = 100), then quality.
+static int NearestRendition(double scale, int quality)
+{
+    int best = 0;
+    double bestCost = 1e18;
+    for (int r = 0; r < g_renditionCount; r++)
+    {
+        double cost = 0.0;
+        if (scale > 0.0) cost += std::fabs(std::log2(g_renditions[r].scale / scale)) * 100.0;
+        if (quality > 0) cost += std::abs(g_renditions[r].quality - quality);
+        if (cost < bestCost)
+        {
+            best = r;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+// Relative JPEG size of a rendition, until measured: pixels times the inverse square root of
+// the quantiser scale (libjpeg quality mapping), which tracks real frames to within ~20%.
+static double RenditionSizeHint(int rendition)
+{
+    const MjpegRendition& r = g_renditions[rendition];
+    const double qscale = r.quality < 50 ? 5000.0 / r.quality : std::max(1.0, 200.0 - 2.0 * r.quality);
+    return r.scale * r.scale / std::sqrt(qscale);
+}
+
+// A frame that takes longer than this share of its slot to send means the link is saturated.
+static constexpr double kMjpegCongestedSlotFraction = 0.75;
+static constexpr double kMjpegDecreaseFactor = 0.7;         // multiplicative decrease of the budget
+static constexpr double kMjpegIncreaseBytesPerSec = 256e3;  // additive increase, per second without congestion
+static constexpr int kMjpegUpgradeHoldMs = 2000;            // no congestion for this long before a better level
+static constexpr int kMjpegStallTimeoutMs = 20000;          // no send progress at all: the viewer is gone
+
+// Expected bytes/s of a level at the server frame rate, from the encoder's running averages.
+// A rendition nobody has watched yet is estimated from a measured one via the size hints.
+static double EstimateMjpegLevelBps(int level, int fps)
+{
+    const MjpegLevel& l = g_mjpegLevels[level];
+    double bytes = (double)g_renditionBytes[l.rendition].load();
+    if (bytes <= 0.0)
+    {
+        for (int r = 0; r < g_renditionCount && bytes <= 0.0; r++)
+        {
+            const uint64_t known = g_renditionBytes[r].load();
+            if (known > 0) bytes = known * RenditionSizeHint(l.rendition) / RenditionSizeHint(r);
+        }
+    }
+    return bytes * fps / l.fpsDivisor;
+}
+
+// AIMD controller over a byte-rate budget. A frame that overruns its send slot cuts the budget
+// to kMjpegDecreaseFactor of what the link just delivered; every clean second adds
+// kMjpegIncreaseBytesPerSec. The level is the best one whose estimated rate fits the budget,
+// but never better than topLevel (the rendition the viewer asked for).
+struct MjpegRateController
+{
+    int topLevel = 0;
+    int level = 0;
+    double budgetBps = 0.0; // 0 = unlimited (no congestion seen, or fully recovered)
+    double lastCongestionMs = -1e9;
+    double lastIncreaseMs = 0.0;
+
+    // Returns true when the level changed.
+    bool OnFrameSent(size_t bytes, double sendMs, int fps, double nowMs)
+    {
+        const double slotMs = 1000.0 * g_mjpegLevels[level].fpsDivisor / std::max(1, fps);
+        if (sendMs > slotMs * kMjpegCongestedSlotFraction)
+        {
+            const double deliveredBps = bytes * 1000.0 / sendMs;
+            const double demandBps = bytes * 1000.0 / slotMs;
+            budgetBps = std::min(deliveredBps, demandBps) * kMjpegDecreaseFactor;
+            lastCongestionMs = nowMs;
+            lastIncreaseMs = nowMs;
+        }
+        else if (budgetBps > 0.0 && nowMs - lastIncreaseMs >= 1000.0)
+        {
+            budgetBps += kMjpegIncreaseBytesPerSec * (nowMs - lastIncreaseMs) / 1000.0;
+            lastIncreaseMs = nowMs;
+            if (budgetBps >= EstimateMjpegLevelBps(topLevel, fps) * 1.5) budgetBps = 0.0;
+        }
+
+        int want = topLevel;
+        if (budgetBps > 0.0)
+        {
+            while (want + 1 < (int)g_mjpegLevels.size() && EstimateMjpegLevelBps(want, fps) > budgetBps) want++;
+        }
+        if (want < level && nowMs - lastCongestionMs < kMjpegUpgradeHoldMs) want = level;
+        if (want == level) return false;
+        level = want;
+        return true;
+    }
+};
+
+// Per-viewer state reported by /control ("mjpegClients").
+struct MjpegClientStatus
+{
+    uint64_t id = 0;
+    std::string ip;
+    int level = 0;
+    int rendition = 0;
+    double fps = 0.0;
+    double kbps = 0.0; // delivered over the last second
+    uint64_t skippedFrames = 0; // published while the viewer was busy, never sent to it
+    size_t queuedBytes = 0;     // left of the part in flight
+    bool ws = false;            // /ws viewer
+    double latencyMs = 0.0;     // /ws: capture -> drawn, last acked frame
+};
+
+static std::mutex g_mjpegClientsMtx;
+static std::vector<MjpegClientStatus> g_mjpegClients;
+static std::atomic<uint64_t> g_mjpegClientIds{ 0 };
+
+static void UpdateMjpegClientStatus(const MjpegClientStatus& st)
+{
+    std::lock_guard<std::mutex> lock(g_mjpegClientsMtx);
+    for (MjpegClientStatus& c : g_mjpegClients)
+    {
+        if (c.id == st.id)
+        {
+            c = st;
+            return;
+        }
+    }
+    g_mjpegClients.push_back(st);
+}
+
+static void RemoveMjpegClientStatus(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(g_mjpegClientsMtx);
+    for (size_t i = 0; i < g_mjpegClients.size(); i++)
+    {
+        if (g_mjpegClients[i].id == id)
+        {
+            g_mjpegClients.erase(g_mjpegClients.begin() + i);
+            return;
+        }
+    }
+}
+
+static std::string MjpegClientsJson()
+{
+    std::lock_guard<std::mutex> lock(g_mjpegClientsMtx);
+    std::string out = "[";
+    for (size_t i = 0; i < g_mjpegClients.size(); i++)
+    {
+        const MjpegClientStatus& c = g_mjpegClients[i];
+        if (i > 0) out += ",";
+        out += std::string("{\"ip\":\"") + c.ip + "\"" +
+            ",\"level\":" + std::to_string(c.level) +
+            ",\"rendition\":" + std::to_string(c.rendition) +
+            ",\"scale\":" + FormatFixed(g_renditions[c.rendition].scale, 2) +
+            ",\"quality\":" + std::to_string(g_renditions[c.rendition].quality) +
+            ",\"fps\":" + FormatFixed(c.fps, 1) +
+            ",\"kbps\":" + FormatFixed(c.kbps, 0) +
+            ",\"skipped\":" + std::to_string((unsigned long long)c.skippedFrames) +
+            ",\"queuedBytes\":" + std::to_string((unsigned long long)c.queuedBytes) +
+            ",\"transport\":\"" + (c.ws ? "ws" : "mjpeg") + "\"" +
+            (c.ws ? ",\"latencyMs\":" + FormatFixed(c.latencyMs, 0) : std::string()) + "}";
+    }
+    out += "]";
+    return out;
+}
+
+static std::string MjpegRenditionsJson()
+{
+    std::string out = "[";
+    for (int r = 0; r < g_renditionCount; r++)
+    {
+        if (r > 0) out += ",";
+        out += std::string("{\"scale\":") + FormatFixed(g_renditions[r].scale, 2) +
+            ",\"quality\":" + std::to_string(g_renditions[r].quality) +
+            ",\"viewers\":" + std::to_string(g_renditionClients[r].load()) +
+            ",\"encodes\":" + std::to_string((unsigned long long)g_renditionEncodes[r].load()) +
+            ",\"avgBytes\":" + std::to_string((unsigned long long)g_renditionBytes[r].load()) + "}";
+    }
+    out += "]";
+    return out;
+}
+
+// /tiles: the dirty-tile stream (see "Dirty-tile stream protocol"). A client starts at a full
+// message and follows deltas in seq order; on any gap it waits for the next full message.
+static void StreamTilesThread(SOCKET client, const std::string& clientIp, HANDLE stopEvent)
+{
+    const std::string headers =
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+        "Pragma: no-cache\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "\r\n";
+
+    u_long nb = 1;
+    (void)ioctlsocket(client, FIONBIO, &nb);
+    int snd = 64 * 1024;
+    (void)setsockopt(client, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+
+    if (!SendAllWithTimeout(client, headers.data(), (int)headers.size(), 1000, stopEvent))
+    {
+        closesocket(client);
+        return;
+    }
+
+    g_tileClientCount.fetch_add(1);
+    g_tilesKeyRequested.store(true);
+    LogInfo("Tile stream to %s (tile clients=%d)\n", clientIp.c_str(), g_tileClientCount.load());
+
+    uint64_t lastSeq = 0;
+    bool synced = false;
+    std::vector<uint8_t> msg;
+
+    while (g_running.load())
+    {
+        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        {
+            g_running.store(false);
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(g_sharedTiles.mtx);
+            g_sharedTiles.cv.wait_for(lock, std::chrono::milliseconds(1000), [&]() {
+                return !g_running.load() || g_sharedTiles.seq != lastSeq;
+            });
+            if (!g_running.load()) break;
+            if (g_sharedTiles.seq == lastSeq || g_sharedTiles.msg.empty())
+            {
+                continue;
+            }
+            const bool inOrder = synced && g_sharedTiles.seq == lastSeq + 1;
+            lastSeq = g_sharedTiles.seq;
+            if (!g_sharedTiles.full && !inOrder)
+            {
+                // Missed a delta (or never synced): wait for a key frame.
+                synced = false;
+                g_tilesKeyRequested.store(true);
+                continue;
+            }
+            msg = g_sharedTiles.msg;
+        }
+        synced = true;
+
+        // Key frames can be large; still drop a client that stalls for long.
+        if (!SendAllWithTimeout(client, msg.data(), (int)msg.size(), 1000, stopEvent)) break;
+    }
+    closesocket(client);
+
+    int left = g_tileClientCount.fetch_sub(1) - 1;
+    LogInfo("Tile client disconnected: %s (tile clients=%d)\n", clientIp.c_str(), left);
+}
+
+// /cursor: newline-delimited JSON, one line per cursor change (plus a repeat every 2 s):
+// {"v":1,"x":..,"y":..,"hx":..,"hy":..,"cw":..,"ch":..,"w":..,"h":..,"id":"<hex>"}
+// x/y = hotspot in frame pixels, hx/hy = hotspot within the image, cw/ch = image size,
+// w/h = frame size, id = /cursor.png?id=<hex>. "v":0 = hidden.
+static void StreamCursorThread(SOCKET client, const std::string& clientIp, HANDLE stopEvent)
+{
+    const std::string headers =
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+        "Pragma: no-cache\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "Content-Type: application/x-ndjson\r\n"
+        "\r\n";
+
+    u_long nb = 1;
+    (void)ioctlsocket(client, FIONBIO, &nb);
+
+    if (!SendAllWithTimeout(client, headers.data(), (int)headers.size(), 1000, stopEvent))
+    {
+        closesocket(client);
+        return;
+    }
+
+    g_cursorClientCount.fetch_add(1);
+    if (g_verbose) LogInfo("Cursor stream to %s\n", clientIp.c_str());
+
+    uint64_t lastSeq = 0;
+    while (g_running.load())
+    {
+        if (stopEvent && WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+        {
+            g_running.store(false);
+            break;
+        }
+
+        char line[256];
+        {
+            std::unique_lock<std::mutex> lock(g_sharedCursor.mtx);
+            g_sharedCursor.cv.wait_for(lock, std::chrono::milliseconds(kKeepaliveFrameMs), [&]() {
+                return !g_running.load() || g_sharedCursor.seq != lastSeq;
+            });
+            if (!g_running.load()) break;
+            if (g_sharedCursor.seq == 0) continue;
+            const SharedCursorState& s = g_sharedCursor;
+            lastSeq = s.seq;
+            std::snprintf(line, sizeof(line),
+                "{\"v\":%d,\"x\":%d,\"y\":%d,\"hx\":%d,\"hy\":%d,\"cw\":%d,\"ch\":%d,\"w\":%d,\"h\":%d,\"id\":\"%016llx\"}\n",
+                s.visible ? 1 : 0, s.x, s.y, s.hotX, s.hotY, s.width, s.height, s.screenW, s.screenH,
+                (unsigned long long)s.shapeId);
+        }
+
+        if (!SendAllWithTimeout(client, line, (int)std::strlen(line), 500, stopEvent)) break;
+    }
+    closesocket(client);
+    g_cursorClientCount.fetch_sub(1);
+}
+
+// /control[?mute=&scale=&maxWidth=]: applies the settings given, then returns the status JSON.
+static std::string HandleControlRequest(const std::string& query, uint16_t serverPort)
+{
+    int mute = -1;
+    if (QueryGetInt(query, "mute", mute))
+    {
+        g_serverAudioMuted.store(mute != 0);
+    }
+    std::string scale;
+    if (QueryGetString(query, "scale", scale))
+    {
+        const double s = std::strtod(scale.c_str(), nullptr);
+        if (s > 0.0) g_outputScale.store(std::min(1.0, std::max(kMinOutputScale, s)));
+    }
+    int maxWidth = -1;
+    if (QueryGetInt(query, "maxWidth", maxWidth) && maxWidth >= 0)
+    {
+        g_outputMaxWidth.store(maxWidth == 0 ? 0 : std::max(kMinOutputWidth, maxWidth));
+    }
+
+    // Always return status (also works as a read endpoint).
+    return std::string("{\"audioMuted\":") + (g_serverAudioMuted.load() ? "true" : "false") +
+        std::string(",\"privateMode\":") + (g_httpAuthEnabled ? "true" : "false") +
+        std::string(",\"port\":") + std::to_string((unsigned)serverPort) +
+        std::string(",\"framesEncoded\":") + std::to_string((unsigned long long)g_framesEncoded.load()) +
+        std::string(",\"framesSkipped\":") + std::to_string((unsigned long long)g_framesSkipped.load()) +
+        std::string(",\"cursorMeta\":") + (g_cursorMeta ? "true" : "false") +
+        std::string(",\"fps\":") + FormatFixed(g_paceFps.load(), 1) +
+        std::string(",\"jitterMs\":") + FormatFixed(g_paceJitterMs.load(), 2) +
+        std::string(",\"overruns\":") + std::to_string((unsigned long long)g_paceOverruns.load()) +
+        std::string(",\"skippedTicks\":") + std::to_string((unsigned long long)g_paceSkippedTicks.load()) +
+        std::string(",\"captureMs\":") + FormatFixed(g_stageCapture.avgMs.load(), 2) +
+        std::string(",\"copyMs\":") + FormatFixed(g_stageCopy.avgMs.load(), 2) +
+        std::string(",\"encodeMs\":") + FormatFixed(g_stageEncode.avgMs.load(), 2) +
+        std::string(",\"pipelineDrops\":") + std::to_string((unsigned long long)g_pipelineDrops.load()) +
+        std::string(",\"scale\":") + FormatFixed(g_outputScale.load(), 2) +
+        std::string(",\"maxWidth\":") + std::to_string(g_outputMaxWidth.load()) +
+        std::string(",\"outputWidth\":") + std::to_string(g_outputWidth.load()) +
+        std::string(",\"outputHeight\":") + std::to_string(g_outputHeight.load()) +
+        std::string(",\"renditions\":") + MjpegRenditionsJson() +
+        std::string(",\"mjpegClients\":") + MjpegClientsJson() +
+        "}";
+}
+
+// Long-lived streams the server loop hands off to a thread (/audio, /tiles, /cursor). The
+// request is already parsed and authorized.
+static void HandleHttpRequestThread(SOCKET client, const std::string& clientIp, const HttpRequest& req, HANDLE stopEvent)
+{
+    const std::string& path = req.path;
+
+    if (path == "/audio")
+    {
+        StreamAudioThread(client, clientIp, stopEvent);
+        return;
+    }
+
+    if (path == "/tiles")
+    {
+        StreamTilesThread(client, clientIp, stopEvent);
+        return;
+    }
+
+    if (path == "/cursor" && g_cursorMeta)
+    {
+        StreamCursorThread(client, clientIp, stopEvent);
+        return;
+    }
+
+    (void)SendHttpNotFound(client);
+    closesocket(client);
+}
+
+// ----------------------------
+// WebSocket video (/ws)
+// ----------------------------
+
+// /ws carries the same JPEGs as /mjpeg, one binary WebSocket message per frame, with the
+// viewer acknowledging each frame once it is on screen. The server keeps at most
+// kWsMaxInFlight unacknowledged frames per viewer, so frames wait in the server (where they are
+// replaced by newer ones), never in TCP buffers.
+//
+// Server -> client message (little-endian), followed by the JPEG:
+//   u32 version (1), u32 header bytes (24), f64 seq, f64 latencyMs (last measured, 0 = none)
+// Client -> server message (16 bytes): f64 seq, f64 holdMs (receive -> drawn, client clock).
+//
+// Latency is measured per acked frame without a shared clock: the ack round trip minus the
+// client's hold time gives the network RTT, so capture -> drawn ~= (send - capture) + RTT / 2
+// + hold.
+static constexpr int kWsMaxInFlight = 2;
+static constexpr size_t kWsHeaderBytes = 24;
+static constexpr size_t kWsAckBytes = 16;
+static constexpr size_t kWsMaxClientMessage = 1024;
+
+static void Sha1(const uint8_t* data, size_t len, uint8_t out[20])
+{
+    uint32_t h[5] = { 0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u };
+    auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+
+    std::vector<uint8_t> msg(data, data + len);
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    const uint64_t bits = (uint64_t)len * 8;
+    for (int i = 7; i >= 0; i--) msg.push_back((uint8_t)(bits >> (8 * i)));
+
+    for (size_t off = 0; off < msg.size(); off += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            const uint8_t* p = &msg[off + 4 * i];
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f;
+            uint32_t k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999u; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1u; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDCu; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6u; }
+            const uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        out[4 * i + 0] = (uint8_t)(h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)h[i];
+    }
+}
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key (RFC 6455 4.2.2).
+static std::string WebSocketAcceptKey(const std::string& key)
+{
+    const std::string s = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    Sha1((const uint8_t*)s.data(), s.size(), digest);
+    return Base64Encode(digest, sizeof(digest));
+}
+
+// A GET that asks for a version-13 WebSocket upgrade.
+static bool IsWebSocketUpgrade(const HttpRequest& req, std::string& key)
+{
+    const std::string* upgrade = req.Header("upgrade");
+    const std::string* version = req.Header("sec-websocket-version");
+    const std::string* k = req.Header("sec-websocket-key");
+    if (!upgrade || !version || !k || *version != "13" || k->empty()) return false;
+    std::string u = *upgrade;
+    for (char& ch : u) ch = (char)std::tolower((unsigned char)ch);
+    if (u != "websocket") return false;
+    key = *k;
+    return true;
+}
+
+// Frame header of an unmasked, unfragmented server message.
+static void AppendWsFrameHeader(std::string& out, uint8_t opcode, uint64_t payloadLen)
+{
+    out.push_back((char)(0x80 | opcode));
+    if (payloadLen < 126)
+    {
+        out.push_back((char)payloadLen);
+    }
+    else if (payloadLen <= 0xFFFF)
+    {
+        out.push_back((char)126);
+        out.push_back((char)(payloadLen >> 8));
+        out.push_back((char)payloadLen);
+    }
+    else
+    {
+        out.push_back((char)127);
+        for (int i = 7; i >= 0; i--) out.push_back((char)(payloadLen >> (8 * i)));
+    }
+}
+
+// One complete client message from the front of buf: 1 = parsed (and erased from buf),
+// 0 = need more bytes, -1 = protocol error with the status code to close with in closeCode
+// (1002: unmasked, fragmented, reserved bits or a control frame over 125 bytes; 1009: oversized).
+static int TakeWsClientMessage(std::string& buf, uint8_t& opcode, std::string& payload, uint16_t& closeCode)
+{
+    if (buf.size() < 2) return 0;
+    const uint8_t b0 = (uint8_t)buf[0];
+    const uint8_t b1 = (uint8_t)buf[1];
+    closeCode = 1002;
+    if (!(b0 & 0x80) || (b0 & 0x70) || !(b1 & 0x80)) return -1;
+    if ((b0 & 0x08) && (b1 & 0x7F) > 125) return -1;
+    size_t pos = 2;
+    uint64_t len = b1 & 0x7F;
+    if (len == 126 || len == 127)
+    {
+        const size_t n = len == 126 ? 2 : 8;
+        if (buf.size() < pos + n) return 0;
+        len = 0;
+        for (size_t i = 0; i < n; i++) len = (len << 8) | (uint8_t)buf[pos + i];
+        pos += n;
+    }
+    if (len > kWsMaxClientMessage)
+    {
+        closeCode = 1009;
+        return -1;
+    }
+    if (buf.size() < pos + 4 + len) return 0;
+    const char* mask = buf.data() + pos;
+    pos += 4;
+    payload.assign(buf, pos, (size_t)len);
+    for (size_t i = 0; i < payload.size(); i++) payload[i] ^= mask[i & 3];
+    opcode = b0 & 0x0F;
+    buf.erase(0, pos + (size_t)len);
+    return 1;
+}
+
+// ----------------------------
+// Event-driven server core
+// ----------------------------
+
+// Socket readiness for the server loop. The loop only uses this interface; WSAPoll is the
+// backend here, and an IOCP/epoll one could replace it without touching the loop.
+struct PollEvent
+{
+    SOCKET s;
+    bool readable;
+    bool writable;
+    bool failed; // error or hang-up
+};
+
+struct SocketPoller
+{
+    virtual ~SocketPoller() = default;
+    virtual void Watch(SOCKET s, bool read, bool write) = 0; // add or update
+    virtual void Forget(SOCKET s) = 0;
+    virtual bool Wait(int timeoutMs, std::vector<PollEvent>& out) = 0;
+};
+
+struct WsaPollPoller : SocketPoller
+{
+    std::vector<WSAPOLLFD> fds;
+    std::unordered_map<SOCKET, size_t> index;
+
+    void Watch(SOCKET s, bool read, bool write) override
+    {
+        const SHORT events = (SHORT)((read ? POLLRDNORM : 0) | (write ? POLLWRNORM : 0));
+        auto it = index.find(s);
+        if (it != index.end())
+        {
+            fds[it->second].events = events;
+            return;
+        }
+        WSAPOLLFD p{};
+        p.fd = s;
+        p.events = events;
+        index[s] = fds.size();
+        fds.push_back(p);
+    }
+
+    void Forget(SOCKET s) override
+    {
+        auto it = index.find(s);
+        if (it == index.end()) return;
+        const size_t i = it->second;
+        index.erase(it);
+        if (i + 1 != fds.size())
+        {
+            fds[i] = fds.back();
+            index[fds[i].fd] = i;
+        }
+        fds.pop_back();
+    }
+
+    bool Wait(int timeoutMs, std::vector<PollEvent>& out) override
+    {
+        out.clear();
+        const int n = WSAPoll(fds.data(), (ULONG)fds.size(), timeoutMs);
+        if (n == SOCKET_ERROR) return false;
+        for (const WSAPOLLFD& p : fds)
+        {
+            if (p.revents == 0) continue;
+            PollEvent e;
+            e.s = p.fd;
+            e.readable = (p.revents & POLLRDNORM) != 0;
+            e.writable = (p.revents & POLLWRNORM) != 0;
+            e.failed = (p.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+            out.push_back(e);
+        }
+        return true;
+    }
+};
+
+static std::unique_ptr<SocketPoller> CreateSocketPoller()
+{
+    return std::make_unique<WsaPollPoller>();
+}
+
+// Lets other threads interrupt the loop's poll (the encode stage publishing a frame): the loop
+// watches a loopback UDP socket and Wake() sends it one datagram. Wakes coalesce until the
+// loop drains them.
+struct LoopWaker
+{
+    SOCKET sock = INVALID_SOCKET;
+    sockaddr_in addr{};
+    std::atomic<bool> pending{ false };
+
+    bool Open()
+    {
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET) return false;
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int len = sizeof(addr);
+        u_long nb = 1;
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || getsockname(sock, (sockaddr*)&addr, &len) == SOCKET_ERROR ||
+            ioctlsocket(sock, FIONBIO, &nb) == SOCKET_ERROR)
+        {
+            closesocket(sock);
+            sock = INVALID_SOCKET;
+            return false;
+        }
+        return true;
+    }
+
+    void Wake()
+    {
+        if (!pending.exchange(true)) (void)sendto(sock, "w", 1, 0, (const sockaddr*)&addr, sizeof(addr));
+    }
+
+    // Cleared before draining, so a wake that races with the drain is never lost.
+    void Drain()
+    {
+        pending.store(false);
+        char buf[16];
+        while (recv(sock, buf, sizeof(buf), 0) > 0)
+        {
+        }
+    }
+};
+
+static std::mutex g_serverWakerMtx;
+static LoopWaker* g_serverWaker = nullptr;
+
+static void WakeServerLoop()
+{
+    std::lock_guard<std::mutex> lock(g_serverWakerMtx);
+    if (g_serverWaker) g_serverWaker->Wake();
+}
+
+// Requests that are not finished after this long are dropped (slowloris / idle connects); an
+// idle keep-alive connection waits this long for its next request.
+static constexpr int kRequestTimeoutMs = 10000;
+static constexpr int kKeepAliveIdleMs = 30000;
+
+// /events pushes the status snapshot at most this often, and a comment line after this long
+// without a change so proxies keep the connection open.
+static constexpr int kEventsIntervalMs = 250;
+static constexpr int kEventsHeartbeatMs = 15000;
+
+// A connection owned by the server loop: reading requests and answering the short ones (with
+// keep-alive), or streaming /mjpeg parts. Output goes through a write cursor:
+// bufs[bufIndex..bufCount) is what is left to send, backed by header and body (owned), asset
+// (a cached page) or pinned (the frame set the part comes from).
+struct LoopConnection
+{
+    SOCKET s = INVALID_SOCKET;
+    std::string ip;
+    double waitStartMs = 0.0; // since the connection went idle, or since its request began
+    HttpRequestParser parser;
+    std::string pending; // bytes after the current request (pipelining), parsed once it is answered
+
+    WSABUF bufs[3]{};
+    int bufIndex = 0;
+    int bufCount = 0;
+    std::string header;
+    std::string body;
+    std::shared_ptr<const CachedHttpAsset> asset;
+    std::shared_ptr<const MjpegFrameSet> pinned;
+    double lastProgressMs = 0.0;
+    bool responding = false; // a short response is in the cursor
+    bool keepAlive = false;
+
+    // Video viewer: /mjpeg, or /ws when ws is set
+    bool mjpeg = false;
+    MjpegRateController rate;
+    MjpegClientStatus status;
+    uint64_t lastSeq = 0;
+    size_t partBytes = 0;       // JPEG bytes of the part in flight, 0 = none
+    double partStartMs = 0.0;
+    double lastSendMs = -1e9;
+    double windowStartMs = 0.0;
+    uint64_t windowBytes = 0;
+    uint64_t windowFrames = 0;
+
+    // /ws: frames sent but not yet acknowledged, oldest first. Client messages collect in pending.
+    struct WsFrameInFlight
+    {
+        uint64_t seq;
+        double sendMs;
+        double captureMs;
+        size_t bytes;
+    };
+    bool ws = false;
+    std::vector<WsFrameInFlight> wsInFlight;
+    bool wsClosing = false;  // our close frame goes out after the part in flight, then the socket closes
+    std::string wsCloseCode; // its status code (2 bytes, or empty)
+    bool wsPongDue = false;  // a ping is answered after the part in flight
+    std::string wsPingPayload;
+
+    // /events subscriber
+    bool events = false;
+    std::string lastEvent; // snapshot last queued
+
+    bool Sending() const { return bufIndex < bufCount; }
+    bool Streaming() const { return mjpeg || events; }
+
+    size_t QueuedBytes() const
+    {
+        size_t n = 0;
+        for (int i = bufIndex; i < bufCount; i++) n += bufs[i].len;
+        return n;
+    }
+
+    // Sends from the write cursor until it is empty or the socket is full (Sending() still
+    // true). false = socket error.
+    bool SendFromCursor()
+    {
+        while (Sending())
+        {
+            DWORD sent = 0;
+            if (WSASend(s, bufs + bufIndex, (DWORD)(bufCount - bufIndex), &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+            {
+                return WSAGetLastError() == WSAEWOULDBLOCK;
+            }
+            lastProgressMs = PerfNowMs();
+            while (bufIndex < bufCount && sent >= bufs[bufIndex].len)
+            {
+                sent -= bufs[bufIndex].len;
+                bufIndex++;
+            }
+            if (bufIndex < bufCount)
+            {
+                bufs[bufIndex].buf += sent;
+                bufs[bufIndex].len -= sent;
+            }
+        }
+        return true;
+    }
+};
+
+// Long-lived streams other than /mjpeg run on their own thread.
+static bool IsThreadedStreamPath(const std::string& path)
+{
+    return path == "/audio" || path == "/tiles" || path == "/cursor";
+}
+
+struct ServerLoop
+{
+    std::unique_ptr<SocketPoller> poller;
+    SOCKET listenSock = INVALID_SOCKET;
+    LoopWaker waker;
+    std::unordered_map<SOCKET, std::unique_ptr<LoopConnection>> conns;
+    uint16_t port = 0;
+    int fps = 0;
+    HANDLE stopEvent = nullptr;
+    double nextSlotMs = 0.0; // earliest reduced-fps viewer that is waiting out its slot
+
+    // /events: MJPEG bytes delivered, turned into kbps once a second.
+    int eventClients = 0;
+    uint64_t mjpegBytes = 0;
+    double kbpsWindowStartMs = 0.0;
+    double mjpegKbps = 0.0;
+
+    void Accept()
+    {
+        for (;;)
+        {
+            sockaddr_in clientAddr{};
+            int clientLen = sizeof(clientAddr);
+            SOCKET client = accept(listenSock, (sockaddr*)&clientAddr, &clientLen);
+            if (client == INVALID_SOCKET) return;
+
+            // Non-blocking, low-latency, and a small send buffer so a slow viewer's backlog
+            // stays in its write cursor instead of seconds of kernel buffering.
+            u_long nb = 1;
+            (void)ioctlsocket(client, FIONBIO, &nb);
+            int one = 1;
+            (void)setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+            int snd = 64 * 1024;
+            (void)setsockopt(client, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+
+            char ip[64] = {};
+            inet_ntop(AF_INET, &clientAddr.sin_addr, ip, sizeof(ip));
+            LogInfo("Client connected: %s\n", ip);
+
+            std::unique_ptr<LoopConnection> c = std::make_unique<LoopConnection>();
+            c->s = client;
+            c->ip = ip;
+            c->waitStartMs = PerfNowMs();
+            poller->Watch(client, true, false);
+            conns[client] = std::move(c);
+        }
+    }
+
+    void Close(LoopConnection& c)
+    {
+        const SOCKET s = c.s;
+        poller->Forget(s);
+        closesocket(c.s);
+        if (c.mjpeg)
+        {
+            g_renditionClients[g_mjpegLevels[c.rate.level].rendition].fetch_sub(1);
+            RemoveMjpegClientStatus(c.status.id);
+            const int left = g_clientCount.fetch_sub(1) - 1;
+            LogInfo("Client disconnected: %s (clients=%d)\n", c.ip.c_str(), left);
+        }
+        if (c.events) eventClients--;
+        conns.erase(s); // destroys c
+    }
+
+    // A stream request leaves the loop: the socket goes back to blocking mode and gets the
+    // threaded handler, with the request already parsed.
+    void HandOff(LoopConnection& c)
+    {
+        poller->Forget(c.s);
+        u_long nb = 0;
+        (void)ioctlsocket(c.s, FIONBIO, &nb);
+        HANDLE stopEventThread = nullptr;
+        (void)DuplicateHandle(GetCurrentProcess(), stopEvent, GetCurrentProcess(), &stopEventThread, SYNCHRONIZE, FALSE, 0);
+        std::thread t([client = c.s, ip = c.ip, req = std::move(c.parser.req), stopEventThread]() {
+            HandleHttpRequestThread(client, ip, req, stopEventThread);
+            if (stopEventThread) CloseHandle(stopEventThread);
+        });
+        t.detach();
+        const SOCKET s = c.s;
+        conns.erase(s); // destroys c
+    }
+
+    // Returns false when the connection was closed.
+    bool OnReadable(LoopConnection& c)
+    {
+        char buf[4096];
+        for (;;)
+        {
+            const int n = recv(c.s, buf, sizeof(buf), 0);
+            if (n == 0 || (n == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+            {
+                Close(c);
+                return false;
+            }
+            if (n == SOCKET_ERROR) return true;
+            if (c.mjpeg && !c.ws) continue; // viewers have nothing more to say; drained to notice hang-ups
+            if (!OnRequestBytes(c, buf, (size_t)n)) return false;
+        }
+    }
+
+    bool OnRequestBytes(LoopConnection& c, const char* data, size_t len)
+    {
+        if (c.ws)
+        {
+            if (c.wsClosing) return true; // nothing after a close frame is read
+            c.pending.append(data, len);
+            return OnWsMessages(c);
+        }
+        if (c.responding || c.Streaming())
+        {
+            if (c.Streaming()) return true;
+            c.pending.append(data, len);
+            if (c.pending.size() <= kMaxRequestBytes) return true;
+            Close(c);
+            return false;
+        }
+        if (!c.parser.Started()) c.waitStartMs = PerfNowMs();
+        size_t used = 0;
+        const HttpParseState st = c.parser.Feed(data, len, &used);
+        if (st == HttpParseState::Error)
+        {
+            static const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            (void)send(c.s, kBadRequest, (int)sizeof(kBadRequest) - 1, 0);
+            Close(c);
+            return false;
+        }
+        if (st != HttpParseState::Done) return true;
+        c.pending.append(data + used, len - used);
+        return Dispatch(c);
+    }
+
+    // Short endpoints are answered here and keep the connection; /audio, /tiles and /cursor go
+    // to a thread; everything else is the /mjpeg stream (also the default for unknown paths).
+    bool Dispatch(LoopConnection& c)
+    {
+        const HttpRequest& req = c.parser.req;
+        const std::string& path = req.path;
+        c.keepAlive = WantsKeepAlive(req);
+        if (g_httpAuthEnabled && !IsHttpAuthorized(req))
+        {
+            static const char kUnauthorized[] = "Unauthorized";
+            return Respond(c, "401 Unauthorized", "text/plain; charset=utf-8", kUnauthorized,
+                "WWW-Authenticate: Basic realm=\"LANSCR\"\r\n");
+        }
+        if (g_verbose) LogInfo("HTTP %s %s from %s\n", req.method.c_str(), req.target.c_str(), c.ip.c_str());
+
+        if (path == "/control")
+        {
+            return Respond(c, "200 OK", "application/json; charset=utf-8", HandleControlRequest(req.query, port),
+                "Cache-Control: no-store\r\n");
+        }
+        if (path == "/" || path == "/index.html")
+        {
+            return RespondAsset(c, GetLandingPage(port));
+        }
+        if (path == "/cursor.png")
+        {
+            std::vector<uint8_t> png;
+            std::string id;
+            if (g_cursorMeta && QueryGetString(req.query, "id", id) && FindCursorShape(std::strtoull(id.c_str(), nullptr, 16), png))
+            {
+                // Shapes are content-addressed, so they never change under the same id.
+                return Respond(c, "200 OK", "image/png", std::string(png.begin(), png.end()),
+                    "Cache-Control: public, max-age=86400, immutable\r\n");
+            }
+            return Respond(c, "404 Not Found", "text/plain; charset=utf-8", "Not found\n", "");
+        }
+        if (path == "/events")
+        {
+            StartEvents(c);
+            return Flush(c);
+        }
+        if (path == "/ws")
+        {
+            std::string key;
+            if (!IsWebSocketUpgrade(req, key))
+            {
+                c.keepAlive = false;
+                return Respond(c, "400 Bad Request", "text/plain; charset=utf-8", "Expected a WebSocket upgrade\n", "");
+            }
+            const std::string query = req.query;
+            StartViewer(c, query, &key);
+            return Flush(c);
+        }
+        if (IsThreadedStreamPath(path))
+        {
+            HandOff(c);
+            return false;
+        }
+        const std::string query = req.query;
+        StartViewer(c, query, nullptr);
+        return Flush(c);
+    }
+
+    // /events: Server-Sent Events. The first snapshot goes out on the next loop tick.
+    void StartEvents(LoopConnection& c)
+    {
+        c.events = true;
+        c.parser.Reset();
+        eventClients++;
+        if (g_verbose) LogInfo("Events stream to %s\n", c.ip.c_str());
+        c.header =
+            "HTTP/1.1 200 OK\r\n"
+            "Connection: close\r\n"
+            "Cache-Control: no-store\r\n"
+            "X-Accel-Buffering: no\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "\r\n"
+            "retry: 2000\n\n";
+        c.bufs[0].buf = const_cast<char*>(c.header.data());
+        c.bufs[0].len = (ULONG)c.header.size();
+        c.bufIndex = 0;
+        c.bufCount = 1;
+        c.lastSendMs = PerfNowMs();
+        c.lastProgressMs = c.lastSendMs;
+    }
+
+    // What the landing page shows. fps/kbps are rounded so an idle server sends nothing new.
+    std::string EventsSnapshot() const
+    {
+        return std::string("{\"audioMuted\":") + (g_serverAudioMuted.load() ? "true" : "false") +
+            ",\"privateMode\":" + (g_httpAuthEnabled ? "true" : "false") +
+            ",\"cursorMeta\":" + (g_cursorMeta ? "true" : "false") +
+            ",\"port\":" + std::to_string((unsigned)port) +
+            ",\"viewers\":" + std::to_string(g_clientCount.load() + g_tileClientCount.load()) +
+            ",\"fps\":" + FormatFixed(g_paceFps.load(), 1) +
+            ",\"kbps\":" + FormatFixed(mjpegKbps, 0) + "}";
+    }
+
+    // Each idle subscriber gets the snapshot if it differs from what it last got (a busy one
+    // simply gets the newest snapshot later), or a heartbeat comment.
+    void PushEvents(double now)
+    {
+        const std::string snapshot = EventsSnapshot();
+        std::vector<LoopConnection*> due;
+        for (auto& kv : conns)
+        {
+            LoopConnection& c = *kv.second;
+            if (!c.events || c.Sending()) continue;
+            if (c.lastEvent != snapshot)
+            {
+                c.lastEvent = snapshot;
+                c.body = "data: " + snapshot + "\n\n";
+            }
+            else if (now - c.lastSendMs >= kEventsHeartbeatMs)
+            {
+                c.body = ":\n\n";
+            }
+            else
+            {
+                continue;
+            }
+            c.bufs[0].buf = const_cast<char*>(c.body.data());
+            c.bufs[0].len = (ULONG)c.body.size();
+            c.bufIndex = 0;
+            c.bufCount = 1;
+            c.lastSendMs = now;
+            c.lastProgressMs = now;
+            due.push_back(&c);
+        }
+        for (LoopConnection* c : due) (void)Flush(*c);
+    }
+
+    // Queues a short response; it is sent when the socket is next writable.
+    bool Respond(LoopConnection& c, const char* status, const char* contentType, std::string body, const std::string& extraHeaders)
+    {
+        c.header = MakeHttpResponseHead(status, contentType, body.size(), c.keepAlive, extraHeaders);
+        c.body = std::move(body);
+        return QueueResponse(c, c.body.data(), c.body.size());
+    }
+
+    // Cached page: 304 when the client's copy is current, else gzip when accepted.
+    bool RespondAsset(LoopConnection& c, std::shared_ptr<const CachedHttpAsset> asset)
+    {
+        const HttpRequest& req = c.parser.req;
+        const std::string gzipTag = asset->etag.substr(0, asset->etag.size() - 1) + "-gz\"";
+        const bool gzip = AcceptsGzip(req);
+        const std::string& etag = gzip ? gzipTag : asset->etag;
+        const std::string extra = "Cache-Control: no-cache\r\nVary: Accept-Encoding\r\nETag: " + etag + "\r\n";
+        if (IfNoneMatchHits(req, asset->etag) || IfNoneMatchHits(req, gzipTag))
+        {
+            c.header = MakeHttpResponseHead("304 Not Modified", nullptr, 0, c.keepAlive, extra);
+            return QueueResponse(c, nullptr, 0);
+        }
+        const std::string& body = gzip ? asset->gzip : asset->identity;
+        c.header = MakeHttpResponseHead("200 OK", asset->contentType.c_str(), body.size(), c.keepAlive,
+            gzip ? extra + "Content-Encoding: gzip\r\n" : extra);
+        c.asset = std::move(asset);
+        return QueueResponse(c, body.data(), body.size());
+    }
+
+    bool QueueResponse(LoopConnection& c, const char* body, size_t bodyLen)
+    {
+        c.bufs[0].buf = const_cast<char*>(c.header.data());
+        c.bufs[0].len = (ULONG)c.header.size();
+        c.bufs[1].buf = const_cast<char*>(body);
+        c.bufs[1].len = (ULONG)bodyLen;
+        c.bufIndex = 0;
+        c.bufCount = bodyLen > 0 ? 2 : 1;
+        c.responding = true;
+        c.lastProgressMs = PerfNowMs();
+        poller->Watch(c.s, true, true);
+        return true;
+    }
+
+    // Response sent: close, or go back to reading (starting with any pipelined bytes).
+    bool FinishResponse(LoopConnection& c)
+    {
+        c.responding = false;
+        c.body.clear();
+        c.asset.reset();
+        if (!c.keepAlive)
+        {
+            Close(c);
+            return false;
+        }
+        c.parser.Reset();
+        c.waitStartMs = PerfNowMs();
+        if (c.pending.empty()) return true;
+        std::string next;
+        next.swap(c.pending);
+        return OnRequestBytes(c, next.data(), next.size());
+    }
+
+    // /mjpeg[?q=&scale=] and /ws[?q=&scale=]: the viewer starts on the rendition nearest to
+    // q/scale (default: the best) and its rate controller may step it down from there, never
+    // above it. wsKey = the WebSocket handshake key for /ws, null for /mjpeg.
+    void StartViewer(LoopConnection& c, const std::string& query, const std::string* wsKey)
+    {
+        int wantQuality = 0;
+        std::string wantScale;
+        (void)QueryGetInt(query, "q", wantQuality);
+        (void)QueryGetString(query, "scale", wantScale);
+        c.rate.topLevel = NearestRendition(std::strtod(wantScale.c_str(), nullptr), wantQuality);
+        c.rate.level = c.rate.topLevel;
+        c.mjpeg = true;
+        c.ws = wsKey != nullptr;
+        c.parser.Reset();
+        c.pending.clear();
+
+        g_clientCount.fetch_add(1);
+        LogInfo("Streaming %s to %s (clients=%d, rendition %d: scale %.2f quality %d)\n", c.ws ? "/ws" : "/mjpeg", c.ip.c_str(),
+            g_clientCount.load(), c.rate.topLevel, g_renditions[c.rate.topLevel].scale, g_renditions[c.rate.topLevel].quality);
+
+        c.status.id = g_mjpegClientIds.fetch_add(1) + 1;
+        c.status.ip = c.ip;
+        c.status.level = c.rate.level;
+        c.status.rendition = c.rate.topLevel;
+        c.status.fps = fps;
+        c.status.ws = c.ws;
+        UpdateMjpegClientStatus(c.status);
+        g_renditionClients[c.rate.topLevel].fetch_add(1);
+        c.windowStartMs = PerfNowMs();
+
+        if (c.ws)
+        {
+            c.header =
+                "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " + WebSocketAcceptKey(*wsKey) + "\r\n"
+                "\r\n";
+        }
+        else
+        {
+            c.header =
+                "HTTP/1.1 200 OK\r\n"
+                "Connection: close\r\n"
+                "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+                "Pragma: no-cache\r\n"
+                "Expires: 0\r\n"
+                "X-Accel-Buffering: no\r\n"
+                "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+                "\r\n";
+        }
+        c.bufs[0].buf = const_cast<char*>(c.header.data());
+        c.bufs[0].len = (ULONG)c.header.size();
+        c.bufIndex = 0;
+        c.bufCount = 1;
+        c.lastProgressMs = PerfNowMs();
+    }
+
+    // Queues the newest frame when the viewer is idle (for /ws: also has a free in-flight slot)
+    // and its level's frame slot has passed. A viewer still busy simply gets whatever is newest
+    // when it is ready (latest wins).
+    bool StartPart(LoopConnection& c, double now)
+    {
+        if (!c.mjpeg || c.Sending() || c.wsClosing) return true;
+        if (c.ws && c.wsInFlight.size() >= (size_t)kWsMaxInFlight) return true;
+        std::shared_ptr<const MjpegFrameSet> set = std::atomic_load(&g_sharedFrame.current);
+        if (!set || set->seq == c.lastSeq) return true;
+
+        const MjpegLevel& lvl = g_mjpegLevels[c.rate.level];
+        const double slotEnd = c.lastSendMs + 1000.0 * lvl.fpsDivisor / std::max(1, fps);
+        if (lvl.fpsDivisor > 1 && now < slotEnd)
+        {
+            nextSlotMs = nextSlotMs > 0.0 ? std::min(nextSlotMs, slotEnd) : slotEnd;
+            return true;
+        }
+
+        const MjpegPart* part = PickRendition(*set, lvl.rendition);
+        if (!part) return true;
+        if (c.lastSeq != 0 && set->seq > c.lastSeq + 1) c.status.skippedFrames += set->seq - c.lastSeq - 1;
+        c.lastSeq = set->seq;
+        if (c.ws)
+        {
+            QueueWsFrame(c, *set, *part, now);
+        }
+        else
+        {
+            MjpegPartBuffers(*part, c.bufs);
+            c.bufIndex = 0;
+            c.bufCount = 3;
+            c.partBytes = part->jpeg->size();
+        }
+        c.pinned = std::move(set);
+        c.partStartMs = now;
+        c.lastProgressMs = now;
+        return Flush(c);
+    }
+
+    // One binary message: frame header + version/seq/latency header (c.header), then the JPEG.
+    void QueueWsFrame(LoopConnection& c, const MjpegFrameSet& set, const MjpegPart& part, double now)
+    {
+        const size_t jpegBytes = part.jpeg->size();
+        c.header.clear();
+        AppendWsFrameHeader(c.header, 0x2, kWsHeaderBytes + jpegBytes);
+        const uint32_t version = 1;
+        const uint32_t headerBytes = (uint32_t)kWsHeaderBytes;
+        const double seq = (double)set.seq;
+        const double latencyMs = c.status.latencyMs;
+        c.header.append((const char*)&version, 4);
+        c.header.append((const char*)&headerBytes, 4);
+        c.header.append((const char*)&seq, 8);
+        c.header.append((const char*)&latencyMs, 8);
+        c.bufs[0].buf = const_cast<char*>(c.header.data());
+        c.bufs[0].len = (ULONG)c.header.size();
+        c.bufs[1].buf = (char*)part.jpeg->data();
+        c.bufs[1].len = (ULONG)jpegBytes;
+        c.bufIndex = 0;
+        c.bufCount = 2;
+        c.lastSendMs = now;
+        c.wsInFlight.push_back({ set.seq, now, set.captureMs, jpegBytes });
+    }
+
+    // Acks (and close) from a /ws viewer. Returns false when the connection was closed.
+    bool OnWsMessages(LoopConnection& c)
+    {
+        uint8_t opcode = 0;
+        std::string payload;
+        uint16_t closeCode = 0;
+        for (;;)
+        {
+            const int r = TakeWsClientMessage(c.pending, opcode, payload, closeCode);
+            if (r == 0) return true;
+            if (r < 0 || opcode == 0x8)
+            {
+                c.wsClosing = true;
+                if (r < 0) c.wsCloseCode = { (char)(closeCode >> 8), (char)(closeCode & 0xFF) };
+                else c.wsCloseCode = payload.substr(0, payload.size() >= 2 ? 2 : 0);
+                c.pending.clear();
+                return c.Sending() ? true : QueueWsClose(c);
+            }
+            if (opcode == 0x9)
+            {
+                // Only the latest ping needs its pong (RFC 6455 5.5.3).
+                c.wsPingPayload = payload;
+                c.wsPongDue = true;
+                if (!c.Sending()) QueueWsPong(c);
+                continue;
+            }
+            if (opcode != 0x2 || payload.size() != kWsAckBytes) continue; // pongs/text: ignored
+            double seq = 0.0;
+            double holdMs = 0.0;
+            std::memcpy(&seq, payload.data(), 8);
+            std::memcpy(&holdMs, payload.data() + 8, 8);
+            if (!OnWsAck(c, (uint64_t)seq, std::max(0.0, holdMs))) return false;
+        }
+    }
+
+    // Answers a ping with a pong carrying the same payload.
+    void QueueWsPong(LoopConnection& c)
+    {
+        c.wsPongDue = false;
+        c.header.clear();
+        AppendWsFrameHeader(c.header, 0xA, c.wsPingPayload.size());
+        c.header += c.wsPingPayload;
+        c.bufs[0].buf = const_cast<char*>(c.header.data());
+        c.bufs[0].len = (ULONG)c.header.size();
+        c.bufIndex = 0;
+        c.bufCount = 1;
+        c.lastProgressMs = PerfNowMs();
+        poller->Watch(c.s, true, true);
+    }
+
+    // Answers a client close frame with one echoing its status code (RFC 6455 5.5.1), or
+    // closes with 1002/1009 on a protocol error; the connection is closed once it is sent.
+    bool QueueWsClose(LoopConnection& c)
+    {
+        c.header.clear();
+        AppendWsFrameHeader(c.header, 0x8, c.wsCloseCode.size());
+        c.header += c.wsCloseCode;
+        c.keepAlive = false;
+        return QueueResponse(c, nullptr, 0);
+    }
+
+    // The ack round trip minus the viewer's hold time is the network RTT; it also stands in
+    // for the send time the rate controller sees for /mjpeg parts.
+    bool OnWsAck(LoopConnection& c, uint64_t seq, double holdMs)
+    {
+        auto it = std::find_if(c.wsInFlight.begin(), c.wsInFlight.end(), [&](const LoopConnection::WsFrameInFlight& f) { return f.seq == seq; });
+        if (it == c.wsInFlight.end()) return true;
+        const LoopConnection::WsFrameInFlight f = *it;
+        c.wsInFlight.erase(c.wsInFlight.begin(), it + 1);
+
+        const double now = PerfNowMs();
+        const double rttMs = std::max(0.0, now - f.sendMs - holdMs);
+        if (f.captureMs > 0.0) c.status.latencyMs = (f.sendMs - f.captureMs) + rttMs / 2.0 + holdMs;
+        OnFrameDelivered(c, f.bytes, rttMs, now);
+        return StartPart(c, now);
+    }
+
+    // Sends from the write cursor until done or the socket is full. Returns false when the
+    // connection was closed.
+    bool Flush(LoopConnection& c)
+    {
+        if (!c.SendFromCursor())
+        {
+            Close(c);
+            return false;
+        }
+        if (c.Sending())
+        {
+            poller->Watch(c.s, true, true);
+            return true;
+        }
+        poller->Watch(c.s, true, false);
+        if (c.responding) return FinishResponse(c);
+        c.pinned.reset();
+        if (c.partBytes > 0) OnPartSent(c);
+        if (c.wsClosing) return QueueWsClose(c);
+        if (c.wsPongDue)
+        {
+            QueueWsPong(c);
+            return true;
+        }
+        return StartPart(c, PerfNowMs());
+    }
+
+    void OnPartSent(LoopConnection& c)
+    {
+        const double now = PerfNowMs();
+        const size_t bytes = c.partBytes;
+        c.partBytes = 0;
+        c.lastSendMs = now;
+        OnFrameDelivered(c, bytes, now - c.partStartMs, now);
+    }
+
+    void OnFrameDelivered(LoopConnection& c, size_t bytes, double sendMs, double now)
+    {
+        mjpegBytes += bytes;
+        c.windowBytes += bytes;
+        c.windowFrames++;
+
+        const int oldLevel = c.rate.level;
+        const bool levelChanged = c.rate.OnFrameSent(bytes, sendMs, fps, now);
+        if (levelChanged)
+        {
+            const MjpegLevel& next = g_mjpegLevels[c.rate.level];
+            g_renditionClients[g_mjpegLevels[oldLevel].rendition].fetch_sub(1);
+            g_renditionClients[next.rendition].fetch_add(1);
+            if (g_verbose)
+            {
+                LogInfo("mjpeg: %s level %d -> %d (scale %.2f quality %d, fps /%d, budget %.0f kbps)\n", c.ip.c_str(), oldLevel,
+                    c.rate.level, g_renditions[next.rendition].scale, g_renditions[next.rendition].quality, next.fpsDivisor,
+                    c.rate.budgetBps * 8.0 / 1000.0);
+            }
+        }
+        if (levelChanged || now - c.windowStartMs >= 1000.0) PublishStatus(c, now);
+    }
+
+    void PublishStatus(LoopConnection& c, double now)
+    {
+        const double secs = std::max(0.001, (now - c.windowStartMs) / 1000.0);
+        c.status.level = c.rate.level;
+        c.status.rendition = g_mjpegLevels[c.rate.level].rendition;
+        c.status.fps = c.windowFrames / secs;
+        c.status.kbps = c.windowBytes * 8.0 / 1000.0 / secs;
+        c.status.queuedBytes = c.QueuedBytes();
+        UpdateMjpegClientStatus(c.status);
+        c.windowStartMs = now;
+        c.windowBytes = 0;
+        c.windowFrames = 0;
+    }
+
+    // Once a second: unfinished requests, idle keep-alive connections and stuck responses time
+    // out, and a viewer whose socket has not taken a byte for kMjpegStallTimeoutMs is gone. A
+    // viewer stuck in a part still has its status refreshed, so /control shows its backlog
+    // instead of its last good second. Also samples the delivered MJPEG bitrate for /events.
+    void Housekeep(double now)
+    {
+        std::vector<LoopConnection*> stale;
+        for (auto& kv : conns)
+        {
+            LoopConnection& c = *kv.second;
+            if (c.Streaming())
+            {
+                if (c.Sending() && now - c.lastProgressMs > kMjpegStallTimeoutMs) stale.push_back(&c);
+                else if (c.ws && !c.wsInFlight.empty() && now - c.wsInFlight.front().sendMs > kMjpegStallTimeoutMs) stale.push_back(&c);
+                else if (c.mjpeg && c.Sending() && now - c.windowStartMs >= 1000.0) PublishStatus(c, now);
+            }
+            else if (c.responding)
+            {
+                if (now - c.lastProgressMs > kRequestTimeoutMs) stale.push_back(&c);
+            }
+            else if (now - c.waitStartMs > (c.parser.Started() ? kRequestTimeoutMs : kKeepAliveIdleMs))
+            {
+                stale.push_back(&c);
+            }
+        }
+        for (LoopConnection* c : stale) Close(*c);
+
+        mjpegKbps = mjpegBytes * 8.0 / std::max(1.0, now - kbpsWindowStartMs);
+        mjpegBytes = 0;
+        kbpsWindowStartMs = now;
+    }
+
+    void Run()
+    {
+        std::vector<PollEvent> events;
+        std::vector<SOCKET> idle;
+        uint64_t seenSeq = 0;
+        double lastExpireMs = PerfNowMs();
+        double lastEventsMs = lastExpireMs;
+        kbpsWindowStartMs = lastExpireMs;
+        poller->Watch(listenSock, true, false);
+        poller->Watch(waker.sock, true, false);
+
+        while (g_running.load())
+        {
+            if (WaitForSingleObject(stopEvent, 0) == WAIT_OBJECT_0)
+            {
+                g_running.store(false);
+                break;
+            }
+
+            double now = PerfNowMs();
+            int timeoutMs = kIdleWaitMs;
+            if (nextSlotMs > 0.0) timeoutMs = std::max(0, std::min(timeoutMs, (int)(nextSlotMs - now) + 1));
+            if (eventClients > 0) timeoutMs = std::max(0, std::min(timeoutMs, (int)(lastEventsMs + kEventsIntervalMs - now) + 1));
+            if (!poller->Wait(timeoutMs, events))
+            {
+                LogError("WSAPoll failed (%d)\n", WSAGetLastError());
+                break;
+            }
+
+            bool frameReady = false;
+            for (const PollEvent& e : events)
+            {
+                if (e.s == listenSock)
+                {
+                    Accept();
+                    continue;
+                }
+                if (e.s == waker.sock)
+                {
+                    waker.Drain();
+                    frameReady = true;
+                    continue;
+                }
+                auto it = conns.find(e.s);
+                if (it == conns.end()) continue;
+                LoopConnection& c = *it->second;
+                if (e.readable || (e.failed && !e.writable))
+                {
+                    if (!OnReadable(c)) continue;
+                }
+                if (e.writable || e.failed)
+                {
+                    (void)Flush(c);
+                }
+            }
+
+            // New frame, or a reduced-fps viewer's slot has passed: start parts for idle viewers.
+            now = PerfNowMs();
+            std::shared_ptr<const MjpegFrameSet> set = std::atomic_load(&g_sharedFrame.current);
+            if (set && set->seq != seenSeq) frameReady = true;
+            if (nextSlotMs > 0.0 && now >= nextSlotMs) frameReady = true;
+            if (frameReady)
+            {
+                seenSeq = set ? set->seq : 0;
+                nextSlotMs = 0.0;
+                idle.clear();
+                for (auto& kv : conns)
+                {
+                    if (kv.second->mjpeg && !kv.second->Sending()) idle.push_back(kv.first);
+                }
+                for (SOCKET s : idle)
+                {
+                    auto it = conns.find(s);
+                    if (it != conns.end()) (void)StartPart(*it->second, now);
+                }
+            }
+
+            if (eventClients > 0 && now - lastEventsMs >= kEventsIntervalMs)
+            {
+                PushEvents(now);
+                lastEventsMs = now;
+            }
+
+            if (now - lastExpireMs >= 1000.0)
+            {
+                Housekeep(now);
+                lastExpireMs = now;
+            }
+        }
+
+        std::vector<LoopConnection*> all;
+        for (auto& kv : conns) all.push_back(kv.second.get());
+        for (LoopConnection* c : all) Close(*c);
+    }
+};
+
+static int RunServer(uint16_t port, int fps, int jpegQuality0to100)
+{
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    // Improve Sleep() timing precision for lower jitter.
+    timeBeginPeriod(1);
+
+    // Reset run flag in case this process previously ran client/server.
+    g_running.store(true);
+    ConfigureMjpegRenditions(jpegQuality0to100);
+
+    HANDLE stopEvent = CreateStopEventForPort(port);
+    if (!stopEvent)
+    {
+        LogError("CreateEvent failed (stop event)\n");
+        return 1;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        LogError("A server is already running for port %u.\n", (unsigned)port);
+        CloseHandle(stopEvent);
+        return 1;
+    }
+
+    g_serverPort.store(port);
+
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    {
+        LogError("WSAStartup failed\n");
+        CloseHandle(stopEvent);
+        return 1;
+    }
+
+    SOCKET listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listenSock == INVALID_SOCKET)
+    {
+        LogError("socket() failed\n");
+        WSACleanup();
+        CloseHandle(stopEvent);
+        return 1;
+    }
+
+    int yes = 1;
+    setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(listenSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+    {
+        LogError("bind() failed (port %u). Maybe already in use?\n", (unsigned)port);
+        closesocket(listenSock);
+        WSACleanup();
+        CloseHandle(stopEvent);
+        return 1;
+    }
+
+    if (listen(listenSock, SOMAXCONN) == SOCKET_ERROR)
+    {
+        LogError("listen() failed\n");
+        closesocket(listenSock);
+        WSACleanup();
+        CloseHandle(stopEvent);
+        return 1;
+    }
+
+    LogInfo("LAN MJPEG server running on http://0.0.0.0:%u/\n", (unsigned)port);
+    for (int r = 0; r < g_renditionCount; r++)
+    {
+        LogInfo("MJPEG rendition %d: scale %.2f quality %d (/mjpeg?scale=%.2f&q=%d)\n", r, g_renditions[r].scale, g_renditions[r].quality,
+            g_renditions[r].scale, g_renditions[r].quality);
+    }
+    LogInfo("Press Ctrl+C to stop.\n");
+
+    // Start one capture thread for all clients (much smoother for LAN / multiple clients).
+    if (!g_captureThreadRunning.exchange(true))
+    {
+        std::thread cap([fps, jpegQuality0to100, stopEvent]() {
+            CaptureLoopThread(fps, jpegQuality0to100, stopEvent);
+        });
+        cap.detach();
+    }
+    if (g_cursorMeta && !g_cursorThreadRunning.exchange(true))
+    {
+        std::thread cur([stopEvent]() { CursorTrackerThread(stopEvent); });
+        cur.detach();
+    }
+
+    // One thread serves accept, request reads and every /mjpeg viewer (see ServerLoop).
+    u_long nb = 1;
+    (void)ioctlsocket(listenSock, FIONBIO, &nb);
+    ServerLoop loop;
+    loop.poller = CreateSocketPoller();
+    loop.listenSock = listenSock;
+    loop.port = port;
+    loop.fps = fps;
+    loop.stopEvent = stopEvent;
+    if (!loop.waker.Open())
+    {
+        LogError("Server loop wake socket failed (%d)\n", WSAGetLastError());
+        g_running.store(false);
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_serverWakerMtx);
+            g_serverWaker = &loop.waker;
+        }
+        loop.Run();
+        {
+            std::lock_guard<std::mutex> lock(g_serverWakerMtx);
+            g_serverWaker = nullptr;
+        }
+        closesocket(loop.waker.sock);
+    }
+
+    closesocket(listenSock);
+    WSACleanup();
+    CloseHandle(stopEvent);
+    timeEndPeriod(1);
+    return 0;
+}
+
+// ----------------------------
+// MJPEG client viewer (WinHTTP + WIC + Win32 window)
+// ----------------------------
+
+// When the frame in a FrameBuffer was made and delivered. seq, captureMs and encodeMs come
+// from the server (MJPEG part headers or the UDP header; 0 when it does not send them), the
+// rest is measured on the viewer's clock.
+struct FrameTiming
+{
+    uint64_t seq = 0;
+    double captureMs = 0.0; // server clock
+    double encodeMs = 0.0;
+    double receivedMs = 0.0; // last byte of the frame in
+    double decodedMs = 0.0;
+};
+
+struct FrameBuffer
+{
+    std::mutex mtx;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> bgra;
+    bool hasFrame = false;
+    FrameTiming timing;
+};
+
+static FrameBuffer g_frame;
+static HWND g_hwnd = nullptr;
+static constexpr UINT WM_NEW_FRAME = WM_APP + 1;
+
+// Per-frame latency of the native viewers, averaged over half a second into the title bar.
+// The server's clock is not the viewer's, so transit (encoded -> received) is shown relative to
+// the fastest frame of the last few seconds: the queueing delay on top of the best case. On the
+// UI thread only.
+struct ClientLatencyStats
+{
+    double lastDecodedMs = 0.0; // identifies the frame painted last
+    uint64_t lastSeq = 0;
+    uint64_t frames = 0;
+    uint64_t dropped = 0; // seq gaps: skipped by the server or replaced before they were painted
+    uint64_t transitFrames = 0;
+    double encodeMs = 0.0;
+    double transitMs = 0.0;
+    double decodeMs = 0.0;
+    double presentMs = 0.0;
+    double windowStartMs = 0.0;
+    double baseMs = 0.0; // min(received - encoded) over the current and previous 5 s
+    double baseCurMs = 0.0;
+    double basePrevMs = 0.0;
+    double baseStartMs = 0.0;
+
+    // Called after each paint; returns true with a new summary in text every 500 ms.
+    bool OnPresented(const FrameTiming& t, double now, std::wstring& text)
+    {
+        if (t.decodedMs <= 0.0 || t.decodedMs == lastDecodedMs) return false;
+        lastDecodedMs = t.decodedMs;
+        if (t.seq != 0)
+        {
+            if (lastSeq != 0 && t.seq > lastSeq + 1) dropped += t.seq - lastSeq - 1;
+            lastSeq = t.seq;
+        }
+        if (windowStartMs == 0.0) windowStartMs = now;
+        frames++;
+        encodeMs += t.encodeMs;
+        decodeMs += t.decodedMs - t.receivedMs;
+        presentMs += now - t.decodedMs;
+        if (t.captureMs > 0.0)
+        {
+            const double raw = t.receivedMs - (t.captureMs + t.encodeMs);
+            if (baseStartMs == 0.0 || now - baseStartMs >= 5000.0)
+            {
+                basePrevMs = baseStartMs == 0.0 ? raw : baseCurMs;
+                baseCurMs = raw;
+                baseStartMs = now;
+            }
+            baseCurMs = std::min(baseCurMs, raw);
+            baseMs = std::min(baseCurMs, basePrevMs);
+            transitMs += raw - baseMs;
+            transitFrames++;
+        }
+        if (now - windowStartMs < 500.0) return false;
+
+        wchar_t buf[256];
+        const double n = (double)frames;
+        if (transitFrames > 0)
+        {
+            std::swprintf(buf, 256, L"seq %llu | encode %.1f ms | transit +%.1f ms | decode %.1f ms | present %.1f ms | dropped %llu",
+                (unsigned long long)lastSeq, encodeMs / n, transitMs / (double)transitFrames, decodeMs / n, presentMs / n,
+                (unsigned long long)dropped);
+        }
+        else
+        {
+            std::swprintf(buf, 256, L"decode %.1f ms | present %.1f ms", decodeMs / n, presentMs / n);
+        }
+        text = buf;
+        frames = 0;
+        transitFrames = 0;
+        encodeMs = transitMs = decodeMs = presentMs = 0.0;
+        windowStartMs = now;
+        return true;
+    }
+};
+
+static ClientLatencyStats g_clientLatency;
+static std::wstring g_clientTitle; // window title without the latency summary
+
+// Cursor drawn by the viewer when the server runs with --cursor-meta (see StreamCursorThread).
+struct ClientCursor
+{
+    std::mutex mtx;
+    bool visible = false;
+    int x = 0; // hotspot, in server frame pixels
+    int y = 0;
+    int hotX = 0;
+    int hotY = 0;
+    int screenW = 0;
+    int screenH = 0;
+    uint64_t shapeId = 0;
+    int shapeW = 0;
+    int shapeH = 0;
+    std::vector<uint8_t> shapeBgra; // straight alpha
+};
+
+static ClientCursor g_clientCursor;
+
+static std::string ToLowerAscii(std::string s)
+{
+    for (char& c : s) c = (char)std::tolower((unsigned char)c);
+    return s;
+}
+
+static bool FindBytes(const std::vector<uint8_t>& buf, const char* needle, size_t needleLen, size_t start, size_t& posOut)
+{
+    if (needleLen == 0 || buf.size() < needleLen) return false;
+    for (size_t i = start; i + needleLen <= buf.size(); i++)
+    {
+        if (std::memcmp(buf.data() + i, needle, needleLen) == 0)
+        {
+            posOut = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Numeric value of a "name: value" line in a lower-cased MJPEG part header, 0 when absent.
+static double PartHeaderNumber(const std::string& headerLower, const char* name)
+{
+    const size_t pos = headerLower.find(name);
+    if (pos == std::string::npos) return 0.0;
+    return std::strtod(headerLower.c_str() + pos + std::strlen(name), nullptr);
+}
+
+// Opens the first frame of an in-memory image. The bytes are read in place (no HGLOBAL
+// copy) and must outlive the frame.
+static HRESULT OpenWicFrame(IWICImagingFactory* factory, const uint8_t* data, size_t len, IWICBitmapFrameDecode** outFrame)
+{
+    *outFrame = nullptr;
+    if (!data || len == 0 || len > 0xFFFFFFFFu) return E_INVALIDARG;
+
+    IWICStream* stream = nullptr;
+    HRESULT hr = factory->CreateStream(&stream);
+    if (FAILED(hr)) return hr;
+    hr = stream->InitializeFromMemory(const_cast<BYTE*>(data), (DWORD)len);
+    if (FAILED(hr))
+    {
+        stream->Release();
+        return hr;
+    }
+
+    IWICBitmapDecoder* decoder = nullptr;
+    hr = factory->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnLoad, &decoder);
+    stream->Release();
+    if (FAILED(hr)) return hr;
+
+    hr = decoder->GetFrame(0, outFrame);
+    decoder->Release();
+    return hr;
+}
+
+static HRESULT WicFrameToBGRA(IWICImagingFactory* factory, IWICBitmapFrameDecode* frame, int& outW, int& outH, std::vector<uint8_t>& outBGRA)
+{
+    UINT w = 0, h = 0;
+    HRESULT hr = frame->GetSize(&w, &h);
+    if (FAILED(hr)) return hr;
+
+    IWICFormatConverter* conv = nullptr;
+    hr = factory->CreateFormatConverter(&conv);
+    if (FAILED(hr)) return hr;
+
+    hr = conv->Initialize(frame, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+    if (FAILED(hr))
+    {
+        conv->Release();
+        return hr;
+    }
+
+    const UINT stride = w * 4;
+    outBGRA.resize((size_t)stride * (size_t)h);
+    hr = conv->CopyPixels(nullptr, stride, (UINT)outBGRA.size(), outBGRA.data());
+    conv->Release();
+    if (FAILED(hr))
+    {
+        outBGRA.clear();
+        return hr;
+    }
+
+    outW = (int)w;
+    outH = (int)h;
+    return S_OK;
+}
+
+static HRESULT DecodeJpegToBGRA(IWICImagingFactory* factory, const uint8_t* jpg, size_t jpgLen, int& outW, int& outH, std::vector<uint8_t>& outBGRA)
+{
+    outBGRA.clear();
+    IWICBitmapFrameDecode* frame = nullptr;
+    HRESULT hr = OpenWicFrame(factory, jpg, jpgLen, &frame);
+    if (FAILED(hr)) return hr;
+    hr = WicFrameToBGRA(factory, frame, outW, outH, outBGRA);
+    frame->Release();
+    return hr;
+}
+
+// Decodes a JPEG frame as Y + interleaved CbCr planes (WIC's planar path, Windows 8.1+) and
+// converts them with the SIMD kernels, skipping WIC's own colour converter. Returns
+// E_NOTIMPL when the codec or the chroma layout (only 4:4:4, 4:2:2, 4:2:0) is unsupported.
+static HRESULT DecodeWicPlanarToBGRA(IWICBitmapFrameDecode* frame, std::vector<uint8_t>& yPlane, std::vector<uint8_t>& cPlane,
+    int& outW, int& outH, std::vector<uint8_t>& outBGRA)
+{
+    IWICPlanarBitmapSourceTransform* planar = nullptr;
+    if (FAILED(frame->QueryInterface(IID_PPV_ARGS(&planar)))) return E_NOTIMPL;
+
+    UINT w = 0, h = 0;
+    HRESULT hr = frame->GetSize(&w, &h);
+    const WICPixelFormatGUID formats[2] = { GUID_WICPixelFormat8bppY, GUID_WICPixelFormat16bppCbCr };
+    WICBitmapPlaneDescription desc[2] = {};
+    BOOL supported = FALSE;
+    if (SUCCEEDED(hr))
+    {
+        UINT tw = w, th = h;
+        hr = planar->DoesSupportTransform(&tw, &th, WICBitmapTransformRotate0, WICPlanarOptionsDefault, formats, desc, 2, &supported);
+        if (SUCCEEDED(hr) && (!supported || tw != w || th != h)) hr = E_NOTIMPL;
+    }
+    const bool halfX = desc[1].Width != w;
+    const bool halfY = desc[1].Height != h;
+    if (SUCCEEDED(hr) && ((halfX && desc[1].Width != (w + 1) / 2) || (halfY && desc[1].Height != (h + 1) / 2)))
+    {
+        hr = E_NOTIMPL;
+    }
+    if (FAILED(hr))
+    {
+        planar->Release();
+        return E_NOTIMPL;
+    }
+
+    const UINT cStride = desc[1].Width * 2;
+    yPlane.resize((size_t)w * h);
+    cPlane.resize((size_t)cStride * desc[1].Height);
+    const WICBitmapPlane planes[2] = {
+        { GUID_WICPixelFormat8bppY, yPlane.data(), w, (UINT)yPlane.size() },
+        { GUID_WICPixelFormat16bppCbCr, cPlane.data(), cStride, (UINT)cPlane.size() },
+    };
+    hr = planar->CopyPixels(nullptr, w, h, WICBitmapTransformRotate0, WICPlanarOptionsDefault, planes, 2);
+    planar->Release();
+    if (FAILED(hr)) return hr;
+
+    const PixelKernels& k = Kernels();
+    outBGRA.resize((size_t)w * h * 4);
+    for (UINT y = 0; y < h; y++)
+    {
+        const uint8_t* cRow = cPlane.data() + (size_t)(halfY ? y / 2 : y) * cStride;
+        k.yccToBgra(yPlane.data() + (size_t)y * w, cRow, (int)w, halfX, outBGRA.data() + (size_t)y * w * 4);
+    }
+    outW = (int)w;
+    outH = (int)h;
+    return S_OK;
+}
+
+// JPEG decoder used by the viewers (see FrameEncoder); one instance per decoding thread.
+// Output is tightly packed BGRA.
+struct FrameDecoder
+{
+    virtual ~FrameDecoder() = default;
+    virtual const char* Name() const = 0;
+    virtual HRESULT Decode(const uint8_t* jpg, size_t jpgLen, int& outW, int& outH, std::vector<uint8_t>& outBGRA) = 0;
+};
+
+// factory is borrowed and must outlive the decoder.
+struct WicFrameDecoder : FrameDecoder
+{
+    IWICImagingFactory* factory = nullptr;
+
+    std::vector<uint8_t> yPlane;
+    std::vector<uint8_t> cPlane;
+
+    explicit WicFrameDecoder(IWICImagingFactory* f) : factory(f) {}
+    const char* Name() const override { return "wic"; }
+
+    HRESULT Decode(const uint8_t* jpg, size_t jpgLen, int& outW, int& outH, std::vector<uint8_t>& outBGRA) override
+    {
+        if (!factory) return E_FAIL;
+        IWICBitmapFrameDecode* frame = nullptr;
+        HRESULT hr = OpenWicFrame(factory, jpg, jpgLen, &frame);
+        if (FAILED(hr)) return hr;
+        hr = DecodeWicPlanarToBGRA(frame, yPlane, cPlane, outW, outH, outBGRA);
+        if (FAILED(hr)) hr = WicFrameToBGRA(factory, frame, outW, outH, outBGRA);
+        frame->Release();
+        return hr;
+    }
+};
+
+struct TurboFrameDecoder : FrameDecoder
+{
+    const TurboJpegApi& tj = TurboJpeg();
+    TurboJpegApi::Handle handle = nullptr;
+
+    TurboFrameDecoder()
+    {
+        if (tj.loaded) handle = tj.initDecompress();
+    }
+    ~TurboFrameDecoder() override
+    {
+        if (handle) tj.destroy(handle);
+    }
+    const char* Name() const override { return "turbo"; }
+
+    HRESULT Decode(const uint8_t* jpg, size_t jpgLen, int& outW, int& outH, std::vector<uint8_t>& outBGRA) override
+    {
+        if (!handle) return E_FAIL;
+        if (!jpg || jpgLen == 0 || jpgLen > 0xFFFFFFFFu) return E_INVALIDARG;
+        int w = 0, h = 0, subsamp = 0, colorspace = 0;
+        if (tj.decompressHeader3(handle, jpg, (unsigned long)jpgLen, &w, &h, &subsamp, &colorspace) != 0 || w <= 0 || h <= 0)
+        {
+            return E_FAIL;
+        }
+        outBGRA.resize((size_t)w * (size_t)h * 4);
+        if (tj.decompress2(handle, jpg, (unsigned long)jpgLen, outBGRA.data(), w, w * 4, h, TurboJpegApi::kPixelBgra, 0) != 0)
+        {
+            if (g_verbose) LogError("turbojpeg: %s\n", tj.errorStr2(handle));
+            outBGRA.clear();
+            return E_FAIL;
+        }
+        outW = w;
+        outH = h;
+        return S_OK;
+    }
+};
+
+static std::unique_ptr<FrameDecoder> CreateFrameDecoder(const std::string& name, IWICImagingFactory* factory)
+{
+    if (name == "wic")
+    {
+        if (!factory) return nullptr;
+        return std::make_unique<WicFrameDecoder>(factory);
+    }
+    if (name == "turbo")
+    {
+        auto dec = std::make_unique<TurboFrameDecoder>();
+        if (!dec->handle) return nullptr;
+        return dec;
+    }
+    return nullptr;
+}
+
+// The decoder chosen with --decoder, falling back to WIC when it cannot be created.
+static std::unique_ptr<FrameDecoder> CreateConfiguredFrameDecoder(IWICImagingFactory* factory)
+{
+    std::unique_ptr<FrameDecoder> dec = CreateFrameDecoder(g_decoderSpec, factory);
+    if (!dec && g_decoderSpec != "wic")
+    {
+        LogError("JPEG decoder '%s' unavailable (turbojpeg.dll not found), using wic\n", g_decoderSpec.c_str());
+        dec = CreateFrameDecoder("wic", factory);
+    }
+    return dec;
+}
+
+static bool MakeAudioUrlFromVideoUrl(const std::wstring& url, std::wstring& outAudioUrl)
+{
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+
+    std::wstring scheme(16, L'\0');
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszScheme = scheme.data();
+    uc.dwSchemeLength = (DWORD)scheme.size();
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+
+    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) return false;
+
+    scheme.resize(uc.dwSchemeLength);
+    host.resize(uc.dwHostNameLength);
+
+    wchar_t buf[2048];
+    swprintf_s(buf, L"%s://%s:%u/audio", scheme.c_str(), host.c_str(), (unsigned)uc.nPort);
+    outAudioUrl = buf;
+    return true;
+}
+
+static bool MakeControlUrlFromVideoUrl(const std::wstring& url, std::wstring& outControlUrl)
+{
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+
+    std::wstring scheme(16, L'\0');
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszScheme = scheme.data();
+    uc.dwSchemeLength = (DWORD)scheme.size();
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+
+    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) return false;
+
+    scheme.resize(uc.dwSchemeLength);
+    host.resize(uc.dwHostNameLength);
+
+    wchar_t buf[2048];
+    swprintf_s(buf, L"%s://%s:%u/control", scheme.c_str(), host.c_str(), (unsigned)uc.nPort);
+    outControlUrl = buf;
+    return true;
+}
+
+static bool MakeServerUrlFromVideoUrl(const std::wstring& url, const wchar_t* pathAndQuery, std::wstring& outUrl)
+{
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+
+    std::wstring scheme(16, L'\0');
+    std::wstring host(256, L'\0');
+    uc.lpszScheme = scheme.data();
+    uc.dwSchemeLength = (DWORD)scheme.size();
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+
+    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) return false;
+
+    scheme.resize(uc.dwSchemeLength);
+    host.resize(uc.dwHostNameLength);
+
+    wchar_t buf[2048];
+    swprintf_s(buf, L"%s://%s:%u%s", scheme.c_str(), host.c_str(), (unsigned)uc.nPort, pathAndQuery);
+    outUrl = buf;
+    return true;
+}
+
+// Pulls a small integer field out of one /cursor JSON line.
+static bool CursorJsonInt(const std::string& line, const char* key, long long& out)
+{
+    std::string k = std::string("\"") + key + "\":";
+    size_t p = line.find(k);
+    if (p == std::string::npos) return false;
+    p += k.size();
+    if (p < line.size() && line[p] == '"')
+    {
+        out = (long long)std::strtoull(line.c_str() + p + 1, nullptr, 16); // "id":"<hex>"
+        return true;
+    }
+    out = std::atoll(line.c_str() + p);
+    return true;
+}
+
+// Follows /cursor (only served with --cursor-meta) and keeps g_clientCursor current.
+// Shapes are fetched once per id from /cursor.png; moves just trigger a repaint.
+static void ClientCursorThread(const std::wstring& videoUrl)
+{
+    std::wstring cursorUrl;
+    if (!MakeServerUrlFromVideoUrl(videoUrl, L"/cursor", cursorUrl)) return;
+
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+    if (!WinHttpCrackUrl(cursorUrl.c_str(), 0, 0, &uc)) return;
+    host.resize(uc.dwHostNameLength);
+    path.resize(uc.dwUrlPathLength);
+
+    const bool https = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+    HINTERNET hSession = WinHttpOpen(L"lanscr-cursor/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (!hSession) return;
+    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
+    if (!hConnect) { WinHttpCloseHandle(hSession); return; }
+
+    DWORD flags = WINHTTP_FLAG_REFRESH;
+    if (https) flags |= WINHTTP_FLAG_SECURE;
+    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+    if (!hReq) { WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession); return; }
+
+    WinHttpMaybeAddAuthHeader(hReq);
+
+    DWORD status = 0;
+    DWORD statusLen = sizeof(status);
+    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
+        !WinHttpReceiveResponse(hReq, nullptr) ||
+        !WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &status, &statusLen, WINHTTP_NO_HEADER_INDEX) ||
+        status != 200)
+    {
+        // Server without --cursor-meta: the cursor is already in the video.
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        return;
+    }
+
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    (void)CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+
+    std::string pending;
+    uint64_t loadedId = 0;
+    uint64_t failedId = 0; // not retried on every move
+    while (g_running.load() && factory)
+    {
+        DWORD avail = 0;
+        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
+        if (avail == 0)
+        {
+            Sleep(5);
+            continue;
+        }
+        size_t oldSize = pending.size();
+        pending.resize(oldSize + avail);
+        DWORD read = 0;
+        if (!WinHttpReadData(hReq, pending.data() + oldSize, avail, &read) || read == 0) break;
+        pending.resize(oldSize + read);
+
+        size_t eol;
+        bool changed = false;
+        while ((eol = pending.find('\n')) != std::string::npos)
+        {
+            const std::string line = pending.substr(0, eol);
+            pending.erase(0, eol + 1);
+
+            long long v = 0, x = 0, y = 0, hx = 0, hy = 0, w = 0, h = 0, id = 0;
+            if (!CursorJsonInt(line, "v", v) || !CursorJsonInt(line, "x", x) || !CursorJsonInt(line, "y", y) ||
+                !CursorJsonInt(line, "hx", hx) || !CursorJsonInt(line, "hy", hy) ||
+                !CursorJsonInt(line, "w", w) || !CursorJsonInt(line, "h", h) || !CursorJsonInt(line, "id", id))
+            {
+                continue;
+            }
+
+            // New shape: fetch + decode outside the lock.
+            int sw = 0, sh = 0;
+            std::vector<uint8_t> shape;
+            const bool needShape = v && (uint64_t)id != loadedId && (uint64_t)id != failedId;
+            if (needShape)
+            {
+                wchar_t q[64];
+                swprintf_s(q, L"/cursor.png?id=%016llx", (unsigned long long)id);
+                std::wstring pngUrl;
+                std::string png;
+                if (MakeServerUrlFromVideoUrl(videoUrl, q, pngUrl) && HttpGetSimpleWinHttp(pngUrl, &png) && !png.empty() &&
+                    SUCCEEDED(DecodeJpegToBGRA(factory, (const uint8_t*)png.data(), png.size(), sw, sh, shape)))
+                {
+                    loadedId = (uint64_t)id;
+                }
+                else
+                {
+                    failedId = (uint64_t)id;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(g_clientCursor.mtx);
+            ClientCursor& c = g_clientCursor;
+            if (!shape.empty())
+            {
+                c.shapeBgra = std::move(shape);
+                c.shapeW = sw;
+                c.shapeH = sh;
+                c.shapeId = loadedId;
+            }
+            c.visible = v != 0 && c.shapeId == (uint64_t)id;
+            c.x = (int)x;
+            c.y = (int)y;
+            c.hotX = (int)hx;
+            c.hotY = (int)hy;
+            c.screenW = (int)w;
+            c.screenH = (int)h;
+            changed = true;
+        }
+        if (changed) PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+    }
+
+    if (factory) factory->Release();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+    WinHttpCloseHandle(hReq);
+    WinHttpCloseHandle(hConnect);
+    WinHttpCloseHandle(hSession);
+}
+
+// Alpha-blends the --cursor-meta cursor into a frame copy (nearest-neighbour if the frame
+// is scaled relative to the server screen).
+static void BlendClientCursor(FrameBuffer& frame)
+{
+    std::lock_guard<std::mutex> lock(g_clientCursor.mtx);
+    const ClientCursor& c = g_clientCursor;
+    if (!c.visible || c.shapeBgra.empty() || c.screenW <= 0 || c.screenH <= 0) return;
+
+    const double fx = (double)frame.width / c.screenW;
+    const double fy = (double)frame.height / c.screenH;
+    const int dx0 = (int)std::floor((c.x - c.hotX) * fx);
+    const int dy0 = (int)std::floor((c.y - c.hotY) * fy);
+    const int dw = std::max(1, (int)(c.shapeW * fx + 0.5));
+    const int dh = std::max(1, (int)(c.shapeH * fy + 0.5));
+    for (int yy = std::max(0, dy0); yy < std::min(frame.height, dy0 + dh); yy++)
+    {
+        const int sy = std::min(c.shapeH - 1, (int)((yy - dy0) / fy));
+        for (int xx = std::max(0, dx0); xx < std::min(frame.width, dx0 + dw); xx++)
+        {
+            const int sx = std::min(c.shapeW - 1, (int)((xx - dx0) / fx));
+            const uint8_t* s = c.shapeBgra.data() + ((size_t)sy * c.shapeW + sx) * 4;
+            uint8_t* d = frame.bgra.data() + ((size_t)yy * frame.width + xx) * 4;
+            const int a = s[3];
+            for (int k = 0; k < 3; k++) d[k] = (uint8_t)((s[k] * a + d[k] * (255 - a) + 127) / 255);
+        }
+    }
+}
+
+static void ClientAudioThread(const std::wstring& audioUrl)
+{
+    // This expects the server to return PCM16 WAV with a streaming header.
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+
+    if (!WinHttpCrackUrl(audioUrl.c_str(), 0, 0, &uc)) return;
+    host.resize(uc.dwHostNameLength);
+    path.resize(uc.dwUrlPathLength);
+
+    const bool https = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+    HINTERNET hSession = WinHttpOpen(L"lanscr-audio/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (!hSession) return;
+    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
+    if (!hConnect) { WinHttpCloseHandle(hSession); return; }
+
+    DWORD flags = WINHTTP_FLAG_REFRESH;
+    if (https) flags |= WINHTTP_FLAG_SECURE;
+    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.empty() ? L"/audio" : path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+    if (!hReq) { WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession); return; }
+
+    WinHttpMaybeAddAuthHeader(hReq);
+
+    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
+        !WinHttpReceiveResponse(hReq, nullptr))
+    {
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        return;
+    }
+
+    // If unauthorized, tell the user how to fix it.
+    {
+        wchar_t code[16] = {};
+        DWORD codeLen = (DWORD)sizeof(code);
+        if (WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE, WINHTTP_HEADER_NAME_BY_INDEX, code, &codeLen, WINHTTP_NO_HEADER_INDEX))
+        {
+            if (wcscmp(code, L"401") == 0)
+            {
+                std::fprintf(stderr, "Unauthorized (401). Use --auth user:pass\n");
+            }
+        }
+    }
+
+    // Read WAV header (44 bytes)
+    uint8_t wav[44] = {};
+    size_t got = 0;
+    while (got < sizeof(wav) && g_running.load())
+    {
+        DWORD avail = 0;
+        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
+        if (avail == 0) { Sleep(5); continue; }
+        DWORD read = 0;
+        DWORD toRead = (DWORD)std::min<DWORD>((DWORD)(sizeof(wav) - got), avail);
+        if (!WinHttpReadData(hReq, wav + got, toRead, &read) || read == 0) break;
+        got += read;
+    }
+    if (got < sizeof(wav))
+    {
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        return;
+    }
+
+    auto r16 = [&](int off) -> uint16_t { return (uint16_t)(wav[off] | (wav[off + 1] << 8)); };
+    auto r32 = [&](int off) -> uint32_t {
+        return (uint32_t)(wav[off] | (wav[off + 1] << 8) | (wav[off + 2] << 16) | (wav[off + 3] << 24));
+    };
+
+    uint16_t fmt = r16(20);
+    uint16_t channels = r16(22);
+    uint32_t rate = r32(24);
+    uint16_t bits = r16(34);
+    if (fmt != 1 || bits != 16 || channels == 0 || rate == 0)
+    {
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        return;
+    }
+
+    WAVEFORMATEX wf{};
+    wf.wFormatTag = WAVE_FORMAT_PCM;
+    wf.nChannels = channels;
+    wf.nSamplesPerSec = rate;
+    wf.wBitsPerSample = 16;
+    wf.nBlockAlign = (WORD)(channels * 2);
+    wf.nAvgBytesPerSec = wf.nSamplesPerSec * wf.nBlockAlign;
+
+    HWAVEOUT hwo = nullptr;
+    if (waveOutOpen(&hwo, WAVE_MAPPER, &wf, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR)
+    {
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        return;
+    }
+
+    const int kBufCount = 4;
+    const DWORD kBufSize = 16384;
+    std::vector<std::vector<uint8_t>> bufs(kBufCount);
+    std::vector<WAVEHDR> hdrs(kBufCount);
+    for (int i = 0; i < kBufCount; i++)
+    {
+        bufs[i].resize(kBufSize);
+        std::memset(&hdrs[i], 0, sizeof(WAVEHDR));
+        hdrs[i].lpData = (LPSTR)bufs[i].data();
+        hdrs[i].dwBufferLength = 0;
+        waveOutPrepareHeader(hwo, &hdrs[i], sizeof(WAVEHDR));
+        hdrs[i].dwFlags |= WHDR_DONE;
+    }
+
+    int idx = 0;
+    while (g_running.load())
+    {
+        // Local client-side mute: keep connection but silence output.
+        if (g_clientAudioMuted.load())
+        {
+            (void)waveOutSetVolume(hwo, 0);
+        }
+        else
+        {
+            (void)waveOutSetVolume(hwo, 0xFFFFFFFF);
+        }
+
+        if (!(hdrs[idx].dwFlags & WHDR_DONE))
+        {
+            Sleep(5);
+            continue;
+        }
+
+        DWORD avail = 0;
+        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
+        if (avail == 0) { Sleep(5); continue; }
+
+        DWORD toRead = (DWORD)std::min<DWORD>(avail, kBufSize);
+        DWORD read = 0;
+        if (!WinHttpReadData(hReq, bufs[idx].data(), toRead, &read) || read == 0) break;
+
+        hdrs[idx].dwBufferLength = read;
+        hdrs[idx].dwFlags &= ~WHDR_DONE;
+        waveOutWrite(hwo, &hdrs[idx], sizeof(WAVEHDR));
+
+        idx = (idx + 1) % kBufCount;
+    }
+
+    waveOutReset(hwo);
+    for (int i = 0; i < kBufCount; i++) waveOutUnprepareHeader(hwo, &hdrs[i], sizeof(WAVEHDR));
+    waveOutClose(hwo);
+
+    WinHttpCloseHandle(hReq);
+    WinHttpCloseHandle(hConnect);
+    WinHttpCloseHandle(hSession);
+}
+
+// /tiles client state: deltas patch the client's frame in place, so they are only applied on
+// top of the message right before them (seq + 1), starting from a full message.
+struct ClientTileStreamState
+{
+    bool synced = false;
+    uint32_t lastSeq = 0;
+    TileMessageView msg;
+    std::vector<TileRect> rects;
+    std::vector<std::vector<uint8_t>> decoded;
+    double receivedMs = 0.0; // when the current message was parsed
+};
+
+// Patches the tiles decoded for the current message into a width x height BGRA frame, which
+// is reallocated (black) when the message has another size.
+static void PatchTileMessage(const ClientTileStreamState& st, std::vector<uint8_t>& frame, int& width, int& height)
+{
+    const TileMessageView& m = st.msg;
+    if (width != m.width || height != m.height || frame.empty())
+    {
+        width = m.width;
+        height = m.height;
+        frame.assign((size_t)m.width * (size_t)m.height * 4, 0);
+    }
+    for (size_t i = 0; i < st.rects.size(); i++)
+    {
+        (void)PatchTileBgra(frame, width, height, st.rects[i], st.decoded[i].data(), st.rects[i].w, st.rects[i].h);
+    }
+}
+
+// Consumes all complete tile messages from buffer. Each one that applies has its tiles decoded
+// into st.rects/st.decoded and is handed to apply. Returns false if the stream is corrupt.
+static bool ConsumeTileMessages(FrameDecoder* decoder, std::vector<uint8_t>& buffer, ClientTileStreamState& st,
+    const std::function<void(const ClientTileStreamState&)>& apply)
+{
+    size_t consumed = 0;
+    for (;;)
+    {
+        long long n = ParseTileMessage(buffer.data() + consumed, buffer.size() - consumed, st.msg);
+        if (n < 0)
+        {
+            std::fprintf(stderr, "Corrupt tile stream\n");
+            return false;
+        }
+        if (n == 0) break;
+        consumed += (size_t)n;
+
+        const TileMessageView& m = st.msg;
+        if (!m.full && (!st.synced || m.seq != st.lastSeq + 1))
+        {
+            st.synced = false;
+            continue;
+        }
+        st.synced = true;
+        st.lastSeq = m.seq;
+        if (m.tiles.empty()) continue; // keepalive
+
+        // Decode before apply, which may hold a lock the UI thread needs for the blit.
+        st.receivedMs = PerfNowMs();
+        st.rects.clear();
+        st.decoded.resize(m.tiles.size());
+        bool ok = true;
+        for (size_t i = 0; i < m.tiles.size() && ok; i++)
+        {
+            int w = 0, h = 0;
+            HRESULT dhr = decoder->Decode(m.tiles[i].jpeg, m.tiles[i].jpegLen, w, h, st.decoded[i]);
+            ok = SUCCEEDED(dhr) && w == m.tiles[i].rect.w && h == m.tiles[i].rect.h;
+            st.rects.push_back(m.tiles[i].rect);
+        }
+        if (!ok)
+        {
+            // The frame would be left half-patched: drop sync until the next full message.
+            st.synced = false;
+            continue;
+        }
+
+        apply(st);
+    }
+    if (consumed > 0) buffer.erase(buffer.begin(), buffer.begin() + consumed);
+    return true;
+}
+
+static void ClientNetworkThread(const std::wstring& url)
+{
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (FAILED(hr))
+    {
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+    std::unique_ptr<FrameDecoder> decoder = CreateConfiguredFrameDecoder(factory);
+
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+
+    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc))
+    {
+        std::fprintf(stderr, "WinHttpCrackUrl failed\n");
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    host.resize(uc.dwHostNameLength);
+    path.resize(uc.dwUrlPathLength);
+
+    // The server uses '/' for an HTML landing page. The native viewer needs the MJPEG endpoint.
+    if (path.empty() || path == L"/" || path == L"/index.html")
+    {
+        path = L"/mjpeg";
+    }
+
+    // /tiles is the dirty-tile stream; everything else is parsed as MJPEG.
+    const bool tileStream = path.compare(0, 6, L"/tiles") == 0;
+    ClientTileStreamState tileState;
+
+    const bool https = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+
+    HINTERNET hSession = WinHttpOpen(L"lan-mjpeg/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (!hSession)
+    {
+        std::fprintf(stderr, "WinHttpOpen failed\n");
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
+    if (!hConnect)
+    {
+        std::fprintf(stderr, "WinHttpConnect failed\n");
+        WinHttpCloseHandle(hSession);
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    DWORD flags = WINHTTP_FLAG_REFRESH;
+    if (https) flags |= WINHTTP_FLAG_SECURE;
+
+    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+    if (!hReq)
+    {
+        std::fprintf(stderr, "WinHttpOpenRequest failed\n");
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    // Ask intermediaries not to buffer/cach e (helps latency in some environments).
+    (void)WinHttpAddRequestHeaders(hReq, L"Cache-Control: no-cache\r\nPragma: no-cache\r\n", (ULONG)-1L, WINHTTP_ADDREQ_FLAG_ADD);
+
+    WinHttpMaybeAddAuthHeader(hReq);
+
+    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
+        !WinHttpReceiveResponse(hReq, nullptr))
+    {
+        std::fprintf(stderr, "HTTP request failed\n");
+        WinHttpCloseHandle(hReq);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    {
+        wchar_t code[16] = {};
+        DWORD codeLen = (DWORD)sizeof(code);
+        if (WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE, WINHTTP_HEADER_NAME_BY_INDEX, code, &codeLen, WINHTTP_NO_HEADER_INDEX))
+        {
+            if (wcscmp(code, L"401") == 0)
+            {
+                std::fprintf(stderr, "Unauthorized (401). Use --auth user:pass\n");
+            }
+        }
+    }
+
+    std::vector<uint8_t> buffer;
+    buffer.reserve(1024 * 1024);
+
+    const char* boundary = "--frame";
+    const size_t boundaryLen = std::strlen(boundary);
+    const char* headerEnd = "\r\n\r\n";
+    const size_t headerEndLen = 4;
+
+    while (g_running.load())
+    {
+        DWORD avail = 0;
+        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
+        if (avail == 0)
+        {
+            Sleep(10);
+            continue;
+        }
+
+        size_t oldSize = buffer.size();
+        buffer.resize(oldSize + avail);
+
+        DWORD read = 0;
+        if (!WinHttpReadData(hReq, buffer.data() + oldSize, avail, &read) || read == 0)
+        {
+            buffer.resize(oldSize);
+            break;
+        }
+        buffer.resize(oldSize + read);
+
+        if (tileStream)
+        {
+            const bool ok = ConsumeTileMessages(decoder.get(), buffer, tileState, [](const ClientTileStreamState& st) {
+                {
+                    std::lock_guard<std::mutex> lock(g_frame.mtx);
+                    PatchTileMessage(st, g_frame.bgra, g_frame.width, g_frame.height);
+                    g_frame.hasFrame = true;
+                    FrameTiming timing; // no seq: keepalive messages would count as drops
+                    timing.receivedMs = st.receivedMs;
+                    timing.decodedMs = PerfNowMs();
+                    g_frame.timing = timing;
+                }
+                PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+            });
+            if (!ok) break;
+            continue;
+        }
+
+        // Parse as many frames as possible
+        for (;;)
+        {
+            size_t bpos = 0;
+            if (!FindBytes(buffer, boundary, boundaryLen, 0, bpos))
+            {
+                // Keep buffer from growing unbounded
+                if (buffer.size() > 4 * 1024 * 1024)
+                {
+                    buffer.erase(buffer.begin(), buffer.begin() + (buffer.size() - 1024 * 1024));
+                }
+                break;
+            }
+
+            if (bpos > 0)
+            {
+                buffer.erase(buffer.begin(), buffer.begin() + bpos);
+            }
+
+            // Need end of headers
+            size_t hend = 0;
+            if (!FindBytes(buffer, headerEnd, headerEndLen, 0, hend)) break;
+
+            std::string headerStr((const char*)buffer.data(), (const char*)buffer.data() + hend + headerEndLen);
+            std::string headerLower = ToLowerAscii(headerStr);
+
+            size_t cl = headerLower.find("content-length:");
+            if (cl == std::string::npos)
+            {
+                // Can't parse, resync by dropping boundary
+                if (buffer.size() > boundaryLen) buffer.erase(buffer.begin(), buffer.begin() + boundaryLen);
+                continue;
+            }
+
+            size_t numStart = cl + std::strlen("content-length:");
+            while (numStart < headerLower.size() && (headerLower[numStart] == ' ' || headerLower[numStart] == '\t')) numStart++;
+
+            int contentLen = std::atoi(headerLower.c_str() + numStart);
+            if (contentLen <= 0)
+            {
+                if (buffer.size() > boundaryLen) buffer.erase(buffer.begin(), buffer.begin() + boundaryLen);
+                continue;
+            }
+
+            size_t jpegStart = hend + headerEndLen;
+            size_t need = jpegStart + (size_t)contentLen + 2; // + trailing \r\n
+            if (buffer.size() < need) break;
+
+            const uint8_t* jpg = buffer.data() + jpegStart;
+            size_t jpgLen = (size_t)contentLen;
+
+            FrameTiming timing;
+            timing.seq = (uint64_t)PartHeaderNumber(headerLower, "x-seq:");
+            timing.captureMs = PartHeaderNumber(headerLower, "x-timestamp:");
+            timing.encodeMs = PartHeaderNumber(headerLower, "x-encode-ms:");
+            timing.receivedMs = PerfNowMs();
+
+            int w = 0, h = 0;
+            std::vector<uint8_t> bgra;
+            HRESULT dhr = decoder->Decode(jpg, jpgLen, w, h, bgra);
+            if (SUCCEEDED(dhr) && !bgra.empty())
+            {
+                timing.decodedMs = PerfNowMs();
+                {
+                    std::lock_guard<std::mutex> lock(g_frame.mtx);
+                    g_frame.width = w;
+                    g_frame.height = h;
+                    g_frame.bgra = std::move(bgra);
+                    g_frame.hasFrame = true;
+                    g_frame.timing = timing;
+                }
+                PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+            }
+
+            buffer.erase(buffer.begin(), buffer.begin() + need);
+        }
+    }
+
+    WinHttpCloseHandle(hReq);
+    WinHttpCloseHandle(hConnect);
+    WinHttpCloseHandle(hSession);
+
+    decoder.reset();
+    factory->Release();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+
+    PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+}
+
+static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    static constexpr UINT IDM_CLIENT_MUTE_LOCAL = 5001;
+    static constexpr UINT IDM_CLIENT_MUTE_SERVER = 5002;
+
+    switch (msg)
+    {
+    case WM_NEW_FRAME:
+        InvalidateRect(hwnd, nullptr, FALSE);
+        return 0;
+
+    case WM_CONTEXTMENU:
+    {
+        HMENU menu = CreatePopupMenu();
+        if (!menu) return 0;
+
+        const bool localMuted = g_clientAudioMuted.load();
+        const bool serverMuted = g_clientWantsServerMuted.load();
+        AppendMenuW(menu, MF_STRING | (localMuted ? MF_CHECKED : 0), IDM_CLIENT_MUTE_LOCAL, L"Mute client audio");
+        AppendMenuW(menu, MF_STRING | (serverMuted ? MF_CHECKED : 0), IDM_CLIENT_MUTE_SERVER, L"Mute server audio");
+
+        POINT pt;
+        pt.x = GET_X_LPARAM(lParam);
+        pt.y = GET_Y_LPARAM(lParam);
+        if (pt.x == -1 && pt.y == -1)
+        {
+            GetCursorPos(&pt);
+        }
+
+        int cmd = (int)TrackPopupMenu(menu, TPM_RETURNCMD | TPM_NONOTIFY, pt.x, pt.y, 0, hwnd, nullptr);
+        DestroyMenu(menu);
+
+        if (cmd == (int)IDM_CLIENT_MUTE_LOCAL)
+        {
+            g_clientAudioMuted.store(!g_clientAudioMuted.load());
+            return 0;
+        }
+        if (cmd == (int)IDM_CLIENT_MUTE_SERVER)
+        {
+            bool newMuted = !g_clientWantsServerMuted.load();
+            g_clientWantsServerMuted.store(newMuted);
+
+            std::wstring control;
+            if (MakeControlUrlFromVideoUrl(g_clientVideoUrl, control))
+            {
+                control += L"?mute=";
+                control += newMuted ? L"1" : L"0";
+                std::thread([control]() {
+                    (void)HttpGetSimpleWinHttp(control, nullptr);
+                }).detach();
+            }
+            return 0;
+        }
+        return 0;
+    }
+
+    case WM_PAINT:
+    {
+        PAINTSTRUCT ps;
+        HDC hdc = BeginPaint(hwnd, &ps);
+
+        RECT rc;
+        GetClientRect(hwnd, &rc);
+
+        FrameBuffer local;
+        {
+            std::lock_guard<std::mutex> lock(g_frame.mtx);
+            local.width = g_frame.width;
+            local.height = g_frame.height;
+            local.bgra = g_frame.bgra;
+            local.hasFrame = g_frame.hasFrame;
+            local.timing = g_frame.timing;
+        }
+        if (local.hasFrame && local.bgra.size() >= (size_t)local.width * (size_t)local.height * 4)
+        {
+            BlendClientCursor(local);
+        }
+
+        if (local.hasFrame && local.width > 0 && local.height > 0 && !local.bgra.empty())
+        {
+            // High-quality scaling (default can look blocky).
+            SetStretchBltMode(hdc, HALFTONE);
+            SetBrushOrgEx(hdc, 0, 0, nullptr);
+
+            // Preserve aspect ratio (letterbox if needed).
+            const int dstW = rc.right - rc.left;
+            const int dstH = rc.bottom - rc.top;
+            double srcAR = (double)local.width / (double)local.height;
+            double dstAR = dstH == 0 ? srcAR : (double)dstW / (double)dstH;
+
+            int drawW = dstW;
+            int drawH = dstH;
+            int offX = 0;
+            int offY = 0;
+            if (dstAR > srcAR)
+            {
+                // Window is wider than source
+                drawH = dstH;
+                drawW = (int)(drawH * srcAR);
+                offX = (dstW - drawW) / 2;
+            }
+            else if (dstAR < srcAR)
+            {
+                // Window is taller than source
+                drawW = dstW;
+                drawH = (int)(drawW / srcAR);
+                offY = (dstH - drawH) / 2;
+            }
+
+            // Shrinking: box + bilinear with the SIMD kernels, then a 1:1 blit (HALFTONE
+            // is slow and soft on large reductions). Enlarging still goes through GDI.
+            static std::vector<uint8_t> scaled;
+            static DownscaleScratch scratch;
+            const uint8_t* bits = local.bgra.data();
+            int bitsW = local.width;
+            int bitsH = local.height;
+            if (drawW > 0 && drawH > 0 && drawW < local.width && drawH < local.height)
+            {
+                scaled.resize((size_t)drawW * drawH * 4);
+                DownscaleBgra(local.bgra.data(), local.width, local.height, local.width * 4, scaled.data(), drawW, drawH, drawW * 4,
+                    true, scratch);
+                bits = scaled.data();
+                bitsW = drawW;
+                bitsH = drawH;
+            }
+
+            BITMAPINFO bmi{};
+            bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+            bmi.bmiHeader.biWidth = bitsW;
+            bmi.bmiHeader.biHeight = -bitsH; // top-down
+            bmi.bmiHeader.biPlanes = 1;
+            bmi.bmiHeader.biBitCount = 32;
+            bmi.bmiHeader.biCompression = BI_RGB;
+
+            StretchDIBits(
+                hdc,
+                offX, offY, drawW, drawH,
+                0, 0, bitsW, bitsH,
+                bits,
+                &bmi,
+                DIB_RGB_COLORS,
+                SRCCOPY);
+
+            std::wstring summary;
+            if (g_clientLatency.OnPresented(local.timing, PerfNowMs(), summary))
+            {
+                SetWindowTextW(hwnd, (g_clientTitle + L" - " + summary).c_str());
+            }
+        }
+        else
+        {
+            const char* txt = "Waiting for frames...";
+            TextOutA(hdc, 10, 10, txt, (int)std::strlen(txt));
+        }
+
+        EndPaint(hwnd, &ps);
+        return 0;
+    }
+
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+
+    default:
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
+}
+
+static int RunClient(const std::wstring& url)
+{
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    // Ensure running flag is set for both video + audio threads.
+    g_running.store(true);
+
+    g_clientVideoUrl = url;
+    g_clientWantsServerMuted.store(false);
+
+    // Reduce OS DPI bitmap-scaling blur on the window.
+    if (HMODULE user32 = LoadLibraryW(L"user32.dll"))
+    {
+        using Fn = BOOL(WINAPI*)(DPI_AWARENESS_CONTEXT);
+        auto fn = (Fn)GetProcAddress(user32, "SetProcessDpiAwarenessContext");
+        if (fn)
+        {
+            (void)fn(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+        }
+        FreeLibrary(user32);
+    }
+
+    HINSTANCE hInst = GetModuleHandle(nullptr);
+
+    WNDCLASS wc{};
+    wc.lpfnWndProc = WndProc;
+    wc.hInstance = hInst;
+    wc.lpszClassName = L"LanMjpegClient";
+    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    wc.hIcon = LoadIconW(hInst, MAKEINTRESOURCEW(IDI_APP_ICON));
+
+    if (!RegisterClass(&wc))
+    {
+        std::fprintf(stderr, "RegisterClass failed\n");
+        return 1;
+    }
+
+    g_clientTitle = L"LAN Screen Viewer (MJPEG over HTTP)";
+    g_hwnd = CreateWindowEx(
+        0,
+        wc.lpszClassName,
+        g_clientTitle.c_str(),
+        WS_OVERLAPPEDWINDOW,
+        CW_USEDEFAULT, CW_USEDEFAULT, 1280, 720,
+        nullptr, nullptr, hInst, nullptr);
+
+    if (!g_hwnd)
+    {
+        std::fprintf(stderr, "CreateWindowEx failed\n");
+        return 1;
+    }
+
+    ShowWindow(g_hwnd, SW_SHOW);
+    UpdateWindow(g_hwnd);
+
+    std::thread net([url]() { ClientNetworkThread(url); });
+    net.detach();
+
+    std::thread cur([url]() { ClientCursorThread(url); });
+    cur.detach();
+
+    std::wstring audioUrl;
+    if (MakeAudioUrlFromVideoUrl(url, audioUrl))
+    {
+        std::thread aud([audioUrl]() { ClientAudioThread(audioUrl); });
+        aud.detach();
+    }
+
+    MSG msg;
+    while (GetMessage(&msg, nullptr, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
     }
 
-    waveOutReset(hwo);
-    for (int i = 0; i < kBufCount; i++) waveOutUnprepareHeader(hwo, &hdrs[i], sizeof(WAVEHDR));
-    waveOutClose(hwo);
+    g_running.store(false);
+    return 0;
+}
 
-    WinHttpCloseHandle(hReq);
-    WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+static uint64_t GetTickMs()
+{
+    return (uint64_t)GetTickCount64();
 }
 
-static void ClientNetworkThread(const std::wstring& url)
+static bool SameAddr(const sockaddr_in& a, const sockaddr_in& b)
 {
-    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-    IWICImagingFactory* factory = nullptr;
-    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
-    if (FAILED(hr))
-    {
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
-    }
+    return a.sin_family == b.sin_family && a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+}
 
-    URL_COMPONENTS uc{};
-    uc.dwStructSize = sizeof(uc);
+static std::string SockaddrToString(const sockaddr_in& a)
+{
+    char ip[64] = {};
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "%s:%u", ip, (unsigned)ntohs(a.sin_port));
+    return std::string(buf);
+}
 
-    std::wstring host(256, L'\0');
-    std::wstring path(1024, L'\0');
-    uc.lpszHostName = host.data();
-    uc.dwHostNameLength = (DWORD)host.size();
-    uc.lpszUrlPath = path.data();
-    uc.dwUrlPathLength = (DWORD)path.size();
+// Every chunk of a frame repeats the frame's header fields. The payload starts at headerBytes,
+// so a later version can append fields and older clients still find the payload.
+#pragma pack(push, 1)
+struct UdpFrameChunkHeader
+{
+    uint32_t magic;
+    uint16_t version;     // kUdpHeaderVersion
+    uint16_t headerBytes; // offset of the payload
+    uint32_t frameId;     // frame seq
+    uint16_t chunkIndex;
+    uint16_t chunkCount;
+    uint16_t payloadLen;
+    uint16_t reserved;
+    double captureMs;     // server monotonic clock (PerfNowMs)
+    double encodeMs;      // 0 when the previous JPEG was resent
+};
+#pragma pack(pop)
 
-    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc))
-    {
-        std::fprintf(stderr, "WinHttpCrackUrl failed\n");
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
-    }
+static constexpr uint32_t kUdpMagic = 0x3355534Cu; // 'LSU3'
+static constexpr uint16_t kUdpHeaderVersion = 1;
+static constexpr char kUdpHello[] = "LSU2"; // client -> server subscription
+static constexpr int kUdpPayloadMax = 1200;
 
-    host.resize(uc.dwHostNameLength);
-    path.resize(uc.dwUrlPathLength);
+struct UdpClientEntry
+{
+    sockaddr_in addr{};
+    uint64_t lastSeenMs = 0;
+};
 
-    // The server uses '/' for an HTML landing page. The native viewer needs the MJPEG endpoint.
-    if (path.empty() || path == L"/" || path == L"/index.html")
+static void UdpServerRecvLoop(SOCKET s, std::mutex* mtx, std::vector<UdpClientEntry>* clients)
+{
+    char buf[256];
+    while (g_running.load())
     {
-        path = L"/mjpeg";
+        sockaddr_in from{};
+        int fromLen = sizeof(from);
+        int n = recvfrom(s, buf, (int)sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+        if (n == SOCKET_ERROR)
+        {
+            int e = WSAGetLastError();
+            if (e == WSAEWOULDBLOCK)
+            {
+                Sleep(2);
+                continue;
+            }
+            Sleep(2);
+            continue;
+        }
+        if (n <= 0) continue;
+
+        const uint64_t now = GetTickMs();
+        std::lock_guard<std::mutex> lock(*mtx);
+        bool found = false;
+        for (auto& c : *clients)
+        {
+            if (SameAddr(c.addr, from))
+            {
+                c.lastSeenMs = now;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            UdpClientEntry e;
+            e.addr = from;
+            e.lastSeenMs = now;
+            clients->push_back(e);
+            if (g_verbose) LogInfo("UDP client added: %s\n", SockaddrToString(from).c_str());
+        }
     }
+}
 
-    const bool https = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+static int RunUdpServer(uint16_t port, int fps, int jpegQuality0to100)
+{
+    EnsureConsoleAllocated();
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+    g_running.store(true);
 
-    HINTERNET hSession = WinHttpOpen(L"lan-mjpeg/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-    if (!hSession)
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
     {
-        std::fprintf(stderr, "WinHttpOpen failed\n");
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        LogError("WSAStartup failed\n");
+        return 1;
     }
 
-    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
-    if (!hConnect)
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET)
     {
-        std::fprintf(stderr, "WinHttpConnect failed\n");
-        WinHttpCloseHandle(hSession);
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        LogError("udp socket() failed\n");
+        WSACleanup();
+        return 1;
     }
 
-    DWORD flags = WINHTTP_FLAG_REFRESH;
-    if (https) flags |= WINHTTP_FLAG_SECURE;
+    int snd = 4 * 1024 * 1024;
+    int rcv = 4 * 1024 * 1024;
+    (void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+    (void)setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcv, sizeof(rcv));
 
-    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
-    if (!hReq)
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
     {
-        std::fprintf(stderr, "WinHttpOpenRequest failed\n");
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        LogError("udp bind() failed on port %u\n", (unsigned)port);
+        closesocket(s);
+        WSACleanup();
+        return 1;
     }
 
-    // Ask intermediaries not to buffer/cach e (helps latency in some environments).
-    (void)WinHttpAddRequestHeaders(hReq, L"Cache-Control: no-cache\r\nPragma: no-cache\r\n", (ULONG)-1L, WINHTTP_ADDREQ_FLAG_ADD);
+    u_long nb = 1;
+    (void)ioctlsocket(s, FIONBIO, &nb);
 
-    WinHttpMaybeAddAuthHeader(hReq);
+    if (fps <= 0) fps = 30;
+    if (fps > 120) fps = 120;
+    if (jpegQuality0to100 < 1) jpegQuality0to100 = 1;
+    if (jpegQuality0to100 > 100) jpegQuality0to100 = 100;
+    FramePacer pacer(fps);
+    double lastStatsMs = PerfNowMs();
 
-    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
-        !WinHttpReceiveResponse(hReq, nullptr))
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (FAILED(hr))
     {
-        std::fprintf(stderr, "HTTP request failed\n");
-        WinHttpCloseHandle(hReq);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        factory->Release();
         if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        closesocket(s);
+        WSACleanup();
+        LogError("WIC factory init failed\n");
+        return 1;
     }
 
+    std::unique_ptr<CaptureSource> source = CreateCaptureSource(g_captureSpec);
+    if (!source)
     {
-        wchar_t code[16] = {};
-        DWORD codeLen = (DWORD)sizeof(code);
-        if (WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE, WINHTTP_HEADER_NAME_BY_INDEX, code, &codeLen, WINHTTP_NO_HEADER_INDEX))
-        {
-            if (wcscmp(code, L"401") == 0)
-            {
-                std::fprintf(stderr, "Unauthorized (401). Use --auth user:pass\n");
-            }
-        }
+        LogError("Unknown capture source '%s', using gdi\n", g_captureSpec.c_str());
+        source = CreateCaptureSource("gdi");
     }
 
-    std::vector<uint8_t> buffer;
-    buffer.reserve(1024 * 1024);
-
-    const char* boundary = "--frame";
-    const size_t boundaryLen = std::strlen(boundary);
-    const char* headerEnd = "\r\n\r\n";
-    const size_t headerEndLen = 4;
-
-    while (g_running.load())
-    {
-        DWORD avail = 0;
-        if (!WinHttpQueryDataAvailable(hReq, &avail)) break;
-        if (avail == 0)
-        {
-            Sleep(10);
-            continue;
-        }
+    // 1 ms timer resolution so the pacer's sleeps land on their deadlines.
+    timeBeginPeriod(1);
 
-        size_t oldSize = buffer.size();
-        buffer.resize(oldSize + avail);
+    CaptureSurface surf;
+    const TileHashImpl hashImpl = BestTileHashImpl();
+    TileHashGrid prevTiles;
+    TileHashGrid curTiles;
+    JpegFrame jf;
+    std::unique_ptr<FrameEncoder> jpegEncoder = CreateConfiguredFrameEncoder(factory);
+    DownscaleScratch scaleScratch;
+    std::vector<uint8_t> scaledPixels;
+    double lastSendMs = 0.0;
+    double encodeMs = 0.0;
+    size_t lastClientCount = 0;
 
-        DWORD read = 0;
-        if (!WinHttpReadData(hReq, buffer.data() + oldSize, avail, &read) || read == 0)
-        {
-            buffer.resize(oldSize);
-            break;
-        }
-        buffer.resize(oldSize + read);
+    std::mutex clientsMtx;
+    std::vector<UdpClientEntry> clients;
+    std::thread recvThread([&]() { UdpServerRecvLoop(s, &clientsMtx, &clients); });
+    recvThread.detach();
 
-        // Parse as many frames as possible
-        for (;;)
-        {
-            size_t bpos = 0;
-            if (!FindBytes(buffer, boundary, boundaryLen, 0, bpos))
-            {
-                // Keep buffer from growing unbounded
-                if (buffer.size() > 4 * 1024 * 1024)
-                {
-                    buffer.erase(buffer.begin(), buffer.begin() + (buffer.size() - 1024 * 1024));
-                }
-                break;
-            }
+    LogInfo("UDP server on 0.0.0.0:%u (run udp-client to subscribe)\n", (unsigned)port);
 
-            if (bpos > 0)
-            {
-                buffer.erase(buffer.begin(), buffer.begin() + bpos);
-            }
+    uint32_t frameId = 0;
+    while (g_running.load())
+    {
+        std::vector<UdpClientEntry> snap;
+        {
+            std::lock_guard<std::mutex> lock(clientsMtx);
+            const uint64_t now = GetTickMs();
+            clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const UdpClientEntry& c) {
+                return (now - c.lastSeenMs) > 3000;
+            }), clients.end());
+            snap = clients;
+        }
 
-            // Need end of headers
-            size_t hend = 0;
-            if (!FindBytes(buffer, headerEnd, headerEndLen, 0, hend)) break;
+        if (snap.empty())
+        {
+            lastClientCount = 0;
+            Sleep(25);
+            pacer.Rebase();
+            continue;
+        }
 
-            std::string headerStr((const char*)buffer.data(), (const char*)buffer.data() + hend + headerEndLen);
-            std::string headerLower = ToLowerAscii(headerStr);
+        const double captureMs = PerfNowMs();
+        hr = source->Capture(surf);
+        if (FAILED(hr))
+        {
+            Sleep(10);
+            continue;
+        }
 
-            size_t cl = headerLower.find("content-length:");
-            if (cl == std::string::npos)
+        // Unchanged desktop: resend the previous JPEG only for new subscribers or as a keepalive.
+        UpdateTileHashes(surf, curTiles, hashImpl);
+        const bool newClient = snap.size() > lastClientCount;
+        lastClientCount = snap.size();
+        if (SameTileHashes(prevTiles, curTiles) && !jf.bytes.empty())
+        {
+            g_framesSkipped.fetch_add(1);
+            if (!newClient && PerfNowMs() - lastSendMs < kKeepaliveFrameMs)
             {
-                // Can't parse, resync by dropping boundary
-                if (buffer.size() > boundaryLen) buffer.erase(buffer.begin(), buffer.begin() + boundaryLen);
+                source->WaitForChange((int)pacer.MsUntilNextTick(), kIdleWaitMs);
+                pacer.Rebase();
                 continue;
             }
-
-            size_t numStart = cl + std::strlen("content-length:");
-            while (numStart < headerLower.size() && (headerLower[numStart] == ' ' || headerLower[numStart] == '\t')) numStart++;
-
-            int contentLen = std::atoi(headerLower.c_str() + numStart);
-            if (contentLen <= 0)
+            encodeMs = 0.0;
+        }
+        else
+        {
+            const double e0 = PerfNowMs();
+            int outW = surf.width;
+            int outH = surf.height;
+            OutputSizeFor(surf.width, surf.height, outW, outH);
+            CaptureSurface out = surf;
+            if (outW != surf.width || outH != surf.height) ScaleSurface(surf, outW, outH, scaleScratch, scaledPixels, out);
+            hr = jpegEncoder ? jpegEncoder->Encode(out, jpegQuality0to100, jf) : E_FAIL;
+            if (FAILED(hr) || jf.bytes.empty())
             {
-                if (buffer.size() > boundaryLen) buffer.erase(buffer.begin(), buffer.begin() + boundaryLen);
+                Sleep(10);
                 continue;
             }
+            prevTiles = curTiles;
+            g_framesEncoded.fetch_add(1);
+            encodeMs = PerfNowMs() - e0;
+        }
+        lastSendMs = PerfNowMs();
 
-            size_t jpegStart = hend + headerEndLen;
-            size_t need = jpegStart + (size_t)contentLen + 2; // + trailing \r\n
-            if (buffer.size() < need) break;
+        frameId++;
+        const size_t total = jf.bytes.size();
+        const uint16_t chunkCount = (uint16_t)((total + (kUdpPayloadMax - 1)) / kUdpPayloadMax);
+        std::vector<uint8_t> packet(sizeof(UdpFrameChunkHeader) + kUdpPayloadMax);
 
-            const uint8_t* jpg = buffer.data() + jpegStart;
-            size_t jpgLen = (size_t)contentLen;
+        for (uint16_t ci = 0; ci < chunkCount; ci++)
+        {
+            const size_t off = (size_t)ci * kUdpPayloadMax;
+            size_t len = total - off;
+            if (len > (size_t)kUdpPayloadMax) len = (size_t)kUdpPayloadMax;
 
-            int w = 0, h = 0;
-            std::vector<uint8_t> bgra;
-            HRESULT dhr = DecodeJpegToBGRA(factory, jpg, jpgLen, w, h, bgra);
-            if (SUCCEEDED(dhr) && !bgra.empty())
+            UdpFrameChunkHeader hdr{};
+            hdr.magic = kUdpMagic;
+            hdr.version = kUdpHeaderVersion;
+            hdr.headerBytes = (uint16_t)sizeof(hdr);
+            hdr.frameId = frameId;
+            hdr.chunkIndex = ci;
+            hdr.chunkCount = chunkCount;
+            hdr.payloadLen = (uint16_t)len;
+            hdr.reserved = 0;
+            hdr.captureMs = captureMs;
+            hdr.encodeMs = encodeMs;
+            std::memcpy(packet.data(), &hdr, sizeof(hdr));
+            std::memcpy(packet.data() + sizeof(hdr), jf.bytes.data() + off, len);
+
+            const int pktLen = (int)(sizeof(hdr) + len);
+            for (const auto& c : snap)
             {
-                {
-                    std::lock_guard<std::mutex> lock(g_frame.mtx);
-                    g_frame.width = w;
-                    g_frame.height = h;
-                    g_frame.bgra = std::move(bgra);
-                    g_frame.hasFrame = true;
-                }
-                PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+                (void)sendto(s, (const char*)packet.data(), pktLen, 0, (const sockaddr*)&c.addr, sizeof(c.addr));
             }
+        }
 
-            buffer.erase(buffer.begin(), buffer.begin() + need);
+        if (PerfNowMs() - lastStatsMs >= kPaceStatsWindowMs)
+        {
+            PublishPaceStats(pacer.TakeStats());
+            lastStatsMs = PerfNowMs();
         }
+        pacer.Wait();
     }
 
-    WinHttpCloseHandle(hReq);
-    WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
-
+    jpegEncoder.reset();
+    source.reset();
     factory->Release();
     if (SUCCEEDED(hrCo)) CoUninitialize();
-
-    PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+    closesocket(s);
+    WSACleanup();
+    timeEndPeriod(1);
+    return 0;
 }
 
-static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+static void UdpClientNetworkThread(const std::string& serverIp, uint16_t port)
 {
-    static constexpr UINT IDM_CLIENT_MUTE_LOCAL = 5001;
-    static constexpr UINT IDM_CLIENT_MUTE_SERVER = 5002;
-
-    switch (msg)
+    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    IWICImagingFactory* factory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (FAILED(hr))
     {
-    case WM_NEW_FRAME:
-        InvalidateRect(hwnd, nullptr, FALSE);
-        return 0;
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
+    std::unique_ptr<FrameDecoder> decoder = CreateConfiguredFrameDecoder(factory);
 
-    case WM_CONTEXTMENU:
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
     {
-        HMENU menu = CreatePopupMenu();
-        if (!menu) return 0;
-
-        const bool localMuted = g_clientAudioMuted.load();
-        const bool serverMuted = g_clientWantsServerMuted.load();
-        AppendMenuW(menu, MF_STRING | (localMuted ? MF_CHECKED : 0), IDM_CLIENT_MUTE_LOCAL, L"Mute client audio");
-        AppendMenuW(menu, MF_STRING | (serverMuted ? MF_CHECKED : 0), IDM_CLIENT_MUTE_SERVER, L"Mute server audio");
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
 
-        POINT pt;
-        pt.x = GET_X_LPARAM(lParam);
-        pt.y = GET_Y_LPARAM(lParam);
-        if (pt.x == -1 && pt.y == -1)
-        {
-            GetCursorPos(&pt);
-        }
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET)
+    {
+        WSACleanup();
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
+    }
 
-        int cmd = (int)TrackPopupMenu(menu, TPM_RETURNCMD | TPM_NONOTIFY, pt.x, pt.y, 0, hwnd, nullptr);
-        DestroyMenu(menu);
+    int snd = 4 * 1024 * 1024;
+    int rcv = 4 * 1024 * 1024;
+    (void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+    (void)setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcv, sizeof(rcv));
 
-        if (cmd == (int)IDM_CLIENT_MUTE_LOCAL)
-        {
-            g_clientAudioMuted.store(!g_clientAudioMuted.load());
-            return 0;
-        }
-        if (cmd == (int)IDM_CLIENT_MUTE_SERVER)
-        {
-            bool newMuted = !g_clientWantsServerMuted.load();
-            g_clientWantsServerMuted.store(newMuted);
+    sockaddr_in bindAddr{};
+    bindAddr.sin_family = AF_INET;
+    bindAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bindAddr.sin_port = htons(0);
+    (void)bind(s, (sockaddr*)&bindAddr, sizeof(bindAddr));
 
-            std::wstring control;
-            if (MakeControlUrlFromVideoUrl(g_clientVideoUrl, control))
-            {
-                control += L"?mute=";
-                control += newMuted ? L"1" : L"0";
-                std::thread([control]() {
-                    (void)HttpGetSimpleWinHttp(control, nullptr);
-                }).detach();
-            }
-            return 0;
-        }
-        return 0;
+    sockaddr_in server{};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, serverIp.c_str(), &server.sin_addr) != 1)
+    {
+        closesocket(s);
+        WSACleanup();
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+        return;
     }
 
-    case WM_PAINT:
-    {
-        PAINTSTRUCT ps;
-        HDC hdc = BeginPaint(hwnd, &ps);
+    u_long nb = 1;
+    (void)ioctlsocket(s, FIONBIO, &nb);
 
-        RECT rc;
-        GetClientRect(hwnd, &rc);
+    uint32_t curFrame = 0;
+    uint16_t curCount = 0;
+    uint16_t curLastChunkLen = 0;
+    std::vector<uint8_t> accum;
+    std::vector<uint8_t> got;
+    uint64_t lastHello = 0;
 
-        FrameBuffer local;
+    while (g_running.load())
+    {
+        const uint64_t now = GetTickMs();
+        if (now - lastHello > 500)
         {
-            std::lock_guard<std::mutex> lock(g_frame.mtx);
-            local.width = g_frame.width;
-            local.height = g_frame.height;
-            local.bgra = g_frame.bgra;
-            local.hasFrame = g_frame.hasFrame;
+            (void)sendto(s, kUdpHello, (int)sizeof(kUdpHello), 0, (const sockaddr*)&server, sizeof(server));
+            lastHello = now;
         }
 
-        if (local.hasFrame && local.width > 0 && local.height > 0 && !local.bgra.empty())
+        uint8_t pkt[1600];
+        sockaddr_in from{};
+        int fromLen = sizeof(from);
+        int n = recvfrom(s, (char*)pkt, (int)sizeof(pkt), 0, (sockaddr*)&from, &fromLen);
+        if (n == SOCKET_ERROR)
         {
-            // High-quality scaling (default can look blocky).
-            SetStretchBltMode(hdc, HALFTONE);
-            SetBrushOrgEx(hdc, 0, 0, nullptr);
-
-            // Preserve aspect ratio (letterbox if needed).
-            const int dstW = rc.right - rc.left;
-            const int dstH = rc.bottom - rc.top;
-            double srcAR = (double)local.width / (double)local.height;
-            double dstAR = dstH == 0 ? srcAR : (double)dstW / (double)dstH;
-
-            int drawW = dstW;
-            int drawH = dstH;
-            int offX = 0;
-            int offY = 0;
-            if (dstAR > srcAR)
-            {
-                // Window is wider than source
-                drawH = dstH;
-                drawW = (int)(drawH * srcAR);
-                offX = (dstW - drawW) / 2;
-            }
-            else if (dstAR < srcAR)
+            int e = WSAGetLastError();
+            if (e == WSAEWOULDBLOCK)
             {
-                // Window is taller than source
-                drawW = dstW;
-                drawH = (int)(drawW / srcAR);
-                offY = (dstH - drawH) / 2;
-            }
-
-            BITMAPINFO bmi{};
-            bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-            bmi.bmiHeader.biWidth = local.width;
-            bmi.bmiHeader.biHeight = -local.height; // top-down
-            bmi.bmiHeader.biPlanes = 1;
-            bmi.bmiHeader.biBitCount = 32;
-            bmi.bmiHeader.biCompression = BI_RGB;
-
-            StretchDIBits(
-                hdc,
-                offX, offY, drawW, drawH,
-                0, 0, local.width, local.height,
-                local.bgra.data(),
-                &bmi,
-                DIB_RGB_COLORS,
-                SRCCOPY);
+                Sleep(1);
+                continue;
+            }
+            Sleep(1);
+            continue;
         }
-        else
+        if (n < (int)sizeof(UdpFrameChunkHeader)) continue;
+
+        UdpFrameChunkHeader hdr{};
+        std::memcpy(&hdr, pkt, sizeof(hdr));
+        if (hdr.magic != kUdpMagic) continue;
+        if (hdr.version < kUdpHeaderVersion || hdr.headerBytes < sizeof(hdr)) continue;
+        if (hdr.payloadLen == 0 || hdr.payloadLen > kUdpPayloadMax) continue;
+        if ((int)(hdr.headerBytes + hdr.payloadLen) > n) continue;
+        if (hdr.chunkCount == 0) continue;
+        if (hdr.chunkIndex >= hdr.chunkCount) continue;
+
+        if (hdr.frameId != curFrame)
         {
-            const char* txt = "Waiting for frames...";
-            TextOutA(hdc, 10, 10, txt, (int)std::strlen(txt));
+            curFrame = hdr.frameId;
+            curCount = hdr.chunkCount;
+            curLastChunkLen = 0;
+            accum.assign((size_t)curCount * kUdpPayloadMax, 0);
+            got.assign(curCount, 0);
         }
+        if (hdr.chunkCount != curCount) continue;
+        if (got[hdr.chunkIndex]) continue;
 
-        EndPaint(hwnd, &ps);
-        return 0;
-    }
-
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        return 0;
+        std::memcpy(accum.data() + (size_t)hdr.chunkIndex * kUdpPayloadMax, pkt + hdr.headerBytes, hdr.payloadLen);
+        got[hdr.chunkIndex] = 1;
+        if (hdr.chunkIndex == (uint16_t)(hdr.chunkCount - 1)) curLastChunkLen = hdr.payloadLen;
 
-    default:
-        return DefWindowProc(hwnd, msg, wParam, lParam);
+        bool complete = true;
+        for (uint16_t k = 0; k < curCount; k++) { if (!got[k]) { complete = false; break; } }
+        if (complete)
+        {
+            if (curLastChunkLen == 0) continue;
+            const size_t jpegLen = (size_t)(curCount - 1) * kUdpPayloadMax + (size_t)curLastChunkLen;
+            FrameTiming timing;
+            timing.seq = hdr.frameId;
+            timing.captureMs = hdr.captureMs;
+            timing.encodeMs = hdr.encodeMs;
+            timing.receivedMs = PerfNowMs();
+            int w = 0, h = 0;
+            std::vector<uint8_t> bgra;
+            HRESULT dhr = decoder->Decode(accum.data(), jpegLen, w, h, bgra);
+            if (SUCCEEDED(dhr) && !bgra.empty())
+            {
+                timing.decodedMs = PerfNowMs();
+                {
+                    std::lock_guard<std::mutex> lock(g_frame.mtx);
+                    g_frame.width = w;
+                    g_frame.height = h;
+                    g_frame.bgra = std::move(bgra);
+                    g_frame.hasFrame = true;
+                    g_frame.timing = timing;
+                }
+                PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+            }
+            got.assign(curCount, 0);
+        }
     }
+
+    closesocket(s);
+    WSACleanup();
+    decoder.reset();
+    factory->Release();
+    if (SUCCEEDED(hrCo)) CoUninitialize();
+    PostMessage(g_hwnd, WM_CLOSE, 0, 0);
 }
 
-static int RunClient(const std::wstring& url)
+static int RunUdpClient(const std::string& serverIp, uint16_t port)
 {
     SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
-
-    // Ensure running flag is set for both video + audio threads.
     g_running.store(true);
 
-    g_clientVideoUrl = url;
-    g_clientWantsServerMuted.store(false);
-
     // Reduce OS DPI bitmap-scaling blur on the window.
     if (HMODULE user32 = LoadLibraryW(L"user32.dll"))
     {
         using Fn = BOOL(WINAPI*)(DPI_AWARENESS_CONTEXT);
         auto fn = (Fn)GetProcAddress(user32, "SetProcessDpiAwarenessContext");
-        if (fn)
-        {
-            (void)fn(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
-        }
+        if (fn) (void)fn(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
         FreeLibrary(user32);
     }
 
     HINSTANCE hInst = GetModuleHandle(nullptr);
 
-    WNDCLASS wc{};
+    const wchar_t* cls = L"LanUdpClient";
+    WNDCLASSW wc{};
     wc.lpfnWndProc = WndProc;
     wc.hInstance = hInst;
-    wc.lpszClassName = L"LanMjpegClient";
+    wc.lpszClassName = cls;
     wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
     wc.hIcon = LoadIconW(hInst, MAKEINTRESOURCEW(IDI_APP_ICON));
+    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    (void)RegisterClassW(&wc);
 
-    if (!RegisterClass(&wc))
-    {
-        std::fprintf(stderr, "RegisterClass failed\n");
-        return 1;
-    }
-
-    g_hwnd = CreateWindowEx(
+    g_clientTitle = L"LAN Screen Viewer (UDP JPEG)";
+    g_hwnd = CreateWindowExW(
         0,
-        wc.lpszClassName,
-        L"LAN Screen Viewer (MJPEG over HTTP)",
+        cls,
+        g_clientTitle.c_str(),
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT, 1280, 720,
         nullptr, nullptr, hInst, nullptr);
 
     if (!g_hwnd)
     {
-        std::fprintf(stderr, "CreateWindowEx failed\n");
+        LogError("CreateWindowEx failed\n");
         return 1;
     }
 
     ShowWindow(g_hwnd, SW_SHOW);
     UpdateWindow(g_hwnd);
 
-    std::thread net([url]() { ClientNetworkThread(url); });
+    std::thread net([serverIp, port]() { UdpClientNetworkThread(serverIp, port); });
     net.detach();
 
-    std::wstring audioUrl;
-    if (MakeAudioUrlFromVideoUrl(url, audioUrl))
-    {
-        std::thread aud([audioUrl]() { ClientAudioThread(audioUrl); });
-        aud.detach();
-    }
-
     MSG msg;
     while (GetMessage(&msg, nullptr, 0, 0) > 0)
     {
@@ -2585,422 +9599,1442 @@ static int RunClient(const std::wstring& url)
     return 0;
 }
 
-static uint64_t GetTickMs()
+// ----------------------------
+// Offline pipeline benchmark (capture -> encode -> publish, no sockets)
+// ----------------------------
+
+// Serial vs pipelined throughput on a synthetic source of the given size, unpaced.
+// Serial: capture + hash + encode on one thread. Pipelined: the capture thread copies each
+// frame into a FrameQueue and an encode thread drains it, as in the server.
+static void BenchPipelineAt(FrameEncoder* encoder, int width, int height, int seconds, int jpegQuality0to100)
 {
-    return (uint64_t)GetTickCount64();
+    char spec[64];
+    std::snprintf(spec, sizeof(spec), "synthetic:%dx%d", width, height);
+    const TileHashImpl hashImpl = BestTileHashImpl();
+
+    uint64_t serialFrames = 0;
+    {
+        std::unique_ptr<CaptureSource> source = CreateCaptureSource(spec);
+        CaptureSurface surf;
+        TileHashGrid tiles;
+        const double p0 = PerfNowMs();
+        while (PerfNowMs() - p0 < seconds * 1000.0)
+        {
+            if (FAILED(source->Capture(surf))) continue;
+            UpdateTileHashes(surf, tiles, hashImpl);
+            JpegFrame frame;
+            if (SUCCEEDED(encoder->Encode(surf, jpegQuality0to100, frame))) serialFrames++;
+        }
+    }
+    const double serialFps = serialFrames * 1000.0 / (seconds * 1000.0);
+
+    FrameQueue queue;
+    std::atomic<bool> stop{ false };
+    uint64_t captured = 0;
+    double captureMs = 0.0;
+    double copyMs = 0.0;
+    std::thread producer([&]() {
+        std::unique_ptr<CaptureSource> source = CreateCaptureSource(spec);
+        CaptureSurface surf;
+        TileHashGrid tiles;
+        while (!stop.load())
+        {
+            const double c0 = PerfNowMs();
+            if (FAILED(source->Capture(surf))) continue;
+            UpdateTileHashes(surf, tiles, hashImpl);
+            const double c1 = PerfNowMs();
+            std::unique_ptr<PipelineFrame> pf = queue.AcquireFree();
+            if (!pf)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            CopySurfaceToFrame(surf, tiles, *pf);
+            pf->captureMs = c0;
+            queue.Push(std::move(pf));
+            captureMs += c1 - c0;
+            copyMs += PerfNowMs() - c1;
+            captured++;
+        }
+    });
+
+    uint64_t encoded = 0;
+    double encodeMs = 0.0;
+    double latencyMs = 0.0;
+    const double p0 = PerfNowMs();
+    while (PerfNowMs() - p0 < seconds * 1000.0)
+    {
+        std::unique_ptr<PipelineFrame> pf = queue.Pop(kIdleWaitMs);
+        if (!pf) continue;
+        const double e0 = PerfNowMs();
+        JpegFrame frame;
+        if (SUCCEEDED(encoder->Encode(pf->surf, jpegQuality0to100, frame)))
+        {
+            const double e1 = PerfNowMs();
+            encodeMs += e1 - e0;
+            latencyMs += e1 - pf->captureMs;
+            encoded++;
+        }
+        queue.Recycle(std::move(pf));
+    }
+    const double elapsed = PerfNowMs() - p0;
+    stop.store(true);
+    queue.Close();
+    producer.join();
+
+    LogInfo("bench: pipeline %4dx%-4d serial=%.1f fps pipelined=%.1f fps (%.2fx) capture=%.2f ms copy=%.2f ms encode=%.2f ms latency=%.1f ms dropped=%llu/%llu\n",
+        width, height,
+        serialFps,
+        encoded * 1000.0 / elapsed,
+        serialFps > 0.0 ? (encoded * 1000.0 / elapsed) / serialFps : 0.0,
+        captured > 0 ? captureMs / captured : 0.0,
+        captured > 0 ? copyMs / captured : 0.0,
+        encoded > 0 ? encodeMs / encoded : 0.0,
+        encoded > 0 ? latencyMs / encoded : 0.0,
+        (unsigned long long)queue.drops,
+        (unsigned long long)captured);
 }
 
-static bool SameAddr(const sockaddr_in& a, const sockaddr_in& b)
+// Static desktop through the server's own capture and encode threads, with one MJPEG viewer
+// on a frozen synthetic screen at 10 fps: after the first frame, repeats must be skipped
+// without an encode or a new seq, and exactly one keepalive must re-publish the frame (under
+// a new seq, still without an encode) kKeepaliveFrameMs after it.
+static void BenchStaticDesktop(int jpegQuality0to100)
 {
-    return a.sin_family == b.sin_family && a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+    const int fps = 10;
+    HANDLE stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!stopEvent) return;
+    const std::string savedSpec = g_captureSpec;
+    g_captureSpec = "synthetic:640x360:still";
+    std::atomic_store(&g_sharedFrame.current, std::shared_ptr<const MjpegFrameSet>());
+    g_clientCount.fetch_add(1);
+    g_renditionClients[0].fetch_add(1);
+    const uint64_t encoded0 = g_framesEncoded.load();
+    g_captureThreadRunning.store(true);
+    std::thread cap([fps, jpegQuality0to100, stopEvent]() { CaptureLoopThread(fps, jpegQuality0to100, stopEvent); });
+
+    std::shared_ptr<const MjpegFrameSet> first;
+    const double p0 = PerfNowMs();
+    while (!(first = std::atomic_load(&g_sharedFrame.current)) && PerfNowMs() - p0 < 5000.0) Sleep(5);
+    const uint64_t encoded1 = g_framesEncoded.load();
+    const uint64_t skipped1 = g_framesSkipped.load();
+
+    // Watch one keepalive interval and a second past it.
+    int publishes = 0;
+    double keepaliveMs = 0.0;
+    uint64_t lastSeq = first ? first->seq : 0;
+    while (first && PerfNowMs() - first->captureMs < kKeepaliveFrameMs + 1000.0)
+    {
+        std::shared_ptr<const MjpegFrameSet> cur = std::atomic_load(&g_sharedFrame.current);
+        if (cur && cur->seq != lastSeq)
+        {
+            if (publishes++ == 0) keepaliveMs = cur->captureMs - first->captureMs;
+            lastSeq = cur->seq;
+        }
+        Sleep(5);
+    }
+    const uint64_t encodes = g_framesEncoded.load() - encoded1;
+    const uint64_t skipped = g_framesSkipped.load() - skipped1;
+
+    SetEvent(stopEvent);
+    cap.join();
+    CloseHandle(stopEvent);
+    g_running.store(true); // the capture loop clears it when it sees the stop event
+    g_renditionClients[0].fetch_sub(1);
+    g_clientCount.fetch_sub(1);
+    std::atomic_store(&g_sharedFrame.current, std::shared_ptr<const MjpegFrameSet>());
+    g_captureSpec = savedSpec;
+
+    // The keepalive is decided on a capture tick, so it may trail the interval by a tick or two.
+    const double tickMs = 1000.0 / fps;
+    const bool ok = first && encoded1 - encoded0 == 1 && encodes == 0 && skipped > 0 && publishes == 1 &&
+        keepaliveMs >= kKeepaliveFrameMs - tickMs && keepaliveMs <= kKeepaliveFrameMs + 2 * tickMs;
+    LogInfo("bench: static desktop first=%s encodes=%llu skipped=%llu republished=%d keepalive after %.0f ms %s\n",
+        first ? "yes" : "no", (unsigned long long)encodes, (unsigned long long)skipped, publishes, keepaliveMs, ok ? "ok" : "FAILED");
 }
 
-static std::string SockaddrToString(const sockaddr_in& a)
+// Pixel-kernel microbenchmark on a captured surface: each variant's GB/s (input bytes) and
+// whether its output matches the scalar variant exactly.
+static void BenchPixelKernels(const CaptureSurface& surf)
 {
-    char ip[64] = {};
-    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
-    char buf[96];
-    std::snprintf(buf, sizeof(buf), "%s:%u", ip, (unsigned)ntohs(a.sin_port));
-    return std::string(buf);
+    const int w = surf.width & ~1;
+    const int h = surf.height & ~1;
+    if (w <= 0 || h <= 0) return;
+    const int cw = w / 2;
+    const int ch = h / 2;
+
+    // Kernel inputs derived from the surface: a 16-bit Y plane and an 8-bit 4:2:0 image.
+    std::vector<int16_t> y16((size_t)w * h), cb16((size_t)w), cr16((size_t)w);
+    std::vector<uint8_t> y8((size_t)w * h), cbcr((size_t)cw * ch * 2);
+    for (int y = 0; y < h; y++)
+    {
+        int16_t* yRow = y16.data() + (size_t)y * w;
+        kPixelKernelsScalar.bgraToYcc(surf.pixels + (size_t)y * surf.stride, w, yRow, cb16.data(), cr16.data());
+        for (int x = 0; x < w; x++)
+        {
+            y8[(size_t)y * w + x] = ClampU8(yRow[x] + 128);
+            if ((y & 1) == 0 && (x & 1) == 0)
+            {
+                uint8_t* c = cbcr.data() + ((size_t)(y / 2) * cw + x / 2) * 2;
+                c[0] = ClampU8(cb16[x] + 128);
+                c[1] = ClampU8(cr16[x] + 128);
+            }
+        }
+    }
+
+    struct KernelRun
+    {
+        const char* name;
+        double inputBytes;
+        std::function<void(const PixelKernels&, std::vector<uint8_t>&)> run;
+    };
+    const KernelRun runs[] = {
+        { "bgra>ycc", (double)w * h * 4, [&](const PixelKernels& k, std::vector<uint8_t>& out) {
+            out.resize((size_t)w * h * 6);
+            int16_t* o = (int16_t*)out.data();
+            for (int y = 0; y < h; y++, o += (size_t)w * 3)
+            {
+                k.bgraToYcc(surf.pixels + (size_t)y * surf.stride, w, o, o + w, o + 2 * w);
+            }
+        } },
+        { "avg2x2", (double)w * h * 2, [&](const PixelKernels& k, std::vector<uint8_t>& out) {
+            out.resize((size_t)cw * ch * 2);
+            for (int y = 0; y < ch; y++)
+            {
+                const int16_t* r0 = y16.data() + (size_t)(2 * y) * w;
+                k.average2x2(r0, r0 + w, cw, (int16_t*)out.data() + (size_t)y * cw);
+            }
+        } },
+        { "ycc420>bgra", (double)w * h * 1.5, [&](const PixelKernels& k, std::vector<uint8_t>& out) {
+            out.resize((size_t)w * h * 4);
+            for (int y = 0; y < h; y++)
+            {
+                k.yccToBgra(y8.data() + (size_t)y * w, cbcr.data() + (size_t)(y / 2) * cw * 2, w, true, out.data() + (size_t)y * w * 4);
+            }
+        } },
+        { "halve", (double)w * h * 4, [&](const PixelKernels& k, std::vector<uint8_t>& out) {
+            out.resize((size_t)cw * ch * 4);
+            for (int y = 0; y < ch; y++)
+            {
+                const uint8_t* r0 = surf.pixels + (size_t)(2 * y) * surf.stride;
+                k.halveBgra(r0, r0 + surf.stride, cw, out.data() + (size_t)y * cw * 4);
+            }
+        } },
+        { "lerprows", (double)w * h * 4, [&](const PixelKernels& k, std::vector<uint8_t>& out) {
+            out.resize((size_t)w * h * 4);
+            for (int y = 0; y < h; y++)
+            {
+                const uint8_t* r0 = surf.pixels + (size_t)y * surf.stride;
+                const uint8_t* r1 = surf.pixels + (size_t)std::min(y + 1, h - 1) * surf.stride;
+                k.lerpRows(r0, r1, w * 4, 96, out.data() + (size_t)y * w * 4);
+            }
+        } },
+    };
+
+    for (const KernelRun& r : runs)
+    {
+        std::vector<uint8_t> ref;
+        r.run(kPixelKernelsScalar, ref);
+        for (const PixelKernels* k : AvailablePixelKernels())
+        {
+            std::vector<uint8_t> out;
+            int iters = 0;
+            const double t0 = PerfNowMs();
+            do
+            {
+                r.run(*k, out);
+                iters++;
+            } while (PerfNowMs() - t0 < 300.0);
+            const double ms = (PerfNowMs() - t0) / iters;
+            LogInfo("bench: kernel %-11s %-6s %.3f ms/frame %.2f GB/s %s\n", r.name, k->name, ms,
+                r.inputBytes / (1024.0 * 1024.0 * 1024.0) / (ms / 1000.0), out == ref ? "ok" : "MISMATCH");
+        }
+    }
 }
 
-#pragma pack(push, 1)
-struct UdpFrameChunkHeader
+// PSNR (dB) of b against a, colour channels only.
+static double PsnrBgra(const uint8_t* a, int aStride, const uint8_t* b, int bStride, int w, int h)
 {
-    uint32_t magic;
-    uint32_t frameId;
-    uint16_t chunkIndex;
-    uint16_t chunkCount;
-    uint16_t payloadLen;
-    uint16_t reserved;
-};
-#pragma pack(pop)
+    double se = 0.0;
+    for (int y = 0; y < h; y++)
+    {
+        const uint8_t* pa = a + (size_t)y * (size_t)aStride;
+        const uint8_t* pb = b + (size_t)y * (size_t)bStride;
+        for (int x = 0; x < w * 4; x++)
+        {
+            if ((x & 3) == 3) continue;
+            const double d = (double)pa[x] - (double)pb[x];
+            se += d * d;
+        }
+    }
+    const double mse = se / ((double)w * h * 3);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// PSNR (dB) of a decoded JPEG against the surface it was encoded from, colour channels only.
+// Returns -1 if WIC cannot decode it.
+static double JpegPsnrAgainst(IWICImagingFactory* factory, const std::vector<uint8_t>& jpeg, const CaptureSurface& surf)
+{
+    int w = 0;
+    int h = 0;
+    std::vector<uint8_t> bgra;
+    if (FAILED(DecodeJpegToBGRA(factory, jpeg.data(), jpeg.size(), w, h, bgra)) || w != surf.width || h != surf.height) return -1.0;
+    return PsnrBgra(surf.pixels, surf.stride, bgra.data(), w * 4, w, h);
+}
+
+// Synthetic content for the adaptive-tiles benchmark. "text" is dark glyph strokes on white,
+// "ui" is flat panels, gradients, borders and text, "photo" is smooth shapes with texture
+// and sensor-like noise, and "mixed" is ui with a photo region (a video player).
+static void FillCorpusText(uint8_t* px, int stride, int x0, int y0, int x1, int y1, uint32_t seed)
+{
+    uint32_t s = seed;
+    auto rnd = [&s]() {
+        s = s * 1664525u + 1013904223u;
+        return s >> 8;
+    };
+    for (int ly = y0 + 4; ly + 14 <= y1; ly += 18)
+    {
+        for (int gx = x0 + 6; gx + 9 <= x1; gx += 9)
+        {
+            if (rnd() % 100 < 15) continue; // space
+            const uint32_t strokes = rnd();
+            for (int k = 0; k < 6; k++)
+            {
+                if (!(strokes & (1u << k))) continue;
+                const bool vertical = k < 3;
+                for (int t = 0; t < 8; t++)
+                {
+                    const int x = vertical ? gx + 1 + k * 3 : gx + t;
+                    const int y = vertical ? ly + 3 + t + (t > 4 ? t - 4 : 0) : ly + 3 + (k - 3) * 5;
+                    if (x >= x1 || y >= y1) continue;
+                    uint8_t* p = px + (size_t)y * stride + (size_t)x * 4;
+                    p[0] = 40;
+                    p[1] = 34;
+                    p[2] = 30;
+                }
+            }
+        }
+    }
+}
+
+static void FillCorpusPhoto(uint8_t* px, int stride, int x0, int y0, int x1, int y1, uint32_t seed)
+{
+    uint32_t s = seed;
+    for (int y = y0; y < y1; y++)
+    {
+        uint8_t* row = px + (size_t)y * stride;
+        for (int x = x0; x < x1; x++)
+        {
+            s = s * 1664525u + 1013904223u;
+            const int noise = (int)((s >> 24) % 13) - 6;
+            const double fx = x * 0.013;
+            const double fy = y * 0.017;
+            const double v = std::sin(fx) * std::cos(fy * 1.3) + 0.5 * std::sin(fx * 3.1 + fy * 2.3) + 0.25 * std::sin(fx * 9.7 - fy * 7.1);
+            const double w = std::cos(fx * 0.7 + fy * 0.4);
+            uint8_t* p = row + (size_t)x * 4;
+            p[0] = ClampU8((int)(100 + 60 * v - 40 * w) + noise);
+            p[1] = ClampU8((int)(120 + 50 * v + 30 * w) + noise);
+            p[2] = ClampU8((int)(140 + 40 * v + 50 * w) + noise);
+            p[3] = 255;
+        }
+    }
+}
+
+static void FillCorpusRect(uint8_t* px, int stride, int x0, int y0, int x1, int y1, uint8_t b, uint8_t g, uint8_t r)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            uint8_t* p = px + (size_t)y * stride + (size_t)x * 4;
+            p[0] = b;
+            p[1] = g;
+            p[2] = r;
+            p[3] = 255;
+        }
+    }
+}
+
+static void MakeCorpusFrame(const char* kind, int w, int h, std::vector<uint8_t>& px)
+{
+    const int stride = w * 4;
+    px.assign((size_t)stride * h, 255);
+    const std::string k = kind;
+    if (k == "photo")
+    {
+        FillCorpusPhoto(px.data(), stride, 0, 0, w, h, 7);
+        return;
+    }
+    if (k == "text")
+    {
+        FillCorpusText(px.data(), stride, 0, 0, w, h, 1);
+        return;
+    }
+
+    // ui / mixed: a window with title bar, sidebar, toolbar buttons and text panes.
+    FillCorpusRect(px.data(), stride, 0, 0, w, h, 240, 238, 236);
+    for (int y = 0; y < 40; y++) FillCorpusRect(px.data(), stride, 0, y, w, y + 1, (uint8_t)(200 - y), (uint8_t)(120 - y), (uint8_t)(40 + y));
+    FillCorpusRect(px.data(), stride, 0, 40, w / 5, h, 52, 48, 45);
+    FillCorpusText(px.data(), stride, 8, 48, w / 5 - 8, h, 3);
+    for (int i = 0; i < 12; i++)
+    {
+        const int bx = w / 5 + 12 + i * 90;
+        if (bx + 80 > w) break;
+        FillCorpusRect(px.data(), stride, bx, 50, bx + 80, 78, 160, 160, 160);
+        FillCorpusRect(px.data(), stride, bx + 1, 51, bx + 79, 77, 250, 250, 250);
+    }
+    FillCorpusText(px.data(), stride, w / 5 + 12, 90, w - 12, h - 12, 5);
+    if (k == "mixed")
+    {
+        FillCorpusPhoto(px.data(), stride, w / 4, h / 5, w / 4 + w / 2, h / 5 + h / 2, 11);
+    }
+}
+
+// Decodes a full /tiles message into a frame; -1 PSNR on any failure.
+static double TileMessagePsnrAgainst(IWICImagingFactory* factory, const std::vector<uint8_t>& msg, const CaptureSurface& surf)
+{
+    TileMessageView view;
+    if (ParseTileMessage(msg.data(), msg.size(), view) != (long long)msg.size()) return -1.0;
+    std::vector<uint8_t> frame((size_t)view.width * view.height * 4, 0);
+    std::vector<uint8_t> tile;
+    for (const TileEntryView& t : view.tiles)
+    {
+        int w = 0, h = 0;
+        if (FAILED(DecodeJpegToBGRA(factory, t.jpeg, t.jpegLen, w, h, tile)) ||
+            !PatchTileBgra(frame, view.width, view.height, t.rect, tile.data(), w, h))
+        {
+            return -1.0;
+        }
+    }
+    return PsnrBgra(surf.pixels, surf.stride, frame.data(), view.width * 4, surf.width, surf.height);
+}
+
+// /tiles round trip on a changing synthetic sequence: each capture goes through
+// CollectDirtyTileRects and BuildTileMessage, then the client's ConsumeTileMessages patches a
+// client-side frame that must match the capture (PSNR). One delta is dropped on the way: the
+// client must stop applying deltas until the next full message, then match again.
+static void BenchTileRoundTrip(IWICImagingFactory* factory, FrameEncoder* encoder, int jpegQuality0to100)
+{
+    std::unique_ptr<CaptureSource> source = CreateCaptureSource("synthetic:640x360");
+    std::unique_ptr<FrameDecoder> decoder = CreateConfiguredFrameDecoder(factory);
+    if (!source || !decoder) return;
+
+    const int kFrames = 40;
+    const int kDropAt = 15;
+    const int kKeyAt = 25;
+    const double kMinPsnrDb = 30.0;
+    TileHashGrid prev;
+    TileHashGrid cur;
+    std::vector<TileRect> rects;
+    std::vector<uint8_t> msg;
+    std::vector<uint8_t> stream;
+    ClientTileStreamState st;
+    std::vector<uint8_t> frame;
+    int frameW = 0;
+    int frameH = 0;
+    double minPsnr = 99.0;
+    int failures = 0;
+    for (int i = 0; i < kFrames && failures == 0; i++)
+    {
+        CaptureSurface surf;
+        if (FAILED(source->Capture(surf)))
+        {
+            failures++;
+            break;
+        }
+        ComputeTileHashes(surf, cur, BestTileHashImpl());
+        const bool key = i == 0 || i == kKeyAt;
+        JpegFrame keyJpeg;
+        if (key && FAILED(encoder->Encode(surf, jpegQuality0to100, keyJpeg))) failures++;
+        if (!key) CollectDirtyTileRects(prev, cur, rects);
+        if (failures > 0 || FAILED(BuildTileMessage(encoder, surf, rects, jpegQuality0to100, (uint32_t)(i + 1), key ? &keyJpeg : nullptr, msg)))
+        {
+            failures++;
+            break;
+        }
+        std::swap(prev, cur);
+        if (i == kDropAt) continue; // lost on the way
+
+        stream.insert(stream.end(), msg.begin(), msg.end());
+        if (!ConsumeTileMessages(decoder.get(), stream, st, [&](const ClientTileStreamState& s) { PatchTileMessage(s, frame, frameW, frameH); }))
+        {
+            failures++;
+            break;
+        }
+        const bool wantSynced = i < kDropAt || i >= kKeyAt;
+        if (st.synced != wantSynced) failures++;
+        if (!wantSynced) continue;
+        const double psnr = frameW == surf.width && frameH == surf.height ?
+            PsnrBgra(surf.pixels, surf.stride, frame.data(), frameW * 4, frameW, frameH) : 0.0;
+        minPsnr = std::min(minPsnr, psnr);
+        if (psnr < kMinPsnrDb) failures++;
+    }
+    LogInfo("bench: tiles round trip frames=%d (delta %d dropped, key at %d) min PSNR %.2f dB %s\n", kFrames, kDropAt, kKeyAt, minPsnr,
+        failures == 0 ? "ok" : "FAILED");
+}
+
+// Fixed 4:4:4 tiles vs --adaptive-tiles on the synthetic corpus at 1080p: bytes and PSNR of a
+// whole-frame message each way, and how many tiles the classifier sent as natural.
+static void BenchAdaptiveTiles(IWICImagingFactory* factory, FrameEncoder* encoder, int jpegQuality0to100)
+{
+    const int w = 1920;
+    const int h = 1080;
+    std::vector<uint8_t> px;
+    std::vector<TileRect> rows;
+    for (int y = 0; y < h; y += kTileSize)
+    {
+        TileRect r;
+        r.y = y;
+        r.w = w;
+        r.h = std::min(kTileSize, h - y);
+        rows.push_back(r);
+    }
+
+    for (const char* kind : { "text", "ui", "photo", "mixed" })
+    {
+        MakeCorpusFrame(kind, w, h, px);
+        CaptureSurface surf;
+        surf.pixels = px.data();
+        surf.width = w;
+        surf.height = h;
+        surf.stride = w * 4;
+
+        std::vector<uint8_t> fixedMsg;
+        std::vector<uint8_t> adaptiveMsg;
+        TileCodingStats stats;
+        if (FAILED(BuildTileMessage(encoder, surf, rows, jpegQuality0to100, 1, nullptr, fixedMsg)) ||
+            FAILED(BuildAdaptiveTileMessage(encoder, surf, nullptr, jpegQuality0to100, 1, adaptiveMsg, &stats)))
+        {
+            LogError("bench: adaptive %-5s encode failed\n", kind);
+            continue;
+        }
+        LogInfo("bench: adaptive %-5s fixed=%8zu bytes %.2f dB  adaptive=%8zu bytes %.2f dB (%+.1f%%) natural tiles=%d/%d\n",
+            kind,
+            fixedMsg.size(), TileMessagePsnrAgainst(factory, fixedMsg, surf),
+            adaptiveMsg.size(), TileMessagePsnrAgainst(factory, adaptiveMsg, surf),
+            100.0 * ((double)adaptiveMsg.size() - (double)fixedMsg.size()) / (double)fixedMsg.size(),
+            stats.naturalTiles, stats.naturalTiles + stats.textTiles);
+    }
+}
+
+
+// JPEG backends on a 4K synthetic frame: WIC and TurboJPEG (if turbojpeg.dll loads), then the
+// strip encoder on 1/2/4/8 threads, which must produce identical bytes that WIC decodes.
+// Decoders are timed on the WIC-encoded frame.
+static void BenchJpegCodecs(IWICImagingFactory* factory, int jpegQuality0to100)
+{
+    std::unique_ptr<CaptureSource> source = CreateCaptureSource("synthetic:3840x2160");
+    CaptureSurface surf;
+    for (int i = 0; i < 3; i++)
+    {
+        if (FAILED(source->Capture(surf))) return;
+    }
+
+    auto timeMs = [](const std::function<bool()>& encode) -> double {
+        int iters = 0;
+        const double t0 = PerfNowMs();
+        do
+        {
+            if (!encode()) return -1.0;
+            iters++;
+        } while (PerfNowMs() - t0 < 1000.0 || iters < 3);
+        return (PerfNowMs() - t0) / iters;
+    };
+
+    JpegFrame wic;
+    for (const char* name : { "wic", "turbo" })
+    {
+        std::unique_ptr<FrameEncoder> enc = CreateFrameEncoder(name, factory);
+        if (!enc)
+        {
+            LogInfo("bench: jpeg %-9s unavailable\n", name);
+            continue;
+        }
+        JpegFrame out;
+        const double ms = timeMs([&]() { return SUCCEEDED(enc->Encode(surf, jpegQuality0to100, out)); });
+        if (ms <= 0.0) continue;
+        LogInfo("bench: jpeg %-9s %6.1f ms %8llu bytes psnr=%.2f dB\n", name, ms,
+            (unsigned long long)out.bytes.size(), JpegPsnrAgainst(factory, out.bytes, surf));
+        if (std::strcmp(name, "wic") == 0) wic = std::move(out);
+    }
 
-static constexpr uint32_t kUdpMagic = 0x3255534Cu; // 'LSU2'
-static constexpr int kUdpPayloadMax = 1200;
+    for (const char* name : { "wic", "turbo" })
+    {
+        std::unique_ptr<FrameDecoder> dec = CreateFrameDecoder(name, factory);
+        if (!dec || wic.bytes.empty()) continue;
+        int w = 0, h = 0;
+        std::vector<uint8_t> bgra;
+        const double ms = timeMs([&]() { return SUCCEEDED(dec->Decode(wic.bytes.data(), wic.bytes.size(), w, h, bgra)); });
+        if (ms > 0.0) LogInfo("bench: decode %-7s %6.1f ms\n", name, ms);
+    }
 
-struct UdpClientEntry
-{
-    sockaddr_in addr{};
-    uint64_t lastSeenMs = 0;
-};
+    std::vector<uint8_t> ref;
+    double oneThreadMs = 0.0;
+    for (int threads : { 1, 2, 4, 8 })
+    {
+        StripJpegEncoder enc(threads);
+        std::vector<uint8_t> out;
+        const double ms = timeMs([&]() { return enc.Encode(surf, jpegQuality0to100, false, out); });
+        if (ms <= 0.0) break;
+        if (threads == 1)
+        {
+            ref = out;
+            oneThreadMs = ms;
+        }
+        const double psnr = JpegPsnrAgainst(factory, out, surf);
+        LogInfo("bench: jpeg strips/%-2d %6.1f ms %8llu bytes psnr=%.2f dB speedup=%.2fx %s\n", threads, ms,
+            (unsigned long long)out.size(), psnr, oneThreadMs / ms,
+            psnr < 0.0 ? "DECODE FAILED" : (out == ref ? "ok" : "MISMATCH"));
+    }
+}
 
-static void UdpServerRecvLoop(SOCKET s, std::mutex* mtx, std::vector<UdpClientEntry>* clients)
+// Fan-out of one published frame to many viewers: "copy" copies the JPEG out of a locked slot
+// for every viewer (the old /mjpeg path), "shared" pins the published buffer. Viewers read one
+// byte per 4 KB instead of sending, so the difference is the per-viewer memcpy and how long the
+// publisher waits for the slot.
+static void BenchFrameFanout(int viewers, size_t frameBytes, int fps, int seconds)
 {
-    char buf[256];
-    while (g_running.load())
+    std::vector<uint8_t> jpeg(frameBytes);
+    for (size_t i = 0; i < jpeg.size(); i++) jpeg[i] = (uint8_t)(i * 131);
+
+    for (int pass = 0; pass < 2; pass++)
     {
-        sockaddr_in from{};
-        int fromLen = sizeof(from);
-        int n = recvfrom(s, buf, (int)sizeof(buf), 0, (sockaddr*)&from, &fromLen);
-        if (n == SOCKET_ERROR)
+        const bool shared = pass == 1;
+        struct CopySlot
         {
-            int e = WSAGetLastError();
-            if (e == WSAEWOULDBLOCK)
-            {
-                Sleep(2);
-                continue;
-            }
-            Sleep(2);
-            continue;
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::vector<uint8_t> bytes;
+            uint64_t seq = 0;
+        } copySlot;
+        SharedJpegFrame sharedSlot;
+        std::atomic<bool> stop{ false };
+        std::atomic<uint64_t> delivered{ 0 };
+        std::atomic<uint64_t> copiedBytes{ 0 };
+        std::atomic<uint64_t> checksum{ 0 };
+
+        std::vector<std::thread> threads;
+        for (int v = 0; v < viewers; v++)
+        {
+            threads.emplace_back([&]() {
+                uint64_t lastSeq = 0;
+                uint64_t sum = 0;
+                std::vector<uint8_t> copy;
+                while (!stop.load())
+                {
+                    std::shared_ptr<const MjpegFrameSet> set;
+                    const std::vector<uint8_t>* bytes = nullptr;
+                    if (shared)
+                    {
+                        set = WaitForMjpegFrame(sharedSlot, lastSeq, 100);
+                        if (!set) continue;
+                        lastSeq = set->seq;
+                        bytes = set->renditions[0].jpeg.get();
+                    }
+                    else
+                    {
+                        std::unique_lock<std::mutex> lock(copySlot.mtx);
+                        copySlot.cv.wait_for(lock, std::chrono::milliseconds(100), [&]() {
+                            return stop.load() || copySlot.seq != lastSeq;
+                        });
+                        if (copySlot.seq == lastSeq) continue;
+                        lastSeq = copySlot.seq;
+                        copy = copySlot.bytes;
+                        copiedBytes.fetch_add(copy.size());
+                        bytes = &copy;
+                    }
+                    for (size_t i = 0; i < bytes->size(); i += 4096) sum += (*bytes)[i];
+                    delivered.fetch_add(1);
+                }
+                checksum.fetch_add(sum);
+            });
         }
-        if (n <= 0) continue;
 
-        const uint64_t now = GetTickMs();
-        std::lock_guard<std::mutex> lock(*mtx);
-        bool found = false;
-        for (auto& c : *clients)
+        uint64_t published = 0;
+        double lockWaitMs = 0.0;
+        double maxLockWaitMs = 0.0;
+        const double cpu0 = ProcessCpuMs();
+        const double p0 = PerfNowMs();
+        while (PerfNowMs() - p0 < seconds * 1000.0)
         {
-            if (SameAddr(c.addr, from))
+            published++;
+            double waitMs = 0.0;
+            if (shared)
             {
-                c.lastSeenMs = now;
-                found = true;
-                break;
+                std::unique_ptr<std::vector<uint8_t>> buf = TakeJpegBuffer();
+                buf->assign(jpeg.begin(), jpeg.end());
+                std::shared_ptr<MjpegFrameSet> set = std::make_shared<MjpegFrameSet>();
+                set->seq = published;
+                set->renditions[0] = MakeMjpegPart(ShareJpegBuffer(std::move(buf)), set->seq, PerfNowMs(), 0.0);
+                const double l0 = PerfNowMs();
+                PublishMjpegFrame(sharedSlot, std::move(set));
+                waitMs = PerfNowMs() - l0;
+            }
+            else
+            {
+                std::vector<uint8_t> bytes(jpeg);
+                const double l0 = PerfNowMs();
+                std::lock_guard<std::mutex> lock(copySlot.mtx);
+                waitMs = PerfNowMs() - l0;
+                copySlot.bytes = std::move(bytes);
+                copySlot.seq = published;
+                copySlot.cv.notify_all();
             }
+            lockWaitMs += waitMs;
+            maxLockWaitMs = std::max(maxLockWaitMs, waitMs);
+            PacerSleepMs(p0 + published * 1000.0 / fps - PerfNowMs());
         }
-        if (!found)
+        stop.store(true);
         {
-            UdpClientEntry e;
-            e.addr = from;
-            e.lastSeenMs = now;
-            clients->push_back(e);
-            if (g_verbose) LogInfo("UDP client added: %s\n", SockaddrToString(from).c_str());
+            std::lock_guard<std::mutex> lock(copySlot.mtx);
+            copySlot.cv.notify_all();
         }
+        for (std::thread& th : threads) th.join();
+        const double secs = (PerfNowMs() - p0) / 1000.0;
+        const double cpuMs = ProcessCpuMs() - cpu0;
+
+        LogInfo("bench: fanout %-6s viewers=%d frame=%zu KB fps=%d delivered=%.0f/s copied=%.2f GB/s cpu=%.1f%% publish wait avg=%.3f max=%.2f ms\n",
+            shared ? "shared" : "copy", viewers, frameBytes / 1024, fps, delivered.load() / secs,
+            copiedBytes.load() / secs / 1e9, 100.0 * cpuMs / (secs * 1000.0), lockWaitMs / std::max<uint64_t>(1, published), maxLockWaitMs);
+        (void)checksum.load();
     }
 }
 
-static int RunUdpServer(uint16_t port, int fps, int jpegQuality0to100)
+// MJPEG part delivery to many viewers over loopback TCP through the server loop's write
+// cursor (LoopConnection::SendFromCursor, waiting in WSAPoll while a socket is full):
+// "split" queues the header, JPEG and trailer one at a time, "gather" queues the prebuilt
+// part's three buffers at once. Reader threads drain every connection.
+static void BenchPartSend(int viewers, size_t frameBytes, int frames)
 {
-    EnsureConsoleAllocated();
-    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
-    g_running.store(true);
+    WSADATA wsa{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return;
 
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int addrLen = sizeof(addr);
+    if (listener == INVALID_SOCKET || bind(listener, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR || getsockname(listener, (sockaddr*)&addr, &addrLen) == SOCKET_ERROR)
     {
-        LogError("WSAStartup failed\n");
-        return 1;
+        if (listener != INVALID_SOCKET) closesocket(listener);
+        WSACleanup();
+        return;
     }
 
-    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (s == INVALID_SOCKET)
+    std::vector<SOCKET> senders;
+    std::vector<std::thread> drains;
+    std::atomic<uint64_t> received{ 0 };
+    for (int v = 0; v < viewers; v++)
     {
-        LogError("udp socket() failed\n");
-        WSACleanup();
-        return 1;
+        SOCKET c = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (c == INVALID_SOCKET || connect(c, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+        {
+            if (c != INVALID_SOCKET) closesocket(c);
+            break;
+        }
+        SOCKET s = accept(listener, nullptr, nullptr);
+        if (s == INVALID_SOCKET)
+        {
+            closesocket(c);
+            break;
+        }
+        u_long nb = 1;
+        (void)ioctlsocket(s, FIONBIO, &nb);
+        int snd = 64 * 1024;
+        (void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
+        senders.push_back(s);
+        drains.emplace_back([c, &received]() {
+            std::vector<char> buf(64 * 1024);
+            int n;
+            while ((n = recv(c, buf.data(), (int)buf.size(), 0)) > 0) received.fetch_add((uint64_t)n);
+            closesocket(c);
+        });
     }
+    closesocket(listener);
 
-    int snd = 4 * 1024 * 1024;
-    int rcv = 4 * 1024 * 1024;
-    (void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
-    (void)setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcv, sizeof(rcv));
+    std::unique_ptr<std::vector<uint8_t>> jpeg = std::make_unique<std::vector<uint8_t>>(frameBytes);
+    for (size_t i = 0; i < frameBytes; i++) (*jpeg)[i] = (uint8_t)(i * 131);
+    const MjpegPart part = MakeMjpegPart(ShareJpegBuffer(std::move(jpeg)), 1, PerfNowMs(), 0.0);
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
-    if (bind(s, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+    for (int pass = 0; pass < 2 && !senders.empty(); pass++)
     {
-        LogError("udp bind() failed on port %u\n", (unsigned)port);
-        closesocket(s);
-        WSACleanup();
-        return 1;
-    }
-
-    u_long nb = 1;
-    (void)ioctlsocket(s, FIONBIO, &nb);
+        const bool gather = pass == 1;
+        uint64_t sends = 0;
+        uint64_t parts = 0;
+        LoopConnection conn;
+        const uint64_t r0 = received.load();
+        const double t0 = PerfNowMs();
+        for (int f = 0; f < frames; f++)
+        {
+            for (SOCKET s : senders)
+            {
+                conn.s = s;
+                bool ok = true;
+                for (int piece = 0; piece < (gather ? 1 : 3) && ok; piece++)
+                {
+                    WSABUF bufs[3];
+                    MjpegPartBuffers(part, bufs);
+                    if (gather) std::copy(bufs, bufs + 3, conn.bufs);
+                    else conn.bufs[0] = bufs[piece];
+                    conn.bufIndex = 0;
+                    conn.bufCount = gather ? 3 : 1;
+                    while (ok && conn.Sending())
+                    {
+                        sends++;
+                        ok = conn.SendFromCursor();
+                        if (ok && conn.Sending())
+                        {
+                            WSAPOLLFD pfd{};
+                            pfd.fd = s;
+                            pfd.events = POLLWRNORM;
+                            ok = WSAPoll(&pfd, 1, 1000) > 0;
+                        }
+                    }
+                }
+                if (ok) parts++;
+            }
+        }
+        conn.s = INVALID_SOCKET;
+        // Let the readers catch up so both passes are measured to full delivery.
+        const uint64_t expected = r0 + parts * (part.header.size() + frameBytes + 2);
+        while (received.load() < expected && PerfNowMs() - t0 < 30000.0) Sleep(1);
+        const double secs = (PerfNowMs() - t0) / 1000.0;
+        LogInfo("bench: parts %-6s viewers=%zu frame=%zu KB sends/part=%.1f parts/s=%.0f %.2f GB/s\n",
+            gather ? "gather" : "split", senders.size(), frameBytes / 1024, parts > 0 ? (double)sends / parts : 0.0,
+            parts / secs, (received.load() - r0) / secs / 1e9);
+    }
+
+    for (SOCKET s : senders) closesocket(s);
+    for (std::thread& th : drains) th.join();
+    WSACleanup();
+}
 
-    if (fps <= 0) fps = 30;
-    if (fps > 120) fps = 120;
-    if (jpegQuality0to100 < 1) jpegQuality0to100 = 1;
-    if (jpegQuality0to100 > 100) jpegQuality0to100 = 100;
-    const int delayMs = (int)(1000 / fps);
+// Shared /audio capture with many listeners (synthetic source, no sockets): every 8th
+// listener drains at half speed and must skip ahead; the rest must stay gap-free (nothing
+// skipped, at least 0.95x realtime, first samples within the pre-roll). One capture runs
+// however many listeners there are.
+static void BenchAudioFanout(int listeners, int seconds)
+{
+    const std::string savedSpec = g_audioSourceSpec;
+    g_audioSourceSpec = "synthetic";
 
-    HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-    IWICImagingFactory* factory = nullptr;
-    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
-    if (FAILED(hr))
+    struct Result
     {
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        closesocket(s);
-        WSACleanup();
-        LogError("WIC factory init failed\n");
-        return 1;
+        bool slow = false;
+        bool joined = false;
+        uint64_t samples = 0;
+        uint64_t skipped = 0;
+        double firstMs = 0.0;
+    };
+    std::vector<Result> results(listeners);
+    std::atomic<bool> stop{ false };
+    const double cpu0 = ProcessCpuMs();
+    const double p0 = PerfNowMs();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < listeners; i++)
+    {
+        threads.emplace_back([&, i]() {
+            Result& r = results[i];
+            r.slow = i % 8 == 0;
+            AudioListener l;
+            const double j0 = PerfNowMs();
+            if (!JoinAudioCapture(l)) return;
+            r.joined = true;
+            std::vector<int16_t> out(l.sampleRate * l.channels / 100); // 10 ms per read
+            while (!stop.load())
+            {
+                const long long n = ReadAudioSamples(l, out.data(), out.size(), kAudioReadWaitMs);
+                if (n < 0) break;
+                if (n > 0 && r.samples == 0) r.firstMs = PerfNowMs() - j0;
+                r.samples += (uint64_t)n;
+                if (r.slow) Sleep(20);
+            }
+            r.skipped = l.skippedSamples;
+            LeaveAudioCapture();
+        });
     }
+    Sleep((DWORD)seconds * 1000);
+    stop.store(true);
+    for (std::thread& th : threads) th.join();
+    const double secs = (PerfNowMs() - p0) / 1000.0;
+    const double cpuMs = ProcessCpuMs() - cpu0;
+    g_audioSourceSpec = savedSpec;
 
-    std::mutex clientsMtx;
-    std::vector<UdpClientEntry> clients;
-    std::thread recvThread([&]() { UdpServerRecvLoop(s, &clientsMtx, &clients); });
-    recvThread.detach();
-
-    LogInfo("UDP server on 0.0.0.0:%u (run udp-client to subscribe)\n", (unsigned)port);
-
-    uint32_t frameId = 0;
-    while (g_running.load())
+    const double perSec = (double)SyntheticAudioSource::kRate * SyntheticAudioSource::kChannels;
+    for (int slow = 0; slow < 2; slow++)
     {
-        std::vector<UdpClientEntry> snap;
+        int n = 0;
+        double minRt = 1e9, maxFirst = 0.0;
+        uint64_t skipped = 0;
+        for (const Result& r : results)
         {
-            std::lock_guard<std::mutex> lock(clientsMtx);
-            const uint64_t now = GetTickMs();
-            clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const UdpClientEntry& c) {
-                return (now - c.lastSeenMs) > 3000;
-            }), clients.end());
-            snap = clients;
+            if (!r.joined || r.slow != (slow == 1)) continue;
+            n++;
+            minRt = std::min(minRt, (double)r.samples / perSec / secs);
+            maxFirst = std::max(maxFirst, r.firstMs);
+            skipped += r.skipped;
         }
+        if (n == 0) continue;
+        const bool ok = slow || (skipped == 0 && minRt >= 0.95 && maxFirst <= kAudioPrerollMs);
+        LogInfo("bench: audio fanout %s listeners=%d delivered>=%.2fx realtime skipped=%.1f s first samples<=%.1f ms%s\n",
+            slow ? "slow" : "fast", n, minRt, skipped / perSec, maxFirst, slow ? "" : (ok ? " ok" : " FAILED"));
+    }
+    LogInfo("bench: audio fanout listeners=%d cpu=%.1f%%\n", listeners, 100.0 * cpuMs / (secs * 1000.0));
+}
 
-        if (snap.empty())
+// HTTP request parser: fixed cases, the same requests fed in random splits (must parse the
+// same), random mutations (must end in Done/Error/NeedMore within the limits, never crash),
+// then requests parsed per second with typical browser headers.
+static void BenchHttpParser()
+{
+    struct Case
+    {
+        const char* text;
+        HttpParseState want;
+        const char* path;
+        const char* query;
+    };
+    static const Case kCases[] = {
+        { "GET / HTTP/1.1\r\n\r\n", HttpParseState::Done, "/", "" },
+        { "GET /mjpeg?q=60&scale=0.5 HTTP/1.1\r\nHost: a\r\n\r\n", HttpParseState::Done, "/mjpeg", "q=60&scale=0.5" },
+        { "\r\nGET /audio HTTP/1.0\nHost: a\n\n", HttpParseState::Done, "/audio", "" },
+        { "GET http://host:8000/tiles?x=1 HTTP/1.1\r\n\r\n", HttpParseState::Done, "/tiles", "x=1" },
+        { "GET /control HTTP/1.1\r\nAuthorization:  Basic abc \r\n\r\n", HttpParseState::Done, "/control", "" },
+        { "GET / HTTP/1.1\r\nHost: a\r\n", HttpParseState::NeedMore, "", "" },
+        { "GET / HTTP/2.0\r\n\r\n", HttpParseState::Error, "", "" },
+        { "GET  / HTTP/1.1\r\n\r\n", HttpParseState::Error, "", "" },
+        { "GET relative HTTP/1.1\r\n\r\n", HttpParseState::Error, "", "" },
+        { "GET / HTTP/1.1\r\nNo colon\r\n\r\n", HttpParseState::Error, "", "" },
+        { "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n", HttpParseState::Error, "", "" },
+        { "GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n", HttpParseState::Error, "", "" },
+        { "G(T / HTTP/1.1\r\n\r\n", HttpParseState::Error, "", "" },
+    };
+    int failures = 0;
+    for (const Case& c : kCases)
+    {
+        HttpRequestParser p;
+        const HttpParseState st = p.Feed(c.text, std::strlen(c.text));
+        if (st != c.want || (st == HttpParseState::Done && (p.req.path != c.path || p.req.query != c.query)))
         {
-            Sleep(25);
-            continue;
+            LogError("bench: http parser case failed: %s\n", c.text);
+            failures++;
         }
-
-        JpegFrame jf;
-        hr = CaptureScreenToJpeg(factory, jpegQuality0to100, jf);
-        if (FAILED(hr) || jf.bytes.empty())
+    }
+    {
+        HttpRequestParser p;
+        const std::string req = "GET /x HTTP/1.1\r\nAuthorization: Basic abc \r\n\r\n";
+        if (p.Feed(req.data(), req.size()) != HttpParseState::Done || !p.req.Header("authorization") ||
+            *p.req.Header("authorization") != "Basic abc")
         {
-            Sleep(10);
-            continue;
+            failures++;
         }
+        std::string big = "GET / HTTP/1.1\r\n";
+        while (big.size() <= kMaxRequestBytes) big += "X-Pad: 0123456789012345678901234567890123456789\r\n";
+        p.Reset();
+        if (p.Feed(big.data(), big.size()) != HttpParseState::Error) failures++;
+        const std::string pipelined = req + "GET /y HTTP/1.1\r\n\r\n";
+        size_t used = 0;
+        p.Reset();
+        if (p.Feed(pipelined.data(), pipelined.size(), &used) != HttpParseState::Done || used != req.size()) failures++;
+    }
+
+    const std::string browser =
+        "GET /mjpeg?q=80 HTTP/1.1\r\n"
+        "Host: 192.168.1.50:8000\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0 Safari/537.36\r\n"
+        "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Connection: keep-alive\r\n"
+        "Referer: http://192.168.1.50:8000/\r\n"
+        "\r\n";
 
-        frameId++;
-        const size_t total = jf.bytes.size();
-        const uint16_t chunkCount = (uint16_t)((total + (kUdpPayloadMax - 1)) / kUdpPayloadMax);
-        std::vector<uint8_t> packet(sizeof(UdpFrameChunkHeader) + kUdpPayloadMax);
-
-        for (uint16_t ci = 0; ci < chunkCount; ci++)
+    uint32_t rng = 12345;
+    auto next = [&]() {
+        rng = rng * 1664525u + 1013904223u;
+        return rng >> 8;
+    };
+    uint64_t fuzzDone = 0;
+    uint64_t fuzzError = 0;
+    for (int iter = 0; iter < 20000; iter++)
+    {
+        // Random split points: must parse exactly like the whole buffer.
+        HttpRequestParser p;
+        size_t pos = 0;
+        HttpParseState st = HttpParseState::NeedMore;
+        while (pos < browser.size() && st == HttpParseState::NeedMore)
         {
-            const size_t off = (size_t)ci * kUdpPayloadMax;
-            size_t len = total - off;
-            if (len > (size_t)kUdpPayloadMax) len = (size_t)kUdpPayloadMax;
-
-            UdpFrameChunkHeader hdr{};
-            hdr.magic = kUdpMagic;
-            hdr.frameId = frameId;
-            hdr.chunkIndex = ci;
-            hdr.chunkCount = chunkCount;
-            hdr.payloadLen = (uint16_t)len;
-            hdr.reserved = 0;
-            std::memcpy(packet.data(), &hdr, sizeof(hdr));
-            std::memcpy(packet.data() + sizeof(hdr), jf.bytes.data() + off, len);
+            const size_t n = std::min(browser.size() - pos, (size_t)(1 + next() % 64));
+            st = p.Feed(browser.data() + pos, n);
+            pos += n;
+        }
+        if (st != HttpParseState::Done || p.req.path != "/mjpeg" || p.req.query != "q=80" || p.req.headers.size() != 7) failures++;
 
-            const int pktLen = (int)(sizeof(hdr) + len);
-            for (const auto& c : snap)
+        // Random byte mutations / truncations / junk.
+        std::string m = browser;
+        const int edits = 1 + (int)(next() % 8);
+        for (int e = 0; e < edits; e++)
+        {
+            const size_t at = next() % m.size();
+            switch (next() % 4)
             {
-                (void)sendto(s, (const char*)packet.data(), pktLen, 0, (const sockaddr*)&c.addr, sizeof(c.addr));
+            case 0: m[at] = (char)next(); break;
+            case 1: m.erase(at, 1 + next() % 16); break;
+            case 2: m.insert(at, 1 + next() % 32, (char)next()); break;
+            default: m.resize(at + 1); break;
             }
+            if (m.empty()) m = "\n";
+        }
+        p.Reset();
+        st = p.Feed(m.data(), m.size());
+        if (st == HttpParseState::Done)
+        {
+            fuzzDone++;
+            if (p.req.path.empty() || p.req.headers.size() > kMaxHttpHeaders) failures++;
+        }
+        else if (st == HttpParseState::Error)
+        {
+            fuzzError++;
         }
-
-        Sleep(delayMs);
     }
+    LogInfo("bench: http parser cases=%zu fuzz=20000 (done=%llu error=%llu) %s\n", sizeof(kCases) / sizeof(kCases[0]),
+        (unsigned long long)fuzzDone, (unsigned long long)fuzzError, failures == 0 ? "ok" : "FAILED");
 
-    factory->Release();
-    if (SUCCEEDED(hrCo)) CoUninitialize();
-    closesocket(s);
-    WSACleanup();
-    return 0;
+    HttpRequestParser p;
+    uint64_t parsed = 0;
+    const double t0 = PerfNowMs();
+    do
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            p.Reset();
+            if (p.Feed(browser.data(), browser.size()) == HttpParseState::Done) parsed++;
+        }
+    } while (PerfNowMs() - t0 < 500.0);
+    const double secs = (PerfNowMs() - t0) / 1000.0;
+    LogInfo("bench: http parser %.0f requests/s (%zu-byte browser request)\n", parsed / secs, browser.size());
 }
 
-static void UdpClientNetworkThread(const std::string& serverIp, uint16_t port)
+// FramePacer on a fake clock (50 fps, 20 ms ticks): on-time frames start exactly on the
+// grid, a late frame starts right away with no catch-up burst after it, and ticks missed
+// entirely are skipped.
+static void BenchFramePacer()
+{
+    double now = 0.0;
+    FramePacer pacer(50, [&]() { return now; }, [&](double ms) { now += ms; });
+    int failures = 0;
+    auto frame = [&](double workMs, int wantSkipped, double wantStart) {
+        now += workMs;
+        const int skipped = pacer.Wait();
+        if (skipped != wantSkipped || std::fabs(now - wantStart) > 1e-6)
+        {
+            LogError("bench: pacer frame after %.0f ms of work started at %.1f ms (want %.1f), skipped %d (want %d)\n",
+                workMs, now, wantStart, skipped, wantSkipped);
+            failures++;
+        }
+    };
+    for (int i = 1; i <= 10; i++) frame(5.0, 0, 20.0 * i);
+    frame(30.0, 0, 230.0); // overrun by half a tick: starts late
+    frame(5.0, 0, 240.0);  // back on the grid, not a burst
+    frame(75.0, 2, 315.0); // 260 and 280 never happen
+    frame(5.0, 0, 320.0);
+    if (pacer.MsUntilNextTick() != 20.0) failures++;
+
+    const FramePacerStats st = pacer.TakeStats();
+    if (st.frames != 14 || st.overruns != 2 || st.skippedTicks != 2) failures++;
+    LogInfo("bench: frame pacer fake clock frames=%llu overruns=%llu skipped=%llu %s\n", (unsigned long long)st.frames,
+        (unsigned long long)st.overruns, (unsigned long long)st.skippedTicks, failures == 0 ? "ok" : "FAILED");
+}
+
+static int RunBench(int seconds, int jpegQuality0to100)
 {
+    EnsureConsoleAllocated();
+    if (seconds <= 0) seconds = 5;
+    if (jpegQuality0to100 < 1) jpegQuality0to100 = 1;
+    if (jpegQuality0to100 > 100) jpegQuality0to100 = 100;
+
     HRESULT hrCo = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
     IWICImagingFactory* factory = nullptr;
     HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
     if (FAILED(hr))
     {
         if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
-    }
-
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
-    {
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
-    }
-
-    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (s == INVALID_SOCKET)
-    {
-        WSACleanup();
-        factory->Release();
-        if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        LogError("WIC factory init failed\n");
+        return 1;
     }
 
-    int snd = 4 * 1024 * 1024;
-    int rcv = 4 * 1024 * 1024;
-    (void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&snd, sizeof(snd));
-    (void)setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcv, sizeof(rcv));
-
-    sockaddr_in bindAddr{};
-    bindAddr.sin_family = AF_INET;
-    bindAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    bindAddr.sin_port = htons(0);
-    (void)bind(s, (sockaddr*)&bindAddr, sizeof(bindAddr));
-
-    sockaddr_in server{};
-    server.sin_family = AF_INET;
-    server.sin_port = htons(port);
-    if (inet_pton(AF_INET, serverIp.c_str(), &server.sin_addr) != 1)
+    std::unique_ptr<CaptureSource> source = CreateCaptureSource(g_captureSpec);
+    if (!source)
     {
-        closesocket(s);
-        WSACleanup();
         factory->Release();
         if (SUCCEEDED(hrCo)) CoUninitialize();
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return;
+        LogError("Unknown capture source '%s'\n", g_captureSpec.c_str());
+        return 1;
     }
 
-    u_long nb = 1;
-    (void)ioctlsocket(s, FIONBIO, &nb);
-
-    uint32_t curFrame = 0;
-    uint16_t curCount = 0;
-    uint16_t curLastChunkLen = 0;
-    std::vector<uint8_t> accum;
-    std::vector<uint8_t> got;
-    uint64_t lastHello = 0;
-
-    while (g_running.load())
+    std::unique_ptr<FrameEncoder> encoder = CreateConfiguredFrameEncoder(factory);
+    if (!encoder)
     {
-        const uint64_t now = GetTickMs();
-        if (now - lastHello > 500)
+        source.reset();
+        factory->Release();
+        if (SUCCEEDED(hrCo)) CoUninitialize();
+        LogError("No JPEG encoder available\n");
+        return 1;
+    }
+
+    CaptureSurface surf;
+    uint64_t frames = 0;
+    uint64_t failures = 0;
+    uint64_t jpegBytes = 0;
+    double captureMs = 0.0;
+    double encodeMs = 0.0;
+
+    // /tiles deltas against the previous frame (same work the capture loop does for tile clients).
+    TileHashGrid prevTiles;
+    TileHashGrid curTiles;
+    std::vector<TileRect> dirtyRects;
+    std::vector<uint8_t> tileMsg;
+    TileMessageView tileView;
+    uint64_t tileMsgs = 0;
+    uint64_t tileBytes = 0;
+    uint64_t tileCount = 0;
+    uint64_t tileParseErrors = 0;
+    double tileMs = 0.0;
+
+    const double start = PerfNowMs();
+    const double end = start + seconds * 1000.0;
+    while (PerfNowMs() < end)
+    {
+        const double t0 = PerfNowMs();
+        hr = source->Capture(surf);
+        const double t1 = PerfNowMs();
+        JpegFrame frame;
+        if (SUCCEEDED(hr)) hr = encoder->Encode(surf, jpegQuality0to100, frame);
+        const double t2 = PerfNowMs();
+        if (FAILED(hr) || frame.bytes.empty())
         {
-            const char hello[] = "LSU2";
-            (void)sendto(s, hello, (int)sizeof(hello), 0, (const sockaddr*)&server, sizeof(server));
-            lastHello = now;
+            failures++;
+            continue;
         }
 
-        uint8_t pkt[1600];
-        sockaddr_in from{};
-        int fromLen = sizeof(from);
-        int n = recvfrom(s, (char*)pkt, (int)sizeof(pkt), 0, (sockaddr*)&from, &fromLen);
-        if (n == SOCKET_ERROR)
+        captureMs += t1 - t0;
+        encodeMs += t2 - t1;
+        jpegBytes += frame.bytes.size();
+        frames++;
+
+        ComputeTileHashes(surf, curTiles, BestTileHashImpl());
+        if (!prevTiles.hashes.empty())
         {
-            int e = WSAGetLastError();
-            if (e == WSAEWOULDBLOCK)
+            const double d0 = PerfNowMs();
+            CollectDirtyTileRects(prevTiles, curTiles, dirtyRects);
+            if (SUCCEEDED(BuildTileMessage(encoder.get(), surf, dirtyRects, jpegQuality0to100, (uint32_t)frames, nullptr, tileMsg)))
             {
-                Sleep(1);
-                continue;
+                tileMs += PerfNowMs() - d0;
+                tileBytes += tileMsg.size();
+                tileCount += dirtyRects.size();
+                tileMsgs++;
+                if (ParseTileMessage(tileMsg.data(), tileMsg.size(), tileView) != (long long)tileMsg.size() ||
+                    tileView.tiles.size() != dirtyRects.size())
+                {
+                    tileParseErrors++;
+                }
             }
-            Sleep(1);
-            continue;
         }
-        if (n < (int)sizeof(UdpFrameChunkHeader)) continue;
+        std::swap(prevTiles, curTiles);
 
-        UdpFrameChunkHeader hdr{};
-        std::memcpy(&hdr, pkt, sizeof(hdr));
-        if (hdr.magic != kUdpMagic) continue;
-        if (hdr.payloadLen == 0 || hdr.payloadLen > kUdpPayloadMax) continue;
-        if ((int)(sizeof(hdr) + hdr.payloadLen) > n) continue;
-        if (hdr.chunkCount == 0) continue;
-        if (hdr.chunkIndex >= hdr.chunkCount) continue;
+        std::unique_ptr<std::vector<uint8_t>> buf = TakeJpegBuffer();
+        buf->swap(frame.bytes);
+        std::shared_ptr<MjpegFrameSet> set = std::make_shared<MjpegFrameSet>();
+        set->seq = frames;
+        set->captureMs = t0;
+        set->renditions[0] = MakeMjpegPart(ShareJpegBuffer(std::move(buf)), set->seq, t0, t2 - t1);
+        PublishMjpegFrame(g_sharedFrame, std::move(set));
+    }
+    const double elapsed = PerfNowMs() - start;
 
-        if (hdr.frameId != curFrame)
+    LogInfo("bench: source=%s %dx%d encoder=%s quality=%d\n", source->Name(), surf.width, surf.height, encoder->Name(), jpegQuality0to100);
+    if (frames > 0)
+    {
+        LogInfo("bench: frames=%llu fps=%.1f capture=%.2f ms encode=%.2f ms jpeg=%llu bytes (failures=%llu)\n",
+            (unsigned long long)frames,
+            frames * 1000.0 / elapsed,
+            captureMs / frames,
+            encodeMs / frames,
+            (unsigned long long)(jpegBytes / frames),
+            (unsigned long long)failures);
+    }
+    else
+    {
+        LogError("bench: no frames produced (failures=%llu)\n", (unsigned long long)failures);
+    }
+    if (tileMsgs > 0)
+    {
+        LogInfo("bench: tiles delta=%llu bytes (%.1f%% of full) rects=%.1f encode=%.2f ms %s\n",
+            (unsigned long long)(tileBytes / tileMsgs),
+            jpegBytes > 0 ? 100.0 * ((double)tileBytes / tileMsgs) / ((double)jpegBytes / frames) : 0.0,
+            (double)tileCount / tileMsgs,
+            tileMs / tileMsgs,
+            tileParseErrors == 0 ? "ok" : "PARSE MISMATCH");
+    }
+
+    // Tile-hash microbenchmark on the last captured surface; every variant must agree.
+    if (frames > 0)
+    {
+        TileHashGrid ref;
+        ComputeTileHashes(surf, ref, TileHashImpl::Scalar);
+        const double mb = (double)surf.width * surf.height * 4 / (1024.0 * 1024.0);
+        std::vector<TileHashImpl> impls{ TileHashImpl::Scalar };
+#if LANSCR_X86_SIMD
+        impls.push_back(TileHashImpl::Sse2);
+        if (g_cpuHasAvx2) impls.push_back(TileHashImpl::Avx2);
+#endif
+        for (TileHashImpl impl : impls)
         {
-            curFrame = hdr.frameId;
-            curCount = hdr.chunkCount;
-            curLastChunkLen = 0;
-            accum.assign((size_t)curCount * kUdpPayloadMax, 0);
-            got.assign(curCount, 0);
+            const char* name = impl == TileHashImpl::Avx2 ? "avx2" : (impl == TileHashImpl::Sse2 ? "sse2" : "scalar");
+            TileHashGrid grid;
+            int iters = 0;
+            const double h0 = PerfNowMs();
+            do
+            {
+                ComputeTileHashes(surf, grid, impl);
+                iters++;
+            } while (PerfNowMs() - h0 < 500.0);
+            const double ms = (PerfNowMs() - h0) / iters;
+            LogInfo("bench: tilehash %-6s %.3f ms/frame %.2f GB/s %s\n", name, ms, mb / 1024.0 / (ms / 1000.0),
+                SameTileHashes(ref, grid) ? "ok" : "MISMATCH");
         }
-        if (hdr.chunkCount != curCount) continue;
-        if (got[hdr.chunkIndex]) continue;
+    }
 
-        std::memcpy(accum.data() + (size_t)hdr.chunkIndex * kUdpPayloadMax, pkt + sizeof(hdr), hdr.payloadLen);
-        got[hdr.chunkIndex] = 1;
-        if (hdr.chunkIndex == (uint16_t)(hdr.chunkCount - 1)) curLastChunkLen = hdr.payloadLen;
+    // Colour-conversion / downscale kernels on the same surface.
+    if (frames > 0) BenchPixelKernels(surf);
 
-        bool complete = true;
-        for (uint16_t k = 0; k < curCount; k++) { if (!got[k]) { complete = false; break; } }
-        if (complete)
+    // Change detection at ~30 fps: "full" copies + hashes every frame and sleeps a fixed tick,
+    // "damage" uses the source's damage rects and waits for updates while idle.
+    // CPU is process time per delivered (changed + encoded) frame.
+    if (frames > 0)
+    {
+        const int tickMs = 33;
+        const TileHashImpl hashImpl = BestTileHashImpl();
+        for (int pass = 0; pass < 2; pass++)
         {
-            if (curLastChunkLen == 0) continue;
-            const size_t jpegLen = (size_t)(curCount - 1) * kUdpPayloadMax + (size_t)curLastChunkLen;
-            int w = 0, h = 0;
-            std::vector<uint8_t> bgra;
-            HRESULT dhr = DecodeJpegToBGRA(factory, accum.data(), jpegLen, w, h, bgra);
-            if (SUCCEEDED(dhr) && !bgra.empty())
+            const bool damageDriven = pass == 1;
+            source->SetDamageTracking(damageDriven);
+            TileHashGrid lastTiles;
+            TileHashGrid tiles;
+            uint64_t ticks = 0;
+            uint64_t delivered = 0;
+            const double cpu0 = ProcessCpuMs();
+            const double p0 = PerfNowMs();
+            while (PerfNowMs() - p0 < seconds * 1000.0)
             {
+                if (FAILED(source->Capture(surf)))
                 {
-                    std::lock_guard<std::mutex> lock(g_frame.mtx);
-                    g_frame.width = w;
-                    g_frame.height = h;
-                    g_frame.bgra = std::move(bgra);
-                    g_frame.hasFrame = true;
+                    Sleep(tickMs);
+                    continue;
                 }
-                PostMessage(g_hwnd, WM_NEW_FRAME, 0, 0);
+                ticks++;
+                if (damageDriven) UpdateTileHashes(surf, tiles, hashImpl);
+                else ComputeTileHashes(surf, tiles, hashImpl);
+                if (SameTileHashes(lastTiles, tiles))
+                {
+                    if (damageDriven) source->WaitForChange(tickMs, kIdleWaitMs);
+                    else Sleep(tickMs);
+                    continue;
+                }
+                JpegFrame frame;
+                if (SUCCEEDED(encoder->Encode(surf, jpegQuality0to100, frame))) delivered++;
+                lastTiles = tiles;
+                Sleep(tickMs);
             }
-            got.assign(curCount, 0);
+            const double cpuMs = ProcessCpuMs() - cpu0;
+            const double wallMs = PerfNowMs() - p0;
+            LogInfo("bench: detect %-6s ticks=%llu delivered=%llu cpu=%.1f%% cpu/frame=%.2f ms\n",
+                damageDriven ? "damage" : "full",
+                (unsigned long long)ticks,
+                (unsigned long long)delivered,
+                wallMs > 0 ? 100.0 * cpuMs / wallMs : 0.0,
+                delivered > 0 ? cpuMs / delivered : 0.0);
         }
+        source->SetDamageTracking(true);
     }
 
-    closesocket(s);
-    WSACleanup();
+    // Capture/encode overlap at common desktop sizes (synthetic source, independent of --capture).
+    if (frames > 0)
+    {
+        const int sizes[3][2] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+        for (const auto& sz : sizes) BenchPipelineAt(encoder.get(), sz[0], sz[1], std::max(2, seconds / 2), jpegQuality0to100);
+        BenchStaticDesktop(jpegQuality0to100);
+        BenchJpegCodecs(factory, jpegQuality0to100);
+        BenchAdaptiveTiles(factory, encoder.get(), jpegQuality0to100);
+        BenchTileRoundTrip(factory, encoder.get(), jpegQuality0to100);
+        BenchFrameFanout(40, 1024 * 1024, 30, std::max(2, seconds / 2));
+        BenchPartSend(64, 256 * 1024, 100);
+        BenchHttpParser();
+        BenchFramePacer();
+        BenchAudioFanout(64, std::max(2, seconds / 2));
+    }
+
+    encoder.reset();
+    source.reset();
     factory->Release();
     if (SUCCEEDED(hrCo)) CoUninitialize();
-    PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+    return frames > 0 ? 0 : 2;
 }
 
-static int RunUdpClient(const std::string& serverIp, uint16_t port)
+// ----------------------------
+// MJPEG load test (loadtest)
+// ----------------------------
+
+// One simulated /mjpeg viewer: counts the parts and bytes it receives.
+struct LoadTestViewer
 {
-    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
-    g_running.store(true);
+    std::wstring url;
+    int rendition = 0;
+    bool connected = false;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+};
 
-    // Reduce OS DPI bitmap-scaling blur on the window.
-    if (HMODULE user32 = LoadLibraryW(L"user32.dll"))
+static void LoadTestViewerThread(LoadTestViewer* v, double untilMs)
+{
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+    std::wstring host(256, L'\0');
+    std::wstring path(1024, L'\0');
+    uc.lpszHostName = host.data();
+    uc.dwHostNameLength = (DWORD)host.size();
+    uc.lpszUrlPath = path.data();
+    uc.dwUrlPathLength = (DWORD)path.size();
+    if (!WinHttpCrackUrl(v->url.c_str(), 0, 0, &uc)) return;
+    host.resize(uc.dwHostNameLength);
+    path.resize(uc.dwUrlPathLength);
+
+    HINTERNET hSession = WinHttpOpen(L"lanscr-loadtest/1.0", WINHTTP_ACCESS_TYPE_NO_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (!hSession) return;
+    HINTERNET hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0);
+    if (!hConnect) { WinHttpCloseHandle(hSession); return; }
+    HINTERNET hReq = WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_REFRESH);
+    if (!hReq) { WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession); return; }
+    WinHttpMaybeAddAuthHeader(hReq);
+
+    if (WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) && WinHttpReceiveResponse(hReq, nullptr))
     {
-        using Fn = BOOL(WINAPI*)(DPI_AWARENESS_CONTEXT);
-        auto fn = (Fn)GetProcAddress(user32, "SetProcessDpiAwarenessContext");
-        if (fn) (void)fn(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
-        FreeLibrary(user32);
+        v->connected = true;
+        static const char kBoundary[] = "--frame\r\n";
+        const size_t boundaryLen = sizeof(kBoundary) - 1;
+        std::vector<char> buf(64 * 1024 + boundaryLen);
+        size_t carry = 0; // tail of the previous read, so a boundary split across reads still counts
+        while (PerfNowMs() < untilMs)
+        {
+            DWORD read = 0;
+            if (!WinHttpReadData(hReq, buf.data() + carry, 64 * 1024, &read) || read == 0) break;
+            v->bytes += read;
+            const size_t n = carry + read;
+            for (size_t i = 0; i + boundaryLen <= n; i++)
+            {
+                if (buf[i] == '-' && std::memcmp(buf.data() + i, kBoundary, boundaryLen) == 0) v->frames++;
+            }
+            carry = std::min(n, boundaryLen - 1);
+            std::memmove(buf.data(), buf.data() + n - carry, carry);
+        }
     }
 
-    HINSTANCE hInst = GetModuleHandle(nullptr);
-
-    const wchar_t* cls = L"LanUdpClient";
-    WNDCLASSW wc{};
-    wc.lpfnWndProc = WndProc;
-    wc.hInstance = hInst;
-    wc.lpszClassName = cls;
-    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
-    wc.hIcon = LoadIconW(hInst, MAKEINTRESOURCEW(IDI_APP_ICON));
-    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-    (void)RegisterClassW(&wc);
+    WinHttpCloseHandle(hReq);
+    WinHttpCloseHandle(hConnect);
+    WinHttpCloseHandle(hSession);
+}
 
-    g_hwnd = CreateWindowExW(
-        0,
-        cls,
-        L"LAN Screen Viewer (UDP JPEG)",
-        WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, 1280, 720,
-        nullptr, nullptr, hInst, nullptr);
+// Reads the "renditions" array of a /control reply.
+static bool ParseControlRenditions(const std::string& json, std::vector<MjpegRendition>& list, std::vector<uint64_t>& encodes)
+{
+    list.clear();
+    encodes.clear();
+    size_t p = json.find("\"renditions\":[");
+    if (p == std::string::npos) return false;
+    const size_t end = json.find(']', p);
+    while ((p = json.find('{', p)) != std::string::npos && p < end)
+    {
+        const size_t close = json.find('}', p);
+        const std::string obj = json.substr(p, close - p);
+        long long quality = 0, enc = 0;
+        const size_t s = obj.find("\"scale\":");
+        if (s == std::string::npos || !CursorJsonInt(obj, "quality", quality) || !CursorJsonInt(obj, "encodes", enc)) return false;
+        list.push_back({ std::strtod(obj.c_str() + s + 8, nullptr), (int)quality });
+        encodes.push_back((uint64_t)enc);
+        p = close;
+    }
+    return !list.empty();
+}
 
-    if (!g_hwnd)
-    {
-        LogError("CreateWindowEx failed\n");
+// loadtest <url> [viewers] [seconds]: opens viewers /mjpeg streams against a running server,
+// spread round-robin over its renditions, and compares what they received with the server's
+// per-rendition encode counters. With a changing source (e.g. --capture synthetic) encodes/s
+// should track renditions x fps, not viewers x fps.
+static int RunLoadTest(const std::wstring& url, int viewerCount, int seconds)
+{
+    std::wstring controlUrl;
+    std::string before, after;
+    std::vector<MjpegRendition> renditions, renditionsAfter;
+    std::vector<uint64_t> encodesBefore, encodesAfter;
+    if (!MakeServerUrlFromVideoUrl(url, L"/control", controlUrl) || !HttpGetSimpleWinHttp(controlUrl, &before) ||
+        !ParseControlRenditions(before, renditions, encodesBefore))
+    {
+        LogError("loadtest: cannot read renditions from %s\n", WideToUtf8(controlUrl).c_str());
         return 1;
     }
 
-    ShowWindow(g_hwnd, SW_SHOW);
-    UpdateWindow(g_hwnd);
+    std::vector<LoadTestViewer> viewers(viewerCount);
+    for (int i = 0; i < viewerCount; i++)
+    {
+        LoadTestViewer& v = viewers[i];
+        v.rendition = i % (int)renditions.size();
+        wchar_t path[128];
+        swprintf_s(path, L"/mjpeg?scale=%.2f&q=%d", renditions[v.rendition].scale, renditions[v.rendition].quality);
+        (void)MakeServerUrlFromVideoUrl(url, path, v.url);
+    }
 
-    std::thread net([serverIp, port]() { UdpClientNetworkThread(serverIp, port); });
-    net.detach();
+    LogInfo("loadtest: %d viewers over %zu renditions for %d s\n", viewerCount, renditions.size(), seconds);
+    const double start = PerfNowMs();
+    const double until = start + seconds * 1000.0;
+    std::vector<std::thread> threads;
+    for (LoadTestViewer& v : viewers) threads.emplace_back(LoadTestViewerThread, &v, until);
+    for (std::thread& th : threads) th.join();
+    const double secs = std::max(0.001, (PerfNowMs() - start) / 1000.0);
 
-    MSG msg;
-    while (GetMessage(&msg, nullptr, 0, 0) > 0)
+    if (!HttpGetSimpleWinHttp(controlUrl, &after) || !ParseControlRenditions(after, renditionsAfter, encodesAfter) ||
+        encodesAfter.size() != encodesBefore.size())
     {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+        LogError("loadtest: cannot read /control after the run\n");
+        return 1;
     }
 
-    g_running.store(false);
-    return 0;
+    uint64_t totalEncodes = 0;
+    uint64_t totalFrames = 0;
+    int connected = 0;
+    for (size_t r = 0; r < renditions.size(); r++)
+    {
+        int n = 0;
+        uint64_t frames = 0, bytes = 0;
+        for (const LoadTestViewer& v : viewers)
+        {
+            if (v.rendition != (int)r) continue;
+            n++;
+            connected += v.connected ? 1 : 0;
+            frames += v.frames;
+            bytes += v.bytes;
+        }
+        const uint64_t enc = encodesAfter[r] - encodesBefore[r];
+        totalEncodes += enc;
+        totalFrames += frames;
+        LogInfo("loadtest: rendition %zu scale %.2f q%d: viewers=%d fps/viewer=%.1f kbps/viewer=%.0f encodes=%llu (%.1f/s)\n",
+            r, renditions[r].scale, renditions[r].quality, n, n > 0 ? frames / secs / n : 0.0,
+            n > 0 ? bytes * 8.0 / 1000.0 / secs / n : 0.0, (unsigned long long)enc, enc / secs);
+    }
+    LogInfo("loadtest: connected=%d/%d frames delivered=%llu (%.1f/s) encodes=%llu (%.1f/s, %.2f per delivered frame)\n",
+        connected, viewerCount, (unsigned long long)totalFrames, totalFrames / secs, (unsigned long long)totalEncodes,
+        totalEncodes / secs, totalFrames > 0 ? (double)totalEncodes / totalFrames : 0.0);
+    return connected == viewerCount ? 0 : 2;
 }
 
 static int RunCli(int argc, char** argv)
@@ -3059,6 +11093,137 @@ static int RunCli(int argc, char** argv)
             i++; // consume value
             continue;
         }
+        if (std::strcmp(a, "--cursor-meta") == 0)
+        {
+            g_cursorMeta = true;
+            continue;
+        }
+        if (std::strcmp(a, "--adaptive-tiles") == 0)
+        {
+            g_adaptiveTiles = true;
+            continue;
+        }
+        if (std::strcmp(a, "--encoder") == 0 || std::strcmp(a, "--decoder") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            const bool isEncoder = a[2] == 'e';
+            const std::string v = argv[i + 1];
+            if (isEncoder ? !IsFrameEncoderName(v) : (v != "wic" && v != "turbo"))
+            {
+                LogError(isEncoder ? "Bad --encoder value. Expected wic, strips or turbo\n" : "Bad --decoder value. Expected wic or turbo\n");
+                return 1;
+            }
+            (isEncoder ? g_encoderSpec : g_decoderSpec) = v;
+            i++; // consume value
+            continue;
+        }
+        if (std::strcmp(a, "--jpeg-threads") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            const char* v = argv[i + 1];
+            if (std::strcmp(v, "auto") == 0)
+            {
+                g_jpegThreads = (int)std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+            }
+            else
+            {
+                g_jpegThreads = std::atoi(v);
+                if (g_jpegThreads < 0 || g_jpegThreads > 64)
+                {
+                    LogError("Bad --jpeg-threads value. Expected 0..64 or auto\n");
+                    return 1;
+                }
+            }
+            i++; // consume value
+            continue;
+        }
+        if (std::strcmp(a, "--max-width") == 0 || std::strcmp(a, "--scale") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            if (a[2] == 'm')
+            {
+                const int w = std::atoi(argv[i + 1]);
+                if (w != 0 && w < kMinOutputWidth)
+                {
+                    LogError("Bad --max-width value. Expected 0 (off) or at least %d\n", kMinOutputWidth);
+                    return 1;
+                }
+                g_outputMaxWidth.store(w);
+            }
+            else
+            {
+                const double s = std::strtod(argv[i + 1], nullptr);
+                if (s < kMinOutputScale || s > 1.0)
+                {
+                    LogError("Bad --scale value. Expected 0.1..1\n");
+                    return 1;
+                }
+                g_outputScale.store(s);
+            }
+            i++; // consume value
+            continue;
+        }
+        if (std::strcmp(a, "--renditions") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            std::vector<MjpegRendition> list;
+            if (!ParseRenditionSpec(argv[i + 1], list))
+            {
+                LogError("Bad --renditions value. Expected up to %d scale:quality pairs, e.g. full:92,full:60,half:60\n", kMaxMjpegRenditions);
+                return 1;
+            }
+            g_renditionSpec = argv[i + 1];
+            i++; // consume value
+            continue;
+        }
+        if (std::strcmp(a, "--capture") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            g_captureSpec = argv[i + 1];
+            if (!CreateCaptureSource(g_captureSpec))
+            {
+                LogError("Bad --capture value. Expected gdi, dxgi or synthetic[:WxH]\n");
+                return 1;
+            }
+            i++; // consume value
+            continue;
+        }
+        if (std::strcmp(a, "--audio-source") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                return 1;
+            }
+            g_audioSourceSpec = argv[i + 1];
+            if (!CreateAudioSource(g_audioSourceSpec))
+            {
+                LogError("Bad --audio-source value. Expected loopback or synthetic[:Hz]\n");
+                return 1;
+            }
+            i++; // consume value
+            continue;
+        }
         if (std::strcmp(a, "-h") == 0 || std::strcmp(a, "--help") == 0)
         {
             PrintUsage();
@@ -3224,6 +11389,23 @@ static int RunCli(int argc, char** argv)
         std::printf("OK\n");
         return 0;
     }
+    else if (mode == "bench")
+    {
+        int seconds = GetIntArg(argv, i + 1, argc, 5);
+        int quality = GetIntArg(argv, i + 2, argc, 92);
+        return RunBench(seconds, quality);
+    }
+    else if (mode == "loadtest")
+    {
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+        const int viewers = std::max(1, GetIntArg(argv, i + 2, argc, 50));
+        const int seconds = std::max(1, GetIntArg(argv, i + 3, argc, 10));
+        return RunLoadTest(Utf8ToWide(argv[i + 1]), viewers, seconds);
+    }
     else if (mode == "stop")
     {
         if (i + 1 >= argc)
@@ -3273,6 +11455,7 @@ enum
     IDC_FPS = 1002,
     IDC_QUALITY = 1003,
     IDC_URL = 1004,
+    IDC_MAX_WIDTH = 1005,
 
     IDC_START_SERVER = 1101,
     IDC_STOP_SERVER = 1102,
@@ -3708,42 +11891,47 @@ static LRESULT CALLBACK LauncherWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
     g_chkPrivate = CreateWindowW(L"BUTTON", L"Private mode (password)", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX, 362, 88, 150, 22, hwnd, (HMENU)IDC_PRIVATE, nullptr, nullptr);
     SendMessageW(g_chkPrivate, BM_SETCHECK, g_httpAuthEnabled ? BST_CHECKED : BST_UNCHECKED, 0);
 
-        CreateWindowW(L"STATIC", L"Client", WS_CHILD | WS_VISIBLE, 12, 106, 80, 18, hwnd, nullptr, nullptr, nullptr);
-        CreateWindowW(L"STATIC", L"URL:", WS_CHILD | WS_VISIBLE, 12, 130, 40, 18, hwnd, nullptr, nullptr, nullptr);
-        g_editUrl = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"http://127.0.0.1:8000/", WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL, 52, 126, 438, 22, hwnd, (HMENU)IDC_URL, nullptr, nullptr);
-        HWND btnOpenClient = CreateWindowW(L"BUTTON", L"Open Client Viewer", WS_CHILD | WS_VISIBLE, 12, 156, 160, 28, hwnd, (HMENU)IDC_OPEN_CLIENT, nullptr, nullptr);
-        g_chkClientMute = CreateWindowW(L"BUTTON", L"Mute client audio", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX, 182, 160, 140, 22, hwnd, (HMENU)IDC_CLIENT_MUTE, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"Max width:", WS_CHILD | WS_VISIBLE, 12, 102, 70, 18, hwnd, nullptr, nullptr, nullptr);
+        g_editMaxWidth = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"0", WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL, 90, 98, 70, 22, hwnd, (HMENU)IDC_MAX_WIDTH, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"(0 = native resolution)", WS_CHILD | WS_VISIBLE, 170, 102, 170, 18, hwnd, nullptr, nullptr, nullptr);
+
+        CreateWindowW(L"STATIC", L"Client", WS_CHILD | WS_VISIBLE, 12, 134, 80, 18, hwnd, nullptr, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"URL:", WS_CHILD | WS_VISIBLE, 12, 158, 40, 18, hwnd, nullptr, nullptr, nullptr);
+        g_editUrl = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"http://127.0.0.1:8000/", WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL, 52, 154, 438, 22, hwnd, (HMENU)IDC_URL, nullptr, nullptr);
+        HWND btnOpenClient = CreateWindowW(L"BUTTON", L"Open Client Viewer", WS_CHILD | WS_VISIBLE, 12, 184, 160, 28, hwnd, (HMENU)IDC_OPEN_CLIENT, nullptr, nullptr);
+        g_chkClientMute = CreateWindowW(L"BUTTON", L"Mute client audio", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX, 182, 188, 140, 22, hwnd, (HMENU)IDC_CLIENT_MUTE, nullptr, nullptr);
         SendMessageW(g_chkClientMute, BM_SETCHECK, g_clientAudioMuted.load() ? BST_CHECKED : BST_UNCHECKED, 0);
 
         // Social links (hover-card popup)
-        CreateWindowW(L"STATIC", L"Social", WS_CHILD | WS_VISIBLE, 12, 196, 80, 18, hwnd, nullptr, nullptr, nullptr);
-        g_btnLinks = CreateWindowW(L"BUTTON", L"Open Links", WS_CHILD | WS_VISIBLE, 12, 218, 140, 30, hwnd, (HMENU)1200, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"Social", WS_CHILD | WS_VISIBLE, 12, 224, 80, 18, hwnd, nullptr, nullptr, nullptr);
+        g_btnLinks = CreateWindowW(L"BUTTON", L"Open Links", WS_CHILD | WS_VISIBLE, 12, 246, 140, 30, hwnd, (HMENU)1200, nullptr, nullptr);
 
         // Server detector
-        CreateWindowW(L"STATIC", L"Detect running servers", WS_CHILD | WS_VISIBLE, 12, 286, 180, 18, hwnd, nullptr, nullptr, nullptr);
-        g_btnDetectServers = CreateWindowW(L"BUTTON", L"Detect", WS_CHILD | WS_VISIBLE, 12, 308, 100, 26, hwnd, (HMENU)1301, nullptr, nullptr);
-        g_btnStopSelected = CreateWindowW(L"BUTTON", L"Stop Selected", WS_CHILD | WS_VISIBLE, 120, 308, 130, 26, hwnd, (HMENU)1302, nullptr, nullptr);
-        HWND btnStopAll = CreateWindowW(L"BUTTON", L"Stop All", WS_CHILD | WS_VISIBLE, 12, 338, 100, 26, hwnd, (HMENU)1304, nullptr, nullptr);
-        g_listServers = CreateWindowExW(WS_EX_CLIENTEDGE, L"LISTBOX", L"", WS_CHILD | WS_VISIBLE | WS_VSCROLL | LBS_NOTIFY, 260, 286, 230, 78, hwnd, (HMENU)1303, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"Detect running servers", WS_CHILD | WS_VISIBLE, 12, 314, 180, 18, hwnd, nullptr, nullptr, nullptr);
+        g_btnDetectServers = CreateWindowW(L"BUTTON", L"Detect", WS_CHILD | WS_VISIBLE, 12, 336, 100, 26, hwnd, (HMENU)1301, nullptr, nullptr);
+        g_btnStopSelected = CreateWindowW(L"BUTTON", L"Stop Selected", WS_CHILD | WS_VISIBLE, 120, 336, 130, 26, hwnd, (HMENU)1302, nullptr, nullptr);
+        HWND btnStopAll = CreateWindowW(L"BUTTON", L"Stop All", WS_CHILD | WS_VISIBLE, 12, 366, 100, 26, hwnd, (HMENU)1304, nullptr, nullptr);
+        g_listServers = CreateWindowExW(WS_EX_CLIENTEDGE, L"LISTBOX", L"", WS_CHILD | WS_VISIBLE | WS_VSCROLL | LBS_NOTIFY, 260, 314, 230, 78, hwnd, (HMENU)1303, nullptr, nullptr);
 
-        CreateWindowW(L"STATIC", L"Log", WS_CHILD | WS_VISIBLE, 12, 372, 80, 18, hwnd, nullptr, nullptr, nullptr);
+        CreateWindowW(L"STATIC", L"Log", WS_CHILD | WS_VISIBLE, 12, 400, 80, 18, hwnd, nullptr, nullptr, nullptr);
         g_launcherLog = CreateWindowExW(
             WS_EX_CLIENTEDGE,
             L"EDIT",
             L"",
             WS_CHILD | WS_VISIBLE | ES_MULTILINE | ES_READONLY | WS_VSCROLL,
-            12, 392, 478, 200,
+            12, 420, 478, 172,
             hwnd,
             nullptr,
             nullptr,
             nullptr);
 
-        HWND btnExit = CreateWindowW(L"BUTTON", L"Exit", WS_CHILD | WS_VISIBLE, 400, 156, 90, 28, hwnd, (HMENU)IDC_EXIT, nullptr, nullptr);
+        HWND btnExit = CreateWindowW(L"BUTTON", L"Exit", WS_CHILD | WS_VISIBLE, 400, 184, 90, 28, hwnd, (HMENU)IDC_EXIT, nullptr, nullptr);
 
         // Apply font
         SetControlFont(g_editPort, font);
         SetControlFont(g_editFps, font);
         SetControlFont(g_editQuality, font);
+        SetControlFont(g_editMaxWidth, font);
         SetControlFont(g_editUrl, font);
         SetControlFont(g_btnStartServer, font);
         SetControlFont(g_btnStopServer, font);
@@ -4019,6 +12207,7 @@ static LRESULT CALLBACK LauncherWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
             int port = ReadIntFromEdit(g_editPort, 8000);
             int fps = ReadIntFromEdit(g_editFps, 10);
             int quality = ReadIntFromEdit(g_editQuality, 92);
+            int maxWidth = ReadIntFromEdit(g_editMaxWidth, 0);
             const bool wantPrivate = g_chkPrivate && (SendMessageW(g_chkPrivate, BM_GETCHECK, 0, 0) == BST_CHECKED);
             if (!wantPrivate)
             {
@@ -4038,6 +12227,9 @@ static LRESULT CALLBACK LauncherWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
             if (fps <= 0) fps = 10;
             if (quality < 1) quality = 1;
             if (quality > 100) quality = 100;
+            if (maxWidth < 0) maxWidth = 0;
+            if (maxWidth > 0 && maxWidth < kMinOutputWidth) maxWidth = kMinOutputWidth;
+            g_outputMaxWidth.store(maxWidth);
 
             // If another instance (or CLI) is already running a server on this port, don't start.
             if (IsServerRunningOnPort((uint16_t)port))
@@ -4056,6 +12248,8 @@ static LRESULT CALLBACK LauncherWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
                 SetWindowTextW(g_editFps, tmp);
                 swprintf_s(tmp, L"%d", quality);
                 SetWindowTextW(g_editQuality, tmp);
+                swprintf_s(tmp, L"%d", maxWidth);
+                SetWindowTextW(g_editMaxWidth, tmp);
                 wchar_t url[256];
                 swprintf_s(url, L"http://127.0.0.1:%d/", port);
                 SetWindowTextW(g_editUrl, url);